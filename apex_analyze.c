@@ -0,0 +1,791 @@
+/*
+ * apex_analyze.c
+ * Contains a static hazard analyzer that estimates the cycles and CPI of a
+ * program without simulating it.
+ *
+ * The program is split into basic blocks. Every control flow edge P -> B
+ * gets a cost: the instructions of B are replayed through the timing model
+ * of apex_timing.c behind the last instructions of P and its most frequent
+ * predecessors, and the cost is the number of cycles B adds. This applies
+ * the pipeline's own rules for EX and MEM forwarding, load-use stalls, the
+ * memory stage latency and the taken branch penalty. The estimate is the
+ * sum of the edge costs weighted by how often each edge is taken.
+ *
+ * Edge counts come from the loop structure: a backward BZ/BNZ closes a
+ * loop whose trip count is given with --trips, recognized from a counter
+ * set by MOVC and stepped by SUBL right before the branch, or taken from
+ * --default-trips. Forward branches are assumed not taken. --profiled
+ * counts the edges instead with a run of the functional model, which
+ * executes no pipeline timing.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_functional.h"
+#include "apex_isa.h"
+#include "apex_timing.h"
+
+/* Instructions before a block that are replayed to set up the pipeline */
+#define ANALYZE_CONTEXT 16
+
+/* Loop trip counts given on the command line */
+#define ANALYZE_MAX_TRIPS 64
+
+typedef struct AnalyzeBlock
+{
+    int first;                  /* Code memory index of the first instruction */
+    int last;
+    double count;               /* Executions */
+    double cycles;              /* Cycles of all executions */
+    double load_use_stalls;
+    double operand_stalls;
+    double memory_stalls;
+    double flush_bubbles;       /* Bubbles of a taken branch into the block */
+    int trips;                  /* Trip count when the block closes a loop, else 0 */
+    int trips_source;           /* 'u'ser, 'c'ounter pattern or 'd'efault */
+} AnalyzeBlock;
+
+/* Edge from block `from`, index 2 * from + taken, the program entry last */
+typedef struct AnalyzeEdge
+{
+    int from;                   /* -1 for the program entry */
+    int to;                     /* -1 when it leaves code memory */
+    int taken;                  /* {TRUE, FALSE} Through a taken BZ/BNZ */
+    double count;
+    APEX_TimingStats cost;      /* Cycles and stalls the edge adds */
+} AnalyzeEdge;
+
+typedef struct AnalyzeTrip
+{
+    int pc;                     /* Backward BZ/BNZ */
+    int trips;
+} AnalyzeTrip;
+
+typedef struct APEX_Analysis
+{
+    const APEX_Instruction *code_memory;
+    int code_memory_size;
+    APEX_TimingConfig timing;
+    int *block_of;              /* Block of every instruction */
+    AnalyzeBlock *blocks;
+    int num_blocks;
+    AnalyzeEdge *edges;         /* 2 * num_blocks + 1 */
+    int *dominant;              /* Most frequent in-edge of every block, -1 for none */
+} APEX_Analysis;
+
+static void
+print_usage(const char *prog)
+{
+    fprintf(stderr, "APEX_Help: Usage %s <input_file> [options]\n", prog);
+    fprintf(stderr, "    --mem-latency <n>       Memory stage cycles of LOAD/STORE (default 1)\n");
+    fprintf(stderr, "    --trips <pc>=<n>        Trip count of the loop closed by the branch at pc\n");
+    fprintf(stderr, "    --default-trips <n>     Trip count of loops without a known counter (default 10)\n");
+    fprintf(stderr, "    --profiled              Count edges with a functional run instead\n");
+    fprintf(stderr, "    --max-insns <n>         Instructions of the functional run (default 10000000)\n");
+    fprintf(stderr, "    --hazards               Print the dependences and stalls of every instruction\n");
+    fprintf(stderr, "    --validate              Simulate the program and compare with the estimate\n");
+}
+
+static int
+branch_target(const APEX_Analysis *an, int index)
+{
+    return index + an->code_memory[index].imm / 4;
+}
+
+static int
+valid_index(const APEX_Analysis *an, int index)
+{
+    return (index >= 0 && index < an->code_memory_size);
+}
+
+/*
+ * Splits code memory into basic blocks, a block starts at the program
+ * entry, at a branch target and after a BZ/BNZ/HALT
+ */
+static int
+find_blocks(APEX_Analysis *an)
+{
+    char *leader;
+    int i, b;
+
+    if (an->code_memory_size <= 0)
+    {
+        return FALSE;
+    }
+    leader = calloc(an->code_memory_size + 1, 1);
+    if (!leader)
+    {
+        return FALSE;
+    }
+    leader[0] = TRUE;
+    for (i = 0; i < an->code_memory_size; ++i)
+    {
+        const APEX_Instruction *ins = &an->code_memory[i];
+
+        if (APEX_opcode_is_branch(ins->opcode))
+        {
+            if (ins->imm % 4 == 0 && valid_index(an, branch_target(an, i)))
+            {
+                leader[branch_target(an, i)] = TRUE;
+            }
+            leader[i + 1] = TRUE;
+        }
+        else if (ins->opcode == OPCODE_HALT)
+        {
+            leader[i + 1] = TRUE;
+        }
+    }
+
+    an->num_blocks = 0;
+    for (i = 0; i < an->code_memory_size; ++i)
+    {
+        an->num_blocks += leader[i];
+    }
+    if (an->num_blocks <= 0)
+    {
+        free(leader);
+        return FALSE;
+    }
+    an->blocks = calloc(an->num_blocks, sizeof(AnalyzeBlock));
+    an->edges = calloc(2 * an->num_blocks + 1, sizeof(AnalyzeEdge));
+    an->dominant = calloc(an->num_blocks, sizeof(int));
+    an->block_of = calloc(an->code_memory_size, sizeof(int));
+    if (!an->blocks || !an->edges || !an->dominant || !an->block_of)
+    {
+        free(leader);
+        return FALSE;
+    }
+
+    b = -1;
+    for (i = 0; i < an->code_memory_size; ++i)
+    {
+        if (leader[i])
+        {
+            an->blocks[++b].first = i;
+        }
+        an->blocks[b].last = i;
+        an->block_of[i] = b;
+    }
+    free(leader);
+
+    for (b = 0; b < an->num_blocks; ++b)
+    {
+        const APEX_Instruction *end = &an->code_memory[an->blocks[b].last];
+        int taken;
+
+        for (taken = FALSE; taken <= TRUE; ++taken)
+        {
+            AnalyzeEdge *edge = &an->edges[2 * b + taken];
+            int next = taken ? branch_target(an, an->blocks[b].last) : an->blocks[b].last + 1;
+
+            edge->from = b;
+            edge->taken = taken;
+            edge->to = -1;
+            if (end->opcode == OPCODE_HALT || (taken && !APEX_opcode_is_branch(end->opcode)))
+            {
+                continue;
+            }
+            if (valid_index(an, next) && (!taken || end->imm % 4 == 0))
+            {
+                edge->to = an->block_of[next];
+            }
+        }
+    }
+    an->edges[2 * an->num_blocks].from = -1;
+    an->edges[2 * an->num_blocks].to = 0;
+    return TRUE;
+}
+
+/*
+ * Trip count of the loop closed by the backward branch at index: a BNZ
+ * right after SUBL Rk,Rk,#c whose Rk is only set by a MOVC before the loop
+ */
+static int
+counter_trips(const APEX_Analysis *an, int index)
+{
+    const APEX_Instruction *code = an->code_memory;
+    int target = branch_target(an, index);
+    int step, reg, i;
+
+    if (code[index].opcode != OPCODE_BNZ || index == 0 || code[index - 1].opcode != OPCODE_SUBL
+        || code[index - 1].rd != code[index - 1].rs1 || code[index - 1].imm <= 0)
+    {
+        return 0;
+    }
+    reg = code[index - 1].rd;
+    step = code[index - 1].imm;
+
+    for (i = target; i < index - 1; ++i)
+    {
+        if (APEX_opcode_writes_rd(code[i].opcode) && code[i].rd == reg)
+        {
+            return 0;
+        }
+    }
+    for (i = target - 1; i >= 0; --i)
+    {
+        if (APEX_opcode_writes_rd(code[i].opcode) && code[i].rd == reg)
+        {
+            if (code[i].opcode == OPCODE_MOVC && code[i].imm > 0)
+            {
+                return (code[i].imm + step - 1) / step;
+            }
+            return 0;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Static edge counts. Every block runs once per iteration of the loops
+ * around it; the iterations of a loop enter its header through the back
+ * edge, except the first which falls through.
+ */
+static void
+count_edges_static(APEX_Analysis *an, const AnalyzeTrip *trips, int num_trips,
+                   int default_trips)
+{
+    int b, l, t;
+
+    /* Trip counts of the loops, kept on the block that closes them */
+    for (b = 0; b < an->num_blocks; ++b)
+    {
+        AnalyzeBlock *block = &an->blocks[b];
+        int last = block->last;
+
+        if (!APEX_opcode_is_branch(an->code_memory[last].opcode)
+            || an->edges[2 * b + TRUE].to < 0 || branch_target(an, last) > last)
+        {
+            continue;
+        }
+        block->trips = counter_trips(an, last);
+        block->trips_source = 'c';
+        for (t = 0; t < num_trips; ++t)
+        {
+            if (trips[t].pc == 4000 + 4 * last)
+            {
+                block->trips = trips[t].trips;
+                block->trips_source = 'u';
+            }
+        }
+        if (block->trips <= 0)
+        {
+            block->trips = default_trips;
+            block->trips_source = 'd';
+        }
+    }
+
+    for (b = 0; b < an->num_blocks; ++b)
+    {
+        /* Only blocks reached by falling through from the entry run */
+        if (b > 0 && (an->blocks[b - 1].count == 0 || an->edges[2 * (b - 1)].to != b))
+        {
+            an->blocks[b].count = 0;
+            continue;
+        }
+        an->blocks[b].count = 1.0;
+        for (l = 0; l < an->num_blocks; ++l)
+        {
+            const AnalyzeBlock *latch = &an->blocks[l];
+
+            if (latch->trips > 0 && branch_target(an, latch->last) <= an->blocks[b].first
+                && an->blocks[b].last <= latch->last)
+            {
+                an->blocks[b].count *= latch->trips;
+            }
+        }
+    }
+
+    /* Back edges take their share of the header's executions, innermost
+     * loop first, the rest falls through */
+    for (b = 0; b < an->num_blocks; ++b)
+    {
+        double remaining = an->blocks[b].count;
+
+        for (l = b; l < an->num_blocks; ++l)
+        {
+            const AnalyzeBlock *latch = &an->blocks[l];
+
+            if (latch->trips > 0 && an->edges[2 * l + TRUE].to == b)
+            {
+                double back = remaining * (latch->trips - 1) / latch->trips;
+
+                an->edges[2 * l + TRUE].count = back;
+                remaining -= back;
+            }
+        }
+        if (b == 0)
+        {
+            an->edges[2 * an->num_blocks].count = remaining;
+        }
+        else if (an->edges[2 * (b - 1)].to == b)
+        {
+            an->edges[2 * (b - 1)].count = remaining;
+        }
+    }
+}
+
+/*
+ * Exact edge counts from a functional run of at most max_insns
+ * instructions, returns the instructions executed
+ */
+static int
+count_edges_profiled(APEX_Analysis *an, int max_insns)
+{
+    APEX_ArchState *state = malloc(sizeof(APEX_ArchState));
+    int executed = 0;
+    int b;
+
+    if (!state)
+    {
+        return 0;
+    }
+    APEX_functional_init(state);
+    an->edges[2 * an->num_blocks].count = 1;
+    while (executed < max_insns)
+    {
+        int index = (state->pc - 4000) / 4;
+        int stepped = APEX_functional_step(state, an->code_memory, an->code_memory_size);
+
+        if (state->fault)
+        {
+            break;
+        }
+        executed++;
+        b = an->block_of[index];
+        if (index == an->blocks[b].last && !state->halted)
+        {
+            int opcode = an->code_memory[index].opcode;
+
+            /* Branches leave zero_flag alone, so it still gives the outcome */
+            an->edges[2 * b + (APEX_opcode_is_branch(opcode)
+                               && (opcode == OPCODE_BZ) == (state->zero_flag == TRUE))]
+                .count++;
+        }
+        if (!stepped)
+        {
+            break;
+        }
+    }
+    free(state);
+
+    for (b = 0; b < an->num_blocks; ++b)
+    {
+        an->blocks[b].count = 0;
+    }
+    for (b = 0; b <= 2 * an->num_blocks; ++b)
+    {
+        if (an->edges[b].to >= 0)
+        {
+            an->blocks[an->edges[b].to].count += an->edges[b].count;
+        }
+    }
+    return executed;
+}
+
+static void
+find_dominant_edges(APEX_Analysis *an)
+{
+    int b, e;
+
+    for (b = 0; b < an->num_blocks; ++b)
+    {
+        an->dominant[b] = -1;
+    }
+    for (e = 0; e <= 2 * an->num_blocks; ++e)
+    {
+        int to = an->edges[e].to;
+
+        if (to >= 0 && an->edges[e].count > 0
+            && (an->dominant[to] < 0 || an->edges[e].count > an->edges[an->dominant[to]].count))
+        {
+            an->dominant[to] = e;
+        }
+    }
+}
+
+static void
+append_record(APEX_TraceRecord *trace, int *count, const APEX_Analysis *an, int index, int taken)
+{
+    const APEX_Instruction *ins = &an->code_memory[index];
+    APEX_TraceRecord *rec = &trace[(*count)++];
+
+    memset(rec, 0, sizeof(*rec));
+    rec->pc = 4000 + 4 * index;
+    rec->opcode = ins->opcode;
+    rec->rd = ins->rd;
+    rec->rs1 = ins->rs1;
+    rec->rs2 = ins->rs2;
+    rec->rs3 = ins->rs3;
+    rec->branch_taken = taken;
+}
+
+/*
+ * Builds the instructions executed before edge e: the tail of its source
+ * block and of the source's most frequent predecessors, oldest first.
+ * Returns the number of records.
+ */
+static int
+build_context(const APEX_Analysis *an, int e, APEX_TraceRecord *trace)
+{
+    int indices[ANALYZE_CONTEXT];
+    int taken[ANALYZE_CONTEXT];
+    int count = 0, n = 0, i;
+
+    while (e >= 0 && an->edges[e].from >= 0 && n < ANALYZE_CONTEXT)
+    {
+        const AnalyzeBlock *block = &an->blocks[an->edges[e].from];
+        int edge_taken = an->edges[e].taken;
+
+        for (i = block->last; i >= block->first && n < ANALYZE_CONTEXT; --i)
+        {
+            indices[n] = i;
+            taken[n++] = (i == block->last) ? edge_taken : FALSE;
+        }
+        e = an->dominant[an->edges[e].from];
+    }
+
+    for (i = n - 1; i >= 0; --i)
+    {
+        append_record(trace, &count, an, indices[i], taken[i]);
+    }
+    return count;
+}
+
+/* a - b for every counter */
+static void
+stats_diff(APEX_TimingStats *out, const APEX_TimingStats *a, const APEX_TimingStats *b)
+{
+    out->cycles = a->cycles - b->cycles;
+    out->instructions = a->instructions - b->instructions;
+    out->load_use_stalls = a->load_use_stalls - b->load_use_stalls;
+    out->operand_stalls = a->operand_stalls - b->operand_stalls;
+    out->memory_stalls = a->memory_stalls - b->memory_stalls;
+    out->branches_taken = a->branches_taken - b->branches_taken;
+    out->flush_bubbles = a->flush_bubbles - b->flush_bubbles;
+    out->forwarded_ex = a->forwarded_ex - b->forwarded_ex;
+    out->forwarded_mem = a->forwarded_mem - b->forwarded_mem;
+}
+
+/*
+ * Cost of every edge: the cycles its target block adds behind its context
+ */
+static void
+cost_edges(APEX_Analysis *an)
+{
+    APEX_TraceRecord *trace = malloc(sizeof(APEX_TraceRecord) * (ANALYZE_CONTEXT + an->code_memory_size));
+    APEX_TimingStats before, after;
+    int e, i, n;
+
+    if (!trace)
+    {
+        return;
+    }
+    for (e = 0; e <= 2 * an->num_blocks; ++e)
+    {
+        AnalyzeEdge *edge = &an->edges[e];
+        AnalyzeBlock *block;
+
+        if (edge->to < 0 || edge->count <= 0)
+        {
+            continue;
+        }
+        block = &an->blocks[edge->to];
+
+        n = build_context(an, e, trace);
+        APEX_timing_run(trace, n, &an->timing, 0, &before);
+        for (i = block->first; i <= block->last; ++i)
+        {
+            append_record(trace, &n, an, i, FALSE);
+        }
+        APEX_timing_run(trace, n, &an->timing, 0, &after);
+        stats_diff(&edge->cost, &after, &before);
+
+        block->cycles += edge->count * edge->cost.cycles;
+        block->load_use_stalls += edge->count * edge->cost.load_use_stalls;
+        block->operand_stalls += edge->count * edge->cost.operand_stalls;
+        block->memory_stalls += edge->count * edge->cost.memory_stalls;
+        if (edge->taken)
+        {
+            block->flush_bubbles += edge->count * an->timing.branch_penalty;
+        }
+    }
+    free(trace);
+}
+
+/*
+ * Prints, for the most frequent entry into every block, the producer of
+ * each source operand and the stalls and forwarding of each instruction
+ */
+static void
+print_hazards(const APEX_Analysis *an)
+{
+    APEX_TraceRecord *trace = malloc(sizeof(APEX_TraceRecord) * (ANALYZE_CONTEXT + an->code_memory_size));
+    APEX_TimingStats prev, cur, diff;
+    int b, i, j, k, n, ctx;
+
+    if (!trace)
+    {
+        return;
+    }
+    for (b = 0; b < an->num_blocks; ++b)
+    {
+        const AnalyzeBlock *block = &an->blocks[b];
+
+        if (an->dominant[b] < 0)
+        {
+            continue;
+        }
+        printf("APEX_ANALYZE: Block %d, pc(%d) to pc(%d)\n", b, 4000 + 4 * block->first,
+               4000 + 4 * block->last);
+
+        ctx = build_context(an, an->dominant[b], trace);
+        n = ctx;
+        APEX_timing_run(trace, n, &an->timing, 0, &prev);
+        for (i = block->first; i <= block->last; ++i)
+        {
+            int srcs[APEX_MAX_SOURCES];
+            int nsrcs;
+
+            append_record(trace, &n, an, i, FALSE);
+            APEX_timing_run(trace, n, &an->timing, 0, &cur);
+            stats_diff(&diff, &cur, &prev);
+            prev = cur;
+
+            printf("    pc(%d) %-5s", trace[n - 1].pc, an->code_memory[i].opcode_str);
+            nsrcs = APEX_opcode_sources(trace[n - 1].opcode, trace[n - 1].rs1, trace[n - 1].rs2,
+                                        trace[n - 1].rs3, srcs);
+            for (j = 0; j < nsrcs; ++j)
+            {
+                printf(" R%d", srcs[j]);
+                for (k = n - 2; k >= 0; --k)
+                {
+                    if (APEX_opcode_writes_rd(trace[k].opcode) && trace[k].rd == srcs[j])
+                    {
+                        printf("<-pc(%d),d=%d%s", trace[k].pc, n - 1 - k,
+                               APEX_opcode_is_load(trace[k].opcode) ? ",load" : "");
+                        break;
+                    }
+                }
+            }
+            if (diff.load_use_stalls)
+            {
+                printf("  load-use stall %d", diff.load_use_stalls);
+            }
+            if (diff.operand_stalls)
+            {
+                printf("  operand stall %d", diff.operand_stalls);
+            }
+            if (diff.memory_stalls)
+            {
+                printf("  memory stall %d", diff.memory_stalls);
+            }
+            if (diff.forwarded_ex)
+            {
+                printf("  EX forward %d", diff.forwarded_ex);
+            }
+            if (diff.forwarded_mem)
+            {
+                printf("  MEM forward %d", diff.forwarded_mem);
+            }
+            printf("\n");
+        }
+    }
+    free(trace);
+}
+
+/*
+ * Simulates the program with the pipeline model, returns TRUE when it
+ * halted within cycle_limit cycles
+ */
+static int
+simulate(APEX_Analysis *an, int cycle_limit, int *cycles, int *instructions)
+{
+    APEX_CPU *cpu = APEX_cpu_create((APEX_Instruction *)an->code_memory, an->code_memory_size);
+    int stopped = FALSE;
+
+    *cycles = 0;
+    *instructions = 0;
+    if (!cpu)
+    {
+        return FALSE;
+    }
+    cpu->single_step = FALSE;
+    cpu->memory_latency = an->timing.load_latency;
+    while (!stopped && cpu->clock + 1 < cycle_limit)
+    {
+        stopped = APEX_cpu_step(cpu);
+        if (!stopped)
+        {
+            cpu->clock++;
+        }
+    }
+    *cycles = cpu->clock + 1;
+    *instructions = cpu->insn_completed;
+    stopped = stopped && cpu->fault.type == APEX_FAULT_NONE;
+    APEX_cpu_stop(cpu);
+    return stopped;
+}
+
+int main(int argc, char const *argv[])
+{
+    APEX_Analysis an;
+    APEX_Instruction *code_memory;
+    AnalyzeTrip trips[ANALYZE_MAX_TRIPS];
+    int num_trips = 0;
+    int default_trips = 10;
+    int memory_latency = 1;
+    int profiled = FALSE;
+    int max_insns = 10000000;
+    int hazards = FALSE;
+    int validate = FALSE;
+    double cycles = 0, instructions = 0;
+    int b, i;
+
+    if (argc < 2)
+    {
+        print_usage(argv[0]);
+        exit(1);
+    }
+    for (i = 2; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--mem-latency") == 0 && i + 1 < argc)
+        {
+            memory_latency = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--trips") == 0 && i + 1 < argc
+                 && num_trips < ANALYZE_MAX_TRIPS)
+        {
+            if (sscanf(argv[++i], "%d=%d", &trips[num_trips].pc, &trips[num_trips].trips) != 2
+                || trips[num_trips].trips < 1)
+            {
+                print_usage(argv[0]);
+                exit(1);
+            }
+            num_trips++;
+        }
+        else if (strcmp(argv[i], "--default-trips") == 0 && i + 1 < argc)
+        {
+            default_trips = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--profiled") == 0)
+        {
+            profiled = TRUE;
+        }
+        else if (strcmp(argv[i], "--max-insns") == 0 && i + 1 < argc)
+        {
+            max_insns = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--hazards") == 0)
+        {
+            hazards = TRUE;
+        }
+        else if (strcmp(argv[i], "--validate") == 0)
+        {
+            validate = TRUE;
+        }
+        else
+        {
+            print_usage(argv[0]);
+            exit(1);
+        }
+    }
+    if (memory_latency < 1 || default_trips < 1)
+    {
+        fprintf(stderr, "APEX_Error: --mem-latency and --default-trips must be positive\n");
+        exit(1);
+    }
+
+    ENABLE_DEBUG_MESSAGES = 0;
+    memset(&an, 0, sizeof(an));
+    code_memory = create_code_memory(argv[1], &an.code_memory_size);
+    if (!code_memory)
+    {
+        fprintf(stderr, "APEX_Error: Unable to read %s\n", argv[1]);
+        exit(1);
+    }
+    an.code_memory = code_memory;
+    APEX_timing_default_config(&an.timing);
+    an.timing.load_latency = memory_latency;
+    an.timing.store_latency = memory_latency;
+    if (!find_blocks(&an))
+    {
+        fprintf(stderr, "APEX_Error: Unable to allocate the analysis\n");
+        exit(1);
+    }
+
+    if (profiled)
+    {
+        count_edges_profiled(&an, max_insns);
+    }
+    else
+    {
+        count_edges_static(&an, trips, num_trips, default_trips);
+    }
+    find_dominant_edges(&an);
+    cost_edges(&an);
+
+    printf("APEX_ANALYZE: %s, %d instructions in %d basic blocks, mem_latency=%d, %s counts\n",
+           argv[1], an.code_memory_size, an.num_blocks, memory_latency,
+           profiled ? "profiled" : "static");
+    printf("| Block | PCs         | Insns | Count      | Cycles/exec | Load-use | Operand | Memory | Flush | Loop trips   |\n");
+    for (b = 0; b < an.num_blocks; ++b)
+    {
+        const AnalyzeBlock *block = &an.blocks[b];
+        double count = block->count > 0 ? block->count : 1;
+        char trips_text[32] = "";
+
+        if (block->trips)
+        {
+            snprintf(trips_text, sizeof(trips_text), "%d (%s)", block->trips,
+                     block->trips_source == 'u' ? "given"
+                     : block->trips_source == 'c' ? "counter" : "default");
+        }
+        printf("| %-5d | %4d-%-4d   | %-5d | %-10.0f | %-11.2f | %-8.2f | %-7.2f | %-6.2f | %-5.2f | %-12s |\n",
+               b, 4000 + 4 * block->first, 4000 + 4 * block->last,
+               block->last - block->first + 1, block->count, block->cycles / count,
+               block->load_use_stalls / count, block->operand_stalls / count,
+               block->memory_stalls / count, block->flush_bubbles / count, trips_text);
+        cycles += block->cycles;
+        instructions += block->count * (block->last - block->first + 1);
+    }
+    printf("APEX_ANALYZE: Estimated cycles = %.0f instructions = %.0f CPI = %.3f\n", cycles,
+           instructions, instructions > 0 ? cycles / instructions : 0.0);
+
+    if (hazards)
+    {
+        print_hazards(&an);
+    }
+
+    if (validate)
+    {
+        /* Four times the estimate, at least a million cycles and at most INT_MAX */
+        int cycle_limit = (cycles * 4 >= INT_MAX) ? INT_MAX
+                          : (cycles * 4 > 1000000) ? (int)(cycles * 4) : 1000000;
+        int sim_cycles, sim_instructions;
+        int halted = simulate(&an, cycle_limit, &sim_cycles, &sim_instructions);
+
+        printf("APEX_ANALYZE: Simulated cycles = %d instructions = %d CPI = %.3f%s\n", sim_cycles,
+               sim_instructions, sim_instructions ? (double)sim_cycles / sim_instructions : 0.0,
+               halted ? "" : " (did not halt)");
+        printf("APEX_ANALYZE: Estimate error, cycles %+.2f%% CPI %+.2f%%\n",
+               sim_cycles ? 100.0 * (cycles - sim_cycles) / sim_cycles : 0.0,
+               (sim_cycles && sim_instructions && instructions > 0)
+                   ? 100.0 * (cycles / instructions * sim_instructions / sim_cycles - 1.0)
+                   : 0.0);
+    }
+
+    free(an.blocks);
+    free(an.edges);
+    free(an.dominant);
+    free(an.block_of);
+    free(code_memory);
+    return 0;
+}
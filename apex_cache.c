@@ -0,0 +1,367 @@
+/*
+ * apex_cache.c
+ * Contains the private L1 data cache model and its MESI snooping bus.
+ *
+ * Caches only hold tags and coherence state, the values live in the shared
+ * data memory. An access returns the number of cycles the memory stage is
+ * occupied. Hits only take the owning cache lock; misses and upgrades take
+ * the bus lock first and then snoop every other cache one at a time, so two
+ * cores never hold each other's cache locks.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cache.h"
+
+void
+APEX_cache_default_config(APEX_CacheConfig *config)
+{
+    config->sets = 64;
+    config->ways = 2;
+    config->line_words = 4;
+    config->hit_latency = 1;
+    config->miss_latency = 10;
+    config->transfer_latency = 4;
+    config->upgrade_latency = 2;
+}
+
+APEX_Cache *
+APEX_cache_create(const APEX_CacheConfig *config, int core_id, APEX_Bus *bus)
+{
+    APEX_Cache *cache;
+
+    if (config->sets <= 0 || config->ways <= 0 || config->line_words <= 0)
+    {
+        return NULL;
+    }
+
+    if (bus && bus->num_caches >= APEX_MAX_CORES)
+    {
+        return NULL;
+    }
+
+    cache = calloc(1, sizeof(APEX_Cache));
+    if (!cache)
+    {
+        return NULL;
+    }
+
+    cache->lines = calloc(config->sets * config->ways, sizeof(APEX_CacheLine));
+    if (!cache->lines)
+    {
+        free(cache);
+        return NULL;
+    }
+
+    cache->config = *config;
+    cache->core_id = core_id;
+    pthread_mutex_init(&cache->lock, NULL);
+
+    if (bus)
+    {
+        cache->bus = bus;
+        bus->caches[bus->num_caches++] = cache;
+    }
+    return cache;
+}
+
+void
+APEX_cache_destroy(APEX_Cache *cache)
+{
+    if (!cache)
+    {
+        return;
+    }
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->lines);
+    free(cache);
+}
+
+static APEX_CacheLine *
+find_line(APEX_Cache *cache, int line_addr)
+{
+    int set = line_addr % cache->config.sets;
+    int tag = line_addr / cache->config.sets;
+    APEX_CacheLine *ways = &cache->lines[set * cache->config.ways];
+    int i;
+
+    for (i = 0; i < cache->config.ways; ++i)
+    {
+        if (ways[i].state != MESI_INVALID && ways[i].tag == tag)
+        {
+            return &ways[i];
+        }
+    }
+    return NULL;
+}
+
+/* Picks an invalid way if there is one, otherwise the least recently used */
+static APEX_CacheLine *
+find_victim(APEX_Cache *cache, int line_addr)
+{
+    int set = line_addr % cache->config.sets;
+    APEX_CacheLine *ways = &cache->lines[set * cache->config.ways];
+    APEX_CacheLine *victim = &ways[0];
+    int i;
+
+    for (i = 0; i < cache->config.ways; ++i)
+    {
+        if (ways[i].state == MESI_INVALID)
+        {
+            return &ways[i];
+        }
+        if (ways[i].last_used < victim->last_used)
+        {
+            victim = &ways[i];
+        }
+    }
+    return victim;
+}
+
+/*
+ * BusRd / BusRdX / BusUpgr handling for a miss or a write to a shared line
+ */
+static int
+bus_transaction(APEX_Cache *cache, int line_addr, int is_write)
+{
+    APEX_Bus *bus = cache->bus;
+    APEX_CacheLine *line;
+    int supplied = FALSE;
+    int shared = FALSE;
+    int latency;
+    int i;
+
+    if (bus)
+    {
+        pthread_mutex_lock(&bus->lock);
+        bus->transactions++;
+
+        for (i = 0; i < bus->num_caches; ++i)
+        {
+            APEX_Cache *other = bus->caches[i];
+            APEX_CacheLine *remote;
+
+            if (other == cache)
+            {
+                continue;
+            }
+
+            pthread_mutex_lock(&other->lock);
+            remote = find_line(other, line_addr);
+            if (remote)
+            {
+                if (remote->state == MESI_MODIFIED)
+                {
+                    /* Owner flushes the line and supplies it */
+                    supplied = TRUE;
+                    other->stats.writebacks++;
+                }
+
+                if (is_write)
+                {
+                    remote->state = MESI_INVALID;
+                    other->stats.invalidations++;
+                }
+                else
+                {
+                    remote->state = MESI_SHARED;
+                    shared = TRUE;
+                }
+            }
+            pthread_mutex_unlock(&other->lock);
+        }
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    line = find_line(cache, line_addr);
+    if (line)
+    {
+        /* Write hit on a shared line, sharers are now invalid */
+        line->state = MESI_MODIFIED;
+        cache->stats.upgrades++;
+        latency = cache->config.upgrade_latency;
+    }
+    else
+    {
+        line = find_victim(cache, line_addr);
+        if (line->state == MESI_MODIFIED)
+        {
+            cache->stats.writebacks++;
+        }
+        if (line->state != MESI_INVALID && line->prefetched)
+        {
+            cache->stats.prefetch_unused++;
+        }
+
+        line->tag = line_addr / cache->config.sets;
+        line->prefetched = FALSE;
+        if (is_write)
+        {
+            line->state = MESI_MODIFIED;
+        }
+        else
+        {
+            line->state = shared ? MESI_SHARED : MESI_EXCLUSIVE;
+        }
+
+        cache->stats.misses++;
+        if (supplied)
+        {
+            cache->stats.transfers++;
+            latency = cache->config.transfer_latency;
+        }
+        else
+        {
+            latency = cache->config.miss_latency;
+        }
+    }
+    line->last_used = ++cache->use_clock;
+    pthread_mutex_unlock(&cache->lock);
+
+    if (bus)
+    {
+        pthread_mutex_unlock(&bus->lock);
+    }
+    return latency;
+}
+
+/*
+ * Looks up a data memory word and returns the memory stage latency
+ */
+int
+APEX_cache_access(APEX_Cache *cache, int address, int is_write)
+{
+    int line_addr = address / cache->config.line_words;
+    APEX_CacheLine *line;
+
+    pthread_mutex_lock(&cache->lock);
+    if (is_write)
+    {
+        cache->stats.writes++;
+    }
+    else
+    {
+        cache->stats.reads++;
+    }
+
+    line = find_line(cache, line_addr);
+    if (line && (!is_write || line->state != MESI_SHARED))
+    {
+        /* E silently becomes M on a write */
+        if (is_write)
+        {
+            line->state = MESI_MODIFIED;
+        }
+        line->last_used = ++cache->use_clock;
+        cache->stats.hits++;
+        if (line->prefetched)
+        {
+            line->prefetched = FALSE;
+            cache->stats.prefetch_hits++;
+        }
+        pthread_mutex_unlock(&cache->lock);
+        return cache->config.hit_latency;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    return bus_transaction(cache, line_addr, is_write);
+}
+
+/*
+ * Returns TRUE when the line holding a data memory word is present, without
+ * counting an access
+ */
+int
+APEX_cache_contains(APEX_Cache *cache, int address)
+{
+    int present;
+
+    pthread_mutex_lock(&cache->lock);
+    present = find_line(cache, address / cache->config.line_words) != NULL;
+    pthread_mutex_unlock(&cache->lock);
+    return present;
+}
+
+/*
+ * Fills the line holding a data memory word on behalf of a prefetcher.
+ * The line is Exclusive without a bus transaction, so only an L1 without a
+ * bus can be prefetched into. Returns FALSE when nothing was filled.
+ */
+int
+APEX_cache_prefetch(APEX_Cache *cache, int address)
+{
+    int line_addr = address / cache->config.line_words;
+    APEX_CacheLine *line;
+
+    if (cache->bus)
+    {
+        return FALSE;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    if (find_line(cache, line_addr))
+    {
+        pthread_mutex_unlock(&cache->lock);
+        return FALSE;
+    }
+
+    line = find_victim(cache, line_addr);
+    if (line->state == MESI_MODIFIED)
+    {
+        cache->stats.writebacks++;
+    }
+    if (line->state != MESI_INVALID && line->prefetched)
+    {
+        cache->stats.prefetch_unused++;
+    }
+    line->tag = line_addr / cache->config.sets;
+    line->state = MESI_EXCLUSIVE;
+    line->prefetched = TRUE;
+    line->last_used = ++cache->use_clock;
+    cache->stats.prefetch_fills++;
+    pthread_mutex_unlock(&cache->lock);
+    return TRUE;
+}
+
+void
+APEX_cache_print_stats(const APEX_Cache *cache)
+{
+    const APEX_CacheStats *s = &cache->stats;
+    int accesses = s->reads + s->writes;
+
+    printf("============== L1 CACHE OF CORE %d =============\n", cache->core_id);
+    printf("|    Reads / Writes            | %d / %d\n", s->reads, s->writes);
+    printf("|    Hits / Misses / Upgrades  | %d / %d / %d\n", s->hits, s->misses, s->upgrades);
+    printf("|    Hit rate                  | %.2f%%\n", accesses ? 100.0 * s->hits / accesses : 0.0);
+    printf("|    L1-to-L1 transfers        | %d\n", s->transfers);
+    printf("|    Invalidations received    | %d\n", s->invalidations);
+    printf("|    Writebacks                | %d\n", s->writebacks);
+}
+
+APEX_Bus *
+APEX_bus_create(void)
+{
+    APEX_Bus *bus = calloc(1, sizeof(APEX_Bus));
+
+    if (bus)
+    {
+        pthread_mutex_init(&bus->lock, NULL);
+    }
+    return bus;
+}
+
+void
+APEX_bus_destroy(APEX_Bus *bus)
+{
+    if (!bus)
+    {
+        return;
+    }
+    pthread_mutex_destroy(&bus->lock);
+    free(bus);
+}
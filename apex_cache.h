@@ -0,0 +1,90 @@
+/*
+ * apex_cache.h
+ * Contains declarations for the private L1 data cache and the snooping bus
+ * that keeps the L1s of several cores MESI coherent
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_CACHE_H_
+#define _APEX_CACHE_H_
+
+#include <pthread.h>
+
+#include "apex_macros.h"
+
+/* MESI line states */
+#define MESI_INVALID 0x0
+#define MESI_SHARED 0x1
+#define MESI_EXCLUSIVE 0x2
+#define MESI_MODIFIED 0x3
+
+typedef struct APEX_CacheConfig
+{
+    int sets;
+    int ways;
+    int line_words;       /* Data memory words per line */
+    int hit_latency;      /* Memory stage cycles on a hit */
+    int miss_latency;     /* Memory stage cycles when data comes from data memory */
+    int transfer_latency; /* Memory stage cycles when another L1 supplies the line */
+    int upgrade_latency;  /* Memory stage cycles to invalidate sharers on a write hit */
+} APEX_CacheConfig;
+
+typedef struct APEX_CacheLine
+{
+    int tag;
+    int state;
+    int last_used;
+    int prefetched;        /* {TRUE, FALSE} Filled by a prefetch and not used yet */
+} APEX_CacheLine;
+
+typedef struct APEX_CacheStats
+{
+    int reads;
+    int writes;
+    int hits;
+    int misses;
+    int upgrades;
+    int transfers;         /* Misses served by another L1 */
+    int invalidations;     /* Lines invalidated by other cores */
+    int writebacks;        /* Modified lines written back to data memory */
+    int prefetch_fills;    /* Lines filled by a prefetch */
+    int prefetch_hits;     /* First demand hits on prefetched lines */
+    int prefetch_unused;   /* Prefetched lines evicted before any demand hit */
+} APEX_CacheStats;
+
+struct APEX_Bus;
+
+typedef struct APEX_Cache
+{
+    APEX_CacheConfig config;
+    APEX_CacheLine *lines; /* sets * ways */
+    int core_id;
+    int use_clock;
+    pthread_mutex_t lock;  /* Guards lines against snoops from other cores */
+    struct APEX_Bus *bus;
+    APEX_CacheStats stats;
+} APEX_Cache;
+
+/* Snooping bus, one coherence transaction at a time */
+typedef struct APEX_Bus
+{
+    pthread_mutex_t lock;
+    APEX_Cache *caches[APEX_MAX_CORES];
+    int num_caches;
+    int transactions;
+} APEX_Bus;
+
+void APEX_cache_default_config(APEX_CacheConfig *config);
+APEX_Cache *APEX_cache_create(const APEX_CacheConfig *config, int core_id, APEX_Bus *bus);
+void APEX_cache_destroy(APEX_Cache *cache);
+int APEX_cache_access(APEX_Cache *cache, int address, int is_write);
+int APEX_cache_contains(APEX_Cache *cache, int address);
+int APEX_cache_prefetch(APEX_Cache *cache, int address);
+void APEX_cache_print_stats(const APEX_Cache *cache);
+
+APEX_Bus *APEX_bus_create(void);
+void APEX_bus_destroy(APEX_Bus *bus);
+
+#endif
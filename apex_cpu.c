@@ -10,10 +10,18 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include <assert.h>
-
+#include "apex_cache.h"
 #include "apex_cpu.h"
+#include "apex_dram.h"
+#include "apex_host_profile.h"
+#include "apex_isa.h"
+#include "apex_journal.h"
 #include "apex_macros.h"
+#include "apex_prefetch.h"
+#include "apex_profile.h"
+#include "apex_sampler.h"
+#include "apex_trace.h"
+#include "apex_watchdog.h"
 int ENABLE_DEBUG_MESSAGES = 1;
 
 /* Converts the PC(4000 series) into array index for code memory
@@ -26,9 +34,39 @@ get_code_memory_index_from_pc(const int pc)
     return (pc - 4000) / 4;
 }
 
+/*
+ * Fills head with the older instruction of a fused pair as if it had gone
+ * through the pipeline on its own
+ */
+void
+APEX_stage_fused_head(const CPU_Stage *stage, CPU_Stage *head)
+{
+    memset(head, 0, sizeof(*head));
+    head->pc = stage->fused_pc;
+    strcpy(head->opcode_str, stage->fused_opcode == OPCODE_CMP ? "CMP" : "ADDL");
+    head->opcode = stage->fused_opcode;
+    head->rd = stage->fused_rd;
+    head->rs1 = stage->fused_rs1;
+    head->rs2 = stage->fused_rs2;
+    head->imm = stage->fused_imm;
+    head->rs1_value = stage->fused_rs1_value;
+    head->rs2_value = stage->fused_rs2_value;
+    head->result_buffer = stage->fused_result;
+    head->has_insn = stage->has_insn;
+}
+
 static void
-print_instruction(const CPU_Stage *stage)
+print_instruction(FILE *out, const CPU_Stage *stage)
 {
+    if (stage->fused)
+    {
+        CPU_Stage head;
+
+        APEX_stage_fused_head(stage, &head);
+        print_instruction(out, &head);
+        fprintf(out, "+ ");
+    }
+
     switch (stage->opcode)
     {
     case OPCODE_ADD:
@@ -39,29 +77,29 @@ print_instruction(const CPU_Stage *stage)
     case OPCODE_OR:
     case OPCODE_XOR:
     {
-        printf("%s,R%d,R%d,R%d ", stage->opcode_str, stage->rd, stage->rs1,
-               stage->rs2);
+        fprintf(out, "%s,R%d,R%d,R%d ", stage->opcode_str, stage->rd, stage->rs1,
+                stage->rs2);
         break;
     }
     case OPCODE_LDR:
     {
         {
-            printf("%s,R%d,R%d,R%d ", stage->opcode_str, stage->rd, stage->rs1,
-                   stage->rs2);
+            fprintf(out, "%s,R%d,R%d,R%d ", stage->opcode_str, stage->rd, stage->rs1,
+                    stage->rs2);
             break;
         }
     }
 
     case OPCODE_STR:
     {
-        printf("%s,R%d,R%d,R%d ", stage->opcode_str, stage->rs1, stage->rs2,
-               stage->rs3);
+        fprintf(out, "%s,R%d,R%d,R%d ", stage->opcode_str, stage->rs1, stage->rs2,
+                stage->rs3);
         break;
     }
 
     case OPCODE_MOVC:
     {
-        printf("%s,R%d,#%d ", stage->opcode_str, stage->rd, stage->imm);
+        fprintf(out, "%s,R%d,#%d ", stage->opcode_str, stage->rd, stage->imm);
         break;
     }
 
@@ -69,43 +107,43 @@ print_instruction(const CPU_Stage *stage)
     case OPCODE_SUBL:
 
     {
-        printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1, stage->imm);
+        fprintf(out, "%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1, stage->imm);
         break;
     }
     case OPCODE_CMP:
     {
-        printf("%s,R%d,R%d", stage->opcode_str, stage->rs1, stage->rs2);
+        fprintf(out, "%s,R%d,R%d", stage->opcode_str, stage->rs1, stage->rs2);
         break;
     }
     case OPCODE_LOAD:
     {
-        printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
-               stage->imm);
+        fprintf(out, "%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
+                stage->imm);
         break;
     }
 
     case OPCODE_STORE:
     {
-        printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rs1, stage->rs2,
-               stage->imm);
+        fprintf(out, "%s,R%d,R%d,#%d ", stage->opcode_str, stage->rs1, stage->rs2,
+                stage->imm);
         break;
     }
 
     case OPCODE_BZ:
     case OPCODE_BNZ:
     {
-        printf("%s,#%d ", stage->opcode_str, stage->imm);
+        fprintf(out, "%s,#%d ", stage->opcode_str, stage->imm);
         break;
     }
 
     case OPCODE_HALT:
     {
-        printf("%s", stage->opcode_str);
+        fprintf(out, "%s", stage->opcode_str);
         break;
     }
     case OPCODE_NOP:
     {
-        printf("%s", stage->opcode_str);
+        fprintf(out, "%s", stage->opcode_str);
         break;
     }
     }
@@ -119,7 +157,7 @@ static void
 print_stage_content(const char *name, const CPU_Stage *stage)
 {
     printf("%-15s: pc(%d) ", name, stage->pc);
-    print_instruction(stage);
+    print_instruction(stdout, stage);
     printf("\n");
 }
 
@@ -148,6 +186,270 @@ print_reg_file(const APEX_CPU *cpu)
 
     printf("\n");
 }
+
+/* Names of the kinds of stage, a kind split over several stages numbers them */
+static const char *stage_names[APEX_STAGE_KINDS] = {"Fetch", "Decode/RF", "Execute", "Memory",
+                                                    "Writeback"};
+
+/*
+ * Lists the pipeline latches from fetch to writeback, returns how many
+ */
+static int
+list_latches(const APEX_CPU *cpu, const CPU_Stage **stages, char names[][16])
+{
+    int i;
+
+    for (i = 0; i < cpu->num_stages; ++i)
+    {
+        int kind = cpu->stage_kind[i];
+
+        stages[i] = &cpu->stages[i];
+        if (cpu->first_stage[kind] == cpu->last_stage[kind])
+        {
+            snprintf(names[i], 16, "%s", stage_names[kind]);
+        }
+        else
+        {
+            snprintf(names[i], 16, "%s %d", stage_names[kind], i - cpu->first_stage[kind] + 1);
+        }
+    }
+    return cpu->num_stages;
+}
+
+/*
+ * Prints the instruction in every pipeline latch, used by the debugger
+ */
+void
+APEX_cpu_print_pipeline(const APEX_CPU *cpu)
+{
+    const CPU_Stage *stages[APEX_LATCHES_MAX];
+    char names[APEX_LATCHES_MAX][16];
+    int count = list_latches(cpu, stages, names);
+    int i;
+
+    for (i = 0; i < count; ++i)
+    {
+        if (stages[i]->has_insn)
+        {
+            print_stage_content(names[i], stages[i]);
+        }
+        else
+        {
+            printf("%-15s: empty\n", names[i]);
+        }
+    }
+    print_reg_file(cpu);
+}
+/*
+ * Returns the latch decode hands instructions to, EX1 of a deeper execute
+ */
+static CPU_Stage *
+execute_entry(APEX_CPU *cpu)
+{
+    return &cpu->stages[cpu->first_stage[APEX_STAGE_EXECUTE]];
+}
+
+/*
+ * Returns the latch execute hands instructions to, MEM1 of a deeper memory
+ */
+static CPU_Stage *
+memory_entry(APEX_CPU *cpu)
+{
+    return &cpu->stages[cpu->first_stage[APEX_STAGE_MEMORY]];
+}
+
+/*
+ * Switches the architectural state of thread into the APEX_CPU fields the
+ * stages work on, and saves the state of the thread switched out
+ */
+static void
+switch_thread(APEX_CPU *cpu, int thread)
+{
+    CPU_Stage *fetch = APEX_LATCH(cpu, APEX_STAGE_FETCH);
+    APEX_Thread *out = &cpu->threads[cpu->thread];
+    const APEX_Thread *in = &cpu->threads[thread];
+
+    if (thread == cpu->thread)
+    {
+        return;
+    }
+
+    out->pc = cpu->pc;
+    memcpy(out->regs, cpu->regs, sizeof(cpu->regs));
+    memcpy(out->regs_valid_check, cpu->regs_valid_check, sizeof(cpu->regs_valid_check));
+    out->zero_flag = cpu->zero_flag;
+    out->fetch_from_next_cycle = cpu->fetch_from_next_cycle;
+    out->fetching = fetch->has_insn;
+    out->code_memory = cpu->code_memory;
+    out->code_memory_size = cpu->code_memory_size;
+
+    cpu->pc = in->pc;
+    memcpy(cpu->regs, in->regs, sizeof(cpu->regs));
+    memcpy(cpu->regs_valid_check, in->regs_valid_check, sizeof(cpu->regs_valid_check));
+    cpu->zero_flag = in->zero_flag;
+    cpu->fetch_from_next_cycle = in->fetch_from_next_cycle;
+    fetch->has_insn = in->fetching;
+    cpu->code_memory = in->code_memory;
+    cpu->code_memory_size = in->code_memory_size;
+    cpu->thread = thread;
+}
+
+/* Runs a stage of an SMT core as the thread of the instruction in its latch */
+static void
+switch_to_stage(APEX_CPU *cpu, const CPU_Stage *stage)
+{
+    if (cpu->num_threads > 1 && stage->has_insn)
+    {
+        switch_thread(cpu, stage->thread);
+    }
+}
+
+/* TRUE while thread has not fetched its HALT and no fault stopped the core */
+static int
+thread_can_fetch(const APEX_CPU *cpu, int thread)
+{
+    const CPU_Stage *fetch = APEX_LATCH(cpu, APEX_STAGE_FETCH);
+    int fetching = (thread == cpu->thread) ? fetch->has_insn : cpu->threads[thread].fetching;
+
+    return fetching && cpu->fault.type == APEX_FAULT_NONE;
+}
+
+/*
+ * Squashes the instructions younger than the one execute resolves, from
+ * decode up to the last execute stage, those of the running thread on an
+ * SMT core. Fetch no longer waits on decode, whatever it holds is squashed
+ * separately.
+ */
+static void
+flush_front_end(APEX_CPU *cpu)
+{
+    int i;
+
+    for (i = cpu->first_stage[APEX_STAGE_DECODE]; i < cpu->last_stage[APEX_STAGE_EXECUTE]; ++i)
+    {
+        if (cpu->stages[i].thread == cpu->thread)
+        {
+            cpu->stages[i].has_insn = FALSE;
+        }
+    }
+    APEX_LATCH(cpu, APEX_STAGE_FETCH)->stalled = FALSE;
+}
+
+/*
+ * Moves the instruction in latch i, one in front of the last stage of its
+ * kind, on to latch i + 1 once that one is free. Runs after the older
+ * latch moved on this cycle.
+ */
+static void
+advance_latch(APEX_CPU *cpu, int i)
+{
+    if (cpu->stages[i].has_insn && !cpu->stages[i + 1].has_insn)
+    {
+        cpu->stages[i + 1] = cpu->stages[i];
+        cpu->stages[i].has_insn = FALSE;
+    }
+}
+
+/*
+ * Copies the instruction at stage->pc from code memory into the latch. A PC
+ * past the end is normal behind HALT, so it gives a NOP that only faults if
+ * it reaches execute without being squashed.
+ */
+static void
+read_code_memory(const APEX_CPU *cpu, CPU_Stage *stage)
+{
+    const APEX_Instruction *current_ins;
+    int index = get_code_memory_index_from_pc(stage->pc);
+
+    if ((unsigned int)index < (unsigned int)cpu->code_memory_size)
+    {
+        current_ins = &cpu->code_memory[index];
+        strcpy(stage->opcode_str, current_ins->opcode_str);
+        stage->opcode = current_ins->opcode;
+        stage->rd = current_ins->rd;
+        stage->rs1 = current_ins->rs1;
+        stage->rs2 = current_ins->rs2;
+        stage->rs3 = current_ins->rs3;
+        stage->imm = current_ins->imm;
+        stage->fault = FALSE;
+    }
+    else
+    {
+        strcpy(stage->opcode_str, "FAULT");
+        stage->opcode = OPCODE_NOP;
+        stage->rd = -1;
+        stage->rs1 = 0;
+        stage->rs2 = 0;
+        stage->rs3 = 0;
+        stage->imm = 0;
+        stage->fault = TRUE;
+    }
+}
+
+/*
+ * Returns TRUE when the loop buffer streams the instruction at pc
+ */
+static int
+loop_buffer_holds(const APEX_CPU *cpu, int pc)
+{
+    return cpu->loop_buffer_active && pc >= cpu->loop_start_pc && pc <= cpu->loop_branch_pc;
+}
+
+/*
+ * Reads the instruction at stage->pc from the loop buffer when it holds it,
+ * otherwise from code memory
+ */
+static void
+read_instruction(const APEX_CPU *cpu, CPU_Stage *stage)
+{
+    stage->loop_predicted = FALSE;
+    if (loop_buffer_holds(cpu, stage->pc))
+    {
+        const APEX_Instruction *ins = &cpu->loop_buffer[(stage->pc - cpu->loop_start_pc) / 4];
+
+        strcpy(stage->opcode_str, ins->opcode_str);
+        stage->opcode = ins->opcode;
+        stage->rd = ins->rd;
+        stage->rs1 = ins->rs1;
+        stage->rs2 = ins->rs2;
+        stage->rs3 = ins->rs3;
+        stage->imm = ins->imm;
+        stage->fault = FALSE;
+        return;
+    }
+    read_code_memory(cpu, stage);
+}
+
+/*
+ * Returns the PC fetched after the instruction in stage, once it has left
+ * fetch. While the loop buffer streams its loop the loop branch is followed
+ * as taken, so the next iteration comes without a fetch bubble; leaving the
+ * loop range releases the buffer.
+ */
+static int
+next_fetch_pc(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    if (cpu->loop_buffer_size == 0)
+    {
+        return stage->pc + 4;
+    }
+
+    cpu->stats.loop_buffer_fetches++;
+    if (!loop_buffer_holds(cpu, stage->pc))
+    {
+        cpu->loop_buffer_active = FALSE;
+        return stage->pc + 4;
+    }
+
+    cpu->stats.loop_buffer_hits++;
+    if (stage->pc == cpu->loop_branch_pc)
+    {
+        stage->loop_predicted = TRUE;
+        return cpu->loop_start_pc;
+    }
+    return stage->pc + 4;
+}
+
 /*
  * Fetch Stage of APEX Pipeline
  *
@@ -156,17 +458,19 @@ print_reg_file(const APEX_CPU *cpu)
 static void
 APEX_fetch(APEX_CPU *cpu)
 {
-    APEX_Instruction *current_ins;
+    CPU_Stage *fetch = APEX_LATCH(cpu, APEX_STAGE_FETCH);
+    CPU_Stage *decode = APEX_LATCH(cpu, APEX_STAGE_DECODE);
 
-    if (cpu->fetch.has_insn)
+    if (fetch->has_insn)
     {
-        if (!cpu->fetch.stalled)
+        if (!fetch->stalled)
         {
 
             /* This fetches new branch target instruction from next cycle */
             if (cpu->fetch_from_next_cycle == TRUE)
             {
                 cpu->fetch_from_next_cycle = FALSE;
+                cpu->fetch_refill_left = cpu->fetch_stages - 1;
                 if (ENABLE_DEBUG_MESSAGES)
                 {
                     printf("Instruction at Fetch____________Stage---> : empty");
@@ -176,46 +480,51 @@ APEX_fetch(APEX_CPU *cpu)
                 return;
             }
 
+            /* The redirected PC is still in the fetch stages before this one */
+            if (cpu->fetch_refill_left > 0)
+            {
+                cpu->fetch_refill_left--;
+                if (ENABLE_DEBUG_MESSAGES)
+                {
+                    printf("Instruction at Fetch____________Stage---> : empty\n");
+                }
+                return;
+            }
+
             /* Store current PC in fetch latch */
-            cpu->fetch.pc = cpu->pc;
+            fetch->pc = cpu->pc;
+            fetch->thread = cpu->thread;
 
             /* Index into code memory using this pc and copy all instruction fields
          * into fetch latch  */
-            current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
-            strcpy(cpu->fetch.opcode_str, current_ins->opcode_str);
-            cpu->fetch.opcode = current_ins->opcode;
-            cpu->fetch.rd = current_ins->rd;
-            cpu->fetch.rs1 = current_ins->rs1;
-            cpu->fetch.rs2 = current_ins->rs2;
-            cpu->fetch.rs3 = current_ins->rs3;
-            cpu->fetch.imm = current_ins->imm;
+            read_instruction(cpu, fetch);
 
-            if (!cpu->decode.stalled)
+            if (!decode->stalled)
             {
                 /* Update PC for next instruction */
-                cpu->pc += 4;
+                cpu->pc = next_fetch_pc(cpu, fetch);
 
                 /* Copy data from fetch latch to decode latch*/
-                cpu->decode = cpu->fetch;
+                *decode = *fetch;
                 /* Stop fetching new instructions if HALT is fetched */
-                // if (cpu->fetch.opcode == OPCODE_HALT)
+                // if (fetch->opcode == OPCODE_HALT)
                 // {
-                //     //  cpu->fetch.has_insn = FALSE;
+                //     //  fetch->has_insn = FALSE;
                 // }
             }
             else
             {
-                cpu->fetch.stalled = 1;
+                fetch->stalled = 1;
             }
             if (ENABLE_DEBUG_MESSAGES)
             {
-                print_stage_content("Instruction at Fetch____________Stage--->", &cpu->fetch);
+                print_stage_content("Instruction at Fetch____________Stage--->", fetch);
             }
         }
 
         else if (ENABLE_DEBUG_MESSAGES)
         {
-            print_stage_content("Instruction at Fetch____________Stage--->", &cpu->fetch);
+            print_stage_content("Instruction at Fetch____________Stage--->", fetch);
         }
     }
     else if (ENABLE_DEBUG_MESSAGES)
@@ -226,978 +535,2615 @@ APEX_fetch(APEX_CPU *cpu)
 }
 
 /*
- * Decode Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Brings the instruction at the PC into the fetch queue, through the
+ * I-cache when there is one. Returns FALSE when fetch waits this cycle.
  */
-static void
-APEX_decode(APEX_CPU *cpu)
+static int
+fetch_into_queue(APEX_CPU *cpu)
 {
-    cpu->decode.stalled = 0;
-    if (cpu->decode.has_insn)
+    CPU_Stage *fetch = APEX_LATCH(cpu, APEX_STAGE_FETCH);
+    CPU_Stage *entry;
+    int index = get_code_memory_index_from_pc(cpu->pc);
+
+    if (cpu->icache_cycles_left > 0)
     {
-        if (!cpu->decode.stalled)
+        /* The missing line arrives when the count reaches 0 */
+        if (--cpu->icache_cycles_left > 0)
         {
-            int stagestalled = 0;
-
-            /* Read operands from register file based on the instruction type */
-            switch (cpu->decode.opcode)
-            {
-            case OPCODE_ADD:
-            case OPCODE_DIV:
-            case OPCODE_MUL:
-            case OPCODE_SUB:
-            case OPCODE_OR:
-            case OPCODE_XOR:
-            case OPCODE_AND:
-            case OPCODE_LDR:
-            {
-                if (cpu->regs_valid_check[cpu->decode.rs1] && cpu->regs_valid_check[cpu->decode.rs2])
-                {
-                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                }
-                else
-                {
-
-                    if (cpu->regs_valid_check[cpu->decode.rs1])
-                    {
-                        cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    }
-                    //excute data
-                    else if (cpu->dataForwardingLines[0] == cpu->decode.rs1)
-                    {
-                        if (cpu->execute.opcode == OPCODE_LDR || cpu->execute.opcode == OPCODE_LOAD)
-                        {
-                            stagestalled = 1;
-                        }
-                        else
-                        {
-                            cpu->decode.rs1_value = cpu->dataForwardingLinesdata[0];
-                        }
-                    } //memory data
-                    else if (cpu->dataForwardingLines[1] == cpu->decode.rs1)
-                    {
+            cpu->stats.icache_stalls++;
+            return FALSE;
+        }
+    }
+    else if (cpu->fetch_queue_count == cpu->fetch_queue_depth)
+    {
+        cpu->stats.fetch_queue_full++;
+        return FALSE;
+    }
+    else if (cpu->icache && (unsigned int)index < (unsigned int)cpu->code_memory_size
+             && !loop_buffer_holds(cpu, cpu->pc))
+    {
+        int latency = APEX_cache_access(cpu->icache, index, FALSE);
 
-                        cpu->decode.rs1_value = cpu->dataForwardingLinesdata[1];
-                    }
-                    else
-                    {
-                        stagestalled = 1;
-                    }
-                    if (!stagestalled)
-                    {
+        if (latency > 1)
+        {
+            cpu->icache_cycles_left = latency - 1;
+            cpu->stats.icache_stalls++;
+            return FALSE;
+        }
+    }
 
-                        if (cpu->regs_valid_check[cpu->decode.rs2])
-                        {
-                            cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                        }
-                        //excute data
-                        else if (cpu->dataForwardingLines[0] == cpu->decode.rs2)
-                        {
-                            if (cpu->execute.opcode == OPCODE_LDR || cpu->execute.opcode == OPCODE_LOAD)
-                            {
-                                stagestalled = 1;
-                            }
-                            else
-                            {
-                                cpu->decode.rs2_value = cpu->dataForwardingLinesdata[0];
-                            }
-
-                        } //memory data
-                        else if (cpu->dataForwardingLines[1] == cpu->decode.rs2)
-                        {
-
-                            cpu->decode.rs2_value = cpu->dataForwardingLinesdata[1];
-                        }
-                        else
-                        {
-                            stagestalled = 1;
-                        }
-                    }
-                }
+    entry = &cpu->fetch_queue[(cpu->fetch_queue_head + cpu->fetch_queue_count)
+                              % APEX_FETCH_QUEUE_MAX];
+    memset(entry, 0, sizeof(CPU_Stage));
+    entry->pc = cpu->pc;
+    entry->has_insn = TRUE;
+    read_instruction(cpu, entry);
+    cpu->fetch_queue_count++;
+    cpu->pc = next_fetch_pc(cpu, entry);
+
+    /* The fetch latch shows the youngest fetched instruction */
+    *fetch = *entry;
+    return TRUE;
+}
 
-                break;
-            }
+/*
+ * Fetch Stage with a fetch queue in front of decode. Fetch keeps filling
+ * the queue while decode stalls, and decode takes the oldest queued
+ * instruction whenever its latch is empty, so an I-cache miss only costs
+ * cycles once the queue has drained.
+ */
+static void
+APEX_fetch_queued(APEX_CPU *cpu)
+{
+    CPU_Stage *fetch = APEX_LATCH(cpu, APEX_STAGE_FETCH);
+    CPU_Stage *decode = APEX_LATCH(cpu, APEX_STAGE_DECODE);
 
-            case OPCODE_ADDL:
-            case OPCODE_SUBL:
-            {
-                if (cpu->regs_valid_check[cpu->decode.rs1])
-                {
-                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                }
-                else
-                {
-                    if (cpu->regs_valid_check[cpu->decode.rs1])
-                    {
-                        cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    }
-                    //excute data
-                    else if (cpu->dataForwardingLines[0] == cpu->decode.rs1)
-                    {
-                        if (cpu->execute.opcode == OPCODE_LDR || cpu->execute.opcode == OPCODE_LOAD)
-                        {
-                            stagestalled = 1;
-                        }
-                        else
-                        {
-                            cpu->decode.rs1_value = cpu->dataForwardingLinesdata[0];
-                        }
-                        //  cpu->decode.rs1_value = cpu->dataForwardingLinesdata[0];
-                    }
-                    //memory data
-                    else if (cpu->dataForwardingLines[1] == cpu->decode.rs1)
-                    {
-                        cpu->decode.rs1_value = cpu->dataForwardingLinesdata[1];
-                    }
-                    else
-                    {
-                        stagestalled = 1;
-                    }
-                }
-                break;
-            }
-            case OPCODE_STORE:
+    if (!fetch->has_insn || cpu->fetch_from_next_cycle)
+    {
+        /* HALT, a fault or a taken branch squashed everything fetched */
+        cpu->fetch_queue_count = 0;
+        cpu->icache_cycles_left = 0;
+    }
+    if (!fetch->has_insn)
+    {
+        if (ENABLE_DEBUG_MESSAGES)
+        {
+            printf("Instruction at Fetch____________Stage---> : empty\n");
+        }
+        return;
+    }
+    if (cpu->fetch_from_next_cycle)
+    {
+        /* The branch target is fetched from the next cycle */
+        cpu->fetch_from_next_cycle = FALSE;
+        cpu->fetch_refill_left = cpu->fetch_stages - 1;
+        if (ENABLE_DEBUG_MESSAGES)
+        {
+            printf("Instruction at Fetch____________Stage---> : empty\n");
+        }
+        return;
+    }
 
-            {
-                if (cpu->regs_valid_check[cpu->decode.rs1] && cpu->regs_valid_check[cpu->decode.rs2])
-                {
-                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                }
-                else
-                {
-                    if (cpu->regs_valid_check[cpu->decode.rs1])
-                    {
-                        cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    }
-                    //excute data
-                    else if (cpu->dataForwardingLines[0] == cpu->decode.rs1)
-                    {
+    if (cpu->fetch_refill_left > 0)
+    {
+        cpu->fetch_refill_left--;
+    }
+    else if (fetch_into_queue(cpu) && ENABLE_DEBUG_MESSAGES)
+    {
+        print_stage_content("Instruction at Fetch____________Stage--->", fetch);
+    }
 
-                        if (cpu->execute.opcode == OPCODE_LDR || cpu->execute.opcode == OPCODE_LOAD)
-                        {
-                            stagestalled = 1;
-                        }
-                        else
-                        {
-                            cpu->decode.rs1_value = cpu->dataForwardingLinesdata[0];
-                        }
-                        // cpu->decode.rs1_value = cpu->dataForwardingLinesdata[0];
-
-                    } //memory data
-                    else if (cpu->dataForwardingLines[1] == cpu->decode.rs1)
-                    {
+    if (!decode->has_insn)
+    {
+        if (cpu->fetch_queue_count > 0)
+        {
+            *decode = cpu->fetch_queue[cpu->fetch_queue_head];
+            cpu->fetch_queue_head = (cpu->fetch_queue_head + 1) % APEX_FETCH_QUEUE_MAX;
+            cpu->fetch_queue_count--;
+        }
+        else
+        {
+            cpu->stats.fetch_queue_empty++;
+        }
+    }
+    cpu->stats.fetch_queue_occupancy += cpu->fetch_queue_count;
+}
 
-                        cpu->decode.rs1_value = cpu->dataForwardingLinesdata[1];
-                    }
-                    else
-                    {
-                        stagestalled = 1;
-                    }
-                    if (!stagestalled)
-                    {
+/*
+ * TRUE when the instruction in stage, or the one fused into it, writes reg
+ * of the running thread
+ */
+static int
+stage_writes(const APEX_CPU *cpu, const CPU_Stage *stage, int reg)
+{
+    return stage->has_insn && stage->thread == cpu->thread
+           && (stage->rd == reg || (stage->fused && stage->fused_rd == reg));
+}
 
-                        if (cpu->regs_valid_check[cpu->decode.rs2])
-                        {
-                            cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                        }
-                        //  excute data
-                        else if (cpu->dataForwardingLines[0] == cpu->decode.rs2)
-                        {
-                            if (cpu->execute.opcode == OPCODE_LDR || cpu->execute.opcode == OPCODE_LOAD)
-                            {
-                                stagestalled = 1;
-                            }
-                            else
-                            {
-                                cpu->decode.rs2_value = cpu->dataForwardingLinesdata[0];
-                            }
-                            //cpu->decode.rs2_value = cpu->dataForwardingLinesdata[0];
-
-                        } //memory data
-                        else if (cpu->dataForwardingLines[1] == cpu->decode.rs2)
-                        {
-
-                            cpu->decode.rs2_value = cpu->dataForwardingLinesdata[1];
-                        }
-                        else
-                        {
-                            stagestalled = 1;
-                        }
-                    }
-                }
+/*
+ * Returns the PC of the in-flight instruction that will write reg, -1 when
+ * none is found
+ */
+static int
+find_producer(const APEX_CPU *cpu, int reg)
+{
+    int i;
 
+    for (i = cpu->first_stage[APEX_STAGE_EXECUTE]; i <= cpu->last_stage[APEX_STAGE_MEMORY]; ++i)
+    {
+        if (stage_writes(cpu, &cpu->stages[i], reg))
+        {
+            return cpu->stages[i].rd == reg ? cpu->stages[i].pc : cpu->stages[i].fused_pc;
+        }
+    }
+    return -1;
+}
+
+/*
+ * TRUE when an instruction from the last execute stage to the last memory
+ * stage will write reg again, those in front of it have not claimed reg yet
+ */
+static int
+has_younger_writer(const APEX_CPU *cpu, int reg)
+{
+    int i;
+
+    for (i = cpu->last_stage[APEX_STAGE_EXECUTE]; i <= cpu->last_stage[APEX_STAGE_MEMORY]; ++i)
+    {
+        if (stage_writes(cpu, &cpu->stages[i], reg))
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Records a stall on a source, events is NULL when nothing collects them */
+static void
+note_stall(APEX_DecodeEvents *events, int reason, int producer)
+{
+    if (events)
+    {
+        events->stall_reason = reason;
+        events->stall_producer = producer;
+    }
+}
+
+/* Records a source taken from a forwarding line */
+static void
+note_forward(APEX_DecodeEvents *events, int producer, int from_mem)
+{
+    if (events)
+    {
+        events->forward_producer[events->num_forwards] = producer;
+        events->forward_from_mem[events->num_forwards++] = from_mem;
+    }
+}
+
+/*
+ * Reads one source register in decode from the register file, the EX
+ * forwarding line or the MEM forwarding line, skipping lines another thread
+ * of an SMT core drives. Returns TRUE when the value is not available yet
+ * and decode has to stall. events is NULL unless the per-PC profiler or the
+ * sampler collects them.
+ */
+static int
+read_operand(APEX_CPU *cpu, int reg, int *value, APEX_DecodeEvents *events)
+{
+    const CPU_Stage *execute = APEX_LATCH(cpu, APEX_STAGE_EXECUTE);
+    const CPU_Stage *writeback = APEX_LATCH(cpu, APEX_STAGE_WRITEBACK);
+
+    /* The instruction on the EX forwarding lines stays in execute when it
+     * could not move on, a deeper execute refills the latch otherwise */
+    const CPU_Stage *executed = execute->stalled ? execute : memory_entry(cpu);
+    int first, last, i;
+
+    /* Nothing forwards before the last execute stage, nor from the execute
+     * latch an earlier execute stage has just filled */
+    first = cpu->first_stage[APEX_STAGE_EXECUTE];
+    last = cpu->last_stage[APEX_STAGE_EXECUTE];
+    for (i = first; first < last && i <= last; ++i)
+    {
+        const CPU_Stage *stage = &cpu->stages[i];
+
+        if (!stage->stalled && stage_writes(cpu, stage, reg))
+        {
+            if (events)
+            {
+                note_stall(events, APEX_STALL_OPERAND, find_producer(cpu, reg));
+            }
+            return TRUE;
+        }
+    }
+
+    if (cpu->regs_valid_check[reg])
+    {
+        *value = cpu->regs[reg];
+        return FALSE;
+    }
+
+    //excute data
+    if (cpu->dataForwardingLines[0] == reg && executed->thread == cpu->thread)
+    {
+        /* A load in execute has no data until it leaves memory */
+        if (executed->opcode == OPCODE_LDR || executed->opcode == OPCODE_LOAD)
+        {
+            note_stall(events, APEX_STALL_LOAD_USE, executed->pc);
+            return TRUE;
+        }
+        *value = cpu->dataForwardingLinesdata[0];
+        note_forward(events, executed->pc, FALSE);
+        return FALSE;
+    }
+
+    /* ADDL fused into the instruction in execute, older than it but
+     * younger than the one leaving memory */
+    if (cpu->dataForwardingLines[2] == reg && executed->thread == cpu->thread)
+    {
+        *value = cpu->dataForwardingLinesdata[2];
+        note_forward(events, executed->fused_pc, FALSE);
+        return FALSE;
+    }
+
+    /* Results waiting in front of the data memory access of a deeper
+     * memory, youngest first; a load there has no data yet */
+    first = cpu->first_stage[APEX_STAGE_MEMORY];
+    last = cpu->last_stage[APEX_STAGE_MEMORY];
+    for (i = first; first < last && i <= last; ++i)
+    {
+        const CPU_Stage *stage = &cpu->stages[i];
+
+        if (!stage_writes(cpu, stage, reg))
+        {
+            continue;
+        }
+        if (stage->rd == reg && APEX_opcode_is_load(stage->opcode))
+        {
+            note_stall(events, APEX_STALL_LOAD_USE, stage->pc);
+            return TRUE;
+        }
+        *value = (stage->rd == reg) ? stage->result_buffer : stage->fused_result;
+        note_forward(events, (stage->rd == reg) ? stage->pc : stage->fused_pc, TRUE);
+        return FALSE;
+    }
+
+    //memory data
+    if (cpu->dataForwardingLines[1] == reg && writeback->thread == cpu->thread)
+    {
+        *value = cpu->dataForwardingLinesdata[1];
+        note_forward(events, writeback->pc, TRUE);
+        return FALSE;
+    }
+
+    if (cpu->dataForwardingLines[3] == reg && writeback->thread == cpu->thread)
+    {
+        *value = cpu->dataForwardingLinesdata[3];
+        note_forward(events, writeback->fused_pc, TRUE);
+        return FALSE;
+    }
+
+    if (!events)
+    {
+        return TRUE;
+    }
+    note_stall(events, APEX_STALL_OPERAND, find_producer(cpu, reg));
+    for (i = 0; i < cpu->mshr_count; ++i)
+    {
+        if (cpu->mshrs[i].rd == reg)
+        {
+            /* A load that left memory with its miss outstanding */
+            note_stall(events, APEX_STALL_LOAD_USE, cpu->mshrs[i].pc);
+        }
+    }
+    return TRUE;
+}
+
+/* Adds one decode cycle to the running totals in cpu->stats */
+static void
+count_decode_events(APEX_CPU *cpu, const APEX_DecodeEvents *events, int stalled)
+{
+    int i;
+
+    if (stalled)
+    {
+        switch (events->stall_reason)
+        {
+        case APEX_STALL_LOAD_USE:
+            cpu->stats.load_use_stalls++;
+            break;
+        case APEX_STALL_OPERAND:
+            cpu->stats.operand_stalls++;
+            break;
+        case APEX_STALL_MEMORY:
+            cpu->stats.memory_stalls++;
+            break;
+        }
+        return;
+    }
+
+    for (i = 0; i < events->num_forwards; ++i)
+    {
+        if (events->forward_from_mem[i])
+        {
+            cpu->stats.forwarded_mem++;
+        }
+        else
+        {
+            cpu->stats.forwarded_ex++;
+        }
+    }
+}
+
+/*
+ * Fuses the CMP or ADDL in decode with the BZ/BNZ, or the LOAD/STORE using
+ * the ADDL result as its address base, that fetch would bring in next.
+ * The latch takes the younger instruction and keeps the older one in its
+ * fused_* fields, and fetch skips the younger one.
+ */
+static void
+fuse_decode(APEX_CPU *cpu)
+{
+    CPU_Stage *fetch = APEX_LATCH(cpu, APEX_STAGE_FETCH);
+    CPU_Stage *stage = APEX_LATCH(cpu, APEX_STAGE_DECODE);
+    const APEX_Instruction *next;
+    int index = get_code_memory_index_from_pc(stage->pc + 4);
+    int queued = cpu->fetch_queue_count > 0;
+    int buffered = loop_buffer_holds(cpu, stage->pc + 4);
+
+    if (stage->fused || stage->fault || (unsigned int)index >= (unsigned int)cpu->code_memory_size)
+    {
+        return;
+    }
+    if (queued)
+    {
+        if (cpu->fetch_queue[cpu->fetch_queue_head].pc != stage->pc + 4)
+        {
+            return;
+        }
+    }
+    else if (!fetch->has_insn || cpu->fetch_from_next_cycle || cpu->pc != stage->pc + 4
+             || cpu->icache_cycles_left > 0 || cpu->fetch_refill_left > 0
+             || (cpu->icache && !buffered && !APEX_cache_contains(cpu->icache, index)))
+    {
+        /* Otherwise fetch brings the younger one in this cycle */
+        return;
+    }
+    next = &cpu->code_memory[index];
+
+    switch (stage->opcode)
+    {
+    case OPCODE_CMP:
+    {
+        if (next->opcode != OPCODE_BZ && next->opcode != OPCODE_BNZ)
+        {
+            return;
+        }
+        break;
+    }
+    case OPCODE_ADDL:
+    {
+        /* A STORE of the ADDL result itself is not address generation */
+        if (!(next->opcode == OPCODE_LOAD && next->rs1 == stage->rd)
+            && !(next->opcode == OPCODE_STORE && next->rs2 == stage->rd && next->rs1 != stage->rd))
+        {
+            return;
+        }
+        break;
+    }
+    default:
+        return;
+    }
+
+    stage->fused = TRUE;
+    stage->fused_pc = stage->pc;
+    stage->fused_opcode = stage->opcode;
+    stage->fused_rd = stage->rd;
+    stage->fused_rs1 = stage->rs1;
+    stage->fused_rs2 = stage->rs2;
+    stage->fused_imm = stage->imm;
+
+    stage->pc += 4;
+    strcpy(stage->opcode_str, next->opcode_str);
+    stage->opcode = next->opcode;
+    stage->rd = next->rd;
+    stage->rs1 = next->rs1;
+    stage->rs2 = next->rs2;
+    stage->rs3 = next->rs3;
+    stage->imm = next->imm;
+    if (queued)
+    {
+        stage->loop_predicted = cpu->fetch_queue[cpu->fetch_queue_head].loop_predicted;
+        cpu->fetch_queue_head = (cpu->fetch_queue_head + 1) % APEX_FETCH_QUEUE_MAX;
+        cpu->fetch_queue_count--;
+    }
+    else
+    {
+        if (cpu->icache && !buffered)
+        {
+            APEX_cache_access(cpu->icache, index, FALSE);
+        }
+        cpu->pc = next_fetch_pc(cpu, stage);
+    }
+}
+
+/*
+ * Reads the sources of a fused pair, the LOAD/STORE address base comes from
+ * the ADDL in execute instead of the register file
+ */
+static int
+read_fused_operands(APEX_CPU *cpu, APEX_DecodeEvents *events)
+{
+    CPU_Stage *stage = APEX_LATCH(cpu, APEX_STAGE_DECODE);
+
+    if (read_operand(cpu, stage->fused_rs1, &stage->fused_rs1_value, events))
+    {
+        return TRUE;
+    }
+    if (stage->fused_opcode == OPCODE_CMP)
+    {
+        return read_operand(cpu, stage->fused_rs2, &stage->fused_rs2_value, events);
+    }
+    if (stage->opcode == OPCODE_STORE)
+    {
+        return read_operand(cpu, stage->rs1, &stage->rs1_value, events);
+    }
+    return FALSE;
+}
+
+/*
+ * Switch-on-stall: when the instruction in decode stalls on an operand,
+ * its thread is rewound to fetch it again and fetch moves on to the next
+ * thread that can fetch. Returns FALSE, leaving decode stalled, when no
+ * other thread can take over. Structural stalls never switch.
+ */
+static int
+switch_on_stall(APEX_CPU *cpu)
+{
+    CPU_Stage *fetch = APEX_LATCH(cpu, APEX_STAGE_FETCH);
+    CPU_Stage *decode = APEX_LATCH(cpu, APEX_STAGE_DECODE);
+    int i;
+
+    if (cpu->num_threads == 1 || cpu->smt_policy != APEX_SMT_SWITCH)
+    {
+        return FALSE;
+    }
+
+    for (i = 1; i < cpu->num_threads; ++i)
+    {
+        int next = (cpu->thread + i) % cpu->num_threads;
+
+        if (thread_can_fetch(cpu, next))
+        {
+            cpu->pc = decode->pc;
+            fetch->stalled = FALSE;
+            cpu->fetch_thread = next;
+            cpu->threads[cpu->thread].switches++;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Decode Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_decode(APEX_CPU *cpu)
+{
+    CPU_Stage *fetch = APEX_LATCH(cpu, APEX_STAGE_FETCH);
+    CPU_Stage *decode = APEX_LATCH(cpu, APEX_STAGE_DECODE);
+    CPU_Stage *execute = APEX_LATCH(cpu, APEX_STAGE_EXECUTE);
+    CPU_Stage *memory = APEX_LATCH(cpu, APEX_STAGE_MEMORY);
+    APEX_DecodeEvents decode_events;
+    APEX_DecodeEvents *events = NULL;
+
+    switch_to_stage(cpu, decode);
+    decode->stalled = 0;
+    if (decode->has_insn)
+    {
+        if (!decode->stalled)
+        {
+            int stagestalled = 0;
+            int operand_stalled;
+
+            /* Only the profiler and the sampler pay for the events */
+            if (APEX_PROFILING(cpu) || cpu->sampler)
+            {
+                events = &decode_events;
+                APEX_profile_events_init(events);
+            }
+
+            if (cpu->fusion)
+            {
+                fuse_decode(cpu);
+            }
+
+            /* Read operands from register file based on the instruction type,
+             * a stall on one source leaves the following ones unread */
+            switch (decode->fused ? OPCODE_NOP : decode->opcode)
+            {
+            case OPCODE_ADD:
+            case OPCODE_DIV:
+            case OPCODE_MUL:
+            case OPCODE_SUB:
+            case OPCODE_OR:
+            case OPCODE_XOR:
+            case OPCODE_AND:
+            case OPCODE_LDR:
+            case OPCODE_STORE:
+            case OPCODE_CMP:
+            {
+                stagestalled = read_operand(cpu, decode->rs1, &decode->rs1_value, events)
+                               || read_operand(cpu, decode->rs2, &decode->rs2_value, events);
                 break;
             }
+
             case OPCODE_STR:
+            {
+                stagestalled = read_operand(cpu, decode->rs1, &decode->rs1_value, events)
+                               || read_operand(cpu, decode->rs2, &decode->rs2_value, events)
+                               || read_operand(cpu, decode->rs3, &decode->rs3_value, events);
+                break;
+            }
+
+            case OPCODE_ADDL:
+            case OPCODE_SUBL:
+            case OPCODE_LOAD:
+            {
+                stagestalled = read_operand(cpu, decode->rs1, &decode->rs1_value, events);
+                break;
+            }
+            case OPCODE_MOVC:
+            {
+                /* MOVC doesn't have register operands */
+                break;
+            }
+            case OPCODE_HALT:
+            case OPCODE_NOP:
+            {
+                /* HALT doesn't have register operands */
+                break;
+            }
+            }
+            if (decode->fused)
+            {
+                stagestalled = read_fused_operands(cpu, events);
+            }
+            /*dataForwardingLines are cleared and set to-1*/
+            for (int count = 0; count < 4; count++)
+            {
+                cpu->dataForwardingLines[count] = -1;
+                cpu->dataForwardingLinesdata[count] = -1;
+            }
+            operand_stalled = stagestalled;
+            /* Execute is still holding an older instruction */
+            if (execute_entry(cpu)->has_insn)
+            {
+                if (!stagestalled)
+                {
+                    note_stall(events, APEX_STALL_MEMORY,
+                               memory->has_insn ? memory->pc : execute->pc);
+                }
+                stagestalled = 1;
+            }
+            if (events)
+            {
+                count_decode_events(cpu, events, stagestalled);
+            }
+            if (APEX_PROFILING(cpu))
+            {
+                APEX_profile_decode(cpu->pc_profile,
+                                    decode->fused ? decode->fused_pc : decode->pc,
+                                    events, stagestalled);
+            }
+            if (operand_stalled && switch_on_stall(cpu))
+            {
+                /* The instruction comes back once its thread is fetched again */
+                decode->has_insn = FALSE;
+            }
+            else if (stagestalled)
+            {
+                decode->stalled = 1;
+            }
+            else
+            {
+                *execute_entry(cpu) = *decode;
+                /* Copy data from decode latch to execute latch*/
+                decode->has_insn = FALSE;
+                //Fetch
+                fetch->stalled = 0;
+            }
+            if (ENABLE_DEBUG_MESSAGES)
+            {
+                print_stage_content("Instruction at Decode/RF_________Stage---->", decode);
+            }
+        }
+        else if (ENABLE_DEBUG_MESSAGES)
+        {
+            print_stage_content("Instruction at Decode/RF________Stage---->", decode);
+        }
+    }
+    else
+    {
+        /* Nothing reads this cycle's forwarding lines, and a deeper pipe
+         * moves their producers on before the next decode, as does an SMT
+         * core that tells their threads apart by the latches */
+        if (cpu->execute_stages > 1 || cpu->memory_stages > 1 || cpu->num_threads > 1)
+        {
+            for (int count = 0; count < 4; count++)
+            {
+                cpu->dataForwardingLines[count] = -1;
+                cpu->dataForwardingLinesdata[count] = -1;
+            }
+        }
+        if (APEX_PROFILING(cpu))
+        {
+            APEX_profile_bubble(cpu->pc_profile);
+        }
+        if (ENABLE_DEBUG_MESSAGES)
+        {
+            printf("Instruction at Decode/RF________Stage---->: empty");
+            printf("\n");
+        }
+    }
+}
+
+/*
+ * Stops the instruction in execute and everything younger. The CPU stops
+ * once the older instructions in memory and writeback have retired.
+ */
+static void
+raise_fault(APEX_CPU *cpu, int type, int address)
+{
+    CPU_Stage *fetch = APEX_LATCH(cpu, APEX_STAGE_FETCH);
+    CPU_Stage *decode = APEX_LATCH(cpu, APEX_STAGE_DECODE);
+    CPU_Stage *execute = APEX_LATCH(cpu, APEX_STAGE_EXECUTE);
+    CPU_Stage head;
+
+    cpu->fault.type = type;
+    cpu->fault.pc = execute->pc;
+    cpu->fault.address = address;
+    cpu->fault.cycle = cpu->clock + 1;
+    cpu->fault.thread = cpu->thread;
+
+    /* rd was marked pending on entry to execute but is never written */
+    if (execute->rd < 16 && execute->rd >= 0)
+    {
+        cpu->regs_valid_check[execute->rd] = 1;
+    }
+    flush_front_end(cpu);
+    fetch->has_insn = FALSE;
+
+    /* A fault stops every thread of an SMT core */
+    decode->has_insn = FALSE;
+
+    if (!execute->fused)
+    {
+        execute->has_insn = FALSE;
+        return;
+    }
+
+    /* The older half of a fused pair retires before the CPU stops */
+    APEX_stage_fused_head(execute, &head);
+    *execute = head;
+    if (execute->rd < 16 && execute->rd >= 0)
+    {
+        cpu->regs_valid_check[execute->rd] = 0;
+    }
+    if (memory_entry(cpu)->has_insn)
+    {
+        execute->stalled = TRUE;
+    }
+    else
+    {
+        *memory_entry(cpu) = *execute;
+        execute->has_insn = FALSE;
+    }
+}
+
+/*
+ * Checks a BZ/BNZ that fetch followed as taken from the loop buffer.
+ * Returns TRUE when it needs no redirect: taken, or falling out of the loop
+ * on the last iteration, which squashes fetch and decode and releases the
+ * loop buffer.
+ */
+static int
+resolve_loop_branch(APEX_CPU *cpu, int taken)
+{
+    CPU_Stage *fetch = APEX_LATCH(cpu, APEX_STAGE_FETCH);
+    CPU_Stage *execute = APEX_LATCH(cpu, APEX_STAGE_EXECUTE);
+
+    if (!execute->loop_predicted)
+    {
+        return FALSE;
+    }
+
+    if (taken)
+    {
+        execute->branch_taken = TRUE;
+        cpu->stats.loop_buffer_taken++;
+        return TRUE;
+    }
+
+    cpu->pc = execute->pc + 4;
+    cpu->fetch_from_next_cycle = TRUE;
+    cpu->loop_buffer_active = FALSE;
+    cpu->stats.loop_buffer_exits++;
+    if (APEX_PROFILING(cpu))
+    {
+        APEX_profile_squash(cpu->pc_profile, execute->pc);
+    }
+    flush_front_end(cpu);
+    fetch->has_insn = TRUE;
+    return TRUE;
+}
+
+/*
+ * Loop stream detection, for a BZ/BNZ in execute that just redirected fetch
+ * to cpu->pc. A backward branch spanning at most loop_buffer_size
+ * instructions that is taken twice in a row has just had its whole body
+ * fetched, which the loop buffer keeps and streams from then on.
+ */
+static void
+detect_loop(APEX_CPU *cpu)
+{
+    CPU_Stage *execute = APEX_LATCH(cpu, APEX_STAGE_EXECUTE);
+    int length = (execute->pc - cpu->pc) / 4 + 1;
+    int start = get_code_memory_index_from_pc(cpu->pc);
+
+    if (cpu->loop_buffer_size == 0 || cpu->pc > execute->pc || length > cpu->loop_buffer_size)
+    {
+        return;
+    }
+    if (cpu->loop_candidate_pc != execute->pc)
+    {
+        cpu->loop_candidate_pc = execute->pc;
+        return;
+    }
+
+    memcpy(cpu->loop_buffer, &cpu->code_memory[start], sizeof(APEX_Instruction) * length);
+    cpu->loop_buffer_active = TRUE;
+    cpu->loop_start_pc = cpu->pc;
+    cpu->loop_branch_pc = execute->pc;
+    cpu->stats.loop_buffer_captures++;
+}
+
+/*
+ * Executes the CMP or ADDL fused into the instruction in execute, ahead of
+ * the BZ/BNZ that reads its zero flag or the LOAD/STORE that uses its result
+ */
+static void
+execute_fused_head(APEX_CPU *cpu)
+{
+    CPU_Stage *stage = APEX_LATCH(cpu, APEX_STAGE_EXECUTE);
+
+    if (stage->fused_opcode == OPCODE_CMP)
+    {
+        cpu->zero_flag = (stage->fused_rs1_value - stage->fused_rs2_value == 0) ? TRUE : FALSE;
+        return;
+    }
+
+    stage->fused_result = stage->fused_rs1_value + stage->fused_imm;
+    cpu->zero_flag = (stage->fused_result == 0) ? TRUE : FALSE;
+    if (stage->opcode == OPCODE_LOAD)
+    {
+        stage->rs1_value = stage->fused_result;
+    }
+    else
+    {
+        stage->rs2_value = stage->fused_result;
+    }
+}
+
+/*
+ * Execute Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_execute(APEX_CPU *cpu)
+{
+    CPU_Stage *fetch = APEX_LATCH(cpu, APEX_STAGE_FETCH);
+    CPU_Stage *execute = APEX_LATCH(cpu, APEX_STAGE_EXECUTE);
+
+    switch_to_stage(cpu, execute);
+    if (execute->has_insn)
+    {
+        if (!execute->stalled)
+        {
+            if (execute->rd < 16 && execute->rd >= 0)
+            {
+                cpu->regs_valid_check[execute->rd] = 0;
+            }
+            if (execute->fused && execute->fused_rd < 16 && execute->fused_rd >= 0)
+            {
+                cpu->regs_valid_check[execute->fused_rd] = 0;
+            }
+
+            execute->branch_taken = FALSE;
+
+            if (execute->fault)
+            {
+                raise_fault(cpu, APEX_FAULT_FETCH, execute->pc);
+                return;
+            }
+
+            if (execute->fused)
+            {
+                execute_fused_head(cpu);
+            }
+
+            /* Execute logic based on instruction type */
+            switch (execute->opcode)
+            {
+            case OPCODE_ADD:
+            {
+                execute->result_buffer = execute->rs1_value + execute->rs2_value;
+
+                /* Set the zero flag based on the result buffer */
+                if (execute->result_buffer == 0)
+                {
+                    cpu->zero_flag = TRUE;
+                }
+                else
+                {
+                    cpu->zero_flag = FALSE;
+                }
+                break;
+            }
+            case OPCODE_SUB:
+            {
+                execute->result_buffer = execute->rs1_value - execute->rs2_value;
+
+                /* Set the zero flag based on the result buffer */
+                if (execute->result_buffer == 0)
+                {
+                    cpu->zero_flag = TRUE;
+                }
+                else
+                {
+                    cpu->zero_flag = FALSE;
+                }
+                break;
+            }
+
+            case OPCODE_MUL:
+            {
+                execute->result_buffer = execute->rs1_value * execute->rs2_value;
+
+                /* Set the zero flag based on the result buffer */
+                if (execute->result_buffer == 0)
+                {
+                    cpu->zero_flag = TRUE;
+                }
+                else
+                {
+                    cpu->zero_flag = FALSE;
+                }
+                break;
+            }
+            case OPCODE_OR:
+            {
+                execute->result_buffer = execute->rs1_value | execute->rs2_value;
+
+                /* Set the zero flag based on the result buffer */
+                if (execute->result_buffer == 0)
+                {
+                    cpu->zero_flag = TRUE;
+                }
+                else
+                {
+                    cpu->zero_flag = FALSE;
+                }
+                break;
+            }
+            case OPCODE_XOR:
+            {
+                execute->result_buffer = execute->rs1_value ^ execute->rs2_value;
+
+                /* Set the zero flag based on the result buffer */
+                if (execute->result_buffer == 0)
+                {
+                    cpu->zero_flag = TRUE;
+                }
+                else
+                {
+                    cpu->zero_flag = FALSE;
+                }
+                break;
+            }
+
+            case OPCODE_DIV:
+            {
+                if (execute->rs2_value == 0)
+                {
+                    raise_fault(cpu, APEX_FAULT_DIVIDE, execute->rs1_value);
+                    return;
+                }
+                /* INT_MIN / -1 wraps instead of trapping on the host */
+                if (execute->rs2_value == -1)
+                {
+                    execute->result_buffer = (int)(0u - (unsigned int)execute->rs1_value);
+                }
+                else
+                {
+                    execute->result_buffer = execute->rs1_value / execute->rs2_value;
+                }
+
+                // /* Set the zero flag based on the result buffer */
+                if (execute->result_buffer == 0)
+                {
+                    cpu->zero_flag = TRUE;
+                }
+                else
+                {
+                    cpu->zero_flag = FALSE;
+                }
+                break;
+            }
+            case OPCODE_AND:
+            {
+                execute->result_buffer = execute->rs1_value & execute->rs2_value;
+
+                /* Set the zero flag based on the result buffer */
+                if (execute->result_buffer == 0)
+                {
+                    cpu->zero_flag = TRUE;
+                }
+                else
+                {
+                    cpu->zero_flag = FALSE;
+                }
+            }
+            case OPCODE_LOAD:
+            {
+                execute->memory_address = execute->rs1_value + execute->imm;
+                /* AND falls through to here without accessing memory */
+                if (execute->opcode == OPCODE_LOAD
+                    && (unsigned int)execute->memory_address >= DATA_MEMORY_SIZE)
+                {
+                    raise_fault(cpu, APEX_FAULT_DATA, execute->memory_address);
+                    return;
+                }
+                break;
+            }
+            case OPCODE_LDR:
+            {
+                execute->memory_address = execute->rs1_value + execute->rs2_value;
+                if ((unsigned int)execute->memory_address >= DATA_MEMORY_SIZE)
+                {
+                    raise_fault(cpu, APEX_FAULT_DATA, execute->memory_address);
+                    return;
+                }
+                break;
+            }
+            case OPCODE_STORE:
+            {
+                execute->memory_address = execute->rs2_value + execute->imm;
+                if ((unsigned int)execute->memory_address >= DATA_MEMORY_SIZE)
+                {
+                    raise_fault(cpu, APEX_FAULT_DATA, execute->memory_address);
+                    return;
+                }
+                break;
+            }
+            case OPCODE_STR:
+            {
+                execute->memory_address = execute->rs2_value + execute->rs3_value;
+                if ((unsigned int)execute->memory_address >= DATA_MEMORY_SIZE)
+                {
+                    raise_fault(cpu, APEX_FAULT_DATA, execute->memory_address);
+                    return;
+                }
+                break;
+            }
+            case OPCODE_ADDL:
+            {
+                execute->result_buffer = execute->rs1_value + execute->imm;
+                /* Set the zero flag based on the result buffer */
+                if (execute->result_buffer == 0)
+                {
+                    cpu->zero_flag = TRUE;
+                }
+                else
+                {
+                    cpu->zero_flag = FALSE;
+                }
+                break;
+            }
+
+            case OPCODE_SUBL:
+            {
+                execute->result_buffer = execute->rs1_value - execute->imm;
+                // /* Set the zero flag based on the result buffer */
+                if (execute->result_buffer == 0)
+                {
+                    cpu->zero_flag = TRUE;
+                }
+                else
+                {
+                    cpu->zero_flag = FALSE;
+                }
+                break;
+            }
+            case OPCODE_CMP:
+            {
+                int cmpResult = execute->rs1_value - execute->rs2_value;
+
+                /* Set the zero flag based on the cmpResult */
+                if (cmpResult == 0)
+                {
+                    cpu->zero_flag = TRUE;
+                }
+                else
+                {
+                    cpu->zero_flag = FALSE;
+                }
+                break;
+            }
+            case OPCODE_BZ:
+            {
+                if (resolve_loop_branch(cpu, cpu->zero_flag == TRUE))
+                {
+                    break;
+                }
+                if (cpu->zero_flag == TRUE)
+                {
+                    /* Calculate new PC, and send it to fetch unit */
+                    cpu->pc = execute->pc + execute->imm;
+                    int inspointer = (cpu->pc - 4000) / 4;
+                    if (!(execute->imm % 4 == 0 && inspointer < cpu->code_memory_size && inspointer >= 0))
+                    {
+                        raise_fault(cpu, APEX_FAULT_BRANCH, cpu->pc);
+                        return;
+                    }
+
+                    /* Since we are using reverse callbacks for pipeline stages,
+                     * this will prevent the new instruction from being fetched in the current cycle*/
+                    cpu->fetch_from_next_cycle = TRUE;
+                    execute->branch_taken = TRUE;
+                    cpu->stats.branch_flushes++;
+                    if (APEX_PROFILING(cpu))
+                    {
+                        APEX_profile_squash(cpu->pc_profile, execute->pc);
+                    }
+
+                    /* Flush previous stages */
+                    flush_front_end(cpu);
+
+                    /* Make sure fetch stage is enabled to start fetching from new PC */
+                    fetch->has_insn = TRUE;
+                    detect_loop(cpu);
+                }
+                break;
+            }
+
+            case OPCODE_BNZ:
+            {
+                if (resolve_loop_branch(cpu, cpu->zero_flag == FALSE))
+                {
+                    break;
+                }
+                if (cpu->zero_flag == FALSE)
+                {
+                    /* Calculate new PC, and send it to fetch unit */
+                    cpu->pc = execute->pc + execute->imm;
+                    int inspointer = (cpu->pc - 4000) / 4;
+                    if (!(execute->imm % 4 == 0 && inspointer < cpu->code_memory_size && inspointer >= 0))
+                    {
+                        raise_fault(cpu, APEX_FAULT_BRANCH, cpu->pc);
+                        return;
+                    }
+
+
+                    /* Since we are using reverse callbacks for pipeline stages,
+                     * this will prevent the new instruction from being fetched in the current cycle*/
+                    cpu->fetch_from_next_cycle = TRUE;
+                    execute->branch_taken = TRUE;
+                    cpu->stats.branch_flushes++;
+                    if (APEX_PROFILING(cpu))
+                    {
+                        APEX_profile_squash(cpu->pc_profile, execute->pc);
+                    }
+
+                    /* Flush previous stages */
+                    flush_front_end(cpu);
+
+                    /* Make sure fetch stage is enabled to start fetching from new PC */
+                    fetch->has_insn = TRUE;
+                    detect_loop(cpu);
+                }
+                break;
+            }
+
+            case OPCODE_MOVC:
+            {
+                execute->result_buffer = execute->imm + 0;
+            }
+            case OPCODE_NOP:
+            case OPCODE_HALT:
+            {
+                /* HALT doesn't have register operands */
+                break;
+            }
+            }
+
+            if (execute->opcode == OPCODE_HALT)
+            {
+                flush_front_end(cpu);
+                fetch->has_insn = FALSE;
+                if (APEX_PROFILING(cpu))
+                {
+                    APEX_profile_squash(cpu->pc_profile, execute->pc);
+                }
+            }
+
+            /* Copy data from execute latch to memory latch, unless memory
+             * is still busy with a multi-cycle access */
+            if (memory_entry(cpu)->has_insn)
+            {
+                execute->stalled = TRUE;
+            }
+            else
+            {
+                *memory_entry(cpu) = *execute;
+                execute->has_insn = FALSE;
+            }
+            if (execute->rd < 16 && execute->rd >= 0)
+            {
+                cpu->dataForwardingLines[0] = execute->rd;
+                cpu->dataForwardingLinesdata[0] = execute->result_buffer;
+            }
+            if (execute->fused && execute->fused_rd < 16 && execute->fused_rd >= 0)
+            {
+                cpu->dataForwardingLines[2] = execute->fused_rd;
+                cpu->dataForwardingLinesdata[2] = execute->fused_result;
+            }
+
+            if (ENABLE_DEBUG_MESSAGES)
+            {
+                print_stage_content("Instruction at Execute ___________Stage---> ", execute);
+            }
+        }
+        else
+        {
+            /* Result is already computed, wait for the memory stage to drain */
+            if (!memory_entry(cpu)->has_insn)
+            {
+                execute->stalled = FALSE;
+                *memory_entry(cpu) = *execute;
+                execute->has_insn = FALSE;
+            }
+            if (execute->rd < 16 && execute->rd >= 0)
+            {
+                cpu->dataForwardingLines[0] = execute->rd;
+                cpu->dataForwardingLinesdata[0] = execute->result_buffer;
+            }
+            if (execute->fused && execute->fused_rd < 16 && execute->fused_rd >= 0)
+            {
+                cpu->dataForwardingLines[2] = execute->fused_rd;
+                cpu->dataForwardingLinesdata[2] = execute->fused_result;
+            }
+
+            if (ENABLE_DEBUG_MESSAGES)
+            {
+                print_stage_content("Instruction at Execute ___________Stage---> ", execute);
+            }
+        }
+    }
+    else if (ENABLE_DEBUG_MESSAGES)
+    {
+        printf("Instruction at Execute __________Stage--->: empty");
+        printf("\n");
+    }
+}
+
+/*
+ * Hash of one architectural location holding value. Registers of core c
+ * follow data memory at DATA_MEMORY_SIZE + c * REG_FILE_SIZE, those of
+ * thread t of an SMT core, which is never part of a multicore system, at
+ * DATA_MEMORY_SIZE + t * REG_FILE_SIZE.
+ */
+static unsigned long long
+location_hash(int location, int value)
+{
+    unsigned long long x = ((unsigned long long)location << 32) | (unsigned int)value;
+
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/*
+ * The digest is the XOR over all locations of location_hash(loc, value) ^
+ * location_hash(loc, 0), so zeroed state hashes to 0 and a write only has
+ * to swap the old value's term for the new one
+ */
+static void
+update_digest(APEX_CPU *cpu, int location, int old_value, int new_value)
+{
+    if (old_value != new_value)
+    {
+        cpu->digest ^= location_hash(location, old_value) ^ location_hash(location, new_value);
+    }
+}
+
+static void
+write_register(APEX_CPU *cpu, int reg, int value)
+{
+    update_digest(cpu, DATA_MEMORY_SIZE + (cpu->core_id + cpu->thread) * REG_FILE_SIZE + reg,
+                  cpu->regs[reg], value);
+    cpu->regs[reg] = value;
+}
+
+/*
+ * Writes the result of a retiring instruction, the data of the first
+ * num_older outstanding loads to the same register is dead then
+ */
+static void
+retire_register(APEX_CPU *cpu, int reg, int value, int num_older)
+{
+    int i;
+
+    write_register(cpu, reg, value);
+    for (i = 0; i < num_older; ++i)
+    {
+        if (cpu->mshrs[i].rd == reg)
+        {
+            cpu->mshrs[i].rd = -1;
+        }
+    }
+}
+
+/*
+ * Cores of a multicore system on separate host threads share data memory,
+ * so its words are only accessed under the bus lock of their L1s
+ */
+static void
+lock_data_memory(const APEX_CPU *cpu)
+{
+    if (cpu->shared_data_memory && cpu->l1 && cpu->l1->bus)
+    {
+        pthread_mutex_lock(&cpu->l1->bus->lock);
+    }
+}
+
+static void
+unlock_data_memory(const APEX_CPU *cpu)
+{
+    if (cpu->shared_data_memory && cpu->l1 && cpu->l1->bus)
+    {
+        pthread_mutex_unlock(&cpu->l1->bus->lock);
+    }
+}
+
+static int
+read_data_memory(const APEX_CPU *cpu, int address)
+{
+    int value;
+
+    lock_data_memory(cpu);
+    value = cpu->data_memory[address];
+    unlock_data_memory(cpu);
+    return value;
+}
+
+static void
+write_data_memory(APEX_CPU *cpu, int address, int value)
+{
+    lock_data_memory(cpu);
+    if (cpu->journal)
+    {
+        APEX_journal_store(cpu->journal, address, cpu->data_memory[address]);
+    }
+    update_digest(cpu, address, cpu->data_memory[address], value);
+    cpu->data_memory[address] = value;
+    unlock_data_memory(cpu);
+    cpu->dirty[address / 64] |= 1ULL << (address % 64);
+}
+
+/*
+ * Recomputes the digest of cpu from scratch, equal to cpu->digest when the
+ * state was only changed by the pipeline
+ */
+unsigned long long
+APEX_state_digest(const APEX_CPU *cpu)
+{
+    unsigned long long digest = 0;
+    int i, t;
+
+    for (i = 0; i < DATA_MEMORY_SIZE; ++i)
+    {
+        if (cpu->data_memory[i] != 0)
+        {
+            digest ^= location_hash(i, cpu->data_memory[i]) ^ location_hash(i, 0);
+        }
+    }
+    for (t = 0; t < cpu->num_threads; ++t)
+    {
+        const int *regs = (t == cpu->thread) ? cpu->regs : cpu->threads[t].regs;
+
+        for (i = 0; i < REG_FILE_SIZE; ++i)
+        {
+            int location = DATA_MEMORY_SIZE + (cpu->core_id + t) * REG_FILE_SIZE + i;
+
+            if (regs[i] != 0)
+            {
+                digest ^= location_hash(location, regs[i]) ^ location_hash(location, 0);
+            }
+        }
+    }
+    return digest;
+}
+
+/*
+ * Hands an access to the DRAM, arriving delay cycles from now
+ */
+static void
+start_dram_access(APEX_CPU *cpu, APEX_DramAccess *access, int address, int is_write, int delay)
+{
+    access->pending = TRUE;
+    access->address = address;
+    access->is_write = is_write;
+    access->arrival = cpu->clock + delay;
+    access->request = 0;
+}
+
+/*
+ * Returns the number of cycles an access to address by the instruction at
+ * pc takes. An access that reads or writes the DRAM is handed to it in
+ * *access instead and returns 0, its cycles are known once it is scheduled.
+ */
+static int
+get_data_memory_latency(APEX_CPU *cpu, int pc, int address, int is_store,
+                        APEX_DramAccess *access)
+{
+    if (address < 0 || address >= DATA_MEMORY_SIZE)
+    {
+        return cpu->memory_latency;
+    }
+    if (cpu->l1)
+    {
+        int misses = cpu->l1->stats.misses;
+        int latency;
+
+        if (cpu->prefetcher)
+        {
+            latency = APEX_prefetch_access(cpu->prefetcher, cpu->l1, pc, address, is_store,
+                                           cpu->clock);
+        }
+        else
+        {
+            latency = APEX_cache_access(cpu->l1, address, is_store);
+        }
+
+        /* A miss reads the line from DRAM instead of taking the fixed miss latency */
+        if (cpu->dram && cpu->l1->stats.misses != misses)
+        {
+            start_dram_access(cpu, access, address, FALSE, cpu->l1->config.hit_latency);
+            return 0;
+        }
+        return latency;
+    }
+    if (cpu->dram)
+    {
+        start_dram_access(cpu, access, address, is_store, 0);
+        return 0;
+    }
+    return cpu->memory_latency;
+}
+
+/*
+ * Returns the youngest buffered store to address, NULL when there is none
+ */
+static const APEX_StoreBufferEntry *
+find_buffered_store(const APEX_CPU *cpu, int address)
+{
+    int i;
+
+    for (i = cpu->store_buffer_count - 1; i >= 0; --i)
+    {
+        const APEX_StoreBufferEntry *entry =
+            &cpu->store_buffer[(cpu->store_buffer_head + i) % APEX_STORE_BUFFER_MAX];
+
+        if (entry->address == address)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Moves the STORE/STR in the memory stage into the store buffer, returns
+ * FALSE when the buffer is full
+ */
+static int
+buffer_store(APEX_CPU *cpu)
+{
+    CPU_Stage *memory = APEX_LATCH(cpu, APEX_STAGE_MEMORY);
+    APEX_StoreBufferEntry *entry;
+
+    if (cpu->store_buffer_count == cpu->store_buffer_depth)
+    {
+        return FALSE;
+    }
+    entry = &cpu->store_buffer[(cpu->store_buffer_head + cpu->store_buffer_count)
+                               % APEX_STORE_BUFFER_MAX];
+    entry->pc = memory->pc;
+    entry->address = memory->memory_address;
+    entry->value = memory->rs1_value;
+    cpu->store_buffer_count++;
+    if (cpu->store_buffer_count > cpu->stats.store_buffer_peak)
+    {
+        cpu->stats.store_buffer_peak = cpu->store_buffer_count;
+    }
+    return TRUE;
+}
+
+/*
+ * Starts a miss of the LOAD/LDR in the memory stage in a free MSHR, it
+ * then leaves the memory stage without its data. The data is read now, so
+ * younger stores cannot change it. Returns FALSE when every MSHR is busy.
+ */
+static int
+start_load_miss(APEX_CPU *cpu, int latency)
+{
+    CPU_Stage *memory = APEX_LATCH(cpu, APEX_STAGE_MEMORY);
+    const APEX_StoreBufferEntry *entry = find_buffered_store(cpu, memory->memory_address);
+    APEX_Mshr *mshr;
+    int i;
+
+    if (cpu->mshr_count == cpu->num_mshrs)
+    {
+        return FALSE;
+    }
+
+    /* An older miss to the same register is overwritten by this one */
+    for (i = 0; i < cpu->mshr_count; ++i)
+    {
+        if (cpu->mshrs[i].rd == memory->rd)
+        {
+            cpu->mshrs[i].rd = -1;
+        }
+    }
+
+    mshr = &cpu->mshrs[cpu->mshr_count++];
+    mshr->pc = memory->pc;
+    mshr->rd = memory->rd;
+    mshr->value = entry ? entry->value : read_data_memory(cpu, memory->memory_address);
+    mshr->cycles_left = latency - 1;
+    mshr->dram = cpu->memory_dram;
+    cpu->memory_dram.pending = FALSE;
+    memory->load_pending = TRUE;
+    cpu->stats.mshr_misses++;
+    if (cpu->mshr_count > cpu->stats.mshr_peak)
+    {
+        cpu->stats.mshr_peak = cpu->mshr_count;
+    }
+    return TRUE;
+}
+
+/*
+ * Advances the outstanding load misses by one cycle and writes the data of
+ * those that end, in time for decode to read it this cycle
+ */
+static void
+complete_load_misses(APEX_CPU *cpu)
+{
+    int i = 0;
+
+    cpu->stats.mshr_occupancy += cpu->mshr_count;
+    while (i < cpu->mshr_count)
+    {
+        APEX_Mshr done = cpu->mshrs[i];
+
+        if (cpu->mshrs[i].dram.pending || --cpu->mshrs[i].cycles_left > 0)
+        {
+            i++;
+            continue;
+        }
+
+        memmove(&cpu->mshrs[i], &cpu->mshrs[i + 1], sizeof(APEX_Mshr) * (cpu->mshr_count - i - 1));
+        cpu->mshr_count--;
+        if (done.rd >= 0)
+        {
+            write_register(cpu, done.rd, done.value);
+            if (!has_younger_writer(cpu, done.rd))
+            {
+                cpu->regs_valid_check[done.rd] = 1;
+            }
+        }
+    }
+}
+
+/*
+ * Spends one cycle writing the oldest buffered store to data memory, in
+ * the background of the memory stage
+ */
+static void
+drain_store_buffer(APEX_CPU *cpu)
+{
+    APEX_StoreBufferEntry *entry = &cpu->store_buffer[cpu->store_buffer_head];
+
+    cpu->stats.store_buffer_occupancy += cpu->store_buffer_count;
+    if (cpu->store_buffer_count == 0 || cpu->store_drain_dram.pending)
+    {
+        return;
+    }
+    if (cpu->store_drain_cycles_left == 0)
+    {
+        cpu->store_drain_cycles_left = get_data_memory_latency(cpu, entry->pc, entry->address, TRUE,
+                                                               &cpu->store_drain_dram);
+        if (cpu->store_drain_dram.pending)
+        {
+            return;
+        }
+    }
+    if (--cpu->store_drain_cycles_left == 0)
+    {
+        write_data_memory(cpu, entry->address, entry->value);
+        cpu->store_buffer_head = (cpu->store_buffer_head + 1) % APEX_STORE_BUFFER_MAX;
+        cpu->store_buffer_count--;
+    }
+}
+
+/*
+ * Offers access to the DRAM queue until it takes it
+ */
+static void
+queue_dram_access(APEX_CPU *cpu, APEX_DramAccess *access)
+{
+    if (access->pending && access->request == 0)
+    {
+        access->request = APEX_dram_enqueue(cpu->dram, access->address, access->is_write,
+                                            access->arrival);
+    }
+}
+
+/*
+ * Once the DRAM has scheduled access, sets *cycles_left so the countdown
+ * of its waiter reaches 0 in the last cycle of the burst
+ */
+static void
+finish_dram_access(APEX_CPU *cpu, APEX_DramAccess *access, int *cycles_left)
+{
+    long done;
+
+    if (!access->pending || access->request == 0)
+    {
+        return;
+    }
+    done = APEX_dram_done(cpu->dram, access->request);
+    if (done >= 0)
+    {
+        *cycles_left = (int)(done - 1 - cpu->clock);
+        access->pending = FALSE;
+    }
+}
+
+/*
+ * Schedules this cycle of the DRAM. The store buffer drain, the load miss
+ * fills and the access of the memory stage compete in its queue, and an
+ * access refused with the queue full is offered again every cycle.
+ */
+static void
+tick_dram(APEX_CPU *cpu)
+{
+    int i;
+
+    queue_dram_access(cpu, &cpu->store_drain_dram);
+    for (i = 0; i < cpu->mshr_count; ++i)
+    {
+        queue_dram_access(cpu, &cpu->mshrs[i].dram);
+    }
+    queue_dram_access(cpu, &cpu->memory_dram);
 
-            {
-                if (cpu->regs_valid_check[cpu->decode.rs1] && cpu->regs_valid_check[cpu->decode.rs2] && cpu->regs_valid_check[cpu->decode.rs3])
-                {
-                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                    cpu->decode.rs3_value = cpu->regs[cpu->decode.rs3];
-                }
-                else
-                {
-                    if (cpu->regs_valid_check[cpu->decode.rs1])
-                    {
-                        cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    }
-                    //excute data
-                    else if (cpu->dataForwardingLines[0] == cpu->decode.rs1)
-                    {
+    while (cpu->dram->clock <= cpu->clock)
+    {
+        APEX_dram_tick(cpu->dram);
+    }
 
-                        //  cpu->decode.rs1_value = cpu->dataForwardingLinesdata[0];
-                        if (cpu->execute.opcode == OPCODE_LDR || cpu->execute.opcode == OPCODE_LOAD)
-                        {
-                            stagestalled = 1;
-                        }
-                        else
-                        {
-                            cpu->decode.rs1_value = cpu->dataForwardingLinesdata[0];
-                        }
-
-                    } //memory data
-                    else if (cpu->dataForwardingLines[1] == cpu->decode.rs1)
-                    {
+    finish_dram_access(cpu, &cpu->store_drain_dram, &cpu->store_drain_cycles_left);
+    for (i = 0; i < cpu->mshr_count; ++i)
+    {
+        finish_dram_access(cpu, &cpu->mshrs[i].dram, &cpu->mshrs[i].cycles_left);
+    }
+    finish_dram_access(cpu, &cpu->memory_dram, &cpu->memory_cycles_left);
+}
 
-                        cpu->decode.rs1_value = cpu->dataForwardingLinesdata[1];
-                    }
-                    else
-                    {
-                        stagestalled = 1;
-                    }
-                    if (!stagestalled)
-                    {
+/*
+ * Memory Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_memory(APEX_CPU *cpu)
+{
+    CPU_Stage *memory = APEX_LATCH(cpu, APEX_STAGE_MEMORY);
+    CPU_Stage *writeback = APEX_LATCH(cpu, APEX_STAGE_WRITEBACK);
 
-                        if (cpu->regs_valid_check[cpu->decode.rs2])
-                        {
-                            cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                        }
-                        //  excute data
-                        else if (cpu->dataForwardingLines[0] == cpu->decode.rs2)
-                        {
-
-                            //  cpu->decode.rs2_value = cpu->dataForwardingLinesdata[0];
-                            if (cpu->execute.opcode == OPCODE_LDR || cpu->execute.opcode == OPCODE_LOAD)
-                            {
-                                stagestalled = 1;
-                            }
-                            else
-                            {
-                                cpu->decode.rs2_value = cpu->dataForwardingLinesdata[0];
-                            }
-                        } //memory data
-                        else if (cpu->dataForwardingLines[1] == cpu->decode.rs2)
-                        {
-
-                            cpu->decode.rs2_value = cpu->dataForwardingLinesdata[1];
-                        }
-                        else
-                        {
-                            stagestalled = 1;
-                        }
-                        if (!stagestalled)
-                        {
-
-                            if (cpu->regs_valid_check[cpu->decode.rs3])
-                            {
-                                cpu->decode.rs3_value = cpu->regs[cpu->decode.rs3];
-                            }
-                            //  excute data
-                            else if (cpu->dataForwardingLines[0] == cpu->decode.rs3)
-                            {
-
-                                //  cpu->decode.rs3_value = cpu->dataForwardingLinesdata[0];
-                                if (cpu->execute.opcode == OPCODE_LDR || cpu->execute.opcode == OPCODE_LOAD)
-                                {
-                                    stagestalled = 1;
-                                }
-                                else
-                                {
-                                    cpu->decode.rs3_value = cpu->dataForwardingLinesdata[0];
-                                }
-                            } //memory data
-                            else if (cpu->dataForwardingLines[1] == cpu->decode.rs3)
-                            {
-
-                                cpu->decode.rs3_value = cpu->dataForwardingLinesdata[1];
-                            }
-                            else
-                            {
-                                stagestalled = 1;
-                            }
-                        }
-                    }
-                }
+    switch_to_stage(cpu, memory);
+    if (cpu->store_buffer_depth > 0)
+    {
+        drain_store_buffer(cpu);
+    }
+    if (cpu->num_mshrs > 0)
+    {
+        complete_load_misses(cpu);
+    }
 
-                break;
+    if (memory->has_insn)
+    {
+        if (memory->stalled && cpu->memory_dram.pending)
+        {
+            /* Waiting for the DRAM to schedule the access */
+        }
+        else if (memory->stalled && cpu->memory_cycles_left == 0)
+        {
+            /* STORE/STR waiting for a free store buffer entry */
+            if (buffer_store(cpu))
+            {
+                memory->stalled = FALSE;
             }
-            case OPCODE_LOAD:
+            else
+            {
+                cpu->stats.store_buffer_full++;
+            }
+        }
+        else if (memory->stalled)
+        {
+            /* Multi-cycle access in progress */
+            cpu->memory_cycles_left--;
+            if (cpu->memory_cycles_left == 0)
+            {
+                memory->stalled = FALSE;
+            }
+        }
+        else if (APEX_opcode_is_store(memory->opcode) && cpu->store_buffer_depth > 0)
+        {
+            cpu->stats.stores++;
+            if (!buffer_store(cpu))
+            {
+                memory->stalled = TRUE;
+                cpu->memory_cycles_left = 0;
+                cpu->stats.store_buffer_full++;
+            }
+        }
+        else if (APEX_opcode_is_load(memory->opcode) || APEX_opcode_is_store(memory->opcode))
+        {
+            int latency;
+
+            if (APEX_opcode_is_load(memory->opcode))
+            {
+                cpu->stats.loads++;
+            }
+            else
+            {
+                cpu->stats.stores++;
+            }
+
+            /* A buffered store to the word answers the load without a memory access */
+            if (APEX_opcode_is_load(memory->opcode)
+                && find_buffered_store(cpu, memory->memory_address))
+            {
+                latency = 1;
+                cpu->stats.store_buffer_forwards++;
+            }
+            else
             {
-                if (cpu->regs_valid_check[cpu->decode.rs1])
+                latency = get_data_memory_latency(cpu, memory->pc,
+                                                  memory->memory_address,
+                                                  APEX_opcode_is_store(memory->opcode),
+                                                  &cpu->memory_dram);
+            }
+
+            if ((latency > 1 || cpu->memory_dram.pending)
+                && APEX_opcode_is_load(memory->opcode) && cpu->num_mshrs > 0)
+            {
+                if (start_load_miss(cpu, latency))
                 {
-                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
+                    latency = 1;
                 }
                 else
                 {
-                    if (cpu->regs_valid_check[cpu->decode.rs1])
-                    {
-                        cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    }
-                    //excute data
-                    else if (cpu->dataForwardingLines[0] == cpu->decode.rs1)
-                    {
-                        //cpu->decode.rs1_value = cpu->dataForwardingLinesdata[0];
-                        if (cpu->execute.opcode == OPCODE_LDR || cpu->execute.opcode == OPCODE_LOAD)
-                        {
-                            stagestalled = 1;
-                        }
-                        else
-                        {
-                            cpu->decode.rs1_value = cpu->dataForwardingLinesdata[0];
-                        }
-                    }
-                    //memory data
-                    else if (cpu->dataForwardingLines[1] == cpu->decode.rs1)
-                    {
-                        cpu->decode.rs1_value = cpu->dataForwardingLinesdata[1];
-                    }
-                    else
-                    {
-                        stagestalled = 1;
-                    }
+                    cpu->stats.mshr_full++;
                 }
-                break;
             }
-            case OPCODE_CMP:
+            if (cpu->memory_dram.pending)
             {
-                if (cpu->regs_valid_check[cpu->decode.rs1] && cpu->regs_valid_check[cpu->decode.rs2])
-                {
-                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                }
-                else
-                {
-                    if (cpu->regs_valid_check[cpu->decode.rs1])
-                    {
-                        cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    }
-                    //excute data
-                    else if (cpu->dataForwardingLines[0] == cpu->decode.rs1)
-                    {
-
-                        //  cpu->decode.rs1_value = cpu->dataForwardingLinesdata[0];
-                        if (cpu->execute.opcode == OPCODE_LDR || cpu->execute.opcode == OPCODE_LOAD)
-                        {
-                            stagestalled = 1;
-                        }
-                        else
-                        {
-                            cpu->decode.rs1_value = cpu->dataForwardingLinesdata[0];
-                        }
-                    } //memory data
-                    else if (cpu->dataForwardingLines[1] == cpu->decode.rs1)
-                    {
-
-                        cpu->decode.rs1_value = cpu->dataForwardingLinesdata[1];
-                    }
-                    else
-                    {
-                        stagestalled = 1;
-                    }
-                    if (!stagestalled)
-                    {
+                memory->stalled = TRUE;
+            }
+            else if (latency > 1)
+            {
+                memory->stalled = TRUE;
+                cpu->memory_cycles_left = latency - 1;
+            }
+        }
 
-                        if (cpu->regs_valid_check[cpu->decode.rs2])
-                        {
-                            cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                        }
-                        //excute data
-                        else if (cpu->dataForwardingLines[0] == cpu->decode.rs2)
-                        {
-
-                            //   cpu->decode.rs2_value = cpu->dataForwardingLinesdata[0];
-                            if (cpu->execute.opcode == OPCODE_LDR || cpu->execute.opcode == OPCODE_LOAD)
-                            {
-                                stagestalled = 1;
-                            }
-                            else
-                            {
-                                cpu->decode.rs2_value = cpu->dataForwardingLinesdata[0];
-                            }
-                        } //memory data
-                        else if (cpu->dataForwardingLines[1] == cpu->decode.rs2)
-                        {
-
-                            cpu->decode.rs2_value = cpu->dataForwardingLinesdata[1];
-                        }
-                        else
-                        {
-                            stagestalled = 1;
-                        }
-                    }
-                }
-                break;
+        if (!memory->stalled)
+        {
+            if (memory->rd < 16 && memory->rd >= 0)
+            {
+                cpu->regs_valid_check[memory->rd] = 0;
             }
-            case OPCODE_MOVC:
+            if (memory->fused && memory->fused_rd < 16 && memory->fused_rd >= 0)
             {
-                /* MOVC doesn't have register operands */
-                break;
+                cpu->regs_valid_check[memory->fused_rd] = 0;
             }
-            case OPCODE_HALT:
+            switch (memory->opcode)
+            {
+            case OPCODE_ADD:
+            case OPCODE_ADDL:
+            case OPCODE_SUB:
+            case OPCODE_SUBL:
+            case OPCODE_DIV:
+            case OPCODE_MUL:
+            case OPCODE_AND:
+            case OPCODE_OR:
+            case OPCODE_XOR:
             case OPCODE_NOP:
+
             {
-                /* HALT doesn't have register operands */
+                /* No work for ADD */
                 break;
             }
+
+            case OPCODE_LOAD:
+            case OPCODE_LDR:
+            {
+                /* Read from data memory, unless an older store is still buffered */
+                const APEX_StoreBufferEntry *entry =
+                    find_buffered_store(cpu, memory->memory_address);
+
+                memory->result_buffer =
+                    entry ? entry->value : read_data_memory(cpu, memory->memory_address);
+                break;
             }
-            /*dataForwardingLines are cleared and set to-1*/
-            for (int count = 0; count < 3; count++)
+            case OPCODE_STORE:
+            case OPCODE_STR:
             {
-                cpu->dataForwardingLines[count] = -1;
-                cpu->dataForwardingLinesdata[count] = -1;
+                if (cpu->store_buffer_depth == 0)
+                {
+                    write_data_memory(cpu, memory->memory_address, memory->rs1_value);
+                }
             }
-            if (stagestalled)
+            }
+
+            /* Copy data from memory latch to writeback latch*/
+            *writeback = *memory;
+            memory->has_insn = FALSE;
+            if (memory->rd < 16 && memory->rd >= 0 && !memory->load_pending)
             {
-                cpu->decode.stalled = 1;
+                cpu->dataForwardingLines[1] = memory->rd;
+                cpu->dataForwardingLinesdata[1] = memory->result_buffer;
             }
-            else
+            if (memory->fused && memory->fused_rd < 16 && memory->fused_rd >= 0
+                && !(memory->load_pending && memory->fused_rd == memory->rd))
             {
-                cpu->execute = cpu->decode;
-                /* Copy data from decode latch to execute latch*/
-                cpu->decode.has_insn = FALSE;
-                //Fetch
-                cpu->fetch.stalled = 0;
+                cpu->dataForwardingLines[3] = memory->fused_rd;
+                cpu->dataForwardingLinesdata[3] = memory->fused_result;
             }
             if (ENABLE_DEBUG_MESSAGES)
             {
-                print_stage_content("Instruction at Decode/RF_________Stage---->", &cpu->decode);
+                print_stage_content("Instruction at Memory ___________Stage--->", memory);
             }
         }
         else if (ENABLE_DEBUG_MESSAGES)
         {
-            print_stage_content("Instruction at Decode/RF________Stage---->", &cpu->decode);
+            print_stage_content("Instruction at Memory ___________Stage--->", memory);
         }
     }
     else if (ENABLE_DEBUG_MESSAGES)
     {
-        printf("Instruction at Decode/RF________Stage---->: empty");
+        printf("Instruction at Memory ___________Stage---> : empty");
         printf("\n");
     }
+
+    if (cpu->dram)
+    {
+        tick_dram(cpu);
+    }
 }
 
 /*
- * Execute Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Retires the CMP or ADDL fused into the instruction in writeback, which
+ * retires in the same cycle
  */
 static void
-APEX_execute(APEX_CPU *cpu)
+retire_fused_head(APEX_CPU *cpu)
 {
+    CPU_Stage *writeback = APEX_LATCH(cpu, APEX_STAGE_WRITEBACK);
+    CPU_Stage head;
 
-    if (cpu->execute.has_insn)
+    APEX_stage_fused_head(writeback, &head);
+    if (head.opcode == OPCODE_ADDL)
     {
-        if (!cpu->execute.stalled)
+        /* A missed LOAD that overwrites the ADDL result keeps it invalid */
+        if (head.rd < 16 && head.rd >= 0 && !has_younger_writer(cpu, head.rd)
+            && !(writeback->load_pending && writeback->rd == head.rd))
         {
-            if (cpu->execute.rd < 16 && cpu->execute.rd >= 0)
-            {
-                cpu->regs_valid_check[cpu->execute.rd] = 0;
-            }
-
-            /* Execute logic based on instruction type */
-            switch (cpu->execute.opcode)
-            {
-            case OPCODE_ADD:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value + cpu->execute.rs2_value;
+            cpu->regs_valid_check[head.rd] = 1;
+        }
+        /* The MSHR of the fused LOAD, if it missed, is the newest one */
+        retire_register(cpu, head.rd, head.result_buffer,
+                        cpu->mshr_count - (writeback->load_pending ? 1 : 0));
+        cpu->stats.fused_memory++;
+    }
+    else
+    {
+        cpu->stats.fused_branches++;
+    }
 
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                }
-                else
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                break;
-            }
-            case OPCODE_SUB:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value - cpu->execute.rs2_value;
+    if (cpu->trace)
+    {
+        APEX_trace_append(cpu->trace, &head);
+    }
+    if (APEX_PROFILING(cpu))
+    {
+        APEX_profile_retire(cpu->pc_profile, head.pc);
+    }
+    cpu->insn_completed++;
+    cpu->threads[cpu->thread].insn_completed++;
+}
 
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                }
-                else
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                break;
-            }
+/* Returns the number of threads that have not halted yet */
+static int
+threads_running(const APEX_CPU *cpu)
+{
+    int running = 0;
+    int i;
 
-            case OPCODE_MUL:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value * cpu->execute.rs2_value;
+    for (i = 0; i < cpu->num_threads; ++i)
+    {
+        if (!cpu->threads[i].halted)
+        {
+            running++;
+        }
+    }
+    return running;
+}
 
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                }
-                else
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                break;
-            }
-            case OPCODE_OR:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value | cpu->execute.rs2_value;
+/*
+ * Marks the thread of the HALT in writeback halted, returns TRUE when it
+ * was the last one running
+ */
+static int
+retire_halt(APEX_CPU *cpu)
+{
+    APEX_Thread *thread = &cpu->threads[cpu->thread];
 
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                }
-                else
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                break;
-            }
-            case OPCODE_XOR:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value ^ cpu->execute.rs2_value;
+    if (!thread->halted)
+    {
+        thread->halted = TRUE;
+        thread->halt_cycle = cpu->clock + 1;
+    }
+    return threads_running(cpu) == 0;
+}
 
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                }
-                else
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                break;
-            }
+/*
+ * Writeback Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static int
+APEX_writeback(APEX_CPU *cpu)
+{
+    CPU_Stage *writeback = APEX_LATCH(cpu, APEX_STAGE_WRITEBACK);
 
-            case OPCODE_DIV:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value / cpu->execute.rs2_value;
+    switch_to_stage(cpu, writeback);
 
-                // /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                }
-                else
-                {
-                    cpu->zero_flag = FALSE;
-                }
-            }
-            case OPCODE_AND:
+    /* HALT retires once the buffered stores are in data memory and the
+     * outstanding loads in registers. On an SMT core only the last thread
+     * waits, the memory stage does not hold the other threads behind it. */
+    if (writeback->has_insn && writeback->opcode == OPCODE_HALT
+        && (cpu->store_buffer_count > 0 || cpu->mshr_count > 0) && threads_running(cpu) == 1)
+    {
+        return 0;
+    }
+
+    if (writeback->has_insn)
+    {
+        if (!writeback->stalled)
+        {
+            if (writeback->fused)
             {
-                cpu->execute.result_buffer = cpu->execute.rs1_value & cpu->execute.rs2_value;
+                retire_fused_head(cpu);
+            }
 
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                }
-                else
-                {
-                    cpu->zero_flag = FALSE;
-                }
+            /* A younger in-flight writer of the same register keeps it
+             * pending, so does the MSHR of a load that missed */
+            if (writeback->rd < 16 && writeback->rd >= 0 && !writeback->load_pending
+                && !has_younger_writer(cpu, writeback->rd))
+            {
+                cpu->regs_valid_check[writeback->rd] = 1;
             }
-            case OPCODE_LOAD:
+            /* Write result to register file based on instruction type */
+            switch (writeback->opcode)
+            {
+            case OPCODE_ADD:
+            case OPCODE_DIV:
+            case OPCODE_MUL:
+            case OPCODE_SUB:
+            case OPCODE_SUBL:
+            case OPCODE_ADDL:
             {
-                cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
+                retire_register(cpu, writeback->rd, writeback->result_buffer,
+                                cpu->mshr_count);
                 break;
             }
+
+            case OPCODE_LOAD:
             case OPCODE_LDR:
             {
-                cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.rs2_value;
+                if (!writeback->load_pending)
+                {
+                    retire_register(cpu, writeback->rd, writeback->result_buffer,
+                                    cpu->mshr_count);
+                }
                 break;
             }
-            case OPCODE_STORE:
+
+            case OPCODE_MOVC:
+            case OPCODE_AND:
+            case OPCODE_OR:
+            case OPCODE_XOR:
             {
-                cpu->execute.memory_address = cpu->execute.rs2_value + cpu->execute.imm;
+                retire_register(cpu, writeback->rd, writeback->result_buffer,
+                                cpu->mshr_count);
                 break;
             }
-            case OPCODE_STR:
+
+            case OPCODE_NOP:
             {
-                cpu->execute.memory_address = cpu->execute.rs2_value + cpu->execute.rs3_value;
                 break;
             }
-            case OPCODE_ADDL:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value + cpu->execute.imm;
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                }
-                else
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                break;
             }
 
-            case OPCODE_SUBL:
+            if (cpu->trace)
             {
-                cpu->execute.result_buffer = cpu->execute.rs1_value - cpu->execute.imm;
-                // /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                }
-                else
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                break;
+                APEX_trace_append(cpu->trace, writeback);
             }
-            case OPCODE_CMP:
+
+            if (APEX_PROFILING(cpu))
             {
-                int cmpResult = cpu->execute.rs1_value - cpu->execute.rs2_value;
+                APEX_profile_retire(cpu->pc_profile, writeback->pc);
+            }
 
-                /* Set the zero flag based on the cmpResult */
-                if (cmpResult == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                }
-                else
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                break;
+            if (cpu->watchdog && writeback->branch_taken)
+            {
+                APEX_watchdog_branch(cpu->watchdog, cpu, writeback->pc);
             }
-            case OPCODE_BZ:
+
+            cpu->insn_completed++;
+            cpu->threads[cpu->thread].insn_completed++;
+            writeback->has_insn = FALSE;
+            if (ENABLE_DEBUG_MESSAGES)
             {
-                if (cpu->zero_flag == TRUE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                    int inspointer = (cpu->pc - 4000) / 4;
-                    // printf ("%d",cpu->pc);
-                    if (!(cpu->execute.imm % 4 == 0 && inspointer < cpu->code_memory_size && inspointer >= 0))
-                    {
-                        printf("Check the address value  ");
-                    }
-                    assert(cpu->execute.imm % 4 == 0 && inspointer < cpu->code_memory_size && inspointer >= 0);
+                print_stage_content("Instruction at Writeback ________Stage--->", writeback);
+            }
+        }
+        else if (ENABLE_DEBUG_MESSAGES)
+        {
+            print_stage_content("Instruction at Writeback ________Stage--->", writeback);
+        }
 
-                    /* Since we are using reverse callbacks for pipeline stages,
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
+        if (writeback->opcode == OPCODE_HALT)
+        {
+            /* Stop the APEX simulator, on an SMT core once every thread has halted */
+            return retire_halt(cpu);
+        }
+    }
+    else if (ENABLE_DEBUG_MESSAGES)
+    {
+        printf("Instruction at Writeback ________Stage---> :empty");
+        printf("\n");
+    }
+    /* Default */
+    return 0;
+}
 
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
+/*
+ * This function creates an APEX cpu around an already decoded code memory.
+ * The code memory is shared with the caller and not freed by APEX_cpu_stop.
+ */
+APEX_CPU *
+APEX_cpu_create(APEX_Instruction *code_memory, int code_memory_size)
+{
+    APEX_CPU *cpu;
 
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                break;
-            }
+    if (!code_memory)
+    {
+        return NULL;
+    }
 
-            case OPCODE_BNZ:
-            {
-                if (cpu->zero_flag == FALSE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
+    cpu = calloc(1, sizeof(APEX_CPU));
 
-                    int inspointer = (cpu->pc - 4000) / 4;
-                    // printf ("%d",cpu->pc);
-                    if (!(cpu->execute.imm % 4 == 0 && inspointer < cpu->code_memory_size && inspointer >= 0))
-                    {
-                        printf("Check the address value  ");
-                    }
-                    assert(cpu->execute.imm % 4 == 0 && inspointer < cpu->code_memory_size && inspointer >= 0);
+    if (!cpu)
+    {
+        return NULL;
+    }
+
+    cpu->data_memory = calloc(DATA_MEMORY_SIZE, sizeof(int));
+    if (!cpu->data_memory)
+    {
+        free(cpu);
+        return NULL;
+    }
 
+    APEX_cpu_reset(cpu, code_memory, code_memory_size);
+    return cpu;
+}
 
-                    /* Since we are using reverse callbacks for pipeline stages,
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
+/*
+ * Lays the latches out from fetch to writeback for the configured depth,
+ * execute_stages and memory_stages latches for execute and memory
+ */
+static void
+layout_stages(APEX_CPU *cpu)
+{
+    int count[APEX_STAGE_KINDS];
+    int kind, i, n = 0;
+
+    count[APEX_STAGE_FETCH] = 1;
+    count[APEX_STAGE_DECODE] = 1;
+    count[APEX_STAGE_EXECUTE] = cpu->execute_stages;
+    count[APEX_STAGE_MEMORY] = cpu->memory_stages;
+    count[APEX_STAGE_WRITEBACK] = 1;
+    for (kind = 0; kind < APEX_STAGE_KINDS; ++kind)
+    {
+        cpu->first_stage[kind] = n;
+        for (i = 0; i < count[kind]; ++i)
+        {
+            cpu->stage_kind[n++] = kind;
+        }
+        cpu->last_stage[kind] = n - 1;
+    }
+    cpu->num_stages = n;
+}
 
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
+/*
+ * Returns a CPU to its power-on state running code_memory, keeping its data
+ * memory allocation. Any cache, prefetcher, DRAM or watchdog is destroyed,
+ * the caller attaches a new one.
+ */
+void
+APEX_cpu_reset(APEX_CPU *cpu, APEX_Instruction *code_memory, int code_memory_size)
+{
+    int *data_memory = cpu->data_memory;
 
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                break;
-            }
+    APEX_cache_destroy(cpu->l1);
+    APEX_prefetch_destroy(cpu->prefetcher);
+    APEX_dram_destroy(cpu->dram);
+    APEX_cache_destroy(cpu->icache);
+    APEX_watchdog_destroy(cpu->watchdog);
+    memset(cpu, 0, sizeof(APEX_CPU));
+    memset(data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
+    cpu->data_memory = data_memory;
 
-            case OPCODE_MOVC:
-            {
-                cpu->execute.result_buffer = cpu->execute.imm + 0;
-            }
-            case OPCODE_NOP:
-            case OPCODE_HALT:
+    /* Initialize PC, Registers and all pipeline stages */
+    cpu->pc = 4000;
+    cpu->single_step = ENABLE_SINGLE_STEP;
+    cpu->memory_latency = 1;
+    cpu->fetch_stages = 1;
+    cpu->execute_stages = 1;
+    cpu->memory_stages = 1;
+    cpu->num_threads = 1;
+    layout_stages(cpu);
+
+    cpu->code_memory = code_memory;
+    cpu->code_memory_size = code_memory_size;
+    cpu->shared_code_memory = TRUE;
+
+    /* To start fetch stage */
+    APEX_LATCH(cpu, APEX_STAGE_FETCH)->has_insn = TRUE;
+}
+
+/*
+ * This function creates and initializes APEX cpu.
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+APEX_CPU *
+APEX_cpu_init(const char *filename)
+{
+    int i;
+    int code_memory_size;
+    APEX_Instruction *code_memory;
+    APEX_CPU *cpu;
+
+    if (!filename)
+    {
+        return NULL;
+    }
+
+    /* Parse input file and create code memory */
+    APEX_HOST_TIMER_START(parse_timer);
+    code_memory = create_code_memory(filename, &code_memory_size);
+    APEX_HOST_TIMER_STOP(parse_timer, HOST_SECTION_PARSE);
+    if (!code_memory)
+    {
+        return NULL;
+    }
+
+    cpu = APEX_cpu_create(code_memory, code_memory_size);
+    if (!cpu)
+    {
+        free(code_memory);
+        return NULL;
+    }
+    cpu->shared_code_memory = FALSE;
+
+    if (ENABLE_DEBUG_MESSAGES)
+    {
+        fprintf(stderr,
+                "APEX_CPU: Initialized APEX CPU, loaded %d instructions\n",
+                cpu->code_memory_size);
+        fprintf(stderr, "APEX_CPU: PC initialized to %d\n", cpu->pc);
+        fprintf(stderr, "APEX_CPU: Printing Code Memory\n");
+        printf("%-9s %-9s %-9s %-9s %-9s %-9s\n", "opcode_str", "rd", "rs1", "rs2", "rs3",
+               "imm");
+
+        for (i = 0; i < cpu->code_memory_size; ++i)
+        {
+            printf("%-9s %-9d %-9d %-9d %-9d %-9d\n", cpu->code_memory[i].opcode_str,
+                   cpu->code_memory[i].rd, cpu->code_memory[i].rs1,
+                   cpu->code_memory[i].rs2, cpu->code_memory[i].rs3, cpu->code_memory[i].imm);
+        }
+    }
+
+    return cpu;
+}
+
+/*
+ * Creates an SMT core with one hardware thread per comma separated program
+ * file. The threads share the pipeline and data memory, and fetch picks
+ * one of them every cycle by smt_policy.
+ */
+APEX_CPU *
+APEX_cpu_init_threads(const char *filenames, int smt_policy)
+{
+    APEX_CPU *cpu = NULL;
+    char *names, *name, *saveptr;
+
+    names = strdup(filenames);
+    if (!names)
+    {
+        return NULL;
+    }
+
+    /* The parser uses strtok, so the list is split with strtok_r */
+    for (name = strtok_r(names, ",", &saveptr); name; name = strtok_r(NULL, ",", &saveptr))
+    {
+        APEX_Thread *thread;
+
+        if (!cpu)
+        {
+            cpu = APEX_cpu_init(name);
+            if (!cpu)
             {
-                /* HALT doesn't have register operands */
                 break;
             }
-            }
+            cpu->smt_policy = smt_policy;
+            continue;
+        }
+        if (cpu->num_threads == APEX_THREADS_MAX)
+        {
+            fprintf(stderr, "APEX_Error: At most %d threads are supported\n", APEX_THREADS_MAX);
+            APEX_cpu_stop(cpu);
+            cpu = NULL;
+            break;
+        }
 
-            /* Copy data from execute latch to memory latch*/
-            cpu->memory = cpu->execute;
-            cpu->execute.has_insn = FALSE;
-            if (cpu->execute.opcode == OPCODE_HALT)
-            {
-                cpu->execute.has_insn = FALSE;
-                cpu->decode.has_insn = FALSE;
-                cpu->fetch.has_insn = FALSE;
-            }
-            if (cpu->execute.rd < 16 && cpu->execute.rd >= 0)
-            {
-                cpu->dataForwardingLines[0] = cpu->execute.rd;
-                cpu->dataForwardingLinesdata[0] = cpu->execute.result_buffer;
-            }
+        thread = &cpu->threads[cpu->num_threads];
+        thread->code_memory = create_code_memory(name, &thread->code_memory_size);
+        if (!thread->code_memory)
+        {
+            fprintf(stderr, "APEX_Error: Unable to initialize thread %d from %s\n",
+                    cpu->num_threads, name);
+            APEX_cpu_stop(cpu);
+            cpu = NULL;
+            break;
+        }
+        thread->pc = 4000;
+        thread->fetching = TRUE;
+        cpu->num_threads++;
+    }
+
+    free(names);
+    return cpu;
+}
+
+/*
+ * Returns the SMT fetch policy named by name, -1 when there is none
+ */
+int
+APEX_smt_parse_policy(const char *name)
+{
+    if (strcmp(name, "round-robin") == 0)
+    {
+        return APEX_SMT_ROUND_ROBIN;
+    }
+    if (strcmp(name, "icount") == 0)
+    {
+        return APEX_SMT_ICOUNT;
+    }
+    if (strcmp(name, "switch") == 0)
+    {
+        return APEX_SMT_SWITCH;
+    }
+    return -1;
+}
+
+const char *
+APEX_smt_policy_name(int smt_policy)
+{
+    switch (smt_policy)
+    {
+    case APEX_SMT_ICOUNT:
+        return "icount";
+    case APEX_SMT_SWITCH:
+        return "switch";
+    }
+    return "round-robin";
+}
 
-            if (ENABLE_DEBUG_MESSAGES)
-            {
-                print_stage_content("Instruction at Execute ___________Stage---> ", &cpu->execute);
-            }
-        }
-        else if (ENABLE_DEBUG_MESSAGES)
+/* TRUE when latches first to last hold no instruction */
+static int
+latches_empty(const APEX_CPU *cpu, int first, int last)
+{
+    int i;
+
+    for (i = first; i <= last; ++i)
+    {
+        if (cpu->stages[i].has_insn)
         {
-            print_stage_content("Instruction at Execute ___________Stage---> ", &cpu->execute);
+            return FALSE;
         }
     }
-    else if (ENABLE_DEBUG_MESSAGES)
+    return TRUE;
+}
+
+/* Instructions of thread from decode to memory, what ICOUNT counts */
+static int
+thread_in_flight(const APEX_CPU *cpu, int thread)
+{
+    int in_flight = 0;
+    int i;
+
+    for (i = cpu->first_stage[APEX_STAGE_DECODE]; i <= cpu->last_stage[APEX_STAGE_MEMORY]; ++i)
     {
-        printf("Instruction at Execute __________Stage--->: empty");
-        printf("\n");
+        if (cpu->stages[i].has_insn && cpu->stages[i].thread == thread)
+        {
+            in_flight++;
+        }
     }
+    return in_flight;
 }
 
 /*
- * Memory Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Returns the thread an SMT core fetches for this cycle, -1 for none.
+ * Candidates are taken in round-robin order after the thread fetched last.
+ * A thread redirected by execute this cycle fetches from the next one on.
  */
-static void
-APEX_memory(APEX_CPU *cpu)
+static int
+select_fetch_thread(APEX_CPU *cpu)
 {
+    int ready[APEX_THREADS_MAX];
+    int best = -1, best_count = 0;
+    int i;
 
-    if (cpu->memory.has_insn)
+    for (i = 0; i < cpu->num_threads; ++i)
     {
-        if (!cpu->memory.stalled)
-        {
-            if (cpu->memory.rd < 16 && cpu->memory.rd >= 0)
-            {
-                cpu->regs_valid_check[cpu->memory.rd] = 0;
-            }
-            switch (cpu->memory.opcode)
-            {
-            case OPCODE_ADD:
-            case OPCODE_ADDL:
-            case OPCODE_SUB:
-            case OPCODE_SUBL:
-            case OPCODE_DIV:
-            case OPCODE_MUL:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_XOR:
-            case OPCODE_NOP:
+        int *redirected = (i == cpu->thread) ? &cpu->fetch_from_next_cycle
+                                             : &cpu->threads[i].fetch_from_next_cycle;
 
-            {
-                /* No work for ADD */
-                break;
-            }
+        ready[i] = thread_can_fetch(cpu, i) && !*redirected;
+        *redirected = FALSE;
+    }
 
-            case OPCODE_LOAD:
-            case OPCODE_LDR:
-            {
-                /* Read from data memory */
-                cpu->memory.result_buffer = cpu->data_memory[cpu->memory.memory_address];
-                break;
-            }
-            case OPCODE_STORE:
-            case OPCODE_STR:
-            {
+    /* Switch-on-stall keeps its thread until it stalls or halts */
+    if (cpu->smt_policy == APEX_SMT_SWITCH && thread_can_fetch(cpu, cpu->fetch_thread))
+    {
+        return ready[cpu->fetch_thread] ? cpu->fetch_thread : -1;
+    }
 
-                cpu->data_memory[cpu->memory.memory_address] = cpu->memory.rs1_value;
-            }
-            }
+    for (i = 1; i <= cpu->num_threads; ++i)
+    {
+        int thread = (cpu->fetch_thread + i) % cpu->num_threads;
+        int count;
 
-            /* Copy data from memory latch to writeback latch*/
-            cpu->writeback = cpu->memory;
-            cpu->memory.has_insn = FALSE;
-            if (cpu->memory.rd < 16 && cpu->memory.rd >= 0)
-            {
-                cpu->dataForwardingLines[1] = cpu->memory.rd;
-                cpu->dataForwardingLinesdata[1] = cpu->memory.result_buffer;
-            }
-            if (ENABLE_DEBUG_MESSAGES)
-            {
-                print_stage_content("Instruction at Memory ___________Stage--->", &cpu->memory);
-            }
+        if (!ready[thread])
+        {
+            continue;
         }
-        else if (ENABLE_DEBUG_MESSAGES)
+        if (cpu->smt_policy != APEX_SMT_ICOUNT)
+        {
+            return thread;
+        }
+        count = thread_in_flight(cpu, thread);
+        if (best < 0 || count < best_count)
         {
-            print_stage_content("Instruction at Memory ___________Stage--->", &cpu->memory);
+            best = thread;
+            best_count = count;
         }
     }
-    else if (ENABLE_DEBUG_MESSAGES)
+    return best;
+}
+
+/*
+ * Fetch of an SMT core, for the thread the fetch policy picks. The fetch
+ * latch is refilled every cycle, so nothing of another thread is lost.
+ */
+static void
+fetch_smt(APEX_CPU *cpu)
+{
+    CPU_Stage *fetch = APEX_LATCH(cpu, APEX_STAGE_FETCH);
+    int thread = select_fetch_thread(cpu);
+
+    if (thread < 0)
     {
-        printf("Instruction at Memory ___________Stage---> : empty");
-        printf("\n");
+        if (ENABLE_DEBUG_MESSAGES)
+        {
+            printf("Instruction at Fetch____________Stage---> : empty\n");
+        }
+        return;
+    }
+
+    switch_thread(cpu, thread);
+    APEX_fetch(cpu);
+    if (!fetch->stalled)
+    {
+        cpu->threads[thread].fetched++;
+        cpu->fetch_thread = thread;
+    }
+}
+
+/* Fetch, through the fetch queue when there is one */
+static void
+APEX_fetch_stage(APEX_CPU *cpu)
+{
+    if (cpu->num_threads > 1)
+    {
+        fetch_smt(cpu);
+    }
+    else if (cpu->fetch_queue_depth > 0)
+    {
+        APEX_fetch_queued(cpu);
+    }
+    else
+    {
+        APEX_fetch(cpu);
     }
 }
 
 /*
- * Writeback Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Work of each kind of stage but writeback, done in the last stage of the
+ * kind. Each one hands its instruction to the latch of the next older
+ * stage, which has already moved on this cycle.
  */
-static int
-APEX_writeback(APEX_CPU *cpu)
+static const struct
 {
+    void (*run)(APEX_CPU *cpu);
+    int host_section;
+} stage_hooks[APEX_STAGE_WRITEBACK] = {
+    {APEX_fetch_stage, HOST_SECTION_FETCH},
+    {APEX_decode, HOST_SECTION_DECODE},
+    {APEX_execute, HOST_SECTION_EXECUTE},
+    {APEX_memory, HOST_SECTION_MEMORY},
+};
 
-    if (cpu->writeback.has_insn)
+/*
+ * Sets the number of stages of fetch, execute and memory, 1 to
+ * APEX_STAGES_MAX each, before the CPU runs. Returns FALSE when out of
+ * range. Results forward from the end of the last execute stage on and
+ * BZ/BNZ resolve there, so every execute stage adds a cycle to a
+ * dependent instruction and to a taken branch; every fetch stage adds a
+ * cycle to a taken branch, and every memory stage a cycle before data
+ * memory is read or written. Execute and memory get a latch per stage,
+ * fetch keeps one and counts the others off in fetch_refill_left.
+ */
+int
+APEX_cpu_set_depth(APEX_CPU *cpu, int fetch_stages, int execute_stages, int memory_stages)
+{
+    if (fetch_stages < 1 || fetch_stages > APEX_STAGES_MAX || execute_stages < 1
+        || execute_stages > APEX_STAGES_MAX || memory_stages < 1 || memory_stages > APEX_STAGES_MAX)
     {
-        if (!cpu->writeback.stalled)
-        {
-            if (cpu->writeback.rd < 16 && cpu->writeback.rd >= 0)
-            {
-                cpu->regs_valid_check[cpu->writeback.rd] = 1;
-            }
-            /* Write result to register file based on instruction type */
-            switch (cpu->writeback.opcode)
-            {
-            case OPCODE_ADD:
-            case OPCODE_DIV:
-            case OPCODE_MUL:
-            case OPCODE_SUB:
-            case OPCODE_SUBL:
-            case OPCODE_ADDL:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                break;
-            }
+        return FALSE;
+    }
+    cpu->fetch_stages = fetch_stages;
+    cpu->execute_stages = execute_stages;
+    cpu->memory_stages = memory_stages;
+    layout_stages(cpu);
+
+    /* The first instruction fills the fetch stages too */
+    cpu->fetch_refill_left = fetch_stages - 1;
+    return TRUE;
+}
 
-            case OPCODE_LOAD:
-            case OPCODE_MOVC:
-            case OPCODE_LDR:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_XOR:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                break;
-            }
+/*
+ * Simulates one clock cycle, stages are called in reverse order.
+ * Returns TRUE when HALT retires in writeback, or when a fault has drained
+ * the pipeline, the remaining stages are then not simulated for this cycle.
+ * Also returns TRUE, after the whole cycle, when the watchdog fires.
+ */
+int
+APEX_cpu_step(APEX_CPU *cpu)
+{
+    int halted;
+    int i;
 
-            case OPCODE_NOP:
-            {
-                break;
-            }
-            }
+    APEX_HOST_COUNT_CYCLE();
 
-            cpu->insn_completed++;
-            cpu->writeback.has_insn = FALSE;
-            if (ENABLE_DEBUG_MESSAGES)
-            {
-                print_stage_content("Instruction at Writeback ________Stage--->", &cpu->writeback);
-            }
-        }
-        else if (ENABLE_DEBUG_MESSAGES)
+    APEX_HOST_TIMER_START(writeback_timer);
+    halted = APEX_writeback(cpu);
+    APEX_HOST_TIMER_STOP(writeback_timer, HOST_SECTION_WRITEBACK);
+    if (cpu->fault.type != APEX_FAULT_NONE && cpu->store_buffer_count == 0 && cpu->mshr_count == 0
+        && latches_empty(cpu, cpu->first_stage[APEX_STAGE_MEMORY],
+                         cpu->last_stage[APEX_STAGE_WRITEBACK]))
+    {
+        halted = TRUE;
+    }
+    if (halted)
+    {
+        /* Decode does not run in the cycle the CPU stops */
+        if (APEX_PROFILING(cpu))
         {
-            print_stage_content("Instruction at Writeback ________Stage--->", &cpu->writeback);
+            APEX_profile_bubble(cpu->pc_profile);
         }
+        return TRUE;
+    }
+
+    /* The latches in front of the last stage of a kind move along behind it */
+    for (i = cpu->first_stage[APEX_STAGE_WRITEBACK] - 1; i >= 0; --i)
+    {
+        int kind = cpu->stage_kind[i];
 
-        if (cpu->writeback.opcode == OPCODE_HALT)
+        APEX_HOST_TIMER_START(stage_timer);
+        if (i == cpu->last_stage[kind])
         {
-            /* Stop the APEX simulator */
-            return TRUE;
+            stage_hooks[kind].run(cpu);
+        }
+        else
+        {
+            advance_latch(cpu, i);
         }
+        APEX_HOST_TIMER_STOP(stage_timer, stage_hooks[kind].host_section);
     }
-    else if (ENABLE_DEBUG_MESSAGES)
+
+    if (cpu->watchdog)
     {
-        printf("Instruction at Writeback ________Stage---> :empty");
-        printf("\n");
+        return APEX_watchdog_cycle(cpu->watchdog, cpu);
     }
-    /* Default */
-    return 0;
+    return FALSE;
 }
 
 /*
- * This function creates and initializes APEX cpu.
- *
- * Note: You are free to edit this function according to your implementation
+ * Prints the cycle count and final architectural state of a run
  */
-APEX_CPU *
-APEX_cpu_init(const char *filename)
+void
+APEX_cpu_print_result(APEX_CPU *cpu, int completed)
 {
-    int i;
-    APEX_CPU *cpu;
+    APEX_HOST_TIMER_START(print_timer);
+    APEX_cpu_write_result(stdout, cpu, completed);
+    APEX_HOST_TIMER_STOP(print_timer, HOST_SECTION_PRINT);
+}
 
-    if (!filename)
+void
+APEX_cpu_write_result(FILE *out, const APEX_CPU *cpu, int completed)
+{
+    fprintf(out, "APEX_CPU: Simulation %s, cycles = %d instructions = %d\n",
+            cpu->fault.type != APEX_FAULT_NONE ? "Faulted" : (completed ? "Complete" : "Stopped"),
+            cpu->clock + 1, cpu->insn_completed);
+    APEX_cpu_write_fault(out, cpu);
+    if (cpu->num_threads > 1)
     {
-        return NULL;
-    }
+        int t;
 
-    cpu = calloc(1, sizeof(APEX_CPU));
+        for (t = 0; t < cpu->num_threads; ++t)
+        {
+            const APEX_Thread *thread = &cpu->threads[t];
 
-    if (!cpu)
+            fprintf(out, "APEX_CPU: Thread %d\n", t);
+            fprintregs(out, t == cpu->thread ? cpu->regs : thread->regs,
+                       t == cpu->thread ? cpu->regs_valid_check : thread->regs_valid_check);
+        }
+    }
+    else
     {
-        return NULL;
+        fprintregstate(out, cpu);
     }
+    fprintdatamemory(out, cpu);
+    fprintf(out, "APEX_CPU: State digest = %016llx\n", cpu->digest);
+}
 
-    /* Initialize PC, Registers and all pipeline stages */
-    cpu->pc = 4000;
-    memset(cpu->regs, 0, sizeof(int) * REG_FILE_SIZE);
-    memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
-    cpu->single_step = ENABLE_SINGLE_STEP;
+/*
+ * Prints the latches and the register scoreboard for watchdog reports
+ */
+static void
+fprint_pipeline_state(FILE *out, const APEX_CPU *cpu)
+{
+    const CPU_Stage *stages[APEX_LATCHES_MAX];
+    char names[APEX_LATCHES_MAX][16];
+    int count = list_latches(cpu, stages, names);
+    int i;
 
-    /* Parse input file and create code memory */
-    cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size);
-    if (!cpu->code_memory)
+    for (i = 0; i < count; ++i)
     {
-        free(cpu);
-        return NULL;
+        if (stages[i]->has_insn)
+        {
+            fprintf(out, "%-15s: pc(%d) ", names[i], stages[i]->pc);
+            print_instruction(out, stages[i]);
+            fprintf(out, "%s\n", stages[i]->stalled ? " (stalled)" : "");
+        }
+        else
+        {
+            fprintf(out, "%-15s: empty\n", names[i]);
+        }
     }
 
-    if (ENABLE_DEBUG_MESSAGES)
+    fprintf(out, "Scoreboard     : invalid");
+    for (i = 0; i < REG_FILE_SIZE; ++i)
     {
-        fprintf(stderr,
-                "APEX_CPU: Initialized APEX CPU, loaded %d instructions\n",
-                cpu->code_memory_size);
-        fprintf(stderr, "APEX_CPU: PC initialized to %d\n", cpu->pc);
-        fprintf(stderr, "APEX_CPU: Printing Code Memory\n");
-        printf("%-9s %-9s %-9s %-9s %-9s %-9s\n", "opcode_str", "rd", "rs1", "rs2", "rs3",
-               "imm");
-
-        for (i = 0; i < cpu->code_memory_size; ++i)
+        if (!cpu->regs_valid_check[i])
         {
-            printf("%-9s %-9d %-9d %-9d %-9d %-9d\n", cpu->code_memory[i].opcode_str,
-                   cpu->code_memory[i].rd, cpu->code_memory[i].rs1,
-                   cpu->code_memory[i].rs2, cpu->code_memory[i].rs3, cpu->code_memory[i].imm);
+            fprintf(out, " R%d", i);
         }
     }
+    fprintf(out, ", forwarding EX R%d MEM R%d, memory cycles left %d, zero flag %d\n",
+            cpu->dataForwardingLines[0], cpu->dataForwardingLines[1], cpu->memory_cycles_left,
+            cpu->zero_flag);
+}
 
-    /* To start fetch stage */
-    cpu->fetch.has_insn = TRUE;
-    return cpu;
+/*
+ * Describes the fault that stopped cpu, nothing when there was none
+ */
+void
+APEX_cpu_write_fault(FILE *out, const APEX_CPU *cpu)
+{
+    switch (cpu->fault.type)
+    {
+    case APEX_FAULT_FETCH:
+        fprintf(out, "APEX_CPU: Fault, fetched pc(%d) outside code memory at cycle %d\n",
+                cpu->fault.pc, cpu->fault.cycle);
+        break;
+    case APEX_FAULT_DATA:
+        fprintf(out, "APEX_CPU: Fault, pc(%d) accessed data address %d outside data memory at cycle %d\n",
+                cpu->fault.pc, cpu->fault.address, cpu->fault.cycle);
+        break;
+    case APEX_FAULT_BRANCH:
+        fprintf(out, "APEX_CPU: Fault, pc(%d) branched to pc(%d) outside code memory at cycle %d\n",
+                cpu->fault.pc, cpu->fault.address, cpu->fault.cycle);
+        break;
+    case APEX_FAULT_DIVIDE:
+        fprintf(out, "APEX_CPU: Fault, pc(%d) divided %d by zero at cycle %d\n",
+                cpu->fault.pc, cpu->fault.address, cpu->fault.cycle);
+        break;
+    case APEX_FAULT_DEADLOCK:
+        fprintf(out, "APEX_CPU: Watchdog, no instruction retired for %d cycles, oldest pc(%d) at cycle %d\n",
+                cpu->fault.address, cpu->fault.pc, cpu->fault.cycle);
+        fprint_pipeline_state(out, cpu);
+        break;
+    case APEX_FAULT_LIVELOCK:
+        fprintf(out, "APEX_CPU: Watchdog, branch at pc(%d) repeats the same state every %d taken branches at cycle %d\n",
+                cpu->fault.pc, cpu->fault.address, cpu->fault.cycle);
+        fprint_pipeline_state(out, cpu);
+        break;
+    }
 }
 
 /*
- * APEX CPU simulation loop
+ * APEX CPU simulation loop, returns TRUE when HALT retired
  *
  * Note: You are free to edit this function according to your implementation
  */
-void APEX_cpu_run(APEX_CPU *cpu, int displayIn, int cyclesnumberIn)
+int APEX_cpu_run(APEX_CPU *cpu, int displayIn, int cyclesnumberIn)
 {
     char user_prompt_val;
+    int completed = FALSE;
     if (displayIn == 1)
     {
         ENABLE_DEBUG_MESSAGES = 1;
@@ -1217,21 +3163,25 @@ void APEX_cpu_run(APEX_CPU *cpu, int displayIn, int cyclesnumberIn)
             printf("--------------------------------------------\n");
         }
 
-        if (APEX_writeback(cpu))
+        if (APEX_cpu_step(cpu))
         {
-            /* Halt in writeback stage */
-            printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock + 1, cpu->insn_completed);
-            printregstate(cpu);
-            printdatamemory(cpu);
+            /* Halt in writeback stage, or a fault drained the pipeline */
+            completed = (cpu->fault.type == APEX_FAULT_NONE);
+            APEX_cpu_print_result(cpu, completed);
             break;
         }
 
-        APEX_memory(cpu);
-        APEX_execute(cpu);
-        APEX_decode(cpu);
-        APEX_fetch(cpu);
+        if (cpu->sampler && cpu->clock + 1 == cpu->sampler->next_cycle)
+        {
+            APEX_sampler_record(cpu->sampler, cpu);
+        }
+
         if (displayIn)
+        {
+            APEX_HOST_TIMER_START(print_timer);
             print_reg_file(cpu);
+            APEX_HOST_TIMER_STOP(print_timer, HOST_SECTION_PRINT);
+        }
 
         if (cpu->single_step)
         {
@@ -1248,16 +3198,14 @@ void APEX_cpu_run(APEX_CPU *cpu, int displayIn, int cyclesnumberIn)
         }
         else if (cyclesnumberIn == (cpu->clock + 1))
         {
-            printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock + 1, cpu->insn_completed);
             // print_reg_file(cpu);
-            printregstate(cpu);
-            printdatamemory(cpu);
+            APEX_cpu_print_result(cpu, FALSE);
             break;
         }
 
         cpu->clock++;
     }
-
+    return completed;
 } /*
  * This function deallocates APEX CPU.
  *
@@ -1265,33 +3213,79 @@ void APEX_cpu_run(APEX_CPU *cpu, int displayIn, int cyclesnumberIn)
  */
 void APEX_cpu_stop(APEX_CPU *cpu)
 {
-    free(cpu->code_memory);
+    int i;
+
+    /* The first thread owns the code memory of the APEX_CPU */
+    switch_thread(cpu, 0);
+    for (i = 1; i < cpu->num_threads; ++i)
+    {
+        free(cpu->threads[i].code_memory);
+    }
+    APEX_cache_destroy(cpu->l1);
+    APEX_prefetch_destroy(cpu->prefetcher);
+    APEX_dram_destroy(cpu->dram);
+    APEX_cache_destroy(cpu->icache);
+    APEX_watchdog_destroy(cpu->watchdog);
+    if (!cpu->shared_data_memory)
+    {
+        free(cpu->data_memory);
+    }
+    if (!cpu->shared_code_memory)
+    {
+        free(cpu->code_memory);
+    }
     free(cpu);
 }
 void printdatamemory(APEX_CPU *cpu)
 {
-    printf("============== STATE OF DATA MEMORY =============\n");
+    fprintdatamemory(stdout, cpu);
+}
+void printregstate(APEX_CPU *cpu)
+{
+    fprintregstate(stdout, cpu);
+}
+void fprintdatamemory(FILE *out, const APEX_CPU *cpu)
+{
+    fprintmemorywords(out, cpu->data_memory, cpu->dirty);
+}
+/* Prints the words set in dirty, words never stored to are left out */
+void fprintmemorywords(FILE *out, const int *data_memory, const unsigned long long *dirty)
+{
+    fprintf(out, "============== STATE OF DATA MEMORY =============\n");
 
-    for (int count = 0; count < 100; count++)
+    for (int word = 0; word < DATA_MEMORY_BITMAP_WORDS; word++)
     {
-        printf("|           MEM[%d]       |     Data  Value=%d        |\n", count, cpu->data_memory[count]);
+        unsigned long long bits = dirty[word];
+
+        while (bits)
+        {
+            int count = word * 64 + __builtin_ctzll(bits);
+
+            bits &= bits - 1;
+            fprintf(out, "|           MEM[%d]       |     Data  Value=%d        |\n", count, data_memory[count]);
+        }
     }
 }
-void printregstate(APEX_CPU *cpu)
+void fprintregstate(FILE *out, const APEX_CPU *cpu)
+{
+    fprintregs(out, cpu->regs, cpu->regs_valid_check);
+}
+/* Prints a register file and its valid bits */
+void fprintregs(FILE *out, const int *regs, const int *regs_valid_check)
 {
-    printf("=============== STATE OF ARCHITECTURAL REGISTER FILE ==========\n");
+    fprintf(out, "=============== STATE OF ARCHITECTURAL REGISTER FILE ==========\n");
 
     int registersNumber = 16;
     for (int count = 0; count < registersNumber; count++)
     {
-        if (cpu->regs_valid_check[count] == 1)
+        if (regs_valid_check[count] == 1)
         {
-            //  printf("|    REG[%d] |       Value=%d  |       STATUS=%s   |\n", count, cpu->regs[count], (cpu->regs_valid_check[count] ? "VALID  " : "INVALID"));
-            printf("|    REG[%d] |       Value=%d  |       STATUS=%s   |\n", count, cpu->regs[count], "VALID  ");
+            //  printf("|    REG[%d] |       Value=%d  |       STATUS=%s   |\n", count, regs[count], (regs_valid_check[count] ? "VALID  " : "INVALID"));
+            fprintf(out, "|    REG[%d] |       Value=%d  |       STATUS=%s   |\n", count, regs[count], "VALID  ");
         }
         else
         {
-            printf("|    REG[%d] |       Value=%d  |       STATUS=%s   |\n", count, cpu->regs[count], "INVALID  ");
+            fprintf(out, "|    REG[%d] |       Value=%d  |       STATUS=%s   |\n", count, regs[count], "INVALID  ");
         }
     }
-}
\ No newline at end of file
+}
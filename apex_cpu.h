@@ -9,6 +9,8 @@
 #ifndef _APEX_CPU_H_
 #define _APEX_CPU_H_
 
+#include <stdio.h>
+
 #include "apex_macros.h"
 
 /* Format of an APEX instruction  */
@@ -39,11 +41,165 @@ typedef struct CPU_Stage
     int rs3_value; // Source-3 Register Value for STR instructions
     int result_buffer;
     int memory_address;
+    int branch_taken; // Set in execute when BZ/BNZ redirects fetch
     int has_insn;
     int stalled; // Flag  stage is stalled
+    int fault; // Fetched from a PC outside code memory
+    int load_pending; // LOAD/LDR left memory with its data still in an MSHR
+    int loop_predicted; // Loop branch fetched from the loop buffer, followed as taken
+    int thread; // Hardware thread of an SMT core the instruction belongs to
+
+    /* Older CMP or ADDL fused into this BZ/BNZ, LOAD or STORE by decode */
+    int fused; // {TRUE, FALSE}
+    int fused_pc;
+    int fused_opcode;
+    int fused_rd;
+    int fused_rs1;
+    int fused_rs2;
+    int fused_imm;
+    int fused_rs1_value;
+    int fused_rs2_value;
+    int fused_result; // ADDL result, also the address base of the LOAD/STORE
 } CPU_Stage;
 
-/* Model of APEX CPU */
+/* Reasons a CPU stops before HALT, see APEX_Fault */
+#define APEX_FAULT_NONE 0
+#define APEX_FAULT_FETCH 1      /* PC outside code memory */
+#define APEX_FAULT_DATA 2       /* LOAD/STORE address outside data memory */
+#define APEX_FAULT_BRANCH 3     /* Taken BZ/BNZ target outside code memory */
+#define APEX_FAULT_DEADLOCK 4   /* Watchdog, nothing retired for too long */
+#define APEX_FAULT_LIVELOCK 5   /* Watchdog, a loop repeats the same state */
+#define APEX_FAULT_DIVIDE 6     /* DIV by zero */
+
+/* First fault of a CPU, raised in execute or by the watchdog */
+typedef struct APEX_Fault
+{
+    int type;               /* APEX_FAULT_* */
+    int pc;                 /* Faulting instruction */
+    int address;            /* PC, data address or branch target out of range,
+                               cycles without retirement, loop length or dividend */
+    int cycle;
+    int thread;             /* Thread of an SMT core that raised it */
+} APEX_Fault;
+
+/* Entries a store buffer can be configured with */
+#define APEX_STORE_BUFFER_MAX 64
+
+/* STORE/STR that left the memory stage but has not written data memory yet */
+typedef struct APEX_StoreBufferEntry
+{
+    int pc;
+    int address;
+    int value;
+} APEX_StoreBufferEntry;
+
+/* Data memory access handed to the DRAM, its countdown waits while pending */
+typedef struct APEX_DramAccess
+{
+    int pending;            /* {TRUE, FALSE} The DRAM has not scheduled it yet */
+    int address;
+    int is_write;
+    long arrival;           /* First cycle the DRAM may schedule it */
+    long request;           /* DRAM request, 0 until the queue takes it */
+} APEX_DramAccess;
+
+/* Outstanding load misses that can be configured */
+#define APEX_MSHR_MAX 16
+
+/* Miss status holding register of a LOAD/LDR that left the memory stage */
+typedef struct APEX_Mshr
+{
+    int pc;
+    int rd;                 /* -1 once a younger write made the data dead */
+    int value;              /* Read when the miss started, written to rd when it ends */
+    int cycles_left;
+    APEX_DramAccess dram;   /* The fill, when it reads the DRAM */
+} APEX_Mshr;
+
+/* Entries a fetch queue can be configured with */
+#define APEX_FETCH_QUEUE_MAX 32
+
+/* Stages the fetch, execute or memory part of the pipeline can be split into */
+#define APEX_STAGES_MAX 4
+
+/* Pipeline latches at the deepest, fetch, decode and writeback included */
+#define APEX_LATCHES_MAX (3 + 2 * APEX_STAGES_MAX)
+
+/* Kinds of pipeline stage, in pipeline order */
+#define APEX_STAGE_FETCH 0
+#define APEX_STAGE_DECODE 1
+#define APEX_STAGE_EXECUTE 2
+#define APEX_STAGE_MEMORY 3
+#define APEX_STAGE_WRITEBACK 4
+#define APEX_STAGE_KINDS 5
+
+/* Instructions a captured loop can be configured with */
+#define APEX_LOOP_BUFFER_MAX 64
+
+/* Hardware threads an SMT core can be configured with */
+#define APEX_THREADS_MAX 8
+
+/* Fetch policies of an SMT core */
+#define APEX_SMT_ROUND_ROBIN 0x0  /* Next thread every cycle */
+#define APEX_SMT_ICOUNT 0x1       /* Thread with the fewest instructions in decode to memory */
+#define APEX_SMT_SWITCH 0x2       /* Same thread until decode stalls on one of its operands */
+
+/*
+ * Hardware thread of an SMT core. pc to code_memory_size hold the state of
+ * the thread while another one is switched into the APEX_CPU fields of the
+ * same name, the rest is always up to date.
+ */
+typedef struct APEX_Thread
+{
+    int pc;
+    int regs[REG_FILE_SIZE];
+    int regs_valid_check[REG_FILE_SIZE];
+    int zero_flag;
+    int fetch_from_next_cycle;
+    int fetching;                        /* {TRUE, FALSE} fetch.has_insn, cleared by HALT */
+    APEX_Instruction *code_memory;       /* Owned by the CPU for every thread but the first */
+    int code_memory_size;
+
+    int halted;                          /* {TRUE, FALSE} HALT retired */
+    int halt_cycle;
+    int insn_completed;
+    long fetched;                        /* Instructions fetch handed to decode */
+    long switches;                       /* Switch-on-stall: stalls that sent the thread back to fetch */
+} APEX_Thread;
+
+/* Running totals of pipeline events, always counted */
+typedef struct APEX_CpuStats
+{
+    long load_use_stalls;   /* Decode cycles waiting on a load in execute */
+    long operand_stalls;    /* Decode cycles waiting on a source not yet forwarded */
+    long memory_stalls;     /* Decode cycles held behind a multi-cycle memory access */
+    long branch_flushes;    /* Taken BZ/BNZ that squashed fetch and decode */
+    long loads;             /* LOAD/LDR that entered the memory stage */
+    long stores;            /* STORE/STR that entered the memory stage */
+    long forwarded_ex;      /* Operands read from the EX forwarding line */
+    long forwarded_mem;     /* Operands read from the MEM forwarding line */
+    long fused_branches;    /* CMP+BZ/BNZ pairs retired as one micro-op */
+    long fused_memory;      /* ADDL+LOAD/STORE pairs retired as one micro-op */
+    long store_buffer_forwards;  /* LOAD/LDR that read a buffered store */
+    long store_buffer_full;      /* Cycles a STORE/STR waited in memory for a free entry */
+    long store_buffer_occupancy; /* Buffered stores summed over all cycles */
+    long store_buffer_peak;      /* Most stores buffered at once */
+    long mshr_misses;            /* LOAD/LDR misses that left memory in an MSHR */
+    long mshr_full;              /* LOAD/LDR misses that blocked memory with every MSHR busy */
+    long mshr_occupancy;         /* Outstanding misses summed over all cycles */
+    long mshr_peak;              /* Most misses outstanding at once */
+    long fetch_queue_empty;      /* Cycles decode found its latch and the fetch queue empty */
+    long fetch_queue_full;       /* Cycles fetch waited for a free fetch queue entry */
+    long fetch_queue_occupancy;  /* Queued instructions summed over all cycles */
+    long icache_stalls;          /* Cycles fetch waited on an I-cache miss */
+    long loop_buffer_fetches;    /* Instructions fetched with a loop buffer configured */
+    long loop_buffer_hits;       /* Of those, read from the loop buffer */
+    long loop_buffer_captures;   /* Loops the loop buffer locked onto */
+    long loop_buffer_taken;      /* Loop branches taken without squashing fetch and decode */
+    long loop_buffer_exits;      /* Loop branches falling through on the last iteration */
+} APEX_CpuStats;
+
+/* Model of APEX CPU, fields the pipeline updates are listed in journal_regions of apex_journal.c */
 typedef struct APEX_CPU
 {
     int pc;                              /* Current program counter */
@@ -53,29 +209,107 @@ typedef struct APEX_CPU
     int regs_valid_check[REG_FILE_SIZE]; /* Integer register file to check register valid*/
     int code_memory_size;                /* Number of instruction in the input file */
     APEX_Instruction *code_memory;       /* Code Memory */
-    int data_memory[DATA_MEMORY_SIZE];   /* Data Memory */
+    int shared_code_memory;              /* {TRUE, FALSE} code_memory is owned by the caller */
+    int *data_memory;                    /* Data Memory, DATA_MEMORY_SIZE words */
+    int shared_data_memory;              /* {TRUE, FALSE} data_memory belongs to a multicore system */
     int single_step;                     /* Wait for user input after every cycle */
     int zero_flag;                       /* {TRUE, FALSE} Used by BZ and BNZ to branch */
     int fetch_from_next_cycle;
 
-    /* Pipeline stages */
-    CPU_Stage fetch;
-    CPU_Stage decode;
-    CPU_Stage execute;
-    CPU_Stage memory;
-    CPU_Stage writeback;
+    /* Pipeline latches from fetch to writeback, youngest first, see
+     * APEX_cpu_set_depth. A kind split over several stages does its work
+     * in the last of them, the ones in front are plain latches; fetch
+     * stages beyond the first only delay a redirected fetch. */
+    CPU_Stage stages[APEX_LATCHES_MAX];
+    int stage_kind[APEX_LATCHES_MAX];    /* APEX_STAGE_* of each latch */
+    int num_stages;
+    int first_stage[APEX_STAGE_KINDS];   /* Latch an instruction enters a kind through */
+    int last_stage[APEX_STAGE_KINDS];    /* Latch of the stage doing the work of a kind */
+    int fetch_stages;
+    int execute_stages;
+    int memory_stages;
+    int fetch_refill_left;               /* Cycles left before the redirected PC is fetched */
+
+    int dataForwardingLines[4]; //0 execute 1memory 2,3 fused ADDL in execute, memory
+    int dataForwardingLinesdata[4];             //One each for 0-EX, 1-MEM 
+    int fusion;                          /* {TRUE, FALSE} Decode fuses CMP+BZ/BNZ and ADDL+LOAD/STORE */
+    int fetch_queue_depth;               /* Entries between fetch and decode, 0 fetches in lockstep */
+    int fetch_queue_head;                /* Index of the oldest fetched instruction */
+    int fetch_queue_count;
+    int icache_cycles_left;              /* Cycles left of the I-cache miss fetch waits on */
+    CPU_Stage fetch_queue[APEX_FETCH_QUEUE_MAX];
+    struct APEX_Cache *icache;           /* Instruction cache indexed by code memory index, NULL when off */
+    int loop_buffer_size;                /* Instructions a captured loop may span, 0 when off */
+    int loop_buffer_active;              /* {TRUE, FALSE} Fetch streams the captured loop */
+    int loop_start_pc;                   /* Target of the loop branch */
+    int loop_branch_pc;                  /* Backward BZ/BNZ closing the captured loop */
+    int loop_candidate_pc;               /* Backward BZ/BNZ taken once, waiting for a second time */
+    APEX_Instruction loop_buffer[APEX_LOOP_BUFFER_MAX];
+
+    int num_threads;                     /* Hardware threads sharing the pipeline, 1 without SMT */
+    int thread;                          /* Thread whose state is in pc, regs, zero_flag, ... */
+    int smt_policy;                      /* APEX_SMT_* */
+    int fetch_thread;                    /* Thread fetched last, or the one switch-on-stall sticks to */
+    APEX_Thread threads[APEX_THREADS_MAX];
 
+    struct APEX_TraceWriter *trace;      /* Committed instruction recorder, NULL when off */
 
-    int dataForwardingLines[3]; //0 execute 1memory 
-    int dataForwardingLinesdata[3];             //One each for 0-EX, 1-MEM 
+    int core_id;                         /* Index of this core in a multicore system */
+    int memory_latency;                  /* Memory stage cycles of LOAD/STORE without a cache */
+    int memory_cycles_left;              /* Remaining cycles of the access in the memory stage */
+    APEX_DramAccess memory_dram;         /* DRAM access of the memory stage */
+    int store_buffer_depth;              /* Entries of the store buffer, 0 stores in the memory stage */
+    int store_buffer_head;               /* Index of the oldest buffered store */
+    int store_buffer_count;
+    int store_drain_cycles_left;         /* Cycles left writing the oldest store, 0 before it starts */
+    APEX_DramAccess store_drain_dram;    /* DRAM access of the oldest store */
+    APEX_StoreBufferEntry store_buffer[APEX_STORE_BUFFER_MAX];
+    int num_mshrs;                       /* Load misses allowed outstanding, 0 blocks the memory stage */
+    int mshr_count;
+    APEX_Mshr mshrs[APEX_MSHR_MAX];      /* Outstanding misses, oldest first */
+    struct APEX_Cache *l1;               /* Private L1 data cache, NULL when off */
+    struct APEX_Prefetcher *prefetcher;  /* Fills the L1 ahead of demand, NULL when off */
+    struct APEX_Dram *dram;              /* DRAM behind data memory, NULL for memory_latency */
+    struct APEX_PcProfiler *pc_profile;  /* Per-PC stall attribution, NULL when off */
+    APEX_CpuStats stats;
+    struct APEX_Sampler *sampler;        /* Time-series snapshots, NULL when off */
+
+    APEX_Fault fault;                    /* type is APEX_FAULT_NONE while running normally */
+    struct APEX_Watchdog *watchdog;      /* Deadlock and livelock detection, NULL when off */
+    struct APEX_Journal *journal;        /* Undo journal of the debugger, NULL when off */
+
+    unsigned long long digest;           /* Hash of regs and data memory, see APEX_state_digest */
+    unsigned long long dirty[DATA_MEMORY_BITMAP_WORDS]; /* Bit per data memory word stored to */
 
 } APEX_CPU;
 
+/* Latch of the stage doing the work of kind, the last of its stages */
+#define APEX_LATCH(cpu, kind) (&(cpu)->stages[(cpu)->last_stage[kind]])
+
+extern int ENABLE_DEBUG_MESSAGES;
+
 APEX_Instruction *create_code_memory(const char *filename, int *size);
+APEX_CPU *APEX_cpu_create(APEX_Instruction *code_memory, int code_memory_size);
+void APEX_cpu_reset(APEX_CPU *cpu, APEX_Instruction *code_memory, int code_memory_size);
 APEX_CPU *APEX_cpu_init(const char *filename);
-void APEX_cpu_run(APEX_CPU *cpu, int dispalyIn, int cyclesnumberIn);
+APEX_CPU *APEX_cpu_init_threads(const char *filenames, int smt_policy);
+int APEX_smt_parse_policy(const char *name);
+const char *APEX_smt_policy_name(int smt_policy);
+int APEX_cpu_set_depth(APEX_CPU *cpu, int fetch_stages, int execute_stages, int memory_stages);
+int APEX_cpu_step(APEX_CPU *cpu);
+int APEX_cpu_run(APEX_CPU *cpu, int dispalyIn, int cyclesnumberIn);
+void APEX_cpu_print_result(APEX_CPU *cpu, int completed);
+void APEX_cpu_write_result(FILE *out, const APEX_CPU *cpu, int completed);
+void APEX_cpu_write_fault(FILE *out, const APEX_CPU *cpu);
+void APEX_cpu_print_pipeline(const APEX_CPU *cpu);
+void APEX_stage_fused_head(const CPU_Stage *stage, CPU_Stage *head);
 void APEX_cpu_stop(APEX_CPU *cpu);
+unsigned long long APEX_state_digest(const APEX_CPU *cpu);
 void printdatamemory(APEX_CPU *cpu);
 void printregstate(APEX_CPU *cpu);
+void fprintdatamemory(FILE *out, const APEX_CPU *cpu);
+void fprintregstate(FILE *out, const APEX_CPU *cpu);
+void fprintregs(FILE *out, const int *regs, const int *regs_valid_check);
+void fprintmemorywords(FILE *out, const int *data_memory, const unsigned long long *dirty);
 
 #endif
@@ -0,0 +1,550 @@
+/*
+ * apex_debugger.c
+ * Contains the interactive debugger of the APEX pipeline.
+ *
+ * Between stops the pipeline runs through APEX_cpu_step at full speed. Stop
+ * conditions are only evaluated in cycles where an instruction retires: a
+ * PC bitmap tells whether the retired instruction has a breakpoint, and a
+ * STORE/STR is only compared when its page has a watched word. Register
+ * watchpoints compare the destination of the retired instruction.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_debugger.h"
+#include "apex_isa.h"
+
+static int
+code_index(const APEX_Debugger *dbg, int pc)
+{
+    int index = (pc - 4000) / 4;
+
+    if (pc < 4000 || (pc - 4000) % 4 != 0 || index >= dbg->cpu->code_memory_size)
+    {
+        return -1;
+    }
+    return index;
+}
+
+static int
+has_breakpoint(const APEX_Debugger *dbg, int pc)
+{
+    int index = code_index(dbg, pc);
+
+    return index >= 0 && ((dbg->breakpoints[index / 64] >> (index % 64)) & 1);
+}
+
+/*
+ * Evaluates the stop conditions of the instruction that retired this cycle,
+ * ins is the writeback latch as it was before the cycle
+ */
+static int
+check_retired(APEX_Debugger *dbg, const CPU_Stage *ins)
+{
+    int stop = FALSE;
+
+    /* The older half of a fused pair retired in the same cycle */
+    if (ins->fused)
+    {
+        CPU_Stage head;
+
+        APEX_stage_fused_head(ins, &head);
+        stop = check_retired(dbg, &head);
+    }
+
+    if (has_breakpoint(dbg, ins->pc))
+    {
+        printf("APEX_DEBUG: Breakpoint at pc(%d) %s retired\n", ins->pc, ins->opcode_str);
+        stop = TRUE;
+    }
+
+    if (dbg->watched_regs && APEX_opcode_writes_rd(ins->opcode) && ins->rd >= 0
+        && ins->rd < REG_FILE_SIZE && ((dbg->watched_regs >> ins->rd) & 1)
+        && dbg->cpu->regs[ins->rd] != dbg->watched_reg_values[ins->rd])
+    {
+        printf("APEX_DEBUG: Watchpoint R%d changed %d -> %d by pc(%d)\n", ins->rd,
+               dbg->watched_reg_values[ins->rd], dbg->cpu->regs[ins->rd], ins->pc);
+        dbg->watched_reg_values[ins->rd] = dbg->cpu->regs[ins->rd];
+        stop = TRUE;
+    }
+
+    /*
+     * The store wrote memory a cycle or more before retiring, a younger store
+     * may already have overwritten the word, so compare the value it stored
+     */
+    if (APEX_opcode_is_store(ins->opcode) && ins->memory_address >= 0
+        && ins->memory_address < DATA_MEMORY_SIZE
+        && dbg->watched_words[ins->memory_address / DEBUG_PAGE_WORDS])
+    {
+        int address = ins->memory_address;
+
+        if (((dbg->watched_words[address / DEBUG_PAGE_WORDS] >> (address % DEBUG_PAGE_WORDS)) & 1)
+            && ins->rs1_value != dbg->watched_values[address])
+        {
+            printf("APEX_DEBUG: Watchpoint MEM[%d] changed %d -> %d by pc(%d)\n", address,
+                   dbg->watched_values[address], ins->rs1_value, ins->pc);
+            dbg->watched_values[address] = ins->rs1_value;
+            stop = TRUE;
+        }
+    }
+    return stop;
+}
+
+static void
+print_position(const APEX_Debugger *dbg)
+{
+    printf("APEX_DEBUG: cycle %d, %d instructions retired, fetch pc(%d)\n", dbg->cycles_done,
+           dbg->cpu->insn_completed, dbg->cpu->pc);
+}
+
+/*
+ * Simulates one cycle, recording it in the journal when reverse stepping
+ * is enabled
+ */
+static int
+step_cycle(APEX_Debugger *dbg)
+{
+    APEX_CPU *cpu = dbg->cpu;
+    int halted;
+
+    if (dbg->journal)
+    {
+        APEX_journal_begin_cycle(dbg->journal, cpu);
+    }
+    if (dbg->cycles_done > 0)
+    {
+        cpu->clock++;
+    }
+    halted = APEX_cpu_step(cpu);
+    dbg->cycles_done = cpu->clock + 1;
+    if (dbg->journal)
+    {
+        APEX_journal_end_cycle(dbg->journal, cpu);
+    }
+    return halted;
+}
+
+/*
+ * Watchpoints compare against the state the debugger moved to
+ */
+static void
+reset_watch_values(APEX_Debugger *dbg)
+{
+    int i;
+
+    for (i = 0; i < DATA_MEMORY_SIZE; ++i)
+    {
+        if ((dbg->watched_words[i / DEBUG_PAGE_WORDS] >> (i % DEBUG_PAGE_WORDS)) & 1)
+        {
+            dbg->watched_values[i] = dbg->cpu->data_memory[i];
+        }
+    }
+    for (i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        dbg->watched_reg_values[i] = dbg->cpu->regs[i];
+    }
+}
+
+/*
+ * Moves to the state after target cycles without checking stops. Earlier
+ * cycles are restored from the journal, later ones are simulated.
+ */
+static void
+travel_to(APEX_Debugger *dbg, int target)
+{
+    if (target < 0)
+    {
+        target = 0;
+    }
+    if (target < dbg->cycles_done)
+    {
+        if (!dbg->journal)
+        {
+            printf("APEX_DEBUG: Going back needs --history\n");
+            return;
+        }
+        dbg->cycles_done = APEX_journal_rewind(dbg->journal, dbg->cpu, target);
+        dbg->halted = FALSE;
+    }
+
+    while (dbg->cycles_done < target && !dbg->halted)
+    {
+        dbg->halted = step_cycle(dbg);
+        if (dbg->cycle_limit && dbg->cycles_done >= dbg->cycle_limit)
+        {
+            dbg->halted = TRUE;
+        }
+    }
+    reset_watch_values(dbg);
+    print_position(dbg);
+}
+
+/*
+ * Simulates until a stop condition, HALT or the cycle limit. stop_cycle is
+ * a one-off limit used by step, 0 when off.
+ */
+static void
+run_until_stop(APEX_Debugger *dbg, int stop_cycle)
+{
+    APEX_CPU *cpu = dbg->cpu;
+
+    if (dbg->halted)
+    {
+        printf("APEX_DEBUG: The program has halted\n");
+        return;
+    }
+
+    while (TRUE)
+    {
+        int retired = cpu->insn_completed;
+        int stop = FALSE;
+
+        /* Only the latch is saved, the stages overwrite it within the cycle */
+        if (APEX_LATCH(cpu, APEX_STAGE_WRITEBACK)->has_insn)
+        {
+            dbg->retiring = *APEX_LATCH(cpu, APEX_STAGE_WRITEBACK);
+        }
+
+        dbg->halted = step_cycle(dbg);
+
+        if (cpu->insn_completed != retired)
+        {
+            stop = check_retired(dbg, &dbg->retiring);
+        }
+        if (dbg->halted)
+        {
+            if (cpu->fault.type != APEX_FAULT_NONE)
+            {
+                APEX_cpu_write_fault(stdout, cpu);
+            }
+            else
+            {
+                printf("APEX_DEBUG: HALT retired\n");
+            }
+            break;
+        }
+        if (dbg->until_insn && cpu->insn_completed >= dbg->until_insn)
+        {
+            printf("APEX_DEBUG: Reached %d retired instructions\n", dbg->until_insn);
+            dbg->until_insn = 0;
+            stop = TRUE;
+        }
+        if (dbg->until_cycle && dbg->cycles_done >= dbg->until_cycle)
+        {
+            printf("APEX_DEBUG: Reached cycle %d\n", dbg->until_cycle);
+            dbg->until_cycle = 0;
+            stop = TRUE;
+        }
+        if (stop_cycle && dbg->cycles_done >= stop_cycle)
+        {
+            stop = TRUE;
+        }
+        if (dbg->cycle_limit && dbg->cycles_done >= dbg->cycle_limit)
+        {
+            printf("APEX_DEBUG: Cycle limit %d reached\n", dbg->cycle_limit);
+            dbg->halted = TRUE;
+            stop = TRUE;
+        }
+        if (stop)
+        {
+            break;
+        }
+    }
+    print_position(dbg);
+}
+
+/* Parses "R5" or "5" */
+static int
+parse_register(const char *arg)
+{
+    int reg;
+
+    if (!arg)
+    {
+        return -1;
+    }
+    reg = strtol((arg[0] == 'R' || arg[0] == 'r') ? arg + 1 : arg, NULL, 0);
+    return (reg >= 0 && reg < REG_FILE_SIZE) ? reg : -1;
+}
+
+static void
+set_watch(APEX_Debugger *dbg, const char *kind, const char *arg, int on)
+{
+    if (kind && strcmp(kind, "mem") == 0 && arg)
+    {
+        int address = strtol(arg, NULL, 0);
+        unsigned long long bit;
+
+        if (address < 0 || address >= DATA_MEMORY_SIZE)
+        {
+            printf("APEX_DEBUG: Address out of range\n");
+            return;
+        }
+        bit = 1ULL << (address % DEBUG_PAGE_WORDS);
+        if (on)
+        {
+            dbg->watched_words[address / DEBUG_PAGE_WORDS] |= bit;
+            dbg->watched_values[address] = dbg->cpu->data_memory[address];
+        }
+        else
+        {
+            dbg->watched_words[address / DEBUG_PAGE_WORDS] &= ~bit;
+        }
+        return;
+    }
+
+    if (kind && strcmp(kind, "reg") == 0)
+    {
+        int reg = parse_register(arg);
+
+        if (reg < 0)
+        {
+            printf("APEX_DEBUG: Invalid register\n");
+            return;
+        }
+        if (on)
+        {
+            dbg->watched_regs |= 1u << reg;
+            dbg->watched_reg_values[reg] = dbg->cpu->regs[reg];
+        }
+        else
+        {
+            dbg->watched_regs &= ~(1u << reg);
+        }
+        return;
+    }
+    printf("APEX_DEBUG: Usage watch/unwatch mem <address> | reg <Rn>\n");
+}
+
+static void
+set_breakpoint(APEX_Debugger *dbg, const char *arg, int on)
+{
+    int index = arg ? code_index(dbg, strtol(arg, NULL, 0)) : -1;
+
+    if (index < 0)
+    {
+        printf("APEX_DEBUG: No instruction at that pc\n");
+        return;
+    }
+    if (on)
+    {
+        dbg->breakpoints[index / 64] |= 1ULL << (index % 64);
+    }
+    else
+    {
+        dbg->breakpoints[index / 64] &= ~(1ULL << (index % 64));
+    }
+}
+
+static void
+print_info(const APEX_Debugger *dbg)
+{
+    int i;
+
+    print_position(dbg);
+    printf("Breakpoints:");
+    for (i = 0; i < dbg->cpu->code_memory_size; ++i)
+    {
+        if (has_breakpoint(dbg, 4000 + i * 4))
+        {
+            printf(" pc(%d)", 4000 + i * 4);
+        }
+    }
+    printf("\nMemory watchpoints:");
+    for (i = 0; i < DATA_MEMORY_SIZE; ++i)
+    {
+        if ((dbg->watched_words[i / DEBUG_PAGE_WORDS] >> (i % DEBUG_PAGE_WORDS)) & 1)
+        {
+            printf(" MEM[%d]", i);
+        }
+    }
+    printf("\nRegister watchpoints:");
+    for (i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        if ((dbg->watched_regs >> i) & 1)
+        {
+            printf(" R%d", i);
+        }
+    }
+    printf("\n");
+    if (dbg->journal)
+    {
+        printf("History: %zu bytes, %d cycles undoable, snapshots every %d cycles\n",
+               APEX_journal_bytes(dbg->journal), dbg->journal->frames,
+               dbg->journal->snapshot_interval);
+    }
+}
+
+static void
+print_memory(const APEX_Debugger *dbg, const char *arg, const char *count_arg)
+{
+    int address = arg ? strtol(arg, NULL, 0) : 0;
+    int count = count_arg ? strtol(count_arg, NULL, 0) : 1;
+    int i;
+
+    for (i = address; i < address + count && i < DATA_MEMORY_SIZE; ++i)
+    {
+        if (i >= 0)
+        {
+            printf("|           MEM[%d]       |     Data  Value=%d        |\n", i,
+                   dbg->cpu->data_memory[i]);
+        }
+    }
+}
+
+static void
+print_help(void)
+{
+    printf("break <pc> | delete <pc>            Stop when the instruction at pc retires\n");
+    printf("watch mem <address> | reg <Rn>      Stop when the word or register changes\n");
+    printf("unwatch mem <address> | reg <Rn>\n");
+    printf("until cycle <n> | insn <n>          Run to cycle n or n retired instructions\n");
+    printf("continue (c), step [n] (s)          Run to the next stop, or n cycles\n");
+    printf("reverse [n] (rs), goto <cycle>      Go back n cycles, or to a cycle (needs --history)\n");
+    printf("regs, mem <address> [count], pipeline, info, quit (q)\n");
+}
+
+/*
+ * Reads debugger commands from in until quit or end of input, returns TRUE
+ * when the program ran to HALT. history is the byte budget of the undo
+ * journal, 0 to disable reverse stepping.
+ */
+int
+APEX_debugger_run(APEX_CPU *cpu, int cycle_limit, size_t history, FILE *in)
+{
+    APEX_Debugger *dbg;
+    char line[256];
+    int completed;
+
+    dbg = calloc(1, sizeof(APEX_Debugger));
+    if (!dbg)
+    {
+        return FALSE;
+    }
+    dbg->breakpoints = calloc((cpu->code_memory_size + 63) / 64 + 1, sizeof(unsigned long long));
+    if (!dbg->breakpoints)
+    {
+        free(dbg);
+        return FALSE;
+    }
+    dbg->cpu = cpu;
+    dbg->cycle_limit = cycle_limit;
+    if (history)
+    {
+        dbg->journal = APEX_journal_create(cpu, history);
+        if (!dbg->journal)
+        {
+            free(dbg->breakpoints);
+            free(dbg);
+            return FALSE;
+        }
+    }
+    ENABLE_DEBUG_MESSAGES = 0;
+
+    printf("APEX_DEBUG: Type help for commands\n");
+    while (TRUE)
+    {
+        char *command, *arg1, *arg2, *saveptr;
+
+        printf("(apex) ");
+        fflush(stdout);
+        if (!fgets(line, sizeof(line), in))
+        {
+            printf("\n");
+            break;
+        }
+
+        command = strtok_r(line, " \t\r\n", &saveptr);
+        arg1 = strtok_r(NULL, " \t\r\n", &saveptr);
+        arg2 = strtok_r(NULL, " \t\r\n", &saveptr);
+        if (!command)
+        {
+            continue;
+        }
+
+        if (strcmp(command, "quit") == 0 || strcmp(command, "q") == 0)
+        {
+            break;
+        }
+        else if (strcmp(command, "break") == 0 || strcmp(command, "b") == 0)
+        {
+            set_breakpoint(dbg, arg1, TRUE);
+        }
+        else if (strcmp(command, "delete") == 0)
+        {
+            set_breakpoint(dbg, arg1, FALSE);
+        }
+        else if (strcmp(command, "watch") == 0)
+        {
+            set_watch(dbg, arg1, arg2, TRUE);
+        }
+        else if (strcmp(command, "unwatch") == 0)
+        {
+            set_watch(dbg, arg1, arg2, FALSE);
+        }
+        else if (strcmp(command, "until") == 0 && arg1 && arg2)
+        {
+            if (strcmp(arg1, "cycle") == 0)
+            {
+                dbg->until_cycle = strtol(arg2, NULL, 0);
+            }
+            else
+            {
+                dbg->until_insn = strtol(arg2, NULL, 0);
+            }
+            run_until_stop(dbg, 0);
+        }
+        else if (strcmp(command, "continue") == 0 || strcmp(command, "c") == 0)
+        {
+            run_until_stop(dbg, 0);
+        }
+        else if (strcmp(command, "step") == 0 || strcmp(command, "s") == 0)
+        {
+            int count = arg1 ? strtol(arg1, NULL, 0) : 1;
+
+            run_until_stop(dbg, dbg->cycles_done + (count > 0 ? count : 1));
+        }
+        else if (strcmp(command, "reverse") == 0 || strcmp(command, "rs") == 0)
+        {
+            int count = arg1 ? strtol(arg1, NULL, 0) : 1;
+
+            travel_to(dbg, dbg->cycles_done - (count > 0 ? count : 1));
+        }
+        else if (strcmp(command, "goto") == 0 && arg1)
+        {
+            travel_to(dbg, strtol(arg1, NULL, 0));
+        }
+        else if (strcmp(command, "regs") == 0)
+        {
+            printregstate(cpu);
+        }
+        else if (strcmp(command, "mem") == 0)
+        {
+            print_memory(dbg, arg1, arg2);
+        }
+        else if (strcmp(command, "pipeline") == 0)
+        {
+            APEX_cpu_print_pipeline(cpu);
+        }
+        else if (strcmp(command, "info") == 0)
+        {
+            print_info(dbg);
+        }
+        else
+        {
+            print_help();
+        }
+    }
+
+    completed = dbg->halted && cpu->fault.type == APEX_FAULT_NONE
+                && APEX_LATCH(cpu, APEX_STAGE_WRITEBACK)->opcode == OPCODE_HALT;
+    cpu->journal = NULL;
+    APEX_journal_destroy(dbg->journal);
+    free(dbg->breakpoints);
+    free(dbg);
+    return completed;
+}
@@ -0,0 +1,43 @@
+/*
+ * apex_debugger.h
+ * Contains declarations for the breakpoint and watchpoint debugger
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_DEBUGGER_H_
+#define _APEX_DEBUGGER_H_
+
+#include <stdio.h>
+
+#include "apex_cpu.h"
+#include "apex_journal.h"
+
+/* Data memory words per watch page, one bitmap word per page */
+#define DEBUG_PAGE_WORDS 64
+#define DEBUG_PAGES (DATA_MEMORY_SIZE / DEBUG_PAGE_WORDS)
+
+typedef struct APEX_Debugger
+{
+    APEX_CPU *cpu;
+    int cycle_limit;                             /* 0 for none */
+    int cycles_done;                             /* Cycles simulated so far */
+    int halted;                                  /* {TRUE, FALSE} HALT retired */
+
+    unsigned long long *breakpoints;             /* Bit per code memory instruction */
+    unsigned long long watched_words[DEBUG_PAGES]; /* Bit per data memory word */
+    int watched_values[DATA_MEMORY_SIZE];        /* Watched words at the last check */
+    unsigned int watched_regs;                   /* Bit per register */
+    int watched_reg_values[REG_FILE_SIZE];
+
+    int until_cycle;                             /* Stop once reached, 0 when off */
+    int until_insn;
+
+    CPU_Stage retiring;                          /* Writeback latch at the start of the cycle */
+    APEX_Journal *journal;                       /* Undo journal, NULL without --history */
+} APEX_Debugger;
+
+int APEX_debugger_run(APEX_CPU *cpu, int cycle_limit, size_t history, FILE *in);
+
+#endif
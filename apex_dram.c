@@ -0,0 +1,314 @@
+/*
+ * apex_dram.c
+ * Contains the DRAM timing model behind the data memory.
+ *
+ * Data memory words are grouped into bursts of line_words words. Consecutive
+ * bursts are spread over the channels first and the banks of a channel
+ * next, and row_lines bursts of a bank share a row.
+ *
+ * Every cycle each channel issues at most one request from the queue
+ * (FR-FCFS): the oldest request to an open row of a ready bank, otherwise
+ * the oldest request to any ready bank. A request to the open row takes
+ * tCAS, to a precharged bank tRCD + tCAS and to another row tRP + tRCD +
+ * tCAS. Its burst then holds the channel data bus for tBURST cycles, which
+ * caps the bandwidth at line_words words per tBURST cycles per channel.
+ * The bank takes no other command until its burst starts; with the closed
+ * page policy it precharges right after, for tRP more cycles.
+ *
+ * The pipeline ticks the DRAM once per cycle, so blocking accesses, the
+ * fills of outstanding load misses and the drains of the store buffer
+ * compete in the queue, and each of them ends when its burst does.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_dram.h"
+
+void
+APEX_dram_default_config(APEX_DramConfig *config)
+{
+    config->channels = 1;
+    config->banks = 8;
+    config->open_page = TRUE;
+    config->line_words = 4;
+    config->row_lines = 16;
+    config->t_rcd = 4;
+    config->t_cas = 4;
+    config->t_rp = 4;
+    config->t_burst = 2;
+    config->queue_depth = 16;
+}
+
+/*
+ * Reads "channels,banks[,open|closed]", returns FALSE when malformed
+ */
+int
+APEX_dram_parse_geometry(const char *arg, APEX_DramConfig *config)
+{
+    char policy[16] = "open";
+    int fields = sscanf(arg, "%d,%d,%15s", &config->channels, &config->banks, policy);
+
+    if (fields < 2)
+    {
+        return FALSE;
+    }
+    if (strcmp(policy, "open") == 0)
+    {
+        config->open_page = TRUE;
+    }
+    else if (strcmp(policy, "closed") == 0)
+    {
+        config->open_page = FALSE;
+    }
+    else
+    {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Reads "tRCD,tCAS,tRP,tBURST", returns FALSE when malformed
+ */
+int
+APEX_dram_parse_timing(const char *arg, APEX_DramConfig *config)
+{
+    return sscanf(arg, "%d,%d,%d,%d", &config->t_rcd, &config->t_cas, &config->t_rp,
+                  &config->t_burst) == 4;
+}
+
+APEX_Dram *
+APEX_dram_create(const APEX_DramConfig *config)
+{
+    APEX_Dram *dram;
+    int i, j;
+
+    if (config->channels <= 0 || config->channels > APEX_DRAM_MAX_CHANNELS
+        || config->banks <= 0 || config->banks > APEX_DRAM_MAX_BANKS
+        || config->line_words <= 0 || config->row_lines <= 0 || config->t_rcd < 0
+        || config->t_cas <= 0 || config->t_rp < 0 || config->t_burst <= 0
+        || config->queue_depth <= 0 || config->queue_depth > APEX_DRAM_MAX_QUEUE)
+    {
+        return NULL;
+    }
+
+    dram = calloc(1, sizeof(APEX_Dram));
+    if (!dram)
+    {
+        return NULL;
+    }
+    dram->config = *config;
+    for (i = 0; i < APEX_DRAM_MAX_CHANNELS; ++i)
+    {
+        for (j = 0; j < APEX_DRAM_MAX_BANKS; ++j)
+        {
+            dram->banks[i][j].open_row = -1;
+        }
+    }
+    return dram;
+}
+
+void
+APEX_dram_destroy(APEX_Dram *dram)
+{
+    free(dram);
+}
+
+/*
+ * Queues an access arriving at cycle arrival, returns its id, or 0 when
+ * the queue is full
+ */
+long
+APEX_dram_enqueue(APEX_Dram *dram, int address, int is_write, long arrival)
+{
+    const APEX_DramConfig *c = &dram->config;
+    APEX_DramRequest *request;
+    int line = address / c->line_words;
+
+    if (dram->queue_count == c->queue_depth)
+    {
+        dram->stats.queue_full++;
+        return 0;
+    }
+
+    request = &dram->queue[dram->queue_count++];
+    request->id = ++dram->next_id;
+    request->address = address;
+    request->is_write = is_write;
+    request->arrival = arrival;
+    request->channel = line % c->channels;
+    request->bank = (line / c->channels) % c->banks;
+    request->row = line / (c->channels * c->banks) / c->row_lines;
+
+    if (dram->queue_count > dram->stats.queue_peak)
+    {
+        dram->stats.queue_peak = dram->queue_count;
+    }
+    if (dram->record)
+    {
+        fprintf(dram->record, "%ld %c %d\n", arrival, is_write ? 'W' : 'R', address);
+    }
+    return request->id;
+}
+
+/*
+ * FR-FCFS pick for a channel, -1 when no request can issue this cycle
+ */
+static int
+pick_request(const APEX_Dram *dram, int channel)
+{
+    int oldest = -1;
+    int i;
+
+    for (i = 0; i < dram->queue_count; ++i)
+    {
+        const APEX_DramRequest *request = &dram->queue[i];
+        const APEX_DramBank *bank = &dram->banks[channel][request->bank];
+
+        if (request->channel != channel || request->arrival > dram->clock
+            || bank->ready_cycle > dram->clock)
+        {
+            continue;
+        }
+        if (bank->open_row == request->row)
+        {
+            return i;
+        }
+        if (oldest < 0)
+        {
+            oldest = i;
+        }
+    }
+    return oldest;
+}
+
+static void
+issue(APEX_Dram *dram, int index)
+{
+    const APEX_DramConfig *c = &dram->config;
+    APEX_DramRequest request = dram->queue[index];
+    APEX_DramBank *bank = &dram->banks[request.channel][request.bank];
+    long data_start, done;
+    int access;
+
+    if (bank->open_row == request.row)
+    {
+        access = c->t_cas;
+        dram->stats.row_hits++;
+    }
+    else if (bank->open_row < 0)
+    {
+        access = c->t_rcd + c->t_cas;
+        dram->stats.row_empty++;
+    }
+    else
+    {
+        access = c->t_rp + c->t_rcd + c->t_cas;
+        dram->stats.row_conflicts++;
+    }
+
+    data_start = dram->clock + access;
+    if (data_start < dram->bus_free[request.channel])
+    {
+        data_start = dram->bus_free[request.channel];
+    }
+    done = data_start + c->t_burst;
+    dram->bus_free[request.channel] = done;
+
+    if (c->open_page)
+    {
+        bank->open_row = request.row;
+        bank->ready_cycle = data_start;
+    }
+    else
+    {
+        bank->open_row = -1;
+        bank->ready_cycle = data_start + c->t_rp;
+    }
+
+    if (request.is_write)
+    {
+        dram->stats.writes++;
+    }
+    else
+    {
+        dram->stats.reads++;
+    }
+    dram->stats.queue_cycles += dram->clock - request.arrival;
+    dram->stats.latency_cycles += done - request.arrival;
+    dram->stats.bus_cycles += c->t_burst;
+    dram->last_done = done;
+    dram->done[request.id % APEX_DRAM_MAX_QUEUE] = done;
+
+    memmove(&dram->queue[index], &dram->queue[index + 1],
+            sizeof(APEX_DramRequest) * (dram->queue_count - index - 1));
+    dram->queue_count--;
+}
+
+/*
+ * Schedules cycle dram->clock, every channel issues at most one request
+ */
+void
+APEX_dram_tick(APEX_Dram *dram)
+{
+    int channel;
+
+    for (channel = 0; channel < dram->config.channels; ++channel)
+    {
+        int index = pick_request(dram, channel);
+
+        if (index >= 0)
+        {
+            issue(dram, index);
+        }
+    }
+    dram->clock++;
+}
+
+/*
+ * Returns the cycle the burst of request id ends, -1 while it is queued.
+ * Only the last APEX_DRAM_MAX_QUEUE requests issued are remembered, so the
+ * caller asks right after every tick.
+ */
+long
+APEX_dram_done(const APEX_Dram *dram, long id)
+{
+    int i;
+
+    for (i = 0; i < dram->queue_count; ++i)
+    {
+        if (dram->queue[i].id == id)
+        {
+            return -1;
+        }
+    }
+    return dram->done[id % APEX_DRAM_MAX_QUEUE];
+}
+
+void
+APEX_dram_print_stats(const APEX_Dram *dram)
+{
+    const APEX_DramConfig *c = &dram->config;
+    const APEX_DramStats *s = &dram->stats;
+    long requests = s->reads + s->writes;
+    long cycles = dram->last_done > dram->clock ? dram->last_done : dram->clock;
+
+    printf("APEX_DRAM: %d channel(s) x %d banks, %s page, tRCD %d tCAS %d tRP %d tBURST %d\n",
+           c->channels, c->banks, c->open_page ? "open" : "closed", c->t_rcd, c->t_cas, c->t_rp,
+           c->t_burst);
+    printf("APEX_DRAM: %ld reads, %ld writes, row hits %.2f%% (%ld hits, %ld empty, %ld conflicts)\n",
+           s->reads, s->writes, requests ? 100.0 * s->row_hits / requests : 0.0, s->row_hits,
+           s->row_empty, s->row_conflicts);
+    printf("APEX_DRAM: Average queueing delay %.2f, average latency %.2f, queue peak %ld, "
+           "%ld retries with the queue full\n",
+           requests ? (double)s->queue_cycles / requests : 0.0,
+           requests ? (double)s->latency_cycles / requests : 0.0, s->queue_peak, s->queue_full);
+    printf("APEX_DRAM: Data bus utilization %.2f%% over %ld cycles, %.2f words per cycle\n",
+           cycles ? 100.0 * s->bus_cycles / ((double)cycles * c->channels) : 0.0, cycles,
+           cycles ? (double)requests * c->line_words / cycles : 0.0);
+}
@@ -0,0 +1,90 @@
+/*
+ * apex_dram.h
+ * Contains declarations for the DRAM timing model behind the data memory
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_DRAM_H_
+#define _APEX_DRAM_H_
+
+#include <stdio.h>
+
+#include "apex_macros.h"
+
+#define APEX_DRAM_MAX_CHANNELS 8
+#define APEX_DRAM_MAX_BANKS 32
+#define APEX_DRAM_MAX_QUEUE 256
+
+typedef struct APEX_DramConfig
+{
+    int channels;
+    int banks;          /* Per channel */
+    int open_page;      /* {TRUE, FALSE} Keep rows open, FALSE precharges after every access */
+    int line_words;     /* Data memory words moved per burst */
+    int row_lines;      /* Bursts per row */
+    int t_rcd;          /* Activate to column command */
+    int t_cas;          /* Column command to data */
+    int t_rp;           /* Precharge */
+    int t_burst;        /* Cycles a burst holds the channel data bus */
+    int queue_depth;    /* Requests waiting over all channels */
+} APEX_DramConfig;
+
+typedef struct APEX_DramBank
+{
+    int open_row;       /* -1 when precharged */
+    long ready_cycle;   /* First cycle the bank takes a command */
+} APEX_DramBank;
+
+typedef struct APEX_DramRequest
+{
+    long id;
+    int address;
+    int is_write;
+    long arrival;
+    int channel;
+    int bank;
+    int row;
+} APEX_DramRequest;
+
+typedef struct APEX_DramStats
+{
+    long reads;
+    long writes;
+    long row_hits;      /* Row already open */
+    long row_empty;     /* Bank precharged, activate only */
+    long row_conflicts; /* Other row open, precharge and activate */
+    long queue_cycles;  /* Cycles from arrival to the first command */
+    long latency_cycles;/* Cycles from arrival to the end of the burst */
+    long bus_cycles;    /* Data bus busy cycles over all channels */
+    long queue_full;    /* Enqueues turned away with the queue full */
+    long queue_peak;
+} APEX_DramStats;
+
+typedef struct APEX_Dram
+{
+    APEX_DramConfig config;
+    APEX_DramBank banks[APEX_DRAM_MAX_CHANNELS][APEX_DRAM_MAX_BANKS];
+    long bus_free[APEX_DRAM_MAX_CHANNELS]; /* First cycle the data bus is idle */
+    APEX_DramRequest queue[APEX_DRAM_MAX_QUEUE]; /* Oldest first */
+    int queue_count;
+    long clock;         /* Next cycle to schedule */
+    long last_done;     /* Cycle the last scheduled burst ends */
+    long next_id;       /* Id of the last request queued */
+    long done[APEX_DRAM_MAX_QUEUE]; /* Burst end of recently issued requests, by id */
+    FILE *record;       /* Requests written as an address trace, NULL when off */
+    APEX_DramStats stats;
+} APEX_Dram;
+
+void APEX_dram_default_config(APEX_DramConfig *config);
+int APEX_dram_parse_geometry(const char *arg, APEX_DramConfig *config);
+int APEX_dram_parse_timing(const char *arg, APEX_DramConfig *config);
+APEX_Dram *APEX_dram_create(const APEX_DramConfig *config);
+void APEX_dram_destroy(APEX_Dram *dram);
+long APEX_dram_enqueue(APEX_Dram *dram, int address, int is_write, long arrival);
+void APEX_dram_tick(APEX_Dram *dram);
+long APEX_dram_done(const APEX_Dram *dram, long id);
+void APEX_dram_print_stats(const APEX_Dram *dram);
+
+#endif
@@ -0,0 +1,241 @@
+/*
+ * apex_dramsim.c
+ * Contains a standalone driver of the DRAM model for tuning it over a
+ * recorded address trace.
+ *
+ * The trace is either a text file with one "<cycle> <R|W> <address>" line
+ * per request in cycle order, as written by apex_sim --dram-trace, or a
+ * committed instruction trace written by apex_sim --trace, whose LOAD/LDR
+ * and STORE/STR arrive --cpi cycles per instruction apart. Requests that
+ * find the queue full retry every cycle.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_dram.h"
+#include "apex_isa.h"
+#include "apex_trace.h"
+
+typedef struct DramsimRequest
+{
+    long arrival;
+    int is_write;
+    int address;
+} DramsimRequest;
+
+static void
+print_usage(const char *prog)
+{
+    fprintf(stderr, "APEX_Help: Usage %s <trace_file> [options]\n", prog);
+    fprintf(stderr, "    --dram <c,b[,policy]>   Channels, banks per channel, open or closed page (default 1,8,open)\n");
+    fprintf(stderr, "    --dram-timing <t>       tRCD,tCAS,tRP,tBURST in cycles (default 4,4,4,2)\n");
+    fprintf(stderr, "    --line-words <n>        Data memory words per burst (default 4)\n");
+    fprintf(stderr, "    --row-lines <n>         Bursts per row (default 16)\n");
+    fprintf(stderr, "    --queue <n>             Request queue entries (default 16)\n");
+    fprintf(stderr, "    --cpi <n>               Cycles per instruction of a committed instruction trace (default 1)\n");
+}
+
+/*
+ * Reads the LOAD/STORE of a committed instruction trace, NULL when the file
+ * is not one
+ */
+static DramsimRequest *
+load_instruction_trace(const char *filename, int cpi, int *count)
+{
+    APEX_TraceHeader header;
+    APEX_TraceRecord *records;
+    DramsimRequest *requests;
+    int num_records, i;
+
+    *count = 0;
+    records = APEX_trace_load(filename, &num_records, &header);
+    if (!records)
+    {
+        return NULL;
+    }
+
+    requests = calloc(num_records ? num_records : 1, sizeof(DramsimRequest));
+    if (!requests)
+    {
+        free(records);
+        return NULL;
+    }
+
+    for (i = 0; i < num_records; ++i)
+    {
+        if (APEX_opcode_is_load(records[i].opcode) || APEX_opcode_is_store(records[i].opcode))
+        {
+            requests[*count].arrival = (long)i * cpi;
+            requests[*count].is_write = APEX_opcode_is_store(records[i].opcode);
+            requests[*count].address = records[i].memory_address;
+            (*count)++;
+        }
+    }
+    free(records);
+    return requests;
+}
+
+/*
+ * Reads a text address trace, NULL on a malformed line
+ */
+static DramsimRequest *
+load_address_trace(const char *filename, int *count)
+{
+    FILE *fp = fopen(filename, "r");
+    DramsimRequest *requests = NULL;
+    int capacity = 0;
+    char line[128];
+    int line_number = 0;
+
+    *count = 0;
+    if (!fp)
+    {
+        return NULL;
+    }
+
+    while (fgets(line, sizeof(line), fp))
+    {
+        DramsimRequest request;
+        char kind;
+
+        line_number++;
+        if (line[0] == '#' || line[0] == '\n')
+        {
+            continue;
+        }
+        if (sscanf(line, "%ld %c %d", &request.arrival, &kind, &request.address) != 3
+            || (kind != 'R' && kind != 'W')
+            || (*count > 0 && request.arrival < requests[*count - 1].arrival))
+        {
+            fprintf(stderr, "APEX_Error: %s:%d is not \"<cycle> <R|W> <address>\" in cycle order\n",
+                    filename, line_number);
+            free(requests);
+            fclose(fp);
+            return NULL;
+        }
+        request.is_write = (kind == 'W');
+
+        if (*count == capacity)
+        {
+            DramsimRequest *grown;
+
+            capacity = capacity ? capacity * 2 : 1024;
+            grown = realloc(requests, capacity * sizeof(DramsimRequest));
+            if (!grown)
+            {
+                free(requests);
+                fclose(fp);
+                return NULL;
+            }
+            requests = grown;
+        }
+        requests[(*count)++] = request;
+    }
+    fclose(fp);
+    return requests ? requests : calloc(1, sizeof(DramsimRequest));
+}
+
+int main(int argc, char const *argv[])
+{
+    APEX_DramConfig config;
+    APEX_Dram *dram;
+    DramsimRequest *requests;
+    int count = 0, next = 0;
+    int cpi = 1;
+    int i;
+
+    if (argc < 2)
+    {
+        print_usage(argv[0]);
+        exit(1);
+    }
+
+    APEX_dram_default_config(&config);
+    for (i = 2; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--dram") == 0 && i + 1 < argc
+            && APEX_dram_parse_geometry(argv[i + 1], &config))
+        {
+            i++;
+        }
+        else if (strcmp(argv[i], "--dram-timing") == 0 && i + 1 < argc
+                 && APEX_dram_parse_timing(argv[i + 1], &config))
+        {
+            i++;
+        }
+        else if (strcmp(argv[i], "--line-words") == 0 && i + 1 < argc)
+        {
+            config.line_words = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--row-lines") == 0 && i + 1 < argc)
+        {
+            config.row_lines = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--queue") == 0 && i + 1 < argc)
+        {
+            config.queue_depth = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--cpi") == 0 && i + 1 < argc)
+        {
+            cpi = strtol(argv[++i], NULL, 0);
+        }
+        else
+        {
+            print_usage(argv[0]);
+            exit(1);
+        }
+    }
+    if (cpi <= 0)
+    {
+        print_usage(argv[0]);
+        exit(1);
+    }
+
+    dram = APEX_dram_create(&config);
+    if (!dram)
+    {
+        fprintf(stderr, "APEX_Error: Invalid DRAM configuration, at most %d channels, %d banks "
+                "and %d queue entries\n", APEX_DRAM_MAX_CHANNELS, APEX_DRAM_MAX_BANKS,
+                APEX_DRAM_MAX_QUEUE);
+        exit(1);
+    }
+
+    requests = load_instruction_trace(argv[1], cpi, &count);
+    if (!requests)
+    {
+        requests = load_address_trace(argv[1], &count);
+    }
+    if (!requests)
+    {
+        fprintf(stderr, "APEX_Error: Unable to read trace %s\n", argv[1]);
+        APEX_dram_destroy(dram);
+        exit(1);
+    }
+
+    while (next < count || dram->queue_count > 0)
+    {
+        if (dram->queue_count == 0 && next < count && requests[next].arrival > dram->clock)
+        {
+            dram->clock = requests[next].arrival;
+        }
+        while (next < count && requests[next].arrival <= dram->clock
+               && APEX_dram_enqueue(dram, requests[next].address, requests[next].is_write,
+                                    requests[next].arrival))
+        {
+            next++;
+        }
+        APEX_dram_tick(dram);
+    }
+
+    printf("APEX_DRAM: %d requests from %s\n", count, argv[1]);
+    APEX_dram_print_stats(dram);
+
+    free(requests);
+    APEX_dram_destroy(dram);
+    return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * apex_functional.c
+ * Contains a functional model of APEX that executes one instruction at a time
+ * without any pipeline timing. It is used to fast-forward programs and to
+ * produce the architectural state the pipeline model starts from.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <string.h>
+
+#include "apex_functional.h"
+#include "apex_isa.h"
+
+void
+APEX_functional_init(APEX_ArchState *state)
+{
+    memset(state, 0, sizeof(*state));
+    state->pc = 4000;
+}
+
+/* Stores an ALU result and updates zero_flag like APEX_execute */
+static void
+write_alu_result(APEX_ArchState *state, int rd, int value)
+{
+    state->regs[rd] = value;
+    state->zero_flag = (value == 0) ? TRUE : FALSE;
+}
+
+static int
+valid_data_address(int address)
+{
+    return (address >= 0 && address < DATA_MEMORY_SIZE);
+}
+
+/*
+ * Executes the instruction at state->pc, returns FALSE once the program
+ * has halted or faulted
+ */
+int
+APEX_functional_step(APEX_ArchState *state, const APEX_Instruction *code_memory,
+                     int code_memory_size)
+{
+    const APEX_Instruction *ins;
+    int srcs[APEX_MAX_SOURCES];
+    int index = (state->pc - 4000) / 4;
+    int next_pc = state->pc + 4;
+    int *regs = state->regs;
+    int nsrcs, address, i;
+
+    if (state->halted || state->fault)
+    {
+        return FALSE;
+    }
+
+    if (state->pc < 4000 || (state->pc - 4000) % 4 != 0 || index >= code_memory_size)
+    {
+        state->fault = TRUE;
+        return FALSE;
+    }
+
+    ins = &code_memory[index];
+    nsrcs = APEX_opcode_sources(ins->opcode, ins->rs1, ins->rs2, ins->rs3, srcs);
+    for (i = 0; i < nsrcs; ++i)
+    {
+        if (srcs[i] < 0 || srcs[i] >= REG_FILE_SIZE)
+        {
+            state->fault = TRUE;
+            return FALSE;
+        }
+    }
+    if (APEX_opcode_writes_rd(ins->opcode) && (ins->rd < 0 || ins->rd >= REG_FILE_SIZE))
+    {
+        state->fault = TRUE;
+        return FALSE;
+    }
+
+    switch (ins->opcode)
+    {
+    case OPCODE_ADD:
+    {
+        write_alu_result(state, ins->rd, regs[ins->rs1] + regs[ins->rs2]);
+        break;
+    }
+    case OPCODE_SUB:
+    {
+        write_alu_result(state, ins->rd, regs[ins->rs1] - regs[ins->rs2]);
+        break;
+    }
+    case OPCODE_MUL:
+    {
+        write_alu_result(state, ins->rd, regs[ins->rs1] * regs[ins->rs2]);
+        break;
+    }
+    case OPCODE_DIV:
+    {
+        if (regs[ins->rs2] == 0)
+        {
+            state->fault = TRUE;
+            return FALSE;
+        }
+        /* INT_MIN / -1 wraps like APEX_execute */
+        if (regs[ins->rs2] == -1)
+        {
+            write_alu_result(state, ins->rd, (int)(0u - (unsigned int)regs[ins->rs1]));
+        }
+        else
+        {
+            write_alu_result(state, ins->rd, regs[ins->rs1] / regs[ins->rs2]);
+        }
+        break;
+    }
+    case OPCODE_AND:
+    {
+        write_alu_result(state, ins->rd, regs[ins->rs1] & regs[ins->rs2]);
+        break;
+    }
+    case OPCODE_OR:
+    {
+        write_alu_result(state, ins->rd, regs[ins->rs1] | regs[ins->rs2]);
+        break;
+    }
+    case OPCODE_XOR:
+    {
+        write_alu_result(state, ins->rd, regs[ins->rs1] ^ regs[ins->rs2]);
+        break;
+    }
+    case OPCODE_ADDL:
+    {
+        write_alu_result(state, ins->rd, regs[ins->rs1] + ins->imm);
+        break;
+    }
+    case OPCODE_SUBL:
+    {
+        write_alu_result(state, ins->rd, regs[ins->rs1] - ins->imm);
+        break;
+    }
+    case OPCODE_CMP:
+    {
+        state->zero_flag = (regs[ins->rs1] == regs[ins->rs2]) ? TRUE : FALSE;
+        break;
+    }
+    case OPCODE_MOVC:
+    {
+        regs[ins->rd] = ins->imm;
+        break;
+    }
+    case OPCODE_LOAD:
+    case OPCODE_LDR:
+    {
+        address = regs[ins->rs1] + ((ins->opcode == OPCODE_LOAD) ? ins->imm : regs[ins->rs2]);
+        if (!valid_data_address(address))
+        {
+            state->fault = TRUE;
+            return FALSE;
+        }
+        regs[ins->rd] = state->data_memory[address];
+        break;
+    }
+    case OPCODE_STORE:
+    case OPCODE_STR:
+    {
+        address = regs[ins->rs2] + ((ins->opcode == OPCODE_STORE) ? ins->imm : regs[ins->rs3]);
+        if (!valid_data_address(address))
+        {
+            state->fault = TRUE;
+            return FALSE;
+        }
+        state->data_memory[address] = regs[ins->rs1];
+        state->dirty[address / 64] |= 1ULL << (address % 64);
+        break;
+    }
+    case OPCODE_BZ:
+    case OPCODE_BNZ:
+    {
+        if ((ins->opcode == OPCODE_BZ) == (state->zero_flag == TRUE))
+        {
+            next_pc = state->pc + ins->imm;
+        }
+        break;
+    }
+    case OPCODE_HALT:
+    {
+        state->halted = TRUE;
+        break;
+    }
+    case OPCODE_NOP:
+    {
+        break;
+    }
+    }
+
+    /* Writeback marks the rd field valid for every retiring instruction */
+    if (ins->rd >= 0 && ins->rd < REG_FILE_SIZE)
+    {
+        state->regs_valid[ins->rd] = TRUE;
+    }
+
+    state->retired++;
+    state->pc = next_pc;
+    return !state->halted;
+}
+
+/*
+ * Executes up to max_insns instructions (all when max_insns <= 0), returns
+ * the number executed
+ */
+int
+APEX_functional_run(APEX_ArchState *state, const APEX_Instruction *code_memory,
+                    int code_memory_size, int max_insns)
+{
+    int start = state->retired;
+
+    while (max_insns <= 0 || state->retired - start < max_insns)
+    {
+        if (!APEX_functional_step(state, code_memory, code_memory_size))
+        {
+            break;
+        }
+    }
+    return state->retired - start;
+}
+
+/*
+ * Starts a pipeline from an architectural state, the pipeline itself is empty
+ */
+void
+APEX_functional_load_cpu(APEX_CPU *cpu, const APEX_ArchState *state)
+{
+    cpu->pc = state->pc;
+    memcpy(cpu->regs, state->regs, sizeof(cpu->regs));
+    memcpy(cpu->regs_valid_check, state->regs_valid, sizeof(cpu->regs_valid_check));
+    memcpy(cpu->data_memory, state->data_memory, sizeof(int) * DATA_MEMORY_SIZE);
+    memcpy(cpu->dirty, state->dirty, sizeof(cpu->dirty));
+    cpu->zero_flag = state->zero_flag;
+    cpu->digest = APEX_state_digest(cpu);
+}
@@ -0,0 +1,35 @@
+/*
+ * apex_functional.h
+ * Contains declarations for the functional (instruction at a time) APEX model
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_FUNCTIONAL_H_
+#define _APEX_FUNCTIONAL_H_
+
+#include "apex_cpu.h"
+
+/* Architectural state between two instructions */
+typedef struct APEX_ArchState
+{
+    int pc;
+    int regs[REG_FILE_SIZE];
+    int regs_valid[REG_FILE_SIZE];     /* Mirrors regs_valid_check after writeback */
+    int zero_flag;
+    int data_memory[DATA_MEMORY_SIZE];
+    unsigned long long dirty[DATA_MEMORY_BITMAP_WORDS]; /* Bit per data memory word stored to */
+    int retired;                       /* Instructions executed, HALT included */
+    int halted;                        /* {TRUE, FALSE} HALT executed */
+    int fault;                         /* {TRUE, FALSE} PC or data address out of range, or DIV by zero */
+} APEX_ArchState;
+
+void APEX_functional_init(APEX_ArchState *state);
+int APEX_functional_step(APEX_ArchState *state, const APEX_Instruction *code_memory,
+                         int code_memory_size);
+int APEX_functional_run(APEX_ArchState *state, const APEX_Instruction *code_memory,
+                        int code_memory_size, int max_insns);
+void APEX_functional_load_cpu(APEX_CPU *cpu, const APEX_ArchState *state);
+
+#endif
@@ -0,0 +1,639 @@
+/*
+ * apex_fuzz.c
+ * Contains a differential fuzzer of the pipeline model.
+ *
+ * Random programs from apex_proggen are run on the pipeline and on the
+ * functional model, which executes one instruction at a time and serves as
+ * the reference. The final registers, register valid bits, zero flag, data
+ * memory, stored words, retired count and the way the run ended (HALT or
+ * fault) must match. Each program also gets a random memory latency, and
+ * every fourth one a private L1, so the timing differs while the results
+ * must not. Everything runs in process on one reused CPU.
+ *
+ * Mismatching programs are written to the --save directory together with
+ * the apex_sim command line that reproduces them.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "apex_cache.h"
+#include "apex_cpu.h"
+#include "apex_dram.h"
+#include "apex_functional.h"
+#include "apex_prefetch.h"
+#include "apex_proggen.h"
+#include "apex_watchdog.h"
+
+/* Cycles without a retirement before a pipeline run counts as hung */
+#define FUZZ_WATCHDOG 2000
+
+/* Instructions after which the reference run gives up */
+#define FUZZ_MAX_INSNS 1000000
+
+typedef struct FuzzTiming
+{
+    int memory_latency;
+    int use_l1;
+    APEX_CacheConfig l1_config;
+    int fusion;
+    int store_buffer;
+    int mshrs;
+    APEX_PrefetchConfig prefetch_config; /* Only with an L1 */
+    int use_dram;                        /* Only without a prefetcher */
+    APEX_DramConfig dram_config;
+    int fetch_queue;
+    int use_icache;                      /* Only with a fetch queue */
+    APEX_CacheConfig icache_config;
+    int loop_buffer;
+    int fetch_stages;
+    int execute_stages;
+    int memory_stages;
+} FuzzTiming;
+
+typedef struct FuzzStats
+{
+    long programs;
+    long halted;
+    long faulted;
+    long mismatches;
+    long instructions;
+    long cycles;
+} FuzzStats;
+
+static void
+print_usage(const char *prog)
+{
+    fprintf(stderr, "APEX_Help: Usage %s [options]\n", prog);
+    fprintf(stderr, "    --count <n>             Programs to run (default 10000)\n");
+    fprintf(stderr, "    --seed <n>              Seed of the first program, program i uses seed + i (default 1)\n");
+    fprintf(stderr, "    --length <n>            Body instructions per program (default 48)\n");
+    fprintf(stderr, "    --dep-distance <n>      Sources read up to n producers back (default 3)\n");
+    fprintf(stderr, "    --dep-percent <n>       Chance a source is a recent producer (default 60)\n");
+    fprintf(stderr, "    --mem <n>               Percent of LOAD/LDR/STORE/STR (default 25)\n");
+    fprintf(stderr, "    --branch <n>            Percent of forward BZ/BNZ (default 8)\n");
+    fprintf(stderr, "    --loops <n>             Percent of blocks that are counted loops (default 30)\n");
+    fprintf(stderr, "    --trips <n>             Most iterations of a loop (default 8)\n");
+    fprintf(stderr, "    --div <n>               Percent of DIV (default 2)\n");
+    fprintf(stderr, "    --div-zero <n>          Percent of DIV whose divisor may be zero (default 0)\n");
+    fprintf(stderr, "    --faults <n>            Percent of LOAD/STORE outside data memory (default 0)\n");
+    fprintf(stderr, "    --save <dir>            Write mismatching programs to dir\n");
+    fprintf(stderr, "    --max-failures <n>      Stop after n mismatches (default 10)\n");
+    fprintf(stderr, "    --emit <file>           Write the program for --seed to file and exit\n");
+}
+
+static double
+host_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Memory timing of a program, derived from its seed so a failure reproduces */
+static void
+pick_timing(unsigned long long seed, FuzzTiming *timing)
+{
+    unsigned long long x = seed * 0x9e3779b97f4a7c15ULL;
+
+    x ^= x >> 29;
+    timing->memory_latency = 1 + (int)(x % 4);
+    timing->use_l1 = ((x >> 8) % 4 == 0);
+    APEX_cache_default_config(&timing->l1_config);
+    timing->l1_config.miss_latency = 2 + (int)((x >> 16) % 11);
+    timing->fusion = ((x >> 24) % 2 == 0);
+    timing->store_buffer = ((x >> 32) % 2 == 0) ? 1 + (int)((x >> 40) % 8) : 0;
+    timing->mshrs = ((x >> 44) % 2 == 0) ? 1 + (int)((x >> 48) % 4) : 0;
+    APEX_prefetch_default_config(&timing->prefetch_config);
+    if (timing->use_l1)
+    {
+        timing->prefetch_config.kind = (int)((x >> 52) % 3);
+        timing->prefetch_config.degree = 1 + (int)((x >> 56) % 4);
+        timing->prefetch_config.distance = 1 + (int)((x >> 60) % 4);
+    }
+    APEX_dram_default_config(&timing->dram_config);
+    timing->use_dram = ((x >> 12) % 3 == 0 && timing->prefetch_config.kind == APEX_PREFETCH_NONE);
+    timing->dram_config.channels = 1 + (int)((x >> 14) % 2);
+    timing->dram_config.banks = 2 << (int)((x >> 36) % 3);
+    timing->dram_config.open_page = ((x >> 18) % 2 == 0);
+    timing->fetch_queue = ((x >> 20) % 2 == 0) ? 1 + (int)((x >> 22) % 8) : 0;
+    timing->use_icache = (timing->fetch_queue > 0 && (x >> 26) % 2 == 0);
+
+    /* Small enough to miss on generated programs */
+    APEX_cache_default_config(&timing->icache_config);
+    timing->icache_config.sets = 4;
+    timing->icache_config.ways = 1 + (int)((x >> 28) % 2);
+    timing->icache_config.miss_latency = 2 + (int)((x >> 30) % 6);
+    timing->loop_buffer = ((x >> 62) % 2 == 0) ? 1 + (int)((x >> 4) % 16) : 0;
+
+    /* Out of bits, the depths come from a second mix of the seed */
+    x = (seed + 1) * 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 31;
+    timing->fetch_stages = ((x >> 8) % 2 == 0) ? 1 + (int)((x >> 10) % APEX_STAGES_MAX) : 1;
+    timing->execute_stages = ((x >> 16) % 2 == 0) ? 1 + (int)((x >> 18) % APEX_STAGES_MAX) : 1;
+    timing->memory_stages = ((x >> 24) % 2 == 0) ? 1 + (int)((x >> 26) % APEX_STAGES_MAX) : 1;
+}
+
+/*
+ * Sets cpu up for the program and, when run is TRUE, runs it until it
+ * stops. Returns FALSE when the pipeline could not be set up.
+ */
+static int
+run_pipeline(APEX_CPU *cpu, APEX_Instruction *code_memory, int size, const FuzzTiming *timing,
+             int run)
+{
+    APEX_cpu_reset(cpu, code_memory, size);
+    cpu->single_step = FALSE;
+    cpu->memory_latency = timing->memory_latency;
+    cpu->fusion = timing->fusion;
+    cpu->store_buffer_depth = timing->store_buffer;
+    cpu->num_mshrs = timing->mshrs;
+    cpu->fetch_queue_depth = timing->fetch_queue;
+    cpu->loop_buffer_size = timing->loop_buffer;
+    APEX_cpu_set_depth(cpu, timing->fetch_stages, timing->execute_stages, timing->memory_stages);
+    if (timing->use_l1)
+    {
+        cpu->l1 = APEX_cache_create(&timing->l1_config, 0, NULL);
+        if (!cpu->l1)
+        {
+            return FALSE;
+        }
+    }
+    if (timing->prefetch_config.kind != APEX_PREFETCH_NONE)
+    {
+        cpu->prefetcher = APEX_prefetch_create(&timing->prefetch_config);
+        if (!cpu->prefetcher)
+        {
+            return FALSE;
+        }
+    }
+    if (timing->use_icache)
+    {
+        cpu->icache = APEX_cache_create(&timing->icache_config, 0, NULL);
+        if (!cpu->icache)
+        {
+            return FALSE;
+        }
+    }
+    if (timing->use_dram)
+    {
+        cpu->dram = APEX_dram_create(&timing->dram_config);
+        if (!cpu->dram)
+        {
+            return FALSE;
+        }
+    }
+    cpu->watchdog = APEX_watchdog_create(FUZZ_WATCHDOG);
+    if (!cpu->watchdog)
+    {
+        return FALSE;
+    }
+
+    while (run && !APEX_cpu_step(cpu))
+    {
+        cpu->clock++;
+    }
+    return TRUE;
+}
+
+/*
+ * Compares the pipeline with the reference, returns FALSE and describes the
+ * first difference in why
+ */
+static int
+compare_states(const APEX_CPU *cpu, const APEX_ArchState *ref, char *why, size_t why_size)
+{
+    int i;
+
+    if (cpu->fault.type == APEX_FAULT_DEADLOCK || cpu->fault.type == APEX_FAULT_LIVELOCK)
+    {
+        snprintf(why, why_size, "pipeline stopped by the watchdog (fault %d) at pc(%d)",
+                 cpu->fault.type, cpu->fault.pc);
+        return FALSE;
+    }
+    if ((cpu->fault.type != APEX_FAULT_NONE) != (ref->fault != FALSE))
+    {
+        snprintf(why, why_size, "pipeline %s, reference %s",
+                 cpu->fault.type != APEX_FAULT_NONE ? "faulted" : "halted",
+                 ref->fault ? "faulted" : "halted");
+        return FALSE;
+    }
+    if (cpu->fault.type != APEX_FAULT_NONE && cpu->fault.type != APEX_FAULT_BRANCH
+        && cpu->fault.pc != ref->pc)
+    {
+        snprintf(why, why_size, "pipeline faulted at pc(%d), reference at pc(%d)", cpu->fault.pc,
+                 ref->pc);
+        return FALSE;
+    }
+    if (cpu->insn_completed != ref->retired)
+    {
+        snprintf(why, why_size, "pipeline retired %d instructions, reference %d",
+                 cpu->insn_completed, ref->retired);
+        return FALSE;
+    }
+    for (i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        if (cpu->regs[i] != ref->regs[i])
+        {
+            snprintf(why, why_size, "R%d is %d in the pipeline, %d in the reference", i,
+                     cpu->regs[i], ref->regs[i]);
+            return FALSE;
+        }
+        if (cpu->regs_valid_check[i] != ref->regs_valid[i])
+        {
+            snprintf(why, why_size, "R%d valid bit is %d in the pipeline, %d in the reference", i,
+                     cpu->regs_valid_check[i], ref->regs_valid[i]);
+            return FALSE;
+        }
+    }
+    if (cpu->zero_flag != ref->zero_flag)
+    {
+        snprintf(why, why_size, "zero flag is %d in the pipeline, %d in the reference",
+                 cpu->zero_flag, ref->zero_flag);
+        return FALSE;
+    }
+    for (i = 0; i < DATA_MEMORY_SIZE; ++i)
+    {
+        if (cpu->data_memory[i] != ref->data_memory[i])
+        {
+            snprintf(why, why_size, "MEM[%d] is %d in the pipeline, %d in the reference", i,
+                     cpu->data_memory[i], ref->data_memory[i]);
+            return FALSE;
+        }
+    }
+    if (memcmp(cpu->dirty, ref->dirty, sizeof(cpu->dirty)) != 0)
+    {
+        snprintf(why, why_size, "stored words differ");
+        return FALSE;
+    }
+    if (cpu->digest != APEX_state_digest(cpu))
+    {
+        snprintf(why, why_size, "incremental state digest differs from a full recompute");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* TRUE when a retired load to reg still has its miss outstanding */
+static int
+load_outstanding(const APEX_CPU *cpu, int reg)
+{
+    int i;
+
+    for (i = 0; i < cpu->mshr_count; ++i)
+    {
+        if (cpu->mshrs[i].rd == reg)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Re-runs a mismatching program with the reference stepped once per
+ * retirement and prints the first retired instruction whose register
+ * result differs
+ */
+static void
+print_first_divergence(APEX_CPU *cpu, APEX_Instruction *code_memory, int size,
+                       const FuzzTiming *timing, APEX_ArchState *ref)
+{
+    int completed = 0;
+    int stopped = FALSE;
+    int i;
+
+    if (!run_pipeline(cpu, code_memory, size, timing, FALSE))
+    {
+        return;
+    }
+    APEX_functional_init(ref);
+
+    while (!stopped)
+    {
+        /* Writeback retires the instruction in its latch and is refilled in the same cycle */
+        CPU_Stage retiring = *APEX_LATCH(cpu, APEX_STAGE_WRITEBACK);
+
+        stopped = APEX_cpu_step(cpu);
+        if (cpu->insn_completed == completed)
+        {
+            cpu->clock++;
+            continue;
+        }
+        completed = cpu->insn_completed;
+
+        /* A fused pair retires both instructions in one cycle */
+        if (retiring.fused)
+        {
+            if (ref->pc != retiring.fused_pc)
+            {
+                printf("APEX_FUZZ:   retirement %d at cycle %d is pc(%d), reference pc(%d)\n",
+                       completed - 1, cpu->clock + 1, retiring.fused_pc, ref->pc);
+                return;
+            }
+            APEX_functional_step(ref, code_memory, size);
+        }
+        if (ref->pc != retiring.pc)
+        {
+            printf("APEX_FUZZ:   retirement %d at cycle %d is pc(%d), reference pc(%d)\n",
+                   completed, cpu->clock + 1, retiring.pc, ref->pc);
+            return;
+        }
+        APEX_functional_step(ref, code_memory, size);
+        for (i = 0; i < REG_FILE_SIZE; ++i)
+        {
+            if (cpu->regs[i] != ref->regs[i] && !load_outstanding(cpu, i))
+            {
+                printf("APEX_FUZZ:   first divergence at cycle %d, pc(%d) %s left R%d = %d, "
+                       "reference %d\n",
+                       cpu->clock + 1, retiring.pc, retiring.opcode_str, i,
+                       cpu->regs[i], ref->regs[i]);
+                return;
+            }
+        }
+        cpu->clock++;
+    }
+}
+
+/*
+ * Writes a mismatching program to dir and prints how to reproduce it
+ */
+static void
+save_failure(const char *dir, unsigned long long seed, const APEX_Instruction *code_memory,
+             int size, const FuzzTiming *timing)
+{
+    char path[1024];
+    FILE *out;
+
+    snprintf(path, sizeof(path), "%s/fuzz_%llu.asm", dir ? dir : ".", seed);
+    if (dir)
+    {
+        out = fopen(path, "w");
+        if (!out)
+        {
+            fprintf(stderr, "APEX_Error: Unable to write %s\n", path);
+            return;
+        }
+        APEX_proggen_write_asm(out, code_memory, size);
+        fclose(out);
+    }
+
+    printf("APEX_FUZZ:   reproduce with apex_sim %s simulate %d --mem-latency %d", path,
+           FUZZ_MAX_INSNS, timing->memory_latency);
+    if (timing->use_l1)
+    {
+        printf(" --l1 %d,%d,%d --miss-latency %d", timing->l1_config.sets, timing->l1_config.ways,
+               timing->l1_config.line_words, timing->l1_config.miss_latency);
+    }
+    if (timing->fusion)
+    {
+        printf(" --fusion on");
+    }
+    if (timing->store_buffer)
+    {
+        printf(" --store-buffer %d", timing->store_buffer);
+    }
+    if (timing->mshrs)
+    {
+        printf(" --mshrs %d", timing->mshrs);
+    }
+    if (timing->prefetch_config.kind != APEX_PREFETCH_NONE)
+    {
+        printf(" --prefetch %s --prefetch-degree %d --prefetch-distance %d",
+               APEX_prefetch_kind_name(timing->prefetch_config.kind),
+               timing->prefetch_config.degree, timing->prefetch_config.distance);
+    }
+    if (timing->use_dram)
+    {
+        printf(" --dram %d,%d,%s", timing->dram_config.channels, timing->dram_config.banks,
+               timing->dram_config.open_page ? "open" : "closed");
+    }
+    if (timing->fetch_queue)
+    {
+        printf(" --fetch-queue %d", timing->fetch_queue);
+    }
+    if (timing->fetch_stages > 1 || timing->execute_stages > 1 || timing->memory_stages > 1)
+    {
+        printf(" --pipeline %d,%d,%d", timing->fetch_stages, timing->execute_stages,
+               timing->memory_stages);
+    }
+    if (timing->loop_buffer)
+    {
+        printf(" --loop-buffer %d", timing->loop_buffer);
+    }
+    if (timing->use_icache)
+    {
+        printf(" --icache %d,%d,%d --icache-miss-latency %d", timing->icache_config.sets,
+               timing->icache_config.ways, timing->icache_config.line_words,
+               timing->icache_config.miss_latency);
+    }
+    printf("%s\n", dir ? "" : " (add --save <dir> to keep the program)");
+}
+
+int main(int argc, char const *argv[])
+{
+    APEX_ProgGenConfig config;
+    APEX_Instruction *code_memory;
+    APEX_ArchState *ref;
+    APEX_CPU *cpu;
+    FuzzStats stats;
+    const char *save_dir = NULL;
+    const char *emit_file = NULL;
+    unsigned long long seed = 1;
+    long count = 10000;
+    long max_failures = 10;
+    double start, seconds;
+    long n;
+    int failed = FALSE;
+    int i;
+
+    APEX_proggen_default_config(&config);
+    for (i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--count") == 0 && i + 1 < argc)
+        {
+            count = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = strtoull(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--length") == 0 && i + 1 < argc)
+        {
+            config.length = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--dep-distance") == 0 && i + 1 < argc)
+        {
+            config.dep_distance = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--dep-percent") == 0 && i + 1 < argc)
+        {
+            config.dep_percent = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--mem") == 0 && i + 1 < argc)
+        {
+            config.mem_percent = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--branch") == 0 && i + 1 < argc)
+        {
+            config.branch_percent = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--loops") == 0 && i + 1 < argc)
+        {
+            config.loop_percent = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--trips") == 0 && i + 1 < argc)
+        {
+            config.max_trips = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--div") == 0 && i + 1 < argc)
+        {
+            config.div_percent = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--div-zero") == 0 && i + 1 < argc)
+        {
+            config.div_zero_percent = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--faults") == 0 && i + 1 < argc)
+        {
+            config.fault_percent = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc)
+        {
+            save_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--max-failures") == 0 && i + 1 < argc)
+        {
+            max_failures = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--emit") == 0 && i + 1 < argc)
+        {
+            emit_file = argv[++i];
+        }
+        else
+        {
+            print_usage(argv[0]);
+            exit(1);
+        }
+    }
+    if (config.length < 1 || config.dep_distance < 1 || config.max_trips < 1
+        || config.mem_percent + config.branch_percent + config.div_percent > 100)
+    {
+        fprintf(stderr, "APEX_Error: --length, --dep-distance and --trips must be positive, "
+                        "--mem + --branch + --div at most 100\n");
+        exit(1);
+    }
+
+    code_memory = calloc(PROGGEN_MAX_PROGRAM, sizeof(APEX_Instruction));
+    ref = malloc(sizeof(APEX_ArchState));
+    if (!code_memory || !ref)
+    {
+        fprintf(stderr, "APEX_Error: Unable to allocate the fuzzer\n");
+        free(code_memory);
+        free(ref);
+        exit(1);
+    }
+
+    if (emit_file)
+    {
+        FILE *out = fopen(emit_file, "w");
+        int size;
+
+        if (!out)
+        {
+            fprintf(stderr, "APEX_Error: Unable to write %s\n", emit_file);
+            free(code_memory);
+            free(ref);
+            exit(1);
+        }
+        size = APEX_proggen_generate(&config, seed, code_memory, PROGGEN_MAX_PROGRAM);
+        APEX_proggen_write_asm(out, code_memory, size);
+        fclose(out);
+        free(code_memory);
+        free(ref);
+        return 0;
+    }
+
+    ENABLE_DEBUG_MESSAGES = 0;
+    cpu = APEX_cpu_create(code_memory, 0);
+    if (!cpu)
+    {
+        fprintf(stderr, "APEX_Error: Unable to allocate the CPU\n");
+        free(code_memory);
+        free(ref);
+        exit(1);
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    start = host_seconds();
+    for (n = 0; n < count && stats.mismatches < max_failures; ++n)
+    {
+        unsigned long long program_seed = seed + n;
+        FuzzTiming timing;
+        char why[256];
+        int size;
+
+        size = APEX_proggen_generate(&config, program_seed, code_memory, PROGGEN_MAX_PROGRAM);
+        pick_timing(program_seed, &timing);
+
+        APEX_functional_init(ref);
+        APEX_functional_run(ref, code_memory, size, FUZZ_MAX_INSNS);
+        if (!ref->halted && !ref->fault)
+        {
+            fprintf(stderr, "APEX_Error: Program %llu did not terminate in the reference\n",
+                    program_seed);
+            failed = TRUE;
+            break;
+        }
+
+        if (!run_pipeline(cpu, code_memory, size, &timing, TRUE))
+        {
+            fprintf(stderr, "APEX_Error: Unable to set up the pipeline\n");
+            failed = TRUE;
+            break;
+        }
+
+        stats.programs++;
+        stats.instructions += cpu->insn_completed;
+        stats.cycles += cpu->clock + 1;
+        if (ref->halted)
+        {
+            stats.halted++;
+        }
+        else
+        {
+            stats.faulted++;
+        }
+
+        if (!compare_states(cpu, ref, why, sizeof(why)))
+        {
+            stats.mismatches++;
+            printf("APEX_FUZZ: Mismatch in program %llu: %s\n", program_seed, why);
+            save_failure(save_dir, program_seed, code_memory, size, &timing);
+            print_first_divergence(cpu, code_memory, size, &timing, ref);
+        }
+    }
+    seconds = host_seconds() - start;
+
+    /* The CPU shares code_memory with the fuzzer, APEX_cpu_stop leaves it to us */
+    APEX_cpu_stop(cpu);
+    free(code_memory);
+    free(ref);
+    if (failed)
+    {
+        return 1;
+    }
+
+    printf("APEX_FUZZ: %ld programs (%ld halted, %ld faulted), %ld mismatches\n", stats.programs,
+           stats.halted, stats.faulted, stats.mismatches);
+    printf("APEX_FUZZ: %ld instructions in %ld cycles, %.2lf s, %.0lf programs/s\n",
+           stats.instructions, stats.cycles, seconds,
+           seconds > 0 ? stats.programs / seconds : 0.0);
+    return stats.mismatches ? 1 : 0;
+}
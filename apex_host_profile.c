@@ -0,0 +1,146 @@
+/*
+ * apex_host_profile.c
+ * Contains the host-side self-profiler of the simulator.
+ *
+ * Sections are timed with rdtsc on x86 and clock_gettime elsewhere. Ticks
+ * are converted to nanoseconds with a ratio measured between program start
+ * and the report, so no calibration loop is needed. Counters are updated
+ * with relaxed atomics because multicore and interval runs time stages on
+ * several host threads.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include "apex_host_profile.h"
+
+#ifdef APEX_HOST_PROFILE
+
+#include <stdio.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+typedef struct APEX_HostSection
+{
+    unsigned long long calls;
+    unsigned long long ticks;
+    unsigned long long histogram[HOST_HISTOGRAM_BUCKETS];
+} APEX_HostSection;
+
+static const char *section_names[HOST_SECTIONS] = {
+    "parse", "fetch", "decode", "execute", "memory", "writeback", "print"};
+
+static APEX_HostSection sections[HOST_SECTIONS];
+static unsigned long long simulated_cycles;
+static unsigned long long start_ticks;
+static unsigned long long start_ns;
+
+static unsigned long long
+host_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+unsigned long long
+APEX_host_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return host_ns();
+#endif
+}
+
+/* Reference point for the tick to nanosecond ratio */
+__attribute__((constructor)) static void
+host_profile_start(void)
+{
+    start_ticks = APEX_host_ticks();
+    start_ns = host_ns();
+}
+
+void
+APEX_host_record(int section, unsigned long long ticks)
+{
+    APEX_HostSection *entry = &sections[section];
+    int bucket = 0;
+
+    while (bucket < HOST_HISTOGRAM_BUCKETS - 1 && (ticks >> (bucket + 1)))
+    {
+        bucket++;
+    }
+
+    __atomic_fetch_add(&entry->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&entry->ticks, ticks, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&entry->histogram[bucket], 1, __ATOMIC_RELAXED);
+}
+
+void
+APEX_host_count_cycle(void)
+{
+    __atomic_fetch_add(&simulated_cycles, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Prints host time per section in ns per simulated cycle, followed by the
+ * distribution of ns per call
+ */
+void
+APEX_host_profile_report(void)
+{
+    unsigned long long elapsed_ticks = APEX_host_ticks() - start_ticks;
+    unsigned long long elapsed_ns = host_ns() - start_ns;
+    double ns_per_tick = elapsed_ticks ? (double)elapsed_ns / elapsed_ticks : 1.0;
+    double total_ns = 0.0;
+    int i, bucket;
+
+    for (i = 0; i < HOST_SECTIONS; ++i)
+    {
+        total_ns += sections[i].ticks * ns_per_tick;
+    }
+
+    printf("============== HOST PROFILE =============\n");
+    printf("APEX_HOST: %llu simulated cycles, %.3f ns per tick\n", simulated_cycles, ns_per_tick);
+    printf("| %-10s %12s %12s %10s %12s %7s\n", "section", "calls", "total ms", "ns/call",
+           "ns/cycle", "share");
+    for (i = 0; i < HOST_SECTIONS; ++i)
+    {
+        const APEX_HostSection *entry = &sections[i];
+        double ns = entry->ticks * ns_per_tick;
+
+        if (!entry->calls)
+        {
+            continue;
+        }
+        printf("| %-10s %12llu %12.3f %10.1f %12.1f %6.1f%%\n", section_names[i], entry->calls,
+               ns / 1e6, ns / entry->calls, simulated_cycles ? ns / simulated_cycles : 0.0,
+               total_ns > 0 ? 100.0 * ns / total_ns : 0.0);
+    }
+
+    printf("============== HOST HISTOGRAMS (ns per call) =============\n");
+    for (i = 0; i < HOST_SECTIONS; ++i)
+    {
+        if (!sections[i].calls)
+        {
+            continue;
+        }
+        printf("| %-10s", section_names[i]);
+        for (bucket = 0; bucket < HOST_HISTOGRAM_BUCKETS; ++bucket)
+        {
+            if (sections[i].histogram[bucket])
+            {
+                printf(" <%.0f:%llu", (double)(2ULL << bucket) * ns_per_tick,
+                       sections[i].histogram[bucket]);
+            }
+        }
+        printf("\n");
+    }
+}
+
+#endif
@@ -0,0 +1,49 @@
+/*
+ * apex_host_profile.h
+ * Contains timers that measure where the simulator itself spends host time.
+ *
+ * Build with -DAPEX_HOST_PROFILE (make HOST_PROFILE=1) to enable them,
+ * otherwise every macro below expands to nothing.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_HOST_PROFILE_H_
+#define _APEX_HOST_PROFILE_H_
+
+/* Timed sections of the simulator */
+#define HOST_SECTION_PARSE 0     /* create_code_memory */
+#define HOST_SECTION_FETCH 1
+#define HOST_SECTION_DECODE 2
+#define HOST_SECTION_EXECUTE 3
+#define HOST_SECTION_MEMORY 4
+#define HOST_SECTION_WRITEBACK 5
+#define HOST_SECTION_PRINT 6     /* Per-cycle and final state printing */
+#define HOST_SECTIONS 7
+
+/* Log2 buckets of ticks per call */
+#define HOST_HISTOGRAM_BUCKETS 32
+
+#ifdef APEX_HOST_PROFILE
+
+unsigned long long APEX_host_ticks(void);
+void APEX_host_record(int section, unsigned long long ticks);
+void APEX_host_count_cycle(void);
+void APEX_host_profile_report(void);
+
+#define APEX_HOST_TIMER_START(timer) unsigned long long timer = APEX_host_ticks()
+#define APEX_HOST_TIMER_STOP(timer, section) APEX_host_record(section, APEX_host_ticks() - (timer))
+#define APEX_HOST_COUNT_CYCLE() APEX_host_count_cycle()
+#define APEX_HOST_PROFILE_REPORT() APEX_host_profile_report()
+
+#else
+
+#define APEX_HOST_TIMER_START(timer)
+#define APEX_HOST_TIMER_STOP(timer, section)
+#define APEX_HOST_COUNT_CYCLE()
+#define APEX_HOST_PROFILE_REPORT()
+
+#endif
+
+#endif
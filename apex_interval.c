@@ -0,0 +1,270 @@
+/*
+ * apex_interval.c
+ * Contains interval-parallel simulation of one long program.
+ *
+ * A functional pass counts the dynamic instructions and splits them into K
+ * intervals. A second functional pass saves the architectural state (regs,
+ * data memory, zero_flag) at the start of every interval's warmup window.
+ * Each interval is then simulated on its own host thread with the full
+ * pipeline model: the warmup instructions rebuild the microarchitectural
+ * state and only the cycles after them are counted.
+ *
+ * The error estimate compares the last `overlap` warmup instructions of an
+ * interval with the same instructions at the end of the previous interval,
+ * which were simulated with full history. If warmup was long enough both
+ * windows take the same number of cycles.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "apex_host_profile.h"
+#include "apex_interval.h"
+
+typedef struct APEX_IntervalThread
+{
+    APEX_Interval *interval;
+    int tail_overlap;               /* Overlap of the next interval */
+    const APEX_IntervalConfig *config;
+    APEX_Instruction *code_memory;
+    int code_memory_size;
+} APEX_IntervalThread;
+
+static void
+record_milestone(int *cycle, int count, const APEX_CPU *cpu)
+{
+    if (*cycle < 0 && cpu->insn_completed >= count)
+    {
+        *cycle = cpu->clock + 1;
+    }
+}
+
+/*
+ * Simulates instructions [start, end) of one interval through the pipeline
+ */
+static void *
+interval_thread(void *arg)
+{
+    APEX_IntervalThread *thread = arg;
+    APEX_Interval *iv = thread->interval;
+    const APEX_IntervalConfig *config = thread->config;
+    int overlap_count = iv->begin - iv->overlap - iv->start;
+    int begin_count = iv->begin - iv->start;
+    int tail_count = iv->end - thread->tail_overlap - iv->start;
+    int end_count = iv->end - iv->start;
+    APEX_CPU *cpu;
+    int halted;
+
+    cpu = APEX_cpu_create(thread->code_memory, thread->code_memory_size);
+    if (!cpu)
+    {
+        return NULL;
+    }
+    APEX_functional_load_cpu(cpu, iv->state);
+    cpu->memory_latency = config->memory_latency;
+    if (config->l1_config)
+    {
+        cpu->l1 = APEX_cache_create(config->l1_config, 0, NULL);
+    }
+
+    iv->overlap_cycle = overlap_count ? -1 : 0;
+    iv->begin_cycle = begin_count ? -1 : 0;
+    iv->tail_cycle = tail_count ? -1 : 0;
+    iv->end_cycle = -1;
+
+    while (TRUE)
+    {
+        halted = APEX_cpu_step(cpu);
+
+        record_milestone(&iv->overlap_cycle, overlap_count, cpu);
+        record_milestone(&iv->begin_cycle, begin_count, cpu);
+        record_milestone(&iv->tail_cycle, tail_count, cpu);
+        record_milestone(&iv->end_cycle, end_count, cpu);
+
+        if (halted || cpu->insn_completed >= end_count)
+        {
+            break;
+        }
+
+        if (config->cycle_limit == (cpu->clock + 1))
+        {
+            break;
+        }
+        cpu->clock++;
+    }
+
+    iv->completed = (cpu->insn_completed >= end_count);
+    iv->cpu = cpu;
+    return NULL;
+}
+
+static double
+host_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Splits the run of filename into config->intervals intervals, simulates
+ * them in parallel and prints the stitched cycle count. The caller turns
+ * ENABLE_DEBUG_MESSAGES off first, the intervals run on host threads.
+ */
+int
+APEX_interval_run(const char *filename, const APEX_IntervalConfig *config)
+{
+    APEX_Instruction *code_memory;
+    APEX_ArchState *state;
+    APEX_Interval *intervals;
+    APEX_IntervalThread *threads;
+    pthread_t *tids;
+    int code_memory_size, total, size, count, k;
+    long cycles = 0, error = 0;
+    int completed = TRUE;
+    double start;
+
+    APEX_HOST_TIMER_START(parse_timer);
+    code_memory = create_code_memory(filename, &code_memory_size);
+    APEX_HOST_TIMER_STOP(parse_timer, HOST_SECTION_PARSE);
+    state = malloc(sizeof(APEX_ArchState));
+    if (!code_memory || !state)
+    {
+        fprintf(stderr, "APEX_Error: Unable to load %s\n", filename);
+        free(code_memory);
+        free(state);
+        return 1;
+    }
+
+    start = host_seconds();
+
+    /* Functional pass 1: length of the dynamic instruction stream */
+    APEX_functional_init(state);
+    total = APEX_functional_run(state, code_memory, code_memory_size, config->instruction_limit);
+    if (state->fault)
+    {
+        fprintf(stderr, "APEX_Error: Functional pass faulted at pc(%d) after %d instructions\n",
+                state->pc, state->retired);
+        free(code_memory);
+        free(state);
+        return 1;
+    }
+
+    count = config->intervals;
+    if (count > total)
+    {
+        count = total;
+    }
+    if (count < 1)
+    {
+        count = 1;
+    }
+    size = (total + count - 1) / count;
+
+    intervals = calloc(count, sizeof(APEX_Interval));
+    threads = calloc(count, sizeof(APEX_IntervalThread));
+    tids = calloc(count, sizeof(pthread_t));
+
+    for (k = 0; k < count; ++k)
+    {
+        APEX_Interval *iv = &intervals[k];
+
+        iv->begin = k * size;
+        iv->end = (k + 1 == count) ? total : (k + 1) * size;
+        iv->start = iv->begin - config->warmup;
+        if (iv->start < 0)
+        {
+            iv->start = 0;
+        }
+        iv->overlap = (iv->begin - iv->start) / 2;
+    }
+
+    /* Functional pass 2: architectural state at every warmup start */
+    APEX_functional_init(state);
+    for (k = 0; k < count; ++k)
+    {
+        APEX_Interval *iv = &intervals[k];
+
+        if (iv->start > state->retired)
+        {
+            APEX_functional_run(state, code_memory, code_memory_size, iv->start - state->retired);
+        }
+        iv->state = malloc(sizeof(APEX_ArchState));
+        memcpy(iv->state, state, sizeof(APEX_ArchState));
+    }
+
+    for (k = 0; k < count; ++k)
+    {
+        threads[k].interval = &intervals[k];
+        threads[k].tail_overlap = (k + 1 < count) ? intervals[k + 1].overlap : 0;
+        threads[k].config = config;
+        threads[k].code_memory = code_memory;
+        threads[k].code_memory_size = code_memory_size;
+        pthread_create(&tids[k], NULL, interval_thread, &threads[k]);
+    }
+    for (k = 0; k < count; ++k)
+    {
+        pthread_join(tids[k], NULL);
+    }
+
+    printf("============== INTERVALS =============\n");
+    for (k = 0; k < count; ++k)
+    {
+        APEX_Interval *iv = &intervals[k];
+        int measured = iv->end_cycle - iv->begin_cycle;
+        int delta = 0;
+
+        if (!iv->cpu || !iv->completed)
+        {
+            completed = FALSE;
+            printf("|    Interval %-3d [%d, %d) did not complete\n", k, iv->begin, iv->end);
+            continue;
+        }
+
+        if (k > 0 && intervals[k - 1].completed)
+        {
+            delta = (iv->begin_cycle - iv->overlap_cycle)
+                    - (intervals[k - 1].end_cycle - intervals[k - 1].tail_cycle);
+            delta = (delta < 0) ? -delta : delta;
+        }
+
+        printf("|    Interval %-3d [%d, %d) warmup %d  cycles = %d  overlap delta = %d\n", k,
+               iv->begin, iv->end, iv->begin - iv->start, measured, delta);
+        cycles += measured;
+        error += delta;
+    }
+
+    printf("APEX_CPU: Interval Simulation %s, cycles = %ld (+/- %ld) instructions = %d\n",
+           completed ? "Complete" : "Stopped", cycles, error, total);
+    printf("APEX_CPU: %d intervals on %d threads, host time = %.3f s\n", count, count,
+           host_seconds() - start);
+
+    if (intervals[count - 1].cpu)
+    {
+        printregstate(intervals[count - 1].cpu);
+        printdatamemory(intervals[count - 1].cpu);
+        printf("APEX_CPU: State digest = %016llx\n", intervals[count - 1].cpu->digest);
+    }
+
+    for (k = 0; k < count; ++k)
+    {
+        if (intervals[k].cpu)
+        {
+            APEX_cpu_stop(intervals[k].cpu);
+        }
+        free(intervals[k].state);
+    }
+    free(tids);
+    free(threads);
+    free(intervals);
+    free(state);
+    free(code_memory);
+    return completed ? 0 : 1;
+}
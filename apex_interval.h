@@ -0,0 +1,44 @@
+/*
+ * apex_interval.h
+ * Contains declarations for interval-parallel simulation of one program
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_INTERVAL_H_
+#define _APEX_INTERVAL_H_
+
+#include "apex_cache.h"
+#include "apex_functional.h"
+
+/* Pipeline configuration every interval is simulated with */
+typedef struct APEX_IntervalConfig
+{
+    int intervals;                     /* K, number of intervals and host threads */
+    int warmup;                        /* Instructions simulated before each interval */
+    int cycle_limit;                   /* Per interval safety limit */
+    int instruction_limit;             /* Cap on the dynamic instruction stream, 0 for none */
+    int memory_latency;
+    const APEX_CacheConfig *l1_config; /* NULL without L1 */
+} APEX_IntervalConfig;
+
+/* One slice [begin, end) of the dynamic instruction stream */
+typedef struct APEX_Interval
+{
+    int start;              /* First simulated instruction, begin - warmup */
+    int begin;              /* First measured instruction */
+    int end;                /* One past the last measured instruction */
+    int overlap;            /* Instructions compared with the previous interval */
+    APEX_ArchState *state;  /* Architectural state before instruction start */
+    APEX_CPU *cpu;
+    int overlap_cycle;      /* Cycle when begin - overlap retired */
+    int begin_cycle;        /* Cycle when begin retired, 0 without warmup */
+    int tail_cycle;         /* Cycle when end - overlap of the next interval retired */
+    int end_cycle;          /* Cycle when end retired */
+    int completed;          /* {TRUE, FALSE} Reached end within the cycle limit */
+} APEX_Interval;
+
+int APEX_interval_run(const char *filename, const APEX_IntervalConfig *config);
+
+#endif
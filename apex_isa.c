@@ -0,0 +1,121 @@
+/*
+ * apex_isa.c
+ * Contains helpers describing the operands and side effects of APEX opcodes.
+ * These follow the register usage of APEX_decode and APEX_writeback.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include "apex_isa.h"
+
+/*
+ * Returns TRUE if the instruction writes its rd field in writeback
+ */
+int
+APEX_opcode_writes_rd(int opcode)
+{
+    switch (opcode)
+    {
+    case OPCODE_ADD:
+    case OPCODE_SUB:
+    case OPCODE_MUL:
+    case OPCODE_DIV:
+    case OPCODE_AND:
+    case OPCODE_OR:
+    case OPCODE_XOR:
+    case OPCODE_MOVC:
+    case OPCODE_LOAD:
+    case OPCODE_LDR:
+    case OPCODE_ADDL:
+    case OPCODE_SUBL:
+    {
+        return TRUE;
+    }
+    }
+    return FALSE;
+}
+
+int
+APEX_opcode_is_load(int opcode)
+{
+    return (opcode == OPCODE_LOAD || opcode == OPCODE_LDR);
+}
+
+int
+APEX_opcode_is_store(int opcode)
+{
+    return (opcode == OPCODE_STORE || opcode == OPCODE_STR);
+}
+
+int
+APEX_opcode_is_branch(int opcode)
+{
+    return (opcode == OPCODE_BZ || opcode == OPCODE_BNZ);
+}
+
+/*
+ * Returns TRUE if the instruction updates zero_flag in execute
+ */
+int
+APEX_opcode_sets_zero_flag(int opcode)
+{
+    switch (opcode)
+    {
+    case OPCODE_ADD:
+    case OPCODE_SUB:
+    case OPCODE_MUL:
+    case OPCODE_DIV:
+    case OPCODE_AND:
+    case OPCODE_OR:
+    case OPCODE_XOR:
+    case OPCODE_ADDL:
+    case OPCODE_SUBL:
+    case OPCODE_CMP:
+    {
+        return TRUE;
+    }
+    }
+    return FALSE;
+}
+
+/*
+ * Fills srcs with the registers read in decode and returns their count
+ */
+int
+APEX_opcode_sources(int opcode, int rs1, int rs2, int rs3, int srcs[APEX_MAX_SOURCES])
+{
+    switch (opcode)
+    {
+    case OPCODE_ADD:
+    case OPCODE_SUB:
+    case OPCODE_MUL:
+    case OPCODE_DIV:
+    case OPCODE_AND:
+    case OPCODE_OR:
+    case OPCODE_XOR:
+    case OPCODE_LDR:
+    case OPCODE_STORE:
+    case OPCODE_CMP:
+    {
+        srcs[0] = rs1;
+        srcs[1] = rs2;
+        return 2;
+    }
+    case OPCODE_STR:
+    {
+        srcs[0] = rs1;
+        srcs[1] = rs2;
+        srcs[2] = rs3;
+        return 3;
+    }
+    case OPCODE_LOAD:
+    case OPCODE_ADDL:
+    case OPCODE_SUBL:
+    {
+        srcs[0] = rs1;
+        return 1;
+    }
+    }
+    return 0;
+}
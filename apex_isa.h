@@ -0,0 +1,24 @@
+/*
+ * apex_isa.h
+ * Contains helpers describing the operands and side effects of APEX opcodes
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_ISA_H_
+#define _APEX_ISA_H_
+
+#include "apex_macros.h"
+
+/* Maximum number of source registers read by one instruction (STR) */
+#define APEX_MAX_SOURCES 3
+
+int APEX_opcode_writes_rd(int opcode);
+int APEX_opcode_is_load(int opcode);
+int APEX_opcode_is_store(int opcode);
+int APEX_opcode_is_branch(int opcode);
+int APEX_opcode_sets_zero_flag(int opcode);
+int APEX_opcode_sources(int opcode, int rs1, int rs2, int rs3, int srcs[APEX_MAX_SOURCES]);
+
+#endif
@@ -0,0 +1,364 @@
+/*
+ * apex_journal.c
+ * Contains the undo journal that lets the debugger step backwards.
+ *
+ * After every cycle the words of APEX_CPU a cycle can change (registers,
+ * latches, forwarding lines, queues, counters) are compared with their
+ * values at the end of the previous cycle, and the old value of each
+ * changed word is appended to a ring of frames, one frame per cycle,
+ * together with the old value of every data memory word the cycle stored,
+ * which write_data_memory hands to APEX_journal_store. Undoing a frame
+ * restores the previous cycle. Full snapshots are taken every
+ * snapshot_interval cycles, so a cycle older than the ring is reached by
+ * restoring the nearest snapshot and simulating forward at most
+ * snapshot_interval cycles. When the snapshots are full every other one is
+ * dropped and the interval doubles, so memory stays within the budget for
+ * runs of any length.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_journal.h"
+
+/* Words of APEX_CPU from field first up to field end */
+#define CPU_FIELDS(first, end) offsetof(APEX_CPU, first), offsetof(APEX_CPU, end) - offsetof(APEX_CPU, first)
+
+static void
+add_region(APEX_Journal *journal, size_t offset, size_t bytes)
+{
+    APEX_JournalRegion *region = &journal->regions[journal->num_regions++];
+
+    region->first = offset / sizeof(int);
+    region->count = bytes / sizeof(int);
+    journal->region_words += region->count;
+}
+
+/*
+ * Lists the parts of APEX_CPU a cycle of cpu can change. Configuration,
+ * pointers and the entries of queues and pipes beyond the configured depth
+ * never change during a debug run, which is what makes a cycle cheap to
+ * journal. A new field updated by the pipeline needs a region here.
+ */
+static void
+journal_regions(APEX_Journal *journal, const APEX_CPU *cpu)
+{
+    /* pc, clock, retired count, registers and scoreboard */
+    add_region(journal, CPU_FIELDS(pc, code_memory_size));
+    /* Zero flag and the latches */
+    add_region(journal, CPU_FIELDS(zero_flag, stages));
+    add_region(journal, offsetof(APEX_CPU, stages), cpu->num_stages * sizeof(CPU_Stage));
+    add_region(journal, CPU_FIELDS(fetch_refill_left, fusion));
+    /* The fetch queue and the store buffer wrap at their maximum whatever their depth */
+    add_region(journal, CPU_FIELDS(fetch_queue_head, fetch_queue));
+    if (cpu->fetch_queue_depth > 0)
+    {
+        add_region(journal, CPU_FIELDS(fetch_queue, icache));
+    }
+    add_region(journal, CPU_FIELDS(loop_buffer_active, loop_buffer));
+    add_region(journal, offsetof(APEX_CPU, loop_buffer),
+               cpu->loop_buffer_size * sizeof(APEX_Instruction));
+    add_region(journal, offsetof(APEX_CPU, threads), cpu->num_threads * sizeof(APEX_Thread));
+    add_region(journal, CPU_FIELDS(memory_cycles_left, store_buffer_depth));
+    add_region(journal, CPU_FIELDS(store_buffer_head, store_buffer));
+    if (cpu->store_buffer_depth > 0)
+    {
+        add_region(journal, CPU_FIELDS(store_buffer, num_mshrs));
+    }
+    add_region(journal, CPU_FIELDS(mshr_count, mshrs));
+    add_region(journal, offsetof(APEX_CPU, mshrs), cpu->num_mshrs * sizeof(APEX_Mshr));
+    add_region(journal, CPU_FIELDS(stats, sampler));
+    add_region(journal, CPU_FIELDS(fault, watchdog));
+    add_region(journal, offsetof(APEX_CPU, digest), sizeof(APEX_CPU) - offsetof(APEX_CPU, digest));
+}
+
+static void
+take_snapshot(APEX_Journal *journal, const APEX_CPU *cpu)
+{
+    APEX_Snapshot *snapshot;
+
+    if (journal->num_snapshots == journal->max_snapshots)
+    {
+        int i, kept = 0;
+
+        for (i = 0; i < journal->num_snapshots; ++i)
+        {
+            if (journal->snapshots[i].cycles % (2 * journal->snapshot_interval) == 0)
+            {
+                if (kept != i)
+                {
+                    journal->snapshots[kept] = journal->snapshots[i];
+                }
+                kept++;
+            }
+        }
+        journal->num_snapshots = kept;
+        journal->snapshot_interval *= 2;
+        if (journal->cycles % journal->snapshot_interval != 0)
+        {
+            return;
+        }
+    }
+
+    snapshot = &journal->snapshots[journal->num_snapshots++];
+    snapshot->cycles = journal->cycles;
+    snapshot->cpu = *cpu;
+    memcpy(snapshot->data_memory, cpu->data_memory, sizeof(int) * DATA_MEMORY_SIZE);
+}
+
+/*
+ * Creates a journal for cpu and attaches it, cpu must not have simulated any
+ * cycle yet. budget bounds the bytes of frames and snapshots, a quarter of it
+ * goes to snapshots.
+ */
+APEX_Journal *
+APEX_journal_create(APEX_CPU *cpu, size_t budget)
+{
+    APEX_Journal *journal;
+    size_t record_bytes;
+
+    journal = calloc(1, sizeof(APEX_Journal));
+    if (!journal)
+    {
+        return NULL;
+    }
+
+    journal_regions(journal, cpu);
+    /* Every compared word, every data memory word, header and trailer */
+    journal->max_frame = journal->region_words + DATA_MEMORY_SIZE + 2;
+
+    journal->max_snapshots = budget / 4 / sizeof(APEX_Snapshot);
+    if (journal->max_snapshots < 2)
+    {
+        journal->max_snapshots = 2;
+    }
+    record_bytes = budget - budget / 4;
+    journal->capacity = record_bytes / sizeof(APEX_JournalRecord);
+    if (journal->capacity < 4 * journal->max_frame)
+    {
+        journal->capacity = 4 * journal->max_frame;
+    }
+
+    journal->records = calloc(journal->capacity, sizeof(APEX_JournalRecord));
+    journal->frame = calloc(journal->max_frame, sizeof(APEX_JournalRecord));
+    journal->stores = calloc(DATA_MEMORY_SIZE, sizeof(APEX_JournalRecord));
+    journal->snapshots = calloc(journal->max_snapshots, sizeof(APEX_Snapshot));
+    if (!journal->records || !journal->frame || !journal->stores || !journal->snapshots)
+    {
+        APEX_journal_destroy(journal);
+        return NULL;
+    }
+
+    journal->snapshot_interval = JOURNAL_SNAPSHOT_INTERVAL;
+    cpu->journal = journal;
+    journal->prev = *cpu;
+    take_snapshot(journal, cpu);
+    return journal;
+}
+
+void
+APEX_journal_destroy(APEX_Journal *journal)
+{
+    if (!journal)
+    {
+        return;
+    }
+    free(journal->records);
+    free(journal->frame);
+    free(journal->stores);
+    free(journal->snapshots);
+    free(journal);
+}
+
+/*
+ * Starts recording a cycle, the state it changes is compared in
+ * APEX_journal_end_cycle
+ */
+void
+APEX_journal_begin_cycle(APEX_Journal *journal, const APEX_CPU *cpu)
+{
+    journal->num_stores = 0;
+}
+
+/*
+ * Notes the value of a data memory word before the cycle stores to it. Only
+ * the first store to a word in a cycle is kept, it holds the old value.
+ */
+void
+APEX_journal_store(APEX_Journal *journal, int address, int old_value)
+{
+    int i;
+
+    for (i = 0; i < journal->num_stores; ++i)
+    {
+        if (journal->stores[i].offset == -(address + 2))
+        {
+            return;
+        }
+    }
+    journal->stores[journal->num_stores].offset = -(address + 2);
+    journal->stores[journal->num_stores].old_value = old_value;
+    journal->num_stores++;
+}
+
+static APEX_JournalRecord *
+record_at(const APEX_Journal *journal, int index)
+{
+    return &journal->records[(journal->head + index) % journal->capacity];
+}
+
+static void
+drop_oldest_frame(APEX_Journal *journal)
+{
+    int count = journal->records[journal->head].old_value + 2;
+
+    journal->head = (journal->head + count) % journal->capacity;
+    journal->used -= count;
+    journal->frames--;
+}
+
+/*
+ * Appends the words changed by the cycle that just ended as one frame
+ */
+void
+APEX_journal_end_cycle(APEX_Journal *journal, const APEX_CPU *cpu)
+{
+    const int *now = (const int *)cpu;
+    int *before = (int *)&journal->prev;
+    APEX_JournalRecord *record;
+    int i, r, count = 0;
+
+    for (r = 0; r < journal->num_regions; ++r)
+    {
+        const APEX_JournalRegion *region = &journal->regions[r];
+
+        for (i = region->first; i < region->first + region->count; ++i)
+        {
+            if (now[i] != before[i])
+            {
+                journal->frame[count].offset = i;
+                journal->frame[count].old_value = before[i];
+                before[i] = now[i];
+                count++;
+            }
+        }
+    }
+    for (i = 0; i < journal->num_stores; ++i)
+    {
+        const APEX_JournalRecord *store = &journal->stores[i];
+
+        if (cpu->data_memory[-(store->offset + 2)] != store->old_value)
+        {
+            journal->frame[count++] = *store;
+        }
+    }
+
+    while (journal->capacity - journal->used < count + 2)
+    {
+        drop_oldest_frame(journal);
+    }
+
+    record = record_at(journal, journal->used++);
+    record->offset = JOURNAL_FRAME;
+    record->old_value = count;
+    for (i = 0; i < count; ++i)
+    {
+        *record_at(journal, journal->used++) = journal->frame[i];
+    }
+    record = record_at(journal, journal->used++);
+    record->offset = JOURNAL_FRAME;
+    record->old_value = count;
+    journal->frames++;
+    journal->cycles++;
+
+    /* Snapshots past this cycle are still valid after a rewind */
+    if (journal->cycles % journal->snapshot_interval == 0
+        && journal->cycles > journal->snapshots[journal->num_snapshots - 1].cycles)
+    {
+        take_snapshot(journal, cpu);
+    }
+}
+
+static void
+undo_frame(APEX_Journal *journal, APEX_CPU *cpu)
+{
+    int count = record_at(journal, journal->used - 1)->old_value;
+    int i;
+
+    for (i = 1; i <= count; ++i)
+    {
+        const APEX_JournalRecord *record = record_at(journal, journal->used - 1 - i);
+
+        if (record->offset >= 0)
+        {
+            ((int *)cpu)[record->offset] = record->old_value;
+        }
+        else
+        {
+            cpu->data_memory[-(record->offset + 2)] = record->old_value;
+        }
+    }
+    journal->used -= count + 2;
+    journal->frames--;
+    journal->cycles--;
+}
+
+/*
+ * Moves cpu back towards target cycles. Returns the cycles reached, which
+ * is target when the frames reach it, otherwise the nearest earlier
+ * snapshot and the caller simulates forward from there.
+ */
+int
+APEX_journal_rewind(APEX_Journal *journal, APEX_CPU *cpu, int target)
+{
+    const APEX_Snapshot *snapshot;
+    int i;
+
+    if (target < 0)
+    {
+        target = 0;
+    }
+    if (target >= journal->cycles)
+    {
+        return journal->cycles;
+    }
+
+    if (journal->cycles - target <= journal->frames)
+    {
+        while (journal->cycles > target)
+        {
+            undo_frame(journal, cpu);
+        }
+        journal->prev = *cpu;
+        return target;
+    }
+
+    snapshot = &journal->snapshots[0];
+    for (i = 1; i < journal->num_snapshots && journal->snapshots[i].cycles <= target; ++i)
+    {
+        snapshot = &journal->snapshots[i];
+    }
+
+    /* Same cpu, so the pointers saved in the snapshot are still its own */
+    *cpu = snapshot->cpu;
+    memcpy(cpu->data_memory, snapshot->data_memory, sizeof(int) * DATA_MEMORY_SIZE);
+    journal->cycles = snapshot->cycles;
+    journal->head = 0;
+    journal->used = 0;
+    journal->frames = 0;
+    journal->prev = *cpu;
+    return journal->cycles;
+}
+
+/* Bytes allocated for frames and snapshots */
+size_t
+APEX_journal_bytes(const APEX_Journal *journal)
+{
+    return sizeof(APEX_Journal) + journal->capacity * sizeof(APEX_JournalRecord)
+           + (journal->max_frame + DATA_MEMORY_SIZE) * sizeof(APEX_JournalRecord)
+           + journal->max_snapshots * sizeof(APEX_Snapshot);
+}
@@ -0,0 +1,86 @@
+/*
+ * apex_journal.h
+ * Contains declarations for the undo journal used for reverse stepping
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_JOURNAL_H_
+#define _APEX_JOURNAL_H_
+
+#include <stddef.h>
+
+#include "apex_cpu.h"
+
+/* Most ranges of APEX_CPU compared after every cycle, see journal_regions */
+#define JOURNAL_MAX_REGIONS 24
+
+/* Offset of the records that open and close every cycle's frame */
+#define JOURNAL_FRAME (-1)
+
+/* First snapshot interval, doubled each time the snapshots are thinned */
+#define JOURNAL_SNAPSHOT_INTERVAL 1024
+
+/*
+ * One undone word. offset >= 0 is a word of APEX_CPU, offset < JOURNAL_FRAME
+ * is data memory address -(offset + 2), JOURNAL_FRAME marks a frame and
+ * old_value then holds its record count.
+ */
+typedef struct APEX_JournalRecord
+{
+    int offset;
+    int old_value;
+} APEX_JournalRecord;
+
+/* Words [first, first + count) of APEX_CPU that a cycle can change */
+typedef struct APEX_JournalRegion
+{
+    int first;
+    int count;
+} APEX_JournalRegion;
+
+/* Full state after `cycles` cycles */
+typedef struct APEX_Snapshot
+{
+    int cycles;
+    APEX_CPU cpu;
+    int data_memory[DATA_MEMORY_SIZE];
+} APEX_Snapshot;
+
+typedef struct APEX_Journal
+{
+    int cycles;                        /* Cycles simulated by the journaled cpu */
+
+    /* Ring of frames, oldest first, the oldest is dropped when full */
+    APEX_JournalRecord *records;
+    int capacity;
+    int head;                          /* Header of the oldest frame */
+    int used;                          /* Records in the ring */
+    int frames;                        /* Cycles that can be undone */
+    APEX_JournalRecord *frame;         /* Records of the cycle being recorded */
+    int max_frame;
+
+    /* Only these words are compared, configuration and pointers are fixed */
+    APEX_JournalRegion regions[JOURNAL_MAX_REGIONS];
+    int num_regions;
+    int region_words;
+    APEX_CPU prev;                     /* Region words of cpu at the end of the previous cycle */
+    APEX_JournalRecord *stores;        /* Data memory words stored this cycle, before the cycle */
+    int num_stores;
+
+    APEX_Snapshot *snapshots;          /* Sorted by cycles, the first is cycle 0 */
+    int max_snapshots;
+    int num_snapshots;
+    int snapshot_interval;
+} APEX_Journal;
+
+APEX_Journal *APEX_journal_create(APEX_CPU *cpu, size_t budget);
+void APEX_journal_destroy(APEX_Journal *journal);
+void APEX_journal_begin_cycle(APEX_Journal *journal, const APEX_CPU *cpu);
+void APEX_journal_store(APEX_Journal *journal, int address, int old_value);
+void APEX_journal_end_cycle(APEX_Journal *journal, const APEX_CPU *cpu);
+int APEX_journal_rewind(APEX_Journal *journal, APEX_CPU *cpu, int target);
+size_t APEX_journal_bytes(const APEX_Journal *journal);
+
+#endif
@@ -15,6 +15,12 @@
 /* Integers */
 #define DATA_MEMORY_SIZE 4096
 
+/* 64-bit words of a bitmap with one bit per data memory word */
+#define DATA_MEMORY_BITMAP_WORDS (DATA_MEMORY_SIZE / 64)
+
+/* Cores in a multicore configuration */
+#define APEX_MAX_CORES 16
+
 /* Size of integer register file */
 #define REG_FILE_SIZE 16
 
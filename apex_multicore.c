@@ -0,0 +1,291 @@
+/*
+ * apex_multicore.c
+ * Contains the N-core APEX system.
+ *
+ * Every core is an independent APEX_CPU pipeline with its own program and a
+ * private L1. All cores share one data memory kept coherent by the MESI bus
+ * in apex_cache.c. Cores are simulated on separate host threads that meet at
+ * a barrier every `quantum` cycles, so no core runs more than one quantum
+ * ahead of another. Data memory words are read and written under the bus
+ * lock, so cores never race on a word; within a quantum the order in which
+ * cores reach the same word still depends on the host scheduler, which is
+ * why only --serial runs are reproducible.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "apex_multicore.h"
+
+typedef struct APEX_CoreThread
+{
+    APEX_Multicore *mc;
+    int core;
+} APEX_CoreThread;
+
+/*
+ * Creates one core per comma separated program file
+ */
+APEX_Multicore *
+APEX_multicore_init(const char *filenames, const APEX_CacheConfig *l1_config, int quantum,
+                    int threaded)
+{
+    APEX_Multicore *mc;
+    char *names, *name, *saveptr;
+
+    mc = calloc(1, sizeof(APEX_Multicore));
+    names = strdup(filenames);
+    if (!mc || !names)
+    {
+        free(mc);
+        free(names);
+        return NULL;
+    }
+
+    mc->quantum = (quantum > 0) ? quantum : 1;
+    mc->threaded = threaded;
+    mc->data_memory = calloc(DATA_MEMORY_SIZE, sizeof(int));
+    mc->bus = APEX_bus_create();
+    if (!mc->data_memory || !mc->bus)
+    {
+        free(names);
+        APEX_multicore_stop(mc);
+        return NULL;
+    }
+
+    /* The parser uses strtok, so the list is split with strtok_r */
+    for (name = strtok_r(names, ",", &saveptr); name; name = strtok_r(NULL, ",", &saveptr))
+    {
+        APEX_CPU *cpu;
+
+        if (mc->num_cores == APEX_MAX_CORES)
+        {
+            fprintf(stderr, "APEX_Error: At most %d cores are supported\n", APEX_MAX_CORES);
+            free(names);
+            APEX_multicore_stop(mc);
+            return NULL;
+        }
+
+        cpu = APEX_cpu_init(name);
+        if (!cpu)
+        {
+            fprintf(stderr, "APEX_Error: Unable to initialize core %d from %s\n", mc->num_cores, name);
+            free(names);
+            APEX_multicore_stop(mc);
+            return NULL;
+        }
+
+        /* Replace the private data memory with the shared one */
+        free(cpu->data_memory);
+        cpu->data_memory = mc->data_memory;
+        cpu->shared_data_memory = TRUE;
+        cpu->core_id = mc->num_cores;
+        cpu->l1 = APEX_cache_create(l1_config, cpu->core_id, mc->bus);
+
+        mc->cores[mc->num_cores] = cpu;
+        mc->done_round[mc->num_cores] = -1;
+        mc->num_cores++;
+
+        if (!cpu->l1)
+        {
+            fprintf(stderr, "APEX_Error: Invalid L1 configuration\n");
+            free(names);
+            APEX_multicore_stop(mc);
+            return NULL;
+        }
+    }
+
+    free(names);
+    return mc;
+}
+
+/*
+ * Runs one core for a quantum of cycles, records the round in which it stops
+ */
+static void
+run_quantum(APEX_Multicore *mc, int core, int round)
+{
+    APEX_CPU *cpu = mc->cores[core];
+    int i;
+
+    if (mc->done_round[core] >= 0)
+    {
+        return;
+    }
+
+    for (i = 0; i < mc->quantum; ++i)
+    {
+        if (APEX_cpu_step(cpu))
+        {
+            /* A fault stops only this core */
+            mc->completed[core] = (cpu->fault.type == APEX_FAULT_NONE);
+            mc->done_round[core] = round;
+            return;
+        }
+
+        if (mc->cycle_limit == (cpu->clock + 1))
+        {
+            mc->done_round[core] = round;
+            return;
+        }
+        cpu->clock++;
+    }
+}
+
+static int
+all_cores_done(const APEX_Multicore *mc)
+{
+    int i;
+
+    for (i = 0; i < mc->num_cores; ++i)
+    {
+        if (mc->done_round[i] < 0)
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * Host thread of one core. The first barrier publishes every core's quantum,
+ * the second keeps the decision from racing with the next quantum.
+ */
+static void *
+core_thread(void *arg)
+{
+    APEX_CoreThread *thread = arg;
+    APEX_Multicore *mc = thread->mc;
+    int round;
+
+    for (round = 0; !mc->finished; ++round)
+    {
+        run_quantum(mc, thread->core, round);
+        if (pthread_barrier_wait(&mc->barrier) == PTHREAD_BARRIER_SERIAL_THREAD)
+        {
+            mc->finished = all_cores_done(mc);
+        }
+        pthread_barrier_wait(&mc->barrier);
+    }
+    return NULL;
+}
+
+static double
+host_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+print_results(const APEX_Multicore *mc, double seconds)
+{
+    unsigned long long dirty[DATA_MEMORY_BITMAP_WORDS] = { 0 };
+    unsigned long long digest = 0;
+    long total_cycles = 0;
+    int i, word;
+
+    for (i = 0; i < mc->num_cores; ++i)
+    {
+        APEX_CPU *cpu = mc->cores[i];
+
+        printf("APEX_CPU[%d]: Simulation %s, cycles = %d instructions = %d\n", i,
+               cpu->fault.type != APEX_FAULT_NONE ? "Faulted" : (mc->completed[i] ? "Complete" : "Stopped"),
+               cpu->clock + 1, cpu->insn_completed);
+        APEX_cpu_write_fault(stdout, cpu);
+        printregstate(cpu);
+        total_cycles += cpu->clock + 1;
+
+        /* Every store swapped a term of the shared memory, so the XOR of the cores covers it */
+        digest ^= cpu->digest;
+        for (word = 0; word < DATA_MEMORY_BITMAP_WORDS; ++word)
+        {
+            dirty[word] |= cpu->dirty[word];
+        }
+    }
+
+    fprintmemorywords(stdout, mc->cores[0]->data_memory, dirty);
+    printf("APEX_MULTICORE: State digest = %016llx\n", digest);
+
+    for (i = 0; i < mc->num_cores; ++i)
+    {
+        APEX_cache_print_stats(mc->cores[i]->l1);
+    }
+    printf("APEX_MULTICORE: %d cores, %d bus transactions, quantum = %d, %s\n", mc->num_cores,
+           mc->bus->transactions, mc->quantum, mc->threaded ? "threaded" : "serial");
+    printf("APEX_MULTICORE: host time = %.3f s, %.0f core-cycles/s\n", seconds,
+           seconds > 0 ? total_cycles / seconds : 0.0);
+}
+
+/*
+ * Simulates every core until it retires HALT or reaches cycle_limit. The
+ * caller turns ENABLE_DEBUG_MESSAGES off first, the cores step on host
+ * threads and would interleave their pipeline dumps.
+ */
+void
+APEX_multicore_run(APEX_Multicore *mc, int cycle_limit)
+{
+    pthread_t threads[APEX_MAX_CORES];
+    APEX_CoreThread args[APEX_MAX_CORES];
+    double start;
+    int round, i;
+
+    mc->cycle_limit = cycle_limit;
+    mc->finished = FALSE;
+    start = host_seconds();
+
+    if (mc->threaded && mc->num_cores > 1)
+    {
+        pthread_barrier_init(&mc->barrier, NULL, mc->num_cores);
+        for (i = 0; i < mc->num_cores; ++i)
+        {
+            args[i].mc = mc;
+            args[i].core = i;
+            pthread_create(&threads[i], NULL, core_thread, &args[i]);
+        }
+        for (i = 0; i < mc->num_cores; ++i)
+        {
+            pthread_join(threads[i], NULL);
+        }
+        pthread_barrier_destroy(&mc->barrier);
+    }
+    else
+    {
+        for (round = 0; !mc->finished; ++round)
+        {
+            for (i = 0; i < mc->num_cores; ++i)
+            {
+                run_quantum(mc, i, round);
+            }
+            mc->finished = all_cores_done(mc);
+        }
+    }
+
+    print_results(mc, host_seconds() - start);
+}
+
+void
+APEX_multicore_stop(APEX_Multicore *mc)
+{
+    int i;
+
+    if (!mc)
+    {
+        return;
+    }
+
+    for (i = 0; i < mc->num_cores; ++i)
+    {
+        APEX_cpu_stop(mc->cores[i]);
+    }
+    APEX_bus_destroy(mc->bus);
+    free(mc->data_memory);
+    free(mc);
+}
@@ -0,0 +1,37 @@
+/*
+ * apex_multicore.h
+ * Contains declarations for an N-core APEX system with shared data memory
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_MULTICORE_H_
+#define _APEX_MULTICORE_H_
+
+#include <pthread.h>
+
+#include "apex_cache.h"
+#include "apex_cpu.h"
+
+typedef struct APEX_Multicore
+{
+    int num_cores;
+    APEX_CPU *cores[APEX_MAX_CORES];
+    int *data_memory;                 /* Shared by every core */
+    APEX_Bus *bus;                    /* Snooping bus of the private L1s */
+    int quantum;                      /* Cycles a core runs between barriers */
+    int threaded;                     /* {TRUE, FALSE} One host thread per core */
+    int cycle_limit;
+    pthread_barrier_t barrier;
+    int done_round[APEX_MAX_CORES];   /* Round in which a core stopped, -1 while running */
+    int completed[APEX_MAX_CORES];    /* {TRUE, FALSE} HALT retired */
+    int finished;                     /* {TRUE, FALSE} Every core has stopped */
+} APEX_Multicore;
+
+APEX_Multicore *APEX_multicore_init(const char *filenames, const APEX_CacheConfig *l1_config,
+                                    int quantum, int threaded);
+void APEX_multicore_run(APEX_Multicore *mc, int cycle_limit);
+void APEX_multicore_stop(APEX_Multicore *mc);
+
+#endif
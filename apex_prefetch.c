@@ -0,0 +1,334 @@
+/*
+ * apex_prefetch.c
+ * Contains the hardware prefetchers of the L1 data cache.
+ *
+ * Every demand access of the memory stage, and every buffered store written
+ * to memory, trains the prefetcher with its PC and address. The candidates
+ * it produces are requested from data memory and land in the L1 after the
+ * L1 miss latency. A demand access to a line still on its way waits for the
+ * rest of that latency instead of missing; such prefetches are late.
+ *
+ * stride: a 64 entry table indexed by PC remembers the last address and
+ * stride of each LOAD/STORE. Once the same non-zero stride is seen twice in
+ * a row, the addresses distance .. distance + degree - 1 strides ahead are
+ * prefetched.
+ *
+ * stream: eight stream trackers follow accesses that move to the next or
+ * previous line. Once a stream has moved twice in the same direction, the
+ * lines distance .. distance + degree - 1 ahead of it are prefetched.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_prefetch.h"
+
+void
+APEX_prefetch_default_config(APEX_PrefetchConfig *config)
+{
+    config->kind = APEX_PREFETCH_NONE;
+    config->degree = 2;
+    config->distance = 1;
+}
+
+/*
+ * Returns the kind named by name, -1 when there is none
+ */
+int
+APEX_prefetch_parse_kind(const char *name)
+{
+    if (strcmp(name, "none") == 0)
+    {
+        return APEX_PREFETCH_NONE;
+    }
+    if (strcmp(name, "stride") == 0)
+    {
+        return APEX_PREFETCH_STRIDE;
+    }
+    if (strcmp(name, "stream") == 0)
+    {
+        return APEX_PREFETCH_STREAM;
+    }
+    return -1;
+}
+
+const char *
+APEX_prefetch_kind_name(int kind)
+{
+    switch (kind)
+    {
+    case APEX_PREFETCH_STRIDE:
+        return "stride";
+    case APEX_PREFETCH_STREAM:
+        return "stream";
+    }
+    return "none";
+}
+
+APEX_Prefetcher *
+APEX_prefetch_create(const APEX_PrefetchConfig *config)
+{
+    APEX_Prefetcher *prefetcher;
+    int i;
+
+    if (config->kind == APEX_PREFETCH_NONE || config->degree <= 0
+        || config->degree > APEX_PREFETCH_DEGREE_MAX || config->distance <= 0)
+    {
+        return NULL;
+    }
+
+    prefetcher = calloc(1, sizeof(APEX_Prefetcher));
+    if (!prefetcher)
+    {
+        return NULL;
+    }
+    prefetcher->config = *config;
+    for (i = 0; i < APEX_PREFETCH_TABLE_SIZE; ++i)
+    {
+        prefetcher->table[i].pc = -1;
+    }
+    for (i = 0; i < APEX_PREFETCH_STREAMS; ++i)
+    {
+        prefetcher->streams[i].line = -1;
+    }
+    return prefetcher;
+}
+
+void
+APEX_prefetch_destroy(APEX_Prefetcher *prefetcher)
+{
+    free(prefetcher);
+}
+
+static int
+find_request(const APEX_Prefetcher *prefetcher, int line)
+{
+    int i;
+
+    for (i = 0; i < prefetcher->queue_count; ++i)
+    {
+        if (prefetcher->queue[i].line == line)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void
+remove_request(APEX_Prefetcher *prefetcher, int index)
+{
+    memmove(&prefetcher->queue[index], &prefetcher->queue[index + 1],
+            sizeof(APEX_PrefetchRequest) * (prefetcher->queue_count - index - 1));
+    prefetcher->queue_count--;
+}
+
+/*
+ * Fills the L1 with the prefetches that have arrived by cycle
+ */
+static void
+complete_requests(APEX_Prefetcher *prefetcher, APEX_Cache *cache, long cycle)
+{
+    int i = 0;
+
+    while (i < prefetcher->queue_count)
+    {
+        if (prefetcher->queue[i].ready_cycle > cycle)
+        {
+            i++;
+            continue;
+        }
+        APEX_cache_prefetch(cache, prefetcher->queue[i].line * cache->config.line_words);
+        remove_request(prefetcher, i);
+    }
+}
+
+/*
+ * Requests the line holding address unless it is present or requested
+ */
+static void
+issue(APEX_Prefetcher *prefetcher, APEX_Cache *cache, int address, long cycle)
+{
+    int line;
+
+    if (address < 0 || address >= DATA_MEMORY_SIZE)
+    {
+        return;
+    }
+
+    line = address / cache->config.line_words;
+    if (APEX_cache_contains(cache, address) || find_request(prefetcher, line) >= 0)
+    {
+        prefetcher->stats.redundant++;
+        return;
+    }
+    if (prefetcher->queue_count == APEX_PREFETCH_QUEUE_MAX)
+    {
+        prefetcher->stats.dropped++;
+        return;
+    }
+
+    prefetcher->queue[prefetcher->queue_count].line = line;
+    prefetcher->queue[prefetcher->queue_count].ready_cycle = cycle + cache->config.miss_latency;
+    prefetcher->queue_count++;
+    prefetcher->stats.issued++;
+}
+
+static void
+train_stride(APEX_Prefetcher *prefetcher, APEX_Cache *cache, int pc, int address, long cycle)
+{
+    APEX_StrideEntry *entry = &prefetcher->table[(pc / 4) % APEX_PREFETCH_TABLE_SIZE];
+    int stride, i;
+
+    if (entry->pc != pc)
+    {
+        entry->pc = pc;
+        entry->last_address = address;
+        entry->stride = 0;
+        return;
+    }
+
+    stride = address - entry->last_address;
+    entry->last_address = address;
+    if (stride == 0)
+    {
+        return;
+    }
+    if (stride != entry->stride)
+    {
+        entry->stride = stride;
+        return;
+    }
+
+    prefetcher->stats.triggers++;
+    for (i = 0; i < prefetcher->config.degree; ++i)
+    {
+        issue(prefetcher, cache, address + stride * (prefetcher->config.distance + i), cycle);
+    }
+}
+
+static void
+train_stream(APEX_Prefetcher *prefetcher, APEX_Cache *cache, int address, long cycle)
+{
+    int line = address / cache->config.line_words;
+    APEX_StreamEntry *stream = NULL;
+    APEX_StreamEntry *victim = &prefetcher->streams[0];
+    int i;
+
+    for (i = 0; i < APEX_PREFETCH_STREAMS; ++i)
+    {
+        APEX_StreamEntry *s = &prefetcher->streams[i];
+
+        if (s->line >= 0 && line - s->line >= -1 && line - s->line <= 1)
+        {
+            stream = s;
+            break;
+        }
+        if (s->line < 0 || s->last_used < victim->last_used)
+        {
+            victim = s;
+        }
+    }
+
+    if (!stream)
+    {
+        victim->line = line;
+        victim->direction = 0;
+        victim->last_used = ++prefetcher->use_clock;
+        return;
+    }
+
+    stream->last_used = ++prefetcher->use_clock;
+    if (line == stream->line)
+    {
+        return;
+    }
+    if (line - stream->line != stream->direction)
+    {
+        stream->direction = line - stream->line;
+        stream->line = line;
+        return;
+    }
+    stream->line = line;
+
+    prefetcher->stats.triggers++;
+    for (i = 0; i < prefetcher->config.degree; ++i)
+    {
+        int target = line + stream->direction * (prefetcher->config.distance + i);
+
+        issue(prefetcher, cache, target * cache->config.line_words, cycle);
+    }
+}
+
+/*
+ * Performs a demand access through the L1 and trains the prefetcher with
+ * it. Returns the number of cycles the access takes.
+ */
+int
+APEX_prefetch_access(APEX_Prefetcher *prefetcher, APEX_Cache *cache, int pc, int address,
+                     int is_write, long cycle)
+{
+    int latency, index;
+
+    complete_requests(prefetcher, cache, cycle);
+
+    index = find_request(prefetcher, address / cache->config.line_words);
+    if (index >= 0)
+    {
+        /* The prefetch is still on its way, the access waits for it */
+        long wait = prefetcher->queue[index].ready_cycle - cycle;
+
+        APEX_cache_prefetch(cache, address);
+        remove_request(prefetcher, index);
+        latency = APEX_cache_access(cache, address, is_write);
+        if (wait > latency)
+        {
+            prefetcher->stats.late_cycles += wait - latency;
+            latency = (int)wait;
+        }
+        prefetcher->stats.late++;
+    }
+    else
+    {
+        latency = APEX_cache_access(cache, address, is_write);
+    }
+
+    switch (prefetcher->config.kind)
+    {
+    case APEX_PREFETCH_STRIDE:
+        train_stride(prefetcher, cache, pc, address, cycle);
+        break;
+    case APEX_PREFETCH_STREAM:
+        train_stream(prefetcher, cache, address, cycle);
+        break;
+    }
+    return latency;
+}
+
+/*
+ * Accuracy: prefetched lines hit by a demand access, of the lines issued.
+ * Coverage: those hits, of the demand misses there would have been.
+ * Timeliness: those hits that did not wait for the prefetch.
+ */
+void
+APEX_prefetch_print_stats(const APEX_Prefetcher *prefetcher, const APEX_Cache *cache)
+{
+    const APEX_PrefetchStats *s = &prefetcher->stats;
+    long useful = cache->stats.prefetch_hits;
+
+    printf("APEX_CPU: %s prefetcher, degree %d, distance %d: %ld issued, %ld redundant, "
+           "%ld dropped with the queue full, %ld useful, %d evicted unused\n",
+           APEX_prefetch_kind_name(prefetcher->config.kind), prefetcher->config.degree,
+           prefetcher->config.distance, s->issued, s->redundant, s->dropped, useful,
+           cache->stats.prefetch_unused);
+    printf("APEX_CPU: Prefetch accuracy %.2f%%, coverage %.2f%%, timeliness %.2f%% "
+           "(%ld late, %.2f cycles waited on average), L1 %d hits, %d misses\n",
+           s->issued ? 100.0 * useful / s->issued : 0.0,
+           useful + cache->stats.misses ? 100.0 * useful / (useful + cache->stats.misses) : 0.0,
+           useful ? 100.0 * (useful - s->late) / useful : 0.0, s->late,
+           s->late ? (double)s->late_cycles / s->late : 0.0, cache->stats.hits, cache->stats.misses);
+}
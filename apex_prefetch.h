@@ -0,0 +1,84 @@
+/*
+ * apex_prefetch.h
+ * Contains declarations for the hardware prefetchers that fill the L1 data
+ * cache ahead of the memory stage
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_PREFETCH_H_
+#define _APEX_PREFETCH_H_
+
+#include "apex_cache.h"
+
+/* Prefetcher kinds */
+#define APEX_PREFETCH_NONE 0x0
+#define APEX_PREFETCH_STRIDE 0x1  /* Per-PC constant stride */
+#define APEX_PREFETCH_STREAM 0x2  /* Next lines of an ascending or descending line stream */
+
+#define APEX_PREFETCH_TABLE_SIZE 64
+#define APEX_PREFETCH_STREAMS 8
+#define APEX_PREFETCH_QUEUE_MAX 16
+#define APEX_PREFETCH_DEGREE_MAX 8
+
+typedef struct APEX_PrefetchConfig
+{
+    int kind;
+    int degree;    /* Prefetches issued per trigger */
+    int distance;  /* Strides, or lines, between the access and the first prefetch */
+} APEX_PrefetchConfig;
+
+/* Reference prediction table entry of the stride prefetcher */
+typedef struct APEX_StrideEntry
+{
+    int pc;        /* -1 when unused */
+    int last_address;
+    int stride;    /* 0 until a second address is seen */
+} APEX_StrideEntry;
+
+typedef struct APEX_StreamEntry
+{
+    int line;      /* Last line of the stream, -1 when unused */
+    int direction; /* +1 or -1, 0 until a second line is seen */
+    int last_used;
+} APEX_StreamEntry;
+
+/* Prefetch on its way from data memory */
+typedef struct APEX_PrefetchRequest
+{
+    int line;
+    long ready_cycle;
+} APEX_PrefetchRequest;
+
+typedef struct APEX_PrefetchStats
+{
+    long triggers;       /* Accesses that produced prefetch candidates */
+    long issued;         /* Lines requested from data memory */
+    long redundant;      /* Candidates already in the L1 or on their way */
+    long dropped;        /* Candidates dropped with the queue full */
+    long late;           /* Demand accesses that waited for their prefetch */
+    long late_cycles;    /* Cycles those accesses waited */
+} APEX_PrefetchStats;
+
+typedef struct APEX_Prefetcher
+{
+    APEX_PrefetchConfig config;
+    APEX_StrideEntry table[APEX_PREFETCH_TABLE_SIZE];
+    APEX_StreamEntry streams[APEX_PREFETCH_STREAMS];
+    int use_clock;
+    APEX_PrefetchRequest queue[APEX_PREFETCH_QUEUE_MAX]; /* Oldest first */
+    int queue_count;
+    APEX_PrefetchStats stats;
+} APEX_Prefetcher;
+
+void APEX_prefetch_default_config(APEX_PrefetchConfig *config);
+int APEX_prefetch_parse_kind(const char *name);
+const char *APEX_prefetch_kind_name(int kind);
+APEX_Prefetcher *APEX_prefetch_create(const APEX_PrefetchConfig *config);
+void APEX_prefetch_destroy(APEX_Prefetcher *prefetcher);
+int APEX_prefetch_access(APEX_Prefetcher *prefetcher, APEX_Cache *cache, int pc, int address,
+                         int is_write, long cycle);
+void APEX_prefetch_print_stats(const APEX_Prefetcher *prefetcher, const APEX_Cache *cache);
+
+#endif
@@ -0,0 +1,304 @@
+/*
+ * apex_profile.c
+ * Contains the per-PC profiler of simulated programs.
+ *
+ * Every cycle decode either issues the instruction in its latch, holds it or
+ * is empty. Issue and stall cycles are charged to the PC in decode, stall
+ * cycles are also charged to the PC of the producer that caused them. Empty
+ * decode cycles are charged to the last taken branch or HALT that squashed
+ * the front end, or to pipeline fill before the first one. The charged
+ * cycles therefore add up to the cycles of the run.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_profile.h"
+
+static const char *stall_names[APEX_STALL_REASONS] = {"LoadUse", "Operand", "Memory"};
+
+APEX_PcProfiler *
+APEX_profile_create(int code_memory_size)
+{
+    APEX_PcProfiler *profile;
+
+    profile = calloc(1, sizeof(APEX_PcProfiler));
+    if (!profile)
+    {
+        return NULL;
+    }
+
+    profile->pcs = calloc(code_memory_size, sizeof(APEX_PcProfile));
+    if (!profile->pcs)
+    {
+        free(profile);
+        return NULL;
+    }
+    profile->size = code_memory_size;
+    profile->squash_pc = -1;
+    return profile;
+}
+
+void
+APEX_profile_destroy(APEX_PcProfiler *profile)
+{
+    if (!profile)
+    {
+        return;
+    }
+    free(profile->pcs);
+    free(profile);
+}
+
+/* Returns the counters of pc, NULL outside code memory */
+static APEX_PcProfile *
+get_pc_profile(const APEX_PcProfiler *profile, int pc)
+{
+    int index = (pc - 4000) / 4;
+
+    if (pc < 4000 || index >= profile->size)
+    {
+        return NULL;
+    }
+    return &profile->pcs[index];
+}
+
+void
+APEX_profile_events_init(APEX_DecodeEvents *events)
+{
+    events->stall_reason = APEX_STALL_NONE;
+    events->stall_producer = -1;
+    events->num_forwards = 0;
+}
+
+/*
+ * Charges one decode cycle of the instruction at pc. Forwarding is counted
+ * only in the cycle the instruction issues.
+ */
+void
+APEX_profile_decode(APEX_PcProfiler *profile, int pc, const APEX_DecodeEvents *events,
+                    int stalled)
+{
+    APEX_PcProfile *consumer = get_pc_profile(profile, pc);
+    APEX_PcProfile *producer;
+    int i;
+
+    if (!consumer)
+    {
+        profile->fill_bubbles++;
+        return;
+    }
+    consumer->cycles++;
+
+    if (stalled)
+    {
+        if (events->stall_reason == APEX_STALL_NONE)
+        {
+            return;
+        }
+        consumer->stalls[events->stall_reason]++;
+        producer = get_pc_profile(profile, events->stall_producer);
+        if (producer)
+        {
+            producer->caused[events->stall_reason]++;
+        }
+        return;
+    }
+
+    for (i = 0; i < events->num_forwards; ++i)
+    {
+        if (events->forward_from_mem[i])
+        {
+            consumer->forwarded_mem++;
+        }
+        else
+        {
+            consumer->forwarded_ex++;
+        }
+        producer = get_pc_profile(profile, events->forward_producer[i]);
+        if (producer)
+        {
+            producer->forwards_given++;
+        }
+    }
+}
+
+/* Charges a cycle in which decode was empty */
+void
+APEX_profile_bubble(APEX_PcProfiler *profile)
+{
+    APEX_PcProfile *squash = get_pc_profile(profile, profile->squash_pc);
+
+    if (squash)
+    {
+        squash->bubbles++;
+    }
+    else
+    {
+        profile->fill_bubbles++;
+    }
+}
+
+/* Records a taken branch or HALT that emptied fetch and decode */
+void
+APEX_profile_squash(APEX_PcProfiler *profile, int pc)
+{
+    profile->squash_pc = pc;
+}
+
+void
+APEX_profile_retire(APEX_PcProfiler *profile, int pc)
+{
+    APEX_PcProfile *entry = get_pc_profile(profile, pc);
+
+    if (entry)
+    {
+        entry->executions++;
+    }
+}
+
+static long
+total_cycles(const APEX_PcProfiler *profile)
+{
+    long total = profile->fill_bubbles;
+    int i;
+
+    for (i = 0; i < profile->size; ++i)
+    {
+        total += profile->pcs[i].cycles + profile->pcs[i].bubbles;
+    }
+    return total;
+}
+
+static long
+total_caused(const APEX_PcProfile *entry)
+{
+    long caused = 0;
+    int reason;
+
+    for (reason = 0; reason < APEX_STALL_REASONS; ++reason)
+    {
+        caused += entry->caused[reason];
+    }
+    return caused;
+}
+
+/*
+ * Writes the input program with the counters of every instruction in front
+ * of its source line
+ */
+int
+APEX_profile_write_listing(const APEX_PcProfiler *profile, const char *asm_filename, FILE *out)
+{
+    FILE *fp;
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t nread;
+    int index = 0;
+
+    fp = fopen(asm_filename, "r");
+    if (!fp)
+    {
+        return FALSE;
+    }
+
+    fprintf(out, "; APEX per-PC profile of %s, %ld cycles\n", asm_filename, total_cycles(profile));
+    fprintf(out, "; Cycles are decode cycles (issue + stalls), Caused are stall cycles of later\n");
+    fprintf(out, "; instructions waiting on this one, Bubbles are empty decode cycles after it squashed\n");
+    fprintf(out, "; %-5s %8s %8s %6s %8s %8s %8s %8s %8s %7s %7s  %s\n", "PC", "Count", "Cycles",
+            "CPI", stall_names[APEX_STALL_LOAD_USE], stall_names[APEX_STALL_OPERAND],
+            stall_names[APEX_STALL_MEMORY], "Caused", "Bubbles", "FwdEX", "FwdMEM", "Source");
+    fprintf(out, "  %-5s %8s %8s %6s %8s %8s %8s %8s %8ld %7s %7s  <pipeline fill>\n", "-", "-",
+            "-", "-", "-", "-", "-", "-", profile->fill_bubbles, "-", "-");
+
+    while ((nread = getline(&line, &len, fp)) != -1)
+    {
+        while (nread > 0 && (line[nread - 1] == '\n' || line[nread - 1] == '\r'))
+        {
+            line[--nread] = '\0';
+        }
+
+        if (index < profile->size)
+        {
+            const APEX_PcProfile *entry = &profile->pcs[index];
+
+            fprintf(out, "  %-5d %8ld %8ld %6.2f %8ld %8ld %8ld %8ld %8ld %7ld %7ld  %s\n",
+                    4000 + index * 4, entry->executions, entry->cycles,
+                    entry->executions ? (double)entry->cycles / entry->executions : 0.0,
+                    entry->stalls[APEX_STALL_LOAD_USE], entry->stalls[APEX_STALL_OPERAND],
+                    entry->stalls[APEX_STALL_MEMORY], total_caused(entry), entry->bubbles,
+                    entry->forwarded_ex, entry->forwarded_mem, line);
+        }
+        else
+        {
+            fprintf(out, "  %s\n", line);
+        }
+        index++;
+    }
+
+    free(line);
+    fclose(fp);
+    return TRUE;
+}
+
+typedef struct APEX_Hotspot
+{
+    int index;
+    long cycles;
+} APEX_Hotspot;
+
+static int
+compare_hotspots(const void *a, const void *b)
+{
+    const APEX_Hotspot *x = a;
+    const APEX_Hotspot *y = b;
+
+    if (x->cycles != y->cycles)
+    {
+        return (x->cycles < y->cycles) ? 1 : -1;
+    }
+    return x->index - y->index;
+}
+
+/*
+ * Prints the top instructions by cycles charged to them, bubbles included
+ */
+void
+APEX_profile_print_hotspots(const APEX_PcProfiler *profile, const APEX_Instruction *code_memory,
+                            int top)
+{
+    APEX_Hotspot *hotspots;
+    long total = total_cycles(profile);
+    int i;
+
+    hotspots = calloc((profile->size > 0) ? profile->size : 1, sizeof(APEX_Hotspot));
+    if (!hotspots)
+    {
+        return;
+    }
+    for (i = 0; i < profile->size; ++i)
+    {
+        hotspots[i].index = i;
+        hotspots[i].cycles = profile->pcs[i].cycles + profile->pcs[i].bubbles;
+    }
+    qsort(hotspots, profile->size, sizeof(APEX_Hotspot), compare_hotspots);
+
+    printf("============== HOT INSTRUCTIONS =============\n");
+    for (i = 0; i < top && i < profile->size && hotspots[i].cycles > 0; ++i)
+    {
+        const APEX_PcProfile *entry = &profile->pcs[hotspots[i].index];
+
+        printf("|  pc(%d) %-5s %8ld cycles %5.1f%%  x%ld  %s %ld  %s %ld  %s %ld  caused %ld  bubbles %ld\n",
+               4000 + hotspots[i].index * 4, code_memory[hotspots[i].index].opcode_str,
+               hotspots[i].cycles, total ? 100.0 * hotspots[i].cycles / total : 0.0,
+               entry->executions, stall_names[APEX_STALL_LOAD_USE],
+               entry->stalls[APEX_STALL_LOAD_USE], stall_names[APEX_STALL_OPERAND],
+               entry->stalls[APEX_STALL_OPERAND], stall_names[APEX_STALL_MEMORY],
+               entry->stalls[APEX_STALL_MEMORY], total_caused(entry), entry->bubbles);
+    }
+    printf("APEX_PROFILE: %ld cycles charged, %ld to pipeline fill\n", total, profile->fill_bubbles);
+    free(hotspots);
+}
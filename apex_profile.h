@@ -0,0 +1,75 @@
+/*
+ * apex_profile.h
+ * Contains declarations for the per-PC stall and hotspot profiler
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_PROFILE_H_
+#define _APEX_PROFILE_H_
+
+#include <stdio.h>
+
+#include "apex_cpu.h"
+#include "apex_isa.h"
+
+/* Building with -DAPEX_NO_PC_PROFILE removes every hook from the pipeline */
+#ifdef APEX_NO_PC_PROFILE
+#define APEX_PROFILING(cpu) 0
+#else
+#define APEX_PROFILING(cpu) ((cpu)->pc_profile != NULL)
+#endif
+
+/* Reasons an instruction is held in decode */
+#define APEX_STALL_NONE -1
+#define APEX_STALL_LOAD_USE 0 /* Source produced by a load still in execute */
+#define APEX_STALL_OPERAND 1  /* Source not in the register file or on a forwarding line */
+#define APEX_STALL_MEMORY 2   /* Execute held behind a multi-cycle memory access */
+#define APEX_STALL_REASONS 3
+
+/* What decode saw for the instruction in its latch during one cycle */
+typedef struct APEX_DecodeEvents
+{
+    int stall_reason;                          /* APEX_STALL_* */
+    int stall_producer;                        /* PC responsible for the stall, -1 unknown */
+    int num_forwards;
+    int forward_producer[APEX_MAX_SOURCES];    /* PC of the forwarding instruction */
+    int forward_from_mem[APEX_MAX_SOURCES];    /* {TRUE, FALSE} MEM line, otherwise EX */
+} APEX_DecodeEvents;
+
+/* Counters of one static instruction */
+typedef struct APEX_PcProfile
+{
+    long executions;                  /* Times retired */
+    long cycles;                      /* Decode cycles, issue plus stalls */
+    long stalls[APEX_STALL_REASONS];  /* Stall cycles as the consumer */
+    long caused[APEX_STALL_REASONS];  /* Stall cycles of others as the producer */
+    long bubbles;                     /* Empty decode cycles after this instruction squashed */
+    long forwarded_ex;                /* Operands received from the EX line */
+    long forwarded_mem;               /* Operands received from the MEM line */
+    long forwards_given;              /* Operands this instruction forwarded */
+} APEX_PcProfile;
+
+typedef struct APEX_PcProfiler
+{
+    int size;                         /* Entries, one per code memory instruction */
+    APEX_PcProfile *pcs;
+    long fill_bubbles;                /* Empty decode cycles not caused by a squash */
+    int squash_pc;                    /* Last taken branch or HALT, -1 before any */
+} APEX_PcProfiler;
+
+APEX_PcProfiler *APEX_profile_create(int code_memory_size);
+void APEX_profile_destroy(APEX_PcProfiler *profile);
+void APEX_profile_events_init(APEX_DecodeEvents *events);
+void APEX_profile_decode(APEX_PcProfiler *profile, int pc, const APEX_DecodeEvents *events,
+                         int stalled);
+void APEX_profile_bubble(APEX_PcProfiler *profile);
+void APEX_profile_squash(APEX_PcProfiler *profile, int pc);
+void APEX_profile_retire(APEX_PcProfiler *profile, int pc);
+int APEX_profile_write_listing(const APEX_PcProfiler *profile, const char *asm_filename,
+                               FILE *out);
+void APEX_profile_print_hotspots(const APEX_PcProfiler *profile,
+                                 const APEX_Instruction *code_memory, int top);
+
+#endif
@@ -0,0 +1,423 @@
+/*
+ * apex_proggen.c
+ * Contains a generator of random valid APEX programs for differential
+ * testing.
+ *
+ * A program is a prologue that sets every register, a body of straight-line
+ * blocks and counted loops, and HALT. Sources are read from the last few
+ * producers with a configurable distance, which controls how much
+ * forwarding and stalling the pipeline sees. Every program terminates:
+ * branches in the body only jump forward within their block, and the only
+ * backward branch closes a loop whose counter register the body never
+ * writes. Memory accesses stay within a window of data memory above the
+ * base register, so loads and stores alias often. Neither leaving data
+ * memory nor dividing by zero happens unless the configuration asks for it.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <string.h>
+
+#include "apex_proggen.h"
+
+/* Words of data memory above the base register that accesses use */
+#define PROGGEN_WINDOW 64
+
+/* Most slots of a block, a slot is one instruction or an address generation pair */
+#define PROGGEN_MAX_BLOCK 16
+
+/* Entries of the producer history */
+#define PROGGEN_HISTORY 16
+
+static const char *const opcode_names[] = {
+    "ADD", "SUB", "MUL", "DIV", "AND", "OR", "EXOR", "MOVC", "LOAD", "STORE",
+    "BZ", "BNZ", "HALT", "LDR", "STR", "ADDL", "SUBL", "CMP", "NOP",
+};
+
+/* ALU instructions picked for the slots that are not memory, branch or DIV */
+static const int alu_opcodes[] = {
+    OPCODE_ADD, OPCODE_SUB, OPCODE_MUL, OPCODE_AND, OPCODE_OR, OPCODE_XOR,
+    OPCODE_ADDL, OPCODE_SUBL, OPCODE_CMP, OPCODE_MOVC, OPCODE_NOP,
+};
+
+typedef struct ProgGen
+{
+    const APEX_ProgGenConfig *config;
+    unsigned long long rng;
+    APEX_Instruction *code_memory;
+    int capacity;
+    int size;
+    int history[PROGGEN_HISTORY];      /* Destinations of the last producers, newest last */
+    int num_history;
+} ProgGen;
+
+/* splitmix64, so a seed gives the same program on every host */
+static unsigned int
+next_random(ProgGen *gen)
+{
+    unsigned long long x = (gen->rng += 0x9e3779b97f4a7c15ULL);
+
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return (unsigned int)((x ^ (x >> 31)) >> 32);
+}
+
+/* Uniform in [0, n) */
+static int
+random_below(ProgGen *gen, int n)
+{
+    return (n <= 1) ? 0 : (int)(next_random(gen) % (unsigned int)n);
+}
+
+static int
+chance(ProgGen *gen, int percent)
+{
+    return random_below(gen, 100) < percent;
+}
+
+static int
+is_reserved(int reg)
+{
+    return (reg == PROGGEN_OFFSET_REG || reg == PROGGEN_BASE_REG || reg == PROGGEN_COUNTER_REG);
+}
+
+/* Any register the body may write */
+static int
+random_destination(ProgGen *gen)
+{
+    int reg;
+
+    do
+    {
+        reg = random_below(gen, REG_FILE_SIZE);
+    } while (is_reserved(reg));
+    return reg;
+}
+
+/* A recent producer with probability dep_percent, otherwise any register */
+static int
+random_source(ProgGen *gen)
+{
+    int window = gen->config->dep_distance;
+
+    if (window > gen->num_history)
+    {
+        window = gen->num_history;
+    }
+    if (window > 0 && chance(gen, gen->config->dep_percent))
+    {
+        return gen->history[gen->num_history - 1 - random_below(gen, window)];
+    }
+    return random_destination(gen);
+}
+
+static void
+record_producer(ProgGen *gen, int reg)
+{
+    if (gen->num_history == PROGGEN_HISTORY)
+    {
+        memmove(gen->history, gen->history + 1, sizeof(int) * (PROGGEN_HISTORY - 1));
+        gen->num_history--;
+    }
+    gen->history[gen->num_history++] = reg;
+}
+
+static void
+emit(ProgGen *gen, int opcode, int rd, int rs1, int rs2, int rs3, int imm)
+{
+    APEX_Instruction *ins = &gen->code_memory[gen->size++];
+
+    memset(ins, 0, sizeof(*ins));
+    strcpy(ins->opcode_str, opcode_names[opcode]);
+    ins->opcode = opcode;
+    ins->rd = rd;
+    ins->rs1 = rs1;
+    ins->rs2 = rs2;
+    ins->rs3 = rs3;
+    ins->imm = imm;
+    if (rd >= 0)
+    {
+        record_producer(gen, rd);
+    }
+}
+
+/* Immediate of a LOAD/STORE, outside data memory with probability fault_percent */
+static int
+memory_offset(ProgGen *gen, int base)
+{
+    if (chance(gen, gen->config->fault_percent))
+    {
+        return chance(gen, 50) ? DATA_MEMORY_SIZE - base + random_below(gen, PROGGEN_WINDOW)
+                               : -base - 1 - random_below(gen, PROGGEN_WINDOW);
+    }
+    return random_below(gen, PROGGEN_WINDOW);
+}
+
+/*
+ * Emits one body instruction, or an address generation pair, into a slot of
+ * the block. `after` slots of the block follow it, a forward branch gets
+ * the number of slots it jumps as its immediate until the block is placed.
+ */
+static void
+emit_body_instruction(ProgGen *gen, int base, int after)
+{
+    const APEX_ProgGenConfig *config = gen->config;
+    int pick = random_below(gen, 100);
+    int opcode, rs1, rs2, reg;
+
+    if (pick < config->mem_percent)
+    {
+        switch (random_below(gen, 5))
+        {
+        case 0:
+            emit(gen, OPCODE_LOAD, random_destination(gen), PROGGEN_BASE_REG, 0, 0,
+                 memory_offset(gen, base));
+            break;
+        case 1:
+            emit(gen, OPCODE_LDR, random_destination(gen), PROGGEN_BASE_REG, PROGGEN_OFFSET_REG,
+                 0, 0);
+            break;
+        case 2:
+            emit(gen, OPCODE_STORE, -1, random_source(gen), PROGGEN_BASE_REG, 0,
+                 memory_offset(gen, base));
+            break;
+        case 3:
+            emit(gen, OPCODE_STR, -1, random_source(gen), PROGGEN_BASE_REG, PROGGEN_OFFSET_REG,
+                 0);
+            break;
+        default:
+            /* Address generation, an ADDL feeding the base of a LOAD/STORE */
+            reg = random_destination(gen);
+            emit(gen, OPCODE_ADDL, reg, PROGGEN_BASE_REG, 0, 0,
+                 random_below(gen, PROGGEN_WINDOW / 2));
+            if (chance(gen, 50))
+            {
+                emit(gen, OPCODE_LOAD, random_destination(gen), reg, 0, 0,
+                     random_below(gen, PROGGEN_WINDOW / 2));
+            }
+            else
+            {
+                /* Storing the ADDL result itself is not address generation */
+                rs1 = random_source(gen);
+                if (rs1 == reg)
+                {
+                    rs1 = PROGGEN_OFFSET_REG;
+                }
+                emit(gen, OPCODE_STORE, -1, rs1, reg, 0, random_below(gen, PROGGEN_WINDOW / 2));
+            }
+            break;
+        }
+        return;
+    }
+    pick -= config->mem_percent;
+
+    if (pick < config->branch_percent)
+    {
+        opcode = chance(gen, 50) ? OPCODE_BZ : OPCODE_BNZ;
+        emit(gen, opcode, -1, 0, 0, 0, 1 + random_below(gen, after + 1));
+        return;
+    }
+    pick -= config->branch_percent;
+
+    if (pick < config->div_percent)
+    {
+        /* The offset register is never zero, other divisors only with div_zero_percent */
+        rs1 = random_source(gen);
+        rs2 = chance(gen, config->div_zero_percent) ? random_source(gen) : PROGGEN_OFFSET_REG;
+        emit(gen, OPCODE_DIV, random_destination(gen), rs1, rs2, 0, 0);
+        return;
+    }
+
+    opcode = alu_opcodes[random_below(gen, sizeof(alu_opcodes) / sizeof(alu_opcodes[0]))];
+    switch (opcode)
+    {
+    case OPCODE_ADDL:
+    case OPCODE_SUBL:
+        rs1 = random_source(gen);
+        emit(gen, opcode, random_destination(gen), rs1, 0, 0, random_below(gen, 16));
+        break;
+    case OPCODE_CMP:
+        rs1 = random_source(gen);
+        rs2 = random_source(gen);
+        emit(gen, opcode, -1, rs1, rs2, 0, 0);
+        break;
+    case OPCODE_MOVC:
+        emit(gen, opcode, random_destination(gen), 0, 0, 0, random_below(gen, 24) - 8);
+        break;
+    case OPCODE_NOP:
+        emit(gen, opcode, -1, 0, 0, 0, 0);
+        break;
+    default:
+        rs1 = random_source(gen);
+        rs2 = random_source(gen);
+        emit(gen, opcode, random_destination(gen), rs1, rs2, 0, 0);
+        break;
+    }
+}
+
+void
+APEX_proggen_default_config(APEX_ProgGenConfig *config)
+{
+    config->length = 48;
+    config->dep_distance = 3;
+    config->dep_percent = 60;
+    config->mem_percent = 25;
+    config->branch_percent = 8;
+    config->loop_percent = 30;
+    config->max_trips = 8;
+    config->div_percent = 2;
+    config->div_zero_percent = 0;
+    config->fault_percent = 0;
+}
+
+/*
+ * Fills code_memory with the program for seed, returns its number of
+ * instructions. The body is cut short when capacity runs out.
+ */
+int
+APEX_proggen_generate(const APEX_ProgGenConfig *config, unsigned long long seed,
+                      APEX_Instruction *code_memory, int capacity)
+{
+    ProgGen gen;
+    int slot_start[PROGGEN_MAX_BLOCK + 1];
+    int base, reg, remaining;
+
+    memset(&gen, 0, sizeof(gen));
+    gen.config = config;
+    gen.rng = seed;
+    gen.code_memory = code_memory;
+    gen.capacity = capacity;
+
+    if (capacity < REG_FILE_SIZE + 1)
+    {
+        return 0;
+    }
+
+    /* Every register is written once, so no read waits on a missing producer */
+    base = random_below(&gen, DATA_MEMORY_SIZE - 2 * PROGGEN_WINDOW);
+    for (reg = 0; reg < REG_FILE_SIZE; ++reg)
+    {
+        int value = random_below(&gen, 64) - 8;
+
+        if (reg == PROGGEN_OFFSET_REG)
+        {
+            value = 1 + random_below(&gen, PROGGEN_WINDOW - 1);
+        }
+        else if (reg == PROGGEN_BASE_REG)
+        {
+            value = base;
+        }
+        else if (reg == PROGGEN_COUNTER_REG)
+        {
+            value = 0;
+        }
+        emit(&gen, OPCODE_MOVC, reg, 0, 0, 0, value);
+    }
+    gen.num_history = 0;
+
+    remaining = config->length;
+    while (remaining > 0)
+    {
+        int block = 4 + random_below(&gen, PROGGEN_MAX_BLOCK - 3);
+        int loop = chance(&gen, config->loop_percent);
+        int start, i;
+
+        if (block > remaining)
+        {
+            block = remaining;
+        }
+        /* Room for the block with every slot a pair, loop control and HALT */
+        if (gen.size + 2 * block + 3 + 1 > capacity)
+        {
+            break;
+        }
+
+        if (loop)
+        {
+            emit(&gen, OPCODE_MOVC, PROGGEN_COUNTER_REG, 0, 0, 0,
+                 1 + random_below(&gen, config->max_trips));
+        }
+        start = gen.size;
+        /* Forward branches of a loop body may land on the SUBL, never past it */
+        for (i = 0; i < block; ++i)
+        {
+            slot_start[i] = gen.size;
+            emit_body_instruction(&gen, base, block - 1 - i);
+        }
+        slot_start[block] = gen.size;
+
+        /* Branches jump to the first instruction of a slot, never between an
+         * ADDL and the LOAD/STORE whose base it computes */
+        for (i = 0; i < block; ++i)
+        {
+            APEX_Instruction *ins = &gen.code_memory[slot_start[i]];
+
+            if (ins->opcode == OPCODE_BZ || ins->opcode == OPCODE_BNZ)
+            {
+                ins->imm = 4 * (slot_start[i + ins->imm] - slot_start[i]);
+            }
+        }
+        if (loop)
+        {
+            emit(&gen, OPCODE_SUBL, PROGGEN_COUNTER_REG, PROGGEN_COUNTER_REG, 0, 0, 1);
+            emit(&gen, OPCODE_BNZ, -1, 0, 0, 0, -4 * (gen.size - start));
+        }
+        remaining -= block;
+    }
+
+    emit(&gen, OPCODE_HALT, -1, 0, 0, 0, 0);
+    return gen.size;
+}
+
+/*
+ * Writes a program in the input file syntax read by create_code_memory
+ */
+void
+APEX_proggen_write_asm(FILE *out, const APEX_Instruction *code_memory, int code_memory_size)
+{
+    int i;
+
+    for (i = 0; i < code_memory_size; ++i)
+    {
+        const APEX_Instruction *ins = &code_memory[i];
+
+        switch (ins->opcode)
+        {
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MUL:
+        case OPCODE_DIV:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_LDR:
+            fprintf(out, "%s R%d,R%d,R%d\n", ins->opcode_str, ins->rd, ins->rs1, ins->rs2);
+            break;
+        case OPCODE_MOVC:
+            fprintf(out, "%s R%d,#%d\n", ins->opcode_str, ins->rd, ins->imm);
+            break;
+        case OPCODE_LOAD:
+        case OPCODE_ADDL:
+        case OPCODE_SUBL:
+            fprintf(out, "%s R%d,R%d,#%d\n", ins->opcode_str, ins->rd, ins->rs1, ins->imm);
+            break;
+        case OPCODE_STORE:
+            fprintf(out, "%s R%d,R%d,#%d\n", ins->opcode_str, ins->rs1, ins->rs2, ins->imm);
+            break;
+        case OPCODE_STR:
+            fprintf(out, "%s R%d,R%d,R%d\n", ins->opcode_str, ins->rs1, ins->rs2, ins->rs3);
+            break;
+        case OPCODE_CMP:
+            fprintf(out, "%s R%d,R%d\n", ins->opcode_str, ins->rs1, ins->rs2);
+            break;
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+            fprintf(out, "%s #%d\n", ins->opcode_str, ins->imm);
+            break;
+        default:
+            fprintf(out, "%s\n", ins->opcode_str);
+            break;
+        }
+    }
+}
@@ -0,0 +1,44 @@
+/*
+ * apex_proggen.h
+ * Contains declarations for the random APEX program generator
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_PROGGEN_H_
+#define _APEX_PROGGEN_H_
+
+#include <stdio.h>
+
+#include "apex_cpu.h"
+
+/* Registers the generator reserves, the body only writes the others */
+#define PROGGEN_OFFSET_REG 12   /* Index register of LDR/STR, never zero, divisor of DIV */
+#define PROGGEN_BASE_REG 13     /* Base register of every memory access */
+#define PROGGEN_COUNTER_REG 14  /* Trip counter of loops */
+
+/* Instructions in a program the generator can emit */
+#define PROGGEN_MAX_PROGRAM 4096
+
+typedef struct APEX_ProgGenConfig
+{
+    int length;             /* Instructions in the body, prologue and loop control excluded */
+    int dep_distance;       /* Sources are read up to this many producers back */
+    int dep_percent;        /* Chance a source is a recent producer */
+    int mem_percent;        /* Chance of LOAD/LDR/STORE/STR */
+    int branch_percent;     /* Chance of a forward BZ/BNZ */
+    int loop_percent;       /* Chance a block of the body is a counted loop */
+    int max_trips;          /* Iterations of a counted loop */
+    int div_percent;        /* Chance of DIV */
+    int div_zero_percent;   /* Chance a DIV divides by any register, which faults when zero */
+    int fault_percent;      /* Chance a memory access leaves data memory */
+} APEX_ProgGenConfig;
+
+void APEX_proggen_default_config(APEX_ProgGenConfig *config);
+int APEX_proggen_generate(const APEX_ProgGenConfig *config, unsigned long long seed,
+                          APEX_Instruction *code_memory, int capacity);
+void APEX_proggen_write_asm(FILE *out, const APEX_Instruction *code_memory,
+                            int code_memory_size);
+
+#endif
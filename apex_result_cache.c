@@ -0,0 +1,273 @@
+/*
+ * apex_result_cache.c
+ * Contains a content-addressed on-disk cache of simulation results.
+ *
+ * The key is a 64-bit FNV-1a hash of the build ID, the decoded code memory,
+ * the initial data memory, the cycle limit and every parameter that changes
+ * timing. A run with the same key is deterministic, so its stored cycle
+ * count, final state and counters can be printed instead of simulating
+ * again.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "apex_result_cache.h"
+#include "apex_watchdog.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static unsigned long long
+hash_bytes(unsigned long long hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+    size_t i;
+
+    for (i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static unsigned long long
+hash_int(unsigned long long hash, int value)
+{
+    return hash_bytes(hash, &value, sizeof(value));
+}
+
+/*
+ * Hashes everything that determines the outcome of running cpu from its
+ * current state for at most cycle_limit cycles
+ */
+unsigned long long
+APEX_result_key(const APEX_CPU *cpu, int cycle_limit, const APEX_CacheConfig *l1_config)
+{
+    unsigned long long hash = FNV_OFFSET;
+    int i;
+
+    hash = hash_bytes(hash, APEX_BUILD_ID, strlen(APEX_BUILD_ID));
+
+    /* Decoded fields only, opcode_str is not used past the parser */
+    hash = hash_int(hash, cpu->code_memory_size);
+    for (i = 0; i < cpu->code_memory_size; ++i)
+    {
+        const APEX_Instruction *ins = &cpu->code_memory[i];
+
+        hash = hash_int(hash, ins->opcode);
+        hash = hash_int(hash, ins->rd);
+        hash = hash_int(hash, ins->rs1);
+        hash = hash_int(hash, ins->rs2);
+        hash = hash_int(hash, ins->rs3);
+        hash = hash_int(hash, ins->imm);
+    }
+
+    hash = hash_int(hash, cpu->pc);
+    hash = hash_bytes(hash, cpu->regs, sizeof(cpu->regs));
+    hash = hash_bytes(hash, cpu->regs_valid_check, sizeof(cpu->regs_valid_check));
+    hash = hash_bytes(hash, cpu->data_memory, sizeof(int) * DATA_MEMORY_SIZE);
+
+    hash = hash_int(hash, cycle_limit);
+    hash = hash_int(hash, cpu->memory_latency);
+    hash = hash_int(hash, cpu->fusion);
+    hash = hash_int(hash, cpu->store_buffer_depth);
+    hash = hash_int(hash, cpu->num_mshrs);
+    hash = hash_int(hash, cpu->prefetcher ? cpu->prefetcher->config.kind : APEX_PREFETCH_NONE);
+    if (cpu->prefetcher)
+    {
+        hash = hash_int(hash, cpu->prefetcher->config.degree);
+        hash = hash_int(hash, cpu->prefetcher->config.distance);
+    }
+    hash = hash_int(hash, cpu->fetch_queue_depth);
+    hash = hash_int(hash, cpu->icache != NULL);
+    if (cpu->icache)
+    {
+        hash = hash_bytes(hash, &cpu->icache->config, sizeof(cpu->icache->config));
+    }
+    hash = hash_int(hash, cpu->loop_buffer_size);
+    hash = hash_int(hash, cpu->fetch_stages);
+    hash = hash_int(hash, cpu->execute_stages);
+    hash = hash_int(hash, cpu->memory_stages);
+    hash = hash_int(hash, cpu->dram != NULL);
+    if (cpu->dram)
+    {
+        hash = hash_bytes(hash, &cpu->dram->config, sizeof(cpu->dram->config));
+    }
+    hash = hash_int(hash, cpu->watchdog ? cpu->watchdog->threshold : 0);
+    hash = hash_int(hash, l1_config != NULL);
+    if (l1_config)
+    {
+        hash = hash_int(hash, l1_config->sets);
+        hash = hash_int(hash, l1_config->ways);
+        hash = hash_int(hash, l1_config->line_words);
+        hash = hash_int(hash, l1_config->hit_latency);
+        hash = hash_int(hash, l1_config->miss_latency);
+        hash = hash_int(hash, l1_config->transfer_latency);
+        hash = hash_int(hash, l1_config->upgrade_latency);
+    }
+    return hash;
+}
+
+/*
+ * Copies the counters of cpu and its features into stats, zero for the
+ * features that are off
+ */
+static void
+save_run_stats(const APEX_CPU *cpu, APEX_RunStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->cpu = cpu->stats;
+    if (cpu->l1)
+    {
+        stats->l1 = cpu->l1->stats;
+    }
+    if (cpu->icache)
+    {
+        stats->icache = cpu->icache->stats;
+    }
+    if (cpu->prefetcher)
+    {
+        stats->prefetch = cpu->prefetcher->stats;
+    }
+    if (cpu->dram)
+    {
+        stats->dram = cpu->dram->stats;
+        stats->dram_clock = cpu->dram->clock;
+        stats->dram_last_done = cpu->dram->last_done;
+    }
+}
+
+/*
+ * Puts the counters saved by save_run_stats back into cpu and its features
+ */
+static void
+restore_run_stats(APEX_CPU *cpu, const APEX_RunStats *stats)
+{
+    cpu->stats = stats->cpu;
+    if (cpu->l1)
+    {
+        cpu->l1->stats = stats->l1;
+    }
+    if (cpu->icache)
+    {
+        cpu->icache->stats = stats->icache;
+    }
+    if (cpu->prefetcher)
+    {
+        cpu->prefetcher->stats = stats->prefetch;
+    }
+    if (cpu->dram)
+    {
+        cpu->dram->stats = stats->dram;
+        cpu->dram->clock = stats->dram_clock;
+        cpu->dram->last_done = stats->dram_last_done;
+    }
+}
+
+static void
+result_path(char *path, size_t size, const char *dir, unsigned long long key)
+{
+    snprintf(path, size, "%s/%016llx.res", dir, key);
+}
+
+/*
+ * Restores the final state stored for key into cpu, returns FALSE on a miss
+ */
+int
+APEX_result_load(const char *dir, unsigned long long key, APEX_CPU *cpu, int *completed)
+{
+    char path[4096];
+    APEX_Result *result;
+    FILE *fp;
+    int hit;
+
+    result_path(path, sizeof(path), dir, key);
+    fp = fopen(path, "rb");
+    if (!fp)
+    {
+        return FALSE;
+    }
+
+    result = malloc(sizeof(APEX_Result));
+    hit = result && fread(result, sizeof(APEX_Result), 1, fp) == 1
+          && memcmp(result->magic, APEX_RESULT_MAGIC, sizeof(result->magic)) == 0
+          && result->key == key
+          && strncmp(result->build_id, APEX_BUILD_ID, sizeof(result->build_id)) == 0;
+    fclose(fp);
+
+    if (hit)
+    {
+        *completed = result->completed;
+        cpu->clock = result->clock;
+        cpu->insn_completed = result->insn_completed;
+        cpu->zero_flag = result->zero_flag;
+        memcpy(cpu->regs, result->regs, sizeof(cpu->regs));
+        memcpy(cpu->regs_valid_check, result->regs_valid, sizeof(cpu->regs_valid_check));
+        memcpy(cpu->data_memory, result->data_memory, sizeof(int) * DATA_MEMORY_SIZE);
+        memcpy(cpu->dirty, result->dirty, sizeof(cpu->dirty));
+        cpu->digest = result->digest;
+        cpu->fault = result->fault;
+        restore_run_stats(cpu, &result->stats);
+    }
+    free(result);
+    return hit;
+}
+
+/*
+ * Stores the final state of cpu under key. The entry is written to a
+ * temporary file and renamed, so concurrent runs never read a partial one.
+ */
+int
+APEX_result_store(const char *dir, unsigned long long key, const APEX_CPU *cpu, int completed)
+{
+    char path[4096], tmp[4200];
+    APEX_Result *result;
+    FILE *fp;
+    int ok;
+
+    result = calloc(1, sizeof(APEX_Result));
+    if (!result)
+    {
+        return FALSE;
+    }
+
+    memcpy(result->magic, APEX_RESULT_MAGIC, sizeof(result->magic));
+    result->key = key;
+    strncpy(result->build_id, APEX_BUILD_ID, sizeof(result->build_id) - 1);
+    result->completed = completed;
+    result->clock = cpu->clock;
+    result->insn_completed = cpu->insn_completed;
+    result->zero_flag = cpu->zero_flag;
+    memcpy(result->regs, cpu->regs, sizeof(result->regs));
+    memcpy(result->regs_valid, cpu->regs_valid_check, sizeof(result->regs_valid));
+    memcpy(result->data_memory, cpu->data_memory, sizeof(int) * DATA_MEMORY_SIZE);
+    memcpy(result->dirty, cpu->dirty, sizeof(result->dirty));
+    result->digest = cpu->digest;
+    result->fault = cpu->fault;
+    save_run_stats(cpu, &result->stats);
+
+    result_path(path, sizeof(path), dir, key);
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+    fp = fopen(tmp, "wb");
+    if (!fp)
+    {
+        free(result);
+        return FALSE;
+    }
+    ok = (fwrite(result, sizeof(APEX_Result), 1, fp) == 1);
+    ok = (fclose(fp) == 0) && ok;
+    ok = ok && (rename(tmp, path) == 0);
+    if (!ok)
+    {
+        remove(tmp);
+    }
+    free(result);
+    return ok;
+}
@@ -0,0 +1,64 @@
+/*
+ * apex_result_cache.h
+ * Contains declarations for the on-disk cache of simulation results
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_RESULT_CACHE_H_
+#define _APEX_RESULT_CACHE_H_
+
+#include "apex_cache.h"
+#include "apex_cpu.h"
+#include "apex_dram.h"
+#include "apex_prefetch.h"
+
+#define APEX_RESULT_MAGIC "APEXRES8"
+
+/* Identifies the simulator binary, results of other builds are ignored */
+#ifndef APEX_BUILD_ID
+#define APEX_BUILD_ID __DATE__ " " __TIME__
+#endif
+
+/*
+ * Every counter behind the statistics a run prints. A feature with counters
+ * of its own adds them here and to save_run_stats and restore_run_stats, so
+ * a cache hit prints the same statistics as the run that stored it.
+ */
+typedef struct APEX_RunStats
+{
+    APEX_CpuStats cpu;
+    APEX_CacheStats l1;                /* Zero without an L1 */
+    APEX_CacheStats icache;            /* Zero without an I-cache */
+    APEX_PrefetchStats prefetch;       /* Zero without a prefetcher */
+    APEX_DramStats dram;               /* Zero without a DRAM */
+    long dram_clock;
+    long dram_last_done;
+} APEX_RunStats;
+
+/* Final state of one run, stored in <dir>/<key>.res */
+typedef struct APEX_Result
+{
+    char magic[8];
+    unsigned long long key;
+    char build_id[64];
+    int completed;                     /* {TRUE, FALSE} HALT retired */
+    int clock;
+    int insn_completed;
+    int zero_flag;
+    APEX_Fault fault;
+    int regs[REG_FILE_SIZE];
+    int regs_valid[REG_FILE_SIZE];
+    int data_memory[DATA_MEMORY_SIZE];
+    unsigned long long digest;
+    unsigned long long dirty[DATA_MEMORY_BITMAP_WORDS];
+    APEX_RunStats stats;
+} APEX_Result;
+
+unsigned long long APEX_result_key(const APEX_CPU *cpu, int cycle_limit,
+                                   const APEX_CacheConfig *l1_config);
+int APEX_result_load(const char *dir, unsigned long long key, APEX_CPU *cpu, int *completed);
+int APEX_result_store(const char *dir, unsigned long long key, const APEX_CPU *cpu, int completed);
+
+#endif
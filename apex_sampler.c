@@ -0,0 +1,224 @@
+/*
+ * apex_sampler.c
+ * Contains the time-series sampler of the pipeline counters.
+ *
+ * Every `period` cycles the simulator turns the difference of cpu->stats
+ * since the previous sample into an APEX_Sample and pushes it into a
+ * preallocated ring. A background thread drains the ring to a CSV or binary
+ * file, so the simulation loop never touches the file. The simulator wakes
+ * the writer once the ring is half full; the writer also drains on its own
+ * every few milliseconds.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "apex_sampler.h"
+
+#define WRITER_POLL_NS 10000000L
+
+static void
+write_sample(APEX_Sampler *sampler, const APEX_Sample *sample)
+{
+    if (!sampler->csv)
+    {
+        fwrite(sample, sizeof(APEX_Sample), 1, sampler->fp);
+        return;
+    }
+
+    fprintf(sampler->fp, "%d,%d,%d,%.4f,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld\n", sample->cycle,
+            sample->cycles, sample->instructions,
+            sample->cycles ? (double)sample->instructions / sample->cycles : 0.0,
+            sample->load_use_stalls, sample->operand_stalls, sample->memory_stalls,
+            sample->branch_flushes, sample->loads, sample->stores, sample->forwarded_ex,
+            sample->forwarded_mem);
+}
+
+static void *
+writer_thread(void *arg)
+{
+    APEX_Sampler *sampler = arg;
+
+    while (TRUE)
+    {
+        unsigned long tail = sampler->tail;
+        unsigned long head = __atomic_load_n(&sampler->head, __ATOMIC_ACQUIRE);
+
+        if (head == tail)
+        {
+            struct timespec deadline;
+
+            if (__atomic_load_n(&sampler->closing, __ATOMIC_ACQUIRE)
+                && __atomic_load_n(&sampler->head, __ATOMIC_ACQUIRE) == tail)
+            {
+                break;
+            }
+
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += WRITER_POLL_NS;
+            if (deadline.tv_nsec >= 1000000000L)
+            {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_mutex_lock(&sampler->lock);
+            pthread_cond_timedwait(&sampler->wake, &sampler->lock, &deadline);
+            pthread_mutex_unlock(&sampler->lock);
+            continue;
+        }
+
+        for (; tail != head; ++tail)
+        {
+            write_sample(sampler, &sampler->ring[tail % sampler->capacity]);
+        }
+        __atomic_store_n(&sampler->tail, tail, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+static void
+wake_writer(APEX_Sampler *sampler)
+{
+    pthread_mutex_lock(&sampler->lock);
+    pthread_cond_signal(&sampler->wake);
+    pthread_mutex_unlock(&sampler->lock);
+}
+
+/*
+ * Opens filename for samples every period cycles, files ending in .csv are
+ * written as text and all others as binary records
+ */
+APEX_Sampler *
+APEX_sampler_open(const char *filename, int period)
+{
+    APEX_Sampler *sampler;
+    size_t len;
+
+    if (!filename || period <= 0)
+    {
+        return NULL;
+    }
+
+    sampler = calloc(1, sizeof(APEX_Sampler));
+    if (!sampler)
+    {
+        return NULL;
+    }
+
+    sampler->capacity = APEX_SAMPLER_CAPACITY;
+    sampler->ring = calloc(sampler->capacity, sizeof(APEX_Sample));
+    sampler->fp = fopen(filename, "wb");
+    if (!sampler->ring || !sampler->fp)
+    {
+        if (sampler->fp)
+        {
+            fclose(sampler->fp);
+        }
+        free(sampler->ring);
+        free(sampler);
+        return NULL;
+    }
+
+    len = strlen(filename);
+    sampler->csv = (len > 4 && strcmp(filename + len - 4, ".csv") == 0);
+    sampler->period = period;
+    sampler->next_cycle = period;
+
+    if (sampler->csv)
+    {
+        fprintf(sampler->fp, "cycle,cycles,instructions,ipc,load_use_stalls,operand_stalls,"
+                             "memory_stalls,branch_flushes,loads,stores,forwarded_ex,forwarded_mem\n");
+    }
+    else
+    {
+        APEX_SampleHeader header;
+
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, APEX_SAMPLE_MAGIC, sizeof(header.magic));
+        header.record_size = sizeof(APEX_Sample);
+        header.period = period;
+        fwrite(&header, sizeof(header), 1, sampler->fp);
+    }
+
+    pthread_mutex_init(&sampler->lock, NULL);
+    pthread_cond_init(&sampler->wake, NULL);
+    pthread_create(&sampler->writer, NULL, writer_thread, sampler);
+    return sampler;
+}
+
+/*
+ * Pushes the counters since the previous sample, called by the simulation
+ * loop once cpu->clock + 1 reaches next_cycle
+ */
+void
+APEX_sampler_record(APEX_Sampler *sampler, const APEX_CPU *cpu)
+{
+    const APEX_CpuStats *now = &cpu->stats;
+    const APEX_CpuStats *then = &sampler->last_stats;
+    unsigned long head = sampler->head;
+    APEX_Sample *sample;
+
+    /* Full ring, the writer is behind: wait rather than lose samples */
+    while (head - __atomic_load_n(&sampler->tail, __ATOMIC_ACQUIRE) == sampler->capacity)
+    {
+        wake_writer(sampler);
+        sched_yield();
+    }
+
+    sample = &sampler->ring[head % sampler->capacity];
+    sample->cycle = cpu->clock + 1;
+    sample->cycles = sample->cycle - sampler->last_cycle;
+    sample->instructions = cpu->insn_completed - sampler->last_instructions;
+    sample->load_use_stalls = now->load_use_stalls - then->load_use_stalls;
+    sample->operand_stalls = now->operand_stalls - then->operand_stalls;
+    sample->memory_stalls = now->memory_stalls - then->memory_stalls;
+    sample->branch_flushes = now->branch_flushes - then->branch_flushes;
+    sample->loads = now->loads - then->loads;
+    sample->stores = now->stores - then->stores;
+    sample->forwarded_ex = now->forwarded_ex - then->forwarded_ex;
+    sample->forwarded_mem = now->forwarded_mem - then->forwarded_mem;
+    __atomic_store_n(&sampler->head, head + 1, __ATOMIC_RELEASE);
+
+    sampler->last_cycle = sample->cycle;
+    sampler->last_instructions = cpu->insn_completed;
+    sampler->last_stats = *now;
+    sampler->next_cycle = sample->cycle + sampler->period;
+
+    if (head + 1 - __atomic_load_n(&sampler->tail, __ATOMIC_ACQUIRE) == sampler->capacity / 2)
+    {
+        wake_writer(sampler);
+    }
+}
+
+/*
+ * Records the last partial window, drains the ring and closes the file
+ */
+void
+APEX_sampler_close(APEX_Sampler *sampler, const APEX_CPU *cpu)
+{
+    if (!sampler)
+    {
+        return;
+    }
+
+    if (cpu && cpu->clock + 1 > sampler->last_cycle)
+    {
+        APEX_sampler_record(sampler, cpu);
+    }
+
+    __atomic_store_n(&sampler->closing, TRUE, __ATOMIC_RELEASE);
+    wake_writer(sampler);
+    pthread_join(sampler->writer, NULL);
+
+    printf("APEX_SAMPLER: %lu samples of %d cycles written\n", sampler->head, sampler->period);
+    fclose(sampler->fp);
+    pthread_cond_destroy(&sampler->wake);
+    pthread_mutex_destroy(&sampler->lock);
+    free(sampler->ring);
+    free(sampler);
+}
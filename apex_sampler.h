@@ -0,0 +1,73 @@
+/*
+ * apex_sampler.h
+ * Contains declarations for time-series snapshots of the pipeline counters
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_SAMPLER_H_
+#define _APEX_SAMPLER_H_
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "apex_cpu.h"
+
+#define APEX_SAMPLE_MAGIC "APEXSMP1"
+#define APEX_SAMPLER_CAPACITY 4096
+
+/* Counters of one window of `cycles` cycles ending at `cycle` */
+typedef struct APEX_Sample
+{
+    int cycle;
+    int cycles;
+    int instructions;        /* Retired in the window */
+    long load_use_stalls;
+    long operand_stalls;
+    long memory_stalls;
+    long branch_flushes;
+    long loads;
+    long stores;
+    long forwarded_ex;
+    long forwarded_mem;
+} APEX_Sample;
+
+/* Binary sample file header, followed by APEX_Sample records */
+typedef struct APEX_SampleHeader
+{
+    char magic[8];
+    int record_size;
+    int period;
+} APEX_SampleHeader;
+
+/*
+ * Single producer, single consumer ring of samples. The simulator only
+ * advances head, the writer thread only advances tail.
+ */
+typedef struct APEX_Sampler
+{
+    int period;                    /* Cycles between samples */
+    int next_cycle;                /* Cycle of the next sample */
+    int last_cycle;                /* Cycle and totals at the previous sample */
+    int last_instructions;
+    APEX_CpuStats last_stats;
+
+    APEX_Sample *ring;
+    unsigned long capacity;
+    unsigned long head;            /* Samples produced */
+    unsigned long tail;            /* Samples written */
+    int closing;                   /* {TRUE, FALSE} No more samples will be produced */
+
+    FILE *fp;
+    int csv;                       /* {TRUE, FALSE} CSV, otherwise binary records */
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} APEX_Sampler;
+
+APEX_Sampler *APEX_sampler_open(const char *filename, int period);
+void APEX_sampler_record(APEX_Sampler *sampler, const APEX_CPU *cpu);
+void APEX_sampler_close(APEX_Sampler *sampler, const APEX_CPU *cpu);
+
+#endif
@@ -0,0 +1,693 @@
+/*
+ * apex_sched.c
+ * Contains a list scheduler that reorders the instructions of every basic
+ * block of an APEX program to remove pipeline stalls.
+ *
+ * Each block's dependence DAG covers registers (RAW, WAR, WAW), data
+ * memory (STORE/STR against every other access, unless both use the same
+ * base register value with different immediates) and the zero flag: the
+ * last instruction that sets it stays after the other setters, so BZ/BNZ
+ * and the following blocks see the same flag. The BZ/BNZ/HALT that ends a
+ * block stays last, so blocks keep their size and branch offsets stay
+ * valid.
+ *
+ * Before scheduling, a destination that only exists to reuse a register
+ * (WAR/WAW against an earlier instruction of the block) is renamed to a
+ * register that the block does not touch and that is dead on entry and
+ * exit, if one exists. Registers are live at HALT unless --live-out names
+ * the program's outputs.
+ *
+ * The scheduler picks, among the instructions whose predecessors are
+ * placed, the one that retires earliest behind the instructions already
+ * placed, using the timing model of apex_timing.c, then the one with the
+ * longest latency path to the end of the block.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_isa.h"
+#include "apex_proggen.h"
+#include "apex_timing.h"
+
+/* Instructions before a block that are replayed while scheduling it */
+#define SCHED_CONTEXT 8
+
+/* Register mask with one bit per register */
+#define SCHED_ALL_REGS ((1u << REG_FILE_SIZE) - 1)
+
+typedef struct SchedBlock
+{
+    int first;
+    int last;
+    unsigned int use;           /* Registers read before written in the block */
+    unsigned int def;
+    unsigned int referenced;    /* Registers read or written in the block */
+    unsigned int live_in;
+    unsigned int live_out;
+    int succ[2];                /* Fall-through and branch target blocks, -1 for none */
+    int exits;                  /* {TRUE, FALSE} Ends in HALT or runs off code memory */
+} SchedBlock;
+
+typedef struct SchedStats
+{
+    int moved;                  /* Instructions placed at a different index */
+    int renamed;                /* Destinations given a new register */
+} SchedStats;
+
+typedef struct SchedResult
+{
+    int completed;              /* {TRUE, FALSE} HALT retired */
+    int cycles;
+    int instructions;
+    int regs[REG_FILE_SIZE];
+    int *data_memory;
+} SchedResult;
+
+static void
+print_usage(const char *prog)
+{
+    fprintf(stderr, "APEX_Help: Usage %s <input_file> <output_file> [options]\n", prog);
+    fprintf(stderr, "    --mem-latency <n>       Memory stage cycles of LOAD/STORE (default 1)\n");
+    fprintf(stderr, "    --live-out <R1,R2,..>   Registers read after HALT (default all)\n");
+    fprintf(stderr, "    --no-rename             Only reorder, keep every register\n");
+}
+
+static unsigned int
+source_mask(const APEX_Instruction *ins)
+{
+    int srcs[APEX_MAX_SOURCES];
+    int n = APEX_opcode_sources(ins->opcode, ins->rs1, ins->rs2, ins->rs3, srcs);
+    unsigned int mask = 0;
+    int i;
+
+    for (i = 0; i < n; ++i)
+    {
+        if (srcs[i] >= 0 && srcs[i] < REG_FILE_SIZE)
+        {
+            mask |= 1u << srcs[i];
+        }
+    }
+    return mask;
+}
+
+static unsigned int
+dest_mask(const APEX_Instruction *ins)
+{
+    if (APEX_opcode_writes_rd(ins->opcode) && ins->rd >= 0 && ins->rd < REG_FILE_SIZE)
+    {
+        return 1u << ins->rd;
+    }
+    return 0;
+}
+
+static int
+ends_block(const APEX_Instruction *ins)
+{
+    return APEX_opcode_is_branch(ins->opcode) || ins->opcode == OPCODE_HALT;
+}
+
+/*
+ * Splits code memory into basic blocks and computes the registers live
+ * into and out of each one. Returns the number of blocks.
+ */
+static int
+find_blocks(const APEX_Instruction *code, int size, unsigned int halt_live, SchedBlock **out)
+{
+    char *leader = calloc(size + 1, 1);
+    int *block_of = calloc(size, sizeof(int));
+    SchedBlock *blocks;
+    int num_blocks = 0;
+    int changed, i, b;
+
+    if (!leader || !block_of)
+    {
+        free(leader);
+        free(block_of);
+        return -1;
+    }
+    leader[0] = TRUE;
+    for (i = 0; i < size; ++i)
+    {
+        if (APEX_opcode_is_branch(code[i].opcode) && code[i].imm % 4 == 0
+            && i + code[i].imm / 4 >= 0 && i + code[i].imm / 4 < size)
+        {
+            leader[i + code[i].imm / 4] = TRUE;
+        }
+        if (ends_block(&code[i]))
+        {
+            leader[i + 1] = TRUE;
+        }
+    }
+    for (i = 0; i < size; ++i)
+    {
+        num_blocks += leader[i];
+    }
+
+    blocks = calloc(num_blocks, sizeof(SchedBlock));
+    if (!blocks)
+    {
+        free(leader);
+        free(block_of);
+        return -1;
+    }
+    b = -1;
+    for (i = 0; i < size; ++i)
+    {
+        if (leader[i])
+        {
+            blocks[++b].first = i;
+        }
+        blocks[b].last = i;
+        block_of[i] = b;
+    }
+
+    for (b = 0; b < num_blocks; ++b)
+    {
+        SchedBlock *block = &blocks[b];
+        const APEX_Instruction *end = &code[block->last];
+
+        for (i = block->first; i <= block->last; ++i)
+        {
+            block->use |= source_mask(&code[i]) & ~block->def;
+            block->def |= dest_mask(&code[i]);
+            block->referenced |= source_mask(&code[i]) | dest_mask(&code[i]);
+        }
+
+        block->succ[0] = block->succ[1] = -1;
+        if (end->opcode == OPCODE_HALT || block->last + 1 >= size)
+        {
+            block->exits = TRUE;
+        }
+        else
+        {
+            block->succ[0] = block_of[block->last + 1];
+        }
+        if (APEX_opcode_is_branch(end->opcode))
+        {
+            int target = block->last + end->imm / 4;
+
+            if (end->imm % 4 == 0 && target >= 0 && target < size)
+            {
+                block->succ[1] = block_of[target];
+            }
+            else
+            {
+                /* Faults, the registers are printed */
+                block->exits = TRUE;
+            }
+        }
+    }
+
+    /* Backward liveness until nothing changes */
+    do
+    {
+        changed = FALSE;
+        for (b = num_blocks - 1; b >= 0; --b)
+        {
+            SchedBlock *block = &blocks[b];
+            unsigned int live_out = block->exits ? halt_live : 0;
+            unsigned int live_in;
+
+            for (i = 0; i < 2; ++i)
+            {
+                if (block->succ[i] >= 0)
+                {
+                    live_out |= blocks[block->succ[i]].live_in;
+                }
+            }
+            live_in = block->use | (live_out & ~block->def);
+            if (live_out != block->live_out || live_in != block->live_in)
+            {
+                block->live_out = live_out;
+                block->live_in = live_in;
+                changed = TRUE;
+            }
+        }
+    } while (changed);
+
+    free(leader);
+    free(block_of);
+    *out = blocks;
+    return num_blocks;
+}
+
+/*
+ * Renames destinations in code[first..last] that reuse a register already
+ * read or written earlier in the block, when the value does not leave the
+ * block, to registers the block does not touch and that are dead around it
+ */
+static void
+rename_block(APEX_Instruction *code, const SchedBlock *block, SchedStats *stats)
+{
+    unsigned int free_regs = SCHED_ALL_REGS & ~(block->live_in | block->live_out | block->referenced);
+    unsigned int seen = 0;
+    int i, j;
+
+    for (i = block->first; i <= block->last && free_regs; ++i)
+    {
+        unsigned int dest = dest_mask(&code[i]);
+        int reg, redefined = FALSE, f;
+
+        seen |= source_mask(&code[i]);
+        if (!dest || !(seen & dest))
+        {
+            seen |= dest;
+            continue;
+        }
+        reg = code[i].rd;
+
+        for (j = i + 1; j <= block->last; ++j)
+        {
+            if (dest_mask(&code[j]) & dest)
+            {
+                redefined = TRUE;
+                break;
+            }
+        }
+        if (!redefined && (block->live_out & dest))
+        {
+            continue;
+        }
+
+        for (f = 0; !(free_regs & (1u << f)); ++f)
+        {
+        }
+        free_regs &= ~(1u << f);
+        code[i].rd = f;
+
+        /* Readers up to and including the next writer of reg */
+        for (j = i + 1; j <= block->last; ++j)
+        {
+            if (code[j].rs1 == reg && (source_mask(&code[j]) & dest))
+            {
+                code[j].rs1 = f;
+            }
+            if (code[j].rs2 == reg && (source_mask(&code[j]) & dest))
+            {
+                code[j].rs2 = f;
+            }
+            if (code[j].rs3 == reg && code[j].opcode == OPCODE_STR)
+            {
+                code[j].rs3 = f;
+            }
+            if (dest_mask(&code[j]) & dest)
+            {
+                break;
+            }
+        }
+        stats->renamed++;
+    }
+}
+
+/* TRUE when two memory accesses may touch the same word */
+static int
+may_alias(const APEX_Instruction *code, int a, int b)
+{
+    const APEX_Instruction *x = &code[a];
+    const APEX_Instruction *y = &code[b];
+    int base_x = APEX_opcode_is_store(x->opcode) ? x->rs2 : x->rs1;
+    int base_y = APEX_opcode_is_store(y->opcode) ? y->rs2 : y->rs1;
+    int i;
+
+    if ((x->opcode != OPCODE_LOAD && x->opcode != OPCODE_STORE)
+        || (y->opcode != OPCODE_LOAD && y->opcode != OPCODE_STORE) || base_x != base_y
+        || x->imm == y->imm)
+    {
+        return TRUE;
+    }
+    /* The base register must hold the same value for both */
+    for (i = a; i < b; ++i)
+    {
+        if (dest_mask(&code[i]) & (1u << base_x))
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* TRUE when instruction b, later in the block, must stay after a */
+static int
+depends(const APEX_Instruction *code, int a, int b, int last_flag_setter)
+{
+    const APEX_Instruction *x = &code[a];
+    const APEX_Instruction *y = &code[b];
+    int x_mem = APEX_opcode_is_load(x->opcode) || APEX_opcode_is_store(x->opcode);
+    int y_mem = APEX_opcode_is_load(y->opcode) || APEX_opcode_is_store(y->opcode);
+
+    if ((dest_mask(x) & (source_mask(y) | dest_mask(y))) || (dest_mask(y) & source_mask(x)))
+    {
+        return TRUE;
+    }
+    if (x_mem && y_mem && (APEX_opcode_is_store(x->opcode) || APEX_opcode_is_store(y->opcode))
+        && may_alias(code, a, b))
+    {
+        return TRUE;
+    }
+    return (b == last_flag_setter && APEX_opcode_sets_zero_flag(x->opcode));
+}
+
+static void
+append_record(APEX_TraceRecord *trace, int *count, const APEX_Instruction *ins, int pc)
+{
+    APEX_TraceRecord *rec = &trace[(*count)++];
+
+    memset(rec, 0, sizeof(*rec));
+    rec->pc = pc;
+    rec->opcode = ins->opcode;
+    rec->rd = ins->rd;
+    rec->rs1 = ins->rs1;
+    rec->rs2 = ins->rs2;
+    rec->rs3 = ins->rs3;
+}
+
+/*
+ * List-schedules code[first..last] into out[first..last], the block
+ * terminator stays last. out[0..first-1] is already final.
+ */
+static void
+schedule_block(const APEX_Instruction *code, APEX_Instruction *out, const SchedBlock *block,
+               const APEX_TimingConfig *timing, SchedStats *stats)
+{
+    int first = block->first;
+    int n = block->last - first + 1 - (ends_block(&code[block->last]) ? 1 : 0);
+    char *dep = calloc((size_t)n * n, 1);
+    int *height = calloc(n, sizeof(int));
+    int *placed = calloc(n, sizeof(int));
+    APEX_TraceRecord *trace = malloc(sizeof(APEX_TraceRecord) * (SCHED_CONTEXT + n + 1));
+    APEX_TimingStats stats_now;
+    int last_flag_setter = -1;
+    int i, j, k, count, context, best_cycles;
+
+    if (!dep || !height || !placed || !trace)
+    {
+        memcpy(&out[first], &code[first], sizeof(APEX_Instruction) * (block->last - first + 1));
+        free(dep);
+        free(height);
+        free(placed);
+        free(trace);
+        return;
+    }
+
+    /* A block ending in HALT leaves no reader of the flag */
+    if (code[block->last].opcode != OPCODE_HALT)
+    {
+        for (i = first; i < first + n; ++i)
+        {
+            if (APEX_opcode_sets_zero_flag(code[i].opcode))
+            {
+                last_flag_setter = i;
+            }
+        }
+    }
+
+    for (i = 0; i < n; ++i)
+    {
+        for (j = i + 1; j < n; ++j)
+        {
+            dep[i * n + j] = depends(code, first + i, first + j, last_flag_setter);
+        }
+    }
+
+    /* Longest latency path to the end of the block */
+    for (i = n - 1; i >= 0; --i)
+    {
+        int latency = APEX_opcode_is_load(code[first + i].opcode) ? timing->load_latency + 1 : 1;
+
+        height[i] = latency;
+        for (j = i + 1; j < n; ++j)
+        {
+            if (dep[i * n + j] && latency + height[j] > height[i])
+            {
+                height[i] = latency + height[j];
+            }
+        }
+    }
+
+    context = 0;
+    for (i = (first > SCHED_CONTEXT) ? first - SCHED_CONTEXT : 0; i < first; ++i)
+    {
+        append_record(trace, &context, &out[i], 4000 + 4 * i);
+    }
+
+    for (k = 0; k < n; ++k)
+    {
+        int best = -1;
+
+        for (i = 0; i < n; ++i)
+        {
+            int ready = !placed[i];
+
+            for (j = 0; j < i && ready; ++j)
+            {
+                ready = !dep[j * n + i] || placed[j];
+            }
+            if (!ready)
+            {
+                continue;
+            }
+
+            count = context + k;
+            append_record(trace, &count, &code[first + i], 4000 + 4 * (first + k));
+            APEX_timing_run(trace, count, timing, 0, &stats_now);
+            if (best < 0 || stats_now.cycles < best_cycles
+                || (stats_now.cycles == best_cycles && height[i] > height[best]))
+            {
+                best = i;
+                best_cycles = stats_now.cycles;
+            }
+        }
+
+        placed[best] = TRUE;
+        out[first + k] = code[first + best];
+        count = context + k;
+        append_record(trace, &count, &code[first + best], 4000 + 4 * (first + k));
+    }
+
+    /* Greedy choices can lose to the original order when memory is slow */
+    APEX_timing_run(trace, context + n, timing, 0, &stats_now);
+    best_cycles = stats_now.cycles;
+    count = context;
+    for (i = 0; i < n; ++i)
+    {
+        append_record(trace, &count, &code[first + i], 4000 + 4 * (first + i));
+    }
+    APEX_timing_run(trace, count, timing, 0, &stats_now);
+    if (stats_now.cycles < best_cycles)
+    {
+        memcpy(&out[first], &code[first], sizeof(APEX_Instruction) * n);
+    }
+    for (i = 0; i < n; ++i)
+    {
+        if (memcmp(&out[first + i], &code[first + i], sizeof(APEX_Instruction)) != 0)
+        {
+            stats->moved++;
+        }
+    }
+
+    if (n < block->last - first + 1)
+    {
+        out[block->last] = code[block->last];
+    }
+
+    free(dep);
+    free(height);
+    free(placed);
+    free(trace);
+}
+
+/*
+ * Runs code on the pipeline until HALT or a fault, returns FALSE when the
+ * CPU could not be created
+ */
+static int
+simulate(APEX_Instruction *code, int size, int memory_latency, SchedResult *result)
+{
+    APEX_CPU *cpu = APEX_cpu_create(code, size);
+    int stopped = FALSE;
+
+    if (!cpu)
+    {
+        return FALSE;
+    }
+    cpu->single_step = FALSE;
+    cpu->memory_latency = memory_latency;
+    while (!stopped && cpu->clock < 10000000)
+    {
+        stopped = APEX_cpu_step(cpu);
+        if (!stopped)
+        {
+            cpu->clock++;
+        }
+    }
+    result->completed = stopped && cpu->fault.type == APEX_FAULT_NONE;
+    result->cycles = cpu->clock + 1;
+    result->instructions = cpu->insn_completed;
+    memcpy(result->regs, cpu->regs, sizeof(result->regs));
+    result->data_memory = cpu->data_memory;
+    cpu->shared_data_memory = TRUE;
+    APEX_cpu_stop(cpu);
+    return TRUE;
+}
+
+static unsigned int
+parse_registers(const char *list)
+{
+    unsigned int mask = 0;
+    const char *p = list;
+
+    while (*p)
+    {
+        int reg;
+
+        if ((*p != 'R' && *p != 'r') || sscanf(p + 1, "%d", &reg) != 1 || reg < 0
+            || reg >= REG_FILE_SIZE)
+        {
+            return 0;
+        }
+        mask |= 1u << reg;
+        p = strchr(p, ',');
+        if (!p)
+        {
+            break;
+        }
+        p++;
+    }
+    return mask;
+}
+
+int main(int argc, char const *argv[])
+{
+    APEX_Instruction *code, *renamed, *scheduled;
+    SchedBlock *blocks;
+    SchedStats stats;
+    SchedResult before, after;
+    APEX_TimingConfig timing;
+    unsigned int live_out = SCHED_ALL_REGS;
+    int memory_latency = 1;
+    int rename = TRUE;
+    int size, num_blocks, b, i, same;
+    FILE *out;
+
+    if (argc < 3)
+    {
+        print_usage(argv[0]);
+        exit(1);
+    }
+    for (i = 3; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--mem-latency") == 0 && i + 1 < argc)
+        {
+            memory_latency = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--live-out") == 0 && i + 1 < argc)
+        {
+            live_out = parse_registers(argv[++i]);
+            if (!live_out)
+            {
+                print_usage(argv[0]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--no-rename") == 0)
+        {
+            rename = FALSE;
+        }
+        else
+        {
+            print_usage(argv[0]);
+            exit(1);
+        }
+    }
+    if (memory_latency < 1)
+    {
+        fprintf(stderr, "APEX_Error: --mem-latency must be positive\n");
+        exit(1);
+    }
+
+    ENABLE_DEBUG_MESSAGES = 0;
+    code = create_code_memory(argv[1], &size);
+    if (!code)
+    {
+        fprintf(stderr, "APEX_Error: Unable to read %s\n", argv[1]);
+        exit(1);
+    }
+    renamed = malloc(sizeof(APEX_Instruction) * size);
+    scheduled = malloc(sizeof(APEX_Instruction) * size);
+    num_blocks = find_blocks(code, size, live_out, &blocks);
+    if (!renamed || !scheduled || num_blocks < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to allocate the scheduler\n");
+        exit(1);
+    }
+
+    APEX_timing_default_config(&timing);
+    timing.load_latency = memory_latency;
+    timing.store_latency = memory_latency;
+
+    memset(&stats, 0, sizeof(stats));
+    memcpy(renamed, code, sizeof(APEX_Instruction) * size);
+    for (b = 0; b < num_blocks; ++b)
+    {
+        if (rename)
+        {
+            rename_block(renamed, &blocks[b], &stats);
+        }
+        schedule_block(renamed, scheduled, &blocks[b], &timing, &stats);
+    }
+
+    out = fopen(argv[2], "w");
+    if (!out)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write %s\n", argv[2]);
+        exit(1);
+    }
+    APEX_proggen_write_asm(out, scheduled, size);
+    fclose(out);
+
+    printf("APEX_SCHED: %s -> %s, %d basic blocks, %d instructions moved, %d registers renamed\n",
+           argv[1], argv[2], num_blocks, stats.moved, stats.renamed);
+
+    if (!simulate(code, size, memory_latency, &before)
+        || !simulate(scheduled, size, memory_latency, &after))
+    {
+        fprintf(stderr, "APEX_Error: Unable to allocate the CPU\n");
+        exit(1);
+    }
+    printf("APEX_SCHED: Simulated cycles before = %d after = %d, saved %d (%.2f%%), mem_latency=%d\n",
+           before.cycles, after.cycles, before.cycles - after.cycles,
+           100.0 * (before.cycles - after.cycles) / before.cycles, memory_latency);
+
+    same = (before.completed == after.completed && before.instructions == after.instructions
+            && memcmp(before.data_memory, after.data_memory, sizeof(int) * DATA_MEMORY_SIZE) == 0);
+    for (i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        if ((live_out & (1u << i)) && before.regs[i] != after.regs[i])
+        {
+            same = FALSE;
+        }
+    }
+    if (same)
+    {
+        printf("APEX_SCHED: Final data memory and live-out registers are identical\n");
+    }
+    else
+    {
+        printf("APEX_SCHED: Final state differs from the original program%s\n",
+               before.completed ? "" : ", the original did not halt");
+    }
+
+    free(before.data_memory);
+    free(after.data_memory);
+    free(blocks);
+    free(renamed);
+    free(scheduled);
+    free(code);
+    return same ? 0 : 1;
+}
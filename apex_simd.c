@@ -0,0 +1,475 @@
+/*
+ * apex_simd.c
+ * Contains a long-lived simulation server for many small runs.
+ *
+ * Programs are parsed once and kept decoded in memory, CPUs are reset and
+ * reused from a pool instead of being allocated for every run. Clients
+ * connect to a Unix domain socket and send one request per line:
+ *
+ *   LOAD <file.asm>                        -> OK <program id> <instructions>
+ *   RUN <program id> simulate <cycles> [--mem-latency n] [--l1 s,w,words]
+ *       [--miss-latency n] [--watchdog n]  -> simulate output, then END
+ *   QUIT                                   -> closes the connection
+ *
+ * Errors are answered with a single ERR line. Connections are served by a
+ * fixed pool of worker threads.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "apex_cache.h"
+#include "apex_cpu.h"
+#include "apex_watchdog.h"
+
+#define SIMD_MAX_PROGRAMS 1024
+#define SIMD_QUEUE_SIZE 64
+#define SIMD_DEFAULT_THREADS 4
+
+typedef struct SIMD_Program
+{
+    char *filename;
+    APEX_Instruction *code_memory;
+    int code_memory_size;
+} SIMD_Program;
+
+typedef struct SIMD_Server
+{
+    /* Decoded programs, entries are never removed */
+    pthread_mutex_t programs_lock;
+    SIMD_Program programs[SIMD_MAX_PROGRAMS];
+    int num_programs;
+
+    /* Idle CPUs ready to be reset for the next run */
+    pthread_mutex_t pool_lock;
+    APEX_CPU **pool;
+    int pool_size;
+    int pool_capacity;
+
+    /* Accepted connections waiting for a worker */
+    pthread_mutex_t queue_lock;
+    pthread_cond_t queue_ready;
+    int queue[SIMD_QUEUE_SIZE];
+    int queue_head;
+    int queue_count;
+} SIMD_Server;
+
+static const char *socket_path;
+
+static void
+handle_signal(int sig)
+{
+    unlink(socket_path);
+    _exit(128 + sig);
+}
+
+/*
+ * Returns the id of filename, parsing it on first use, -1 when it can't be
+ * read
+ */
+static int
+load_program(SIMD_Server *server, const char *filename, int *size)
+{
+    APEX_Instruction *code_memory;
+    int id;
+
+    pthread_mutex_lock(&server->programs_lock);
+    for (id = 0; id < server->num_programs; ++id)
+    {
+        if (strcmp(server->programs[id].filename, filename) == 0)
+        {
+            *size = server->programs[id].code_memory_size;
+            pthread_mutex_unlock(&server->programs_lock);
+            return id;
+        }
+    }
+
+    /* create_code_memory uses strtok, parse under the lock */
+    code_memory = create_code_memory(filename, size);
+    if (!code_memory || server->num_programs == SIMD_MAX_PROGRAMS)
+    {
+        free(code_memory);
+        pthread_mutex_unlock(&server->programs_lock);
+        return -1;
+    }
+
+    id = server->num_programs;
+    server->programs[id].filename = strdup(filename);
+    server->programs[id].code_memory = code_memory;
+    server->programs[id].code_memory_size = *size;
+    server->num_programs++;
+    pthread_mutex_unlock(&server->programs_lock);
+    return id;
+}
+
+static SIMD_Program *
+get_program(SIMD_Server *server, int id)
+{
+    SIMD_Program *program = NULL;
+
+    pthread_mutex_lock(&server->programs_lock);
+    if (id >= 0 && id < server->num_programs)
+    {
+        program = &server->programs[id];
+    }
+    pthread_mutex_unlock(&server->programs_lock);
+    return program;
+}
+
+/* Takes a CPU from the pool, or creates one, reset to run program */
+static APEX_CPU *
+acquire_cpu(SIMD_Server *server, SIMD_Program *program)
+{
+    APEX_CPU *cpu = NULL;
+
+    pthread_mutex_lock(&server->pool_lock);
+    if (server->pool_size > 0)
+    {
+        cpu = server->pool[--server->pool_size];
+    }
+    pthread_mutex_unlock(&server->pool_lock);
+
+    if (!cpu)
+    {
+        return APEX_cpu_create(program->code_memory, program->code_memory_size);
+    }
+    APEX_cpu_reset(cpu, program->code_memory, program->code_memory_size);
+    return cpu;
+}
+
+static void
+release_cpu(SIMD_Server *server, APEX_CPU *cpu)
+{
+    pthread_mutex_lock(&server->pool_lock);
+    if (server->pool_size < server->pool_capacity)
+    {
+        server->pool[server->pool_size++] = cpu;
+        cpu = NULL;
+    }
+    pthread_mutex_unlock(&server->pool_lock);
+
+    if (cpu)
+    {
+        APEX_cpu_stop(cpu);
+    }
+}
+
+/* Simulates until HALT retires or cycle_limit, returns TRUE on HALT */
+static int
+simulate(APEX_CPU *cpu, int cycle_limit)
+{
+    while (TRUE)
+    {
+        if (APEX_cpu_step(cpu))
+        {
+            return TRUE;
+        }
+        if (cycle_limit == (cpu->clock + 1))
+        {
+            return FALSE;
+        }
+        cpu->clock++;
+    }
+}
+
+/*
+ * RUN <program id> simulate <cycles> [options]
+ */
+static void
+run_request(SIMD_Server *server, char *args, FILE *out)
+{
+    APEX_CacheConfig l1_config;
+    SIMD_Program *program;
+    APEX_CPU *cpu;
+    char *saveptr, *token, *mode;
+    int id, cycles, memory_latency = 1, use_l1 = FALSE, watchdog = 0, completed;
+
+    APEX_cache_default_config(&l1_config);
+
+    token = strtok_r(args, " \t", &saveptr);
+    mode = strtok_r(NULL, " \t", &saveptr);
+    args = strtok_r(NULL, " \t", &saveptr);
+    if (!token || !mode || !args)
+    {
+        fprintf(out, "ERR usage: RUN <program id> simulate <cycles> [options]\n");
+        return;
+    }
+    id = strtol(token, NULL, 0);
+    cycles = strtol(args, NULL, 0);
+
+    if (strcmp(mode, "simulate") != 0)
+    {
+        fprintf(out, "ERR only simulate runs are served\n");
+        return;
+    }
+
+    while ((token = strtok_r(NULL, " \t", &saveptr)))
+    {
+        char *value = strtok_r(NULL, " \t", &saveptr);
+
+        if (!value)
+        {
+            fprintf(out, "ERR missing value for %s\n", token);
+            return;
+        }
+        if (strcmp(token, "--mem-latency") == 0)
+        {
+            memory_latency = strtol(value, NULL, 0);
+        }
+        else if (strcmp(token, "--watchdog") == 0)
+        {
+            watchdog = strtol(value, NULL, 0);
+        }
+        else if (strcmp(token, "--miss-latency") == 0)
+        {
+            l1_config.miss_latency = strtol(value, NULL, 0);
+        }
+        else if (strcmp(token, "--l1") == 0
+                 && sscanf(value, "%d,%d,%d", &l1_config.sets, &l1_config.ways,
+                           &l1_config.line_words) == 3)
+        {
+            use_l1 = TRUE;
+        }
+        else
+        {
+            fprintf(out, "ERR unknown option %s\n", token);
+            return;
+        }
+    }
+
+    program = get_program(server, id);
+    if (!program)
+    {
+        fprintf(out, "ERR unknown program %d\n", id);
+        return;
+    }
+
+    cpu = acquire_cpu(server, program);
+    if (!cpu)
+    {
+        fprintf(out, "ERR out of memory\n");
+        return;
+    }
+    cpu->memory_latency = memory_latency;
+    if (use_l1)
+    {
+        cpu->l1 = APEX_cache_create(&l1_config, 0, NULL);
+        if (!cpu->l1)
+        {
+            fprintf(out, "ERR invalid L1 configuration\n");
+            release_cpu(server, cpu);
+            return;
+        }
+    }
+
+    if (watchdog > 0)
+    {
+        cpu->watchdog = APEX_watchdog_create(watchdog);
+        if (!cpu->watchdog)
+        {
+            fprintf(out, "ERR out of memory\n");
+            release_cpu(server, cpu);
+            return;
+        }
+    }
+
+    completed = simulate(cpu, cycles);
+    APEX_cpu_write_result(out, cpu, completed);
+    fprintf(out, "END\n");
+    release_cpu(server, cpu);
+}
+
+/*
+ * Serves the requests of one connection until QUIT or end of input
+ */
+static void
+serve_connection(SIMD_Server *server, int fd)
+{
+    FILE *in, *out;
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t nread;
+    int out_fd = dup(fd);
+
+    in = fdopen(fd, "r");
+    out = (out_fd >= 0) ? fdopen(out_fd, "w") : NULL;
+    if (!in || !out)
+    {
+        if (in)
+        {
+            fclose(in);
+        }
+        else
+        {
+            close(fd);
+        }
+        if (out)
+        {
+            fclose(out);
+        }
+        else if (out_fd >= 0)
+        {
+            close(out_fd);
+        }
+        return;
+    }
+
+    while ((nread = getline(&line, &len, in)) != -1)
+    {
+        char *command, *args, *saveptr;
+
+        line[strcspn(line, "\r\n")] = '\0';
+        command = strtok_r(line, " \t", &saveptr);
+        args = strtok_r(NULL, "", &saveptr);
+        if (!command)
+        {
+            continue;
+        }
+
+        if (strcmp(command, "QUIT") == 0)
+        {
+            break;
+        }
+        else if (strcmp(command, "LOAD") == 0 && args)
+        {
+            int size, id = load_program(server, args, &size);
+
+            if (id < 0)
+            {
+                fprintf(out, "ERR unable to load %s\n", args);
+            }
+            else
+            {
+                fprintf(out, "OK %d %d\n", id, size);
+            }
+        }
+        else if (strcmp(command, "RUN") == 0 && args)
+        {
+            run_request(server, args, out);
+        }
+        else
+        {
+            fprintf(out, "ERR unknown request %s\n", command);
+        }
+        fflush(out);
+    }
+
+    free(line);
+    fclose(out);
+    fclose(in);
+}
+
+static void *
+worker_thread(void *arg)
+{
+    SIMD_Server *server = arg;
+    int fd;
+
+    while (TRUE)
+    {
+        pthread_mutex_lock(&server->queue_lock);
+        while (server->queue_count == 0)
+        {
+            pthread_cond_wait(&server->queue_ready, &server->queue_lock);
+        }
+        fd = server->queue[server->queue_head];
+        server->queue_head = (server->queue_head + 1) % SIMD_QUEUE_SIZE;
+        server->queue_count--;
+        pthread_cond_broadcast(&server->queue_ready);
+        pthread_mutex_unlock(&server->queue_lock);
+
+        serve_connection(server, fd);
+    }
+    return NULL;
+}
+
+static void
+enqueue_connection(SIMD_Server *server, int fd)
+{
+    pthread_mutex_lock(&server->queue_lock);
+    while (server->queue_count == SIMD_QUEUE_SIZE)
+    {
+        pthread_cond_wait(&server->queue_ready, &server->queue_lock);
+    }
+    server->queue[(server->queue_head + server->queue_count) % SIMD_QUEUE_SIZE] = fd;
+    server->queue_count++;
+    pthread_cond_broadcast(&server->queue_ready);
+    pthread_mutex_unlock(&server->queue_lock);
+}
+
+int
+main(int argc, char const *argv[])
+{
+    static SIMD_Server server;
+    struct sockaddr_un addr;
+    pthread_t thread;
+    int threads = SIMD_DEFAULT_THREADS;
+    int listen_fd, i;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "APEX_Help: Usage %s <socket_path> [threads]\n", argv[0]);
+        exit(1);
+    }
+    socket_path = argv[1];
+    if (argc > 2)
+    {
+        threads = strtol(argv[2], NULL, 0);
+        threads = (threads > 0) ? threads : 1;
+    }
+
+    ENABLE_DEBUG_MESSAGES = 0;
+    pthread_mutex_init(&server.programs_lock, NULL);
+    pthread_mutex_init(&server.pool_lock, NULL);
+    pthread_mutex_init(&server.queue_lock, NULL);
+    pthread_cond_init(&server.queue_ready, NULL);
+    server.pool_capacity = threads;
+    server.pool = calloc(threads, sizeof(APEX_CPU *));
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 || strlen(socket_path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "APEX_Error: Unable to create socket %s\n", socket_path);
+        exit(1);
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+    unlink(socket_path);
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, 128) < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to listen on %s\n", socket_path);
+        exit(1);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    for (i = 0; i < threads; ++i)
+    {
+        pthread_create(&thread, NULL, worker_thread, &server);
+        pthread_detach(thread);
+    }
+    fprintf(stderr, "APEX_SIMD: Listening on %s with %d threads\n", socket_path, threads);
+
+    while (TRUE)
+    {
+        int fd = accept(listen_fd, NULL, NULL);
+
+        if (fd >= 0)
+        {
+            enqueue_connection(&server, fd);
+        }
+    }
+    return 0;
+}
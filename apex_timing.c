@@ -0,0 +1,217 @@
+/*
+ * apex_timing.c
+ * Contains the trace-driven timing model of the 5 stage APEX pipeline.
+ *
+ * The model consumes a committed instruction stream recorded by apex_trace.c
+ * and only computes the cycle in which every instruction passes each stage.
+ * No ALU or memory semantics are evaluated, so a timing sweep costs one pass
+ * over the trace per configuration.
+ *
+ * With the default configuration the model follows the stall, forwarding and
+ * flush rules of APEX_decode and APEX_execute, and reports the same cycle
+ * count as a full simulation of the recorded program.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "apex_isa.h"
+#include "apex_timing.h"
+
+static int
+max_int(int a, int b)
+{
+    return (a > b) ? a : b;
+}
+
+/*
+ * Default configuration matches the simulated pipeline
+ */
+void
+APEX_timing_default_config(APEX_TimingConfig *config)
+{
+    config->forwarding = TRUE;
+    config->load_latency = 1;
+    config->store_latency = 1;
+    config->branch_penalty = 2;
+}
+
+/*
+ * Replays the trace against the timing configuration.
+ *
+ * For every instruction the model tracks
+ *   fetch      - cycle in which fetch copied it into the decode latch
+ *   exec_enter - first cycle it spent in execute
+ *   exec       - cycle in which execute passed it to the memory stage
+ *   mem_end    - last cycle it spent in the memory stage
+ *   writeback  - mem_end + 1
+ * A cycle_limit of zero or less replays the whole trace.
+ */
+void
+APEX_timing_run(const APEX_TraceRecord *trace, int count, const APEX_TimingConfig *config,
+                int cycle_limit, APEX_TimingStats *stats)
+{
+    int reg_written[REG_FILE_SIZE];
+    int reg_exec[REG_FILE_SIZE];
+    int reg_mem_end[REG_FILE_SIZE];
+    int reg_is_load[REG_FILE_SIZE];
+    int srcs[APEX_MAX_SOURCES];
+    int prev_fetch = 0;
+    int prev_exec = 0;
+    int prev_mem_end = 0;
+    int fetch_ready = 1;
+    int i, j;
+
+    memset(stats, 0, sizeof(*stats));
+    memset(reg_written, 0, sizeof(reg_written));
+    stats->completed = TRUE;
+
+    for (i = 0; i < count; ++i)
+    {
+        const APEX_TraceRecord *rec = &trace[i];
+        int fetch, exec_enter, exec, exec_in_order, exec_operands, mem_end, writeback;
+        int nsrcs, latency, load_use = FALSE;
+
+        fetch = max_int(prev_fetch + 1, fetch_ready);
+
+        /* Decode takes one cycle and waits for execute to drain */
+        exec_in_order = max_int(fetch + 2, prev_exec + 1);
+
+        /* Operand readiness: EX forwarding for ALU results, MEM forwarding
+         * once a load leaves memory, otherwise wait for writeback */
+        exec_operands = 0;
+        nsrcs = APEX_opcode_sources(rec->opcode, rec->rs1, rec->rs2, rec->rs3, srcs);
+        for (j = 0; j < nsrcs; ++j)
+        {
+            int r = srcs[j];
+            int ready;
+
+            if (r < 0 || r >= REG_FILE_SIZE || !reg_written[r])
+            {
+                continue;
+            }
+
+            if (!config->forwarding)
+            {
+                ready = reg_mem_end[r] + 2;
+            }
+            else if (reg_is_load[r])
+            {
+                ready = reg_mem_end[r] + 1;
+            }
+            else
+            {
+                ready = reg_exec[r] + 1;
+            }
+
+            if (ready > exec_operands)
+            {
+                exec_operands = ready;
+                load_use = reg_is_load[r];
+            }
+        }
+
+        exec_enter = max_int(exec_in_order, exec_operands);
+        if (exec_enter > exec_in_order)
+        {
+            if (load_use)
+            {
+                stats->load_use_stalls += exec_enter - exec_in_order;
+            }
+            else
+            {
+                stats->operand_stalls += exec_enter - exec_in_order;
+            }
+        }
+
+        /* Execute holds its result while memory is busy with an older access */
+        exec = max_int(exec_enter, prev_mem_end);
+        stats->memory_stalls += exec - exec_enter;
+
+        /* Count operands that were not yet in the register file at decode */
+        if (config->forwarding)
+        {
+            for (j = 0; j < nsrcs; ++j)
+            {
+                int r = srcs[j];
+
+                if (r < 0 || r >= REG_FILE_SIZE || !reg_written[r] || reg_mem_end[r] + 1 <= exec_enter - 1)
+                {
+                    continue;
+                }
+                if (!reg_is_load[r] && reg_exec[r] >= exec_enter - 1)
+                {
+                    stats->forwarded_ex++;
+                }
+                else
+                {
+                    stats->forwarded_mem++;
+                }
+            }
+        }
+
+        latency = 1;
+        if (APEX_opcode_is_load(rec->opcode))
+        {
+            latency = config->load_latency;
+        }
+        else if (APEX_opcode_is_store(rec->opcode))
+        {
+            latency = config->store_latency;
+        }
+        mem_end = exec + latency;
+        writeback = mem_end + 1;
+
+        if (cycle_limit > 0 && writeback > cycle_limit)
+        {
+            stats->completed = FALSE;
+            stats->cycles = cycle_limit;
+            return;
+        }
+
+        if (APEX_opcode_writes_rd(rec->opcode) && rec->rd >= 0 && rec->rd < REG_FILE_SIZE)
+        {
+            reg_written[rec->rd] = TRUE;
+            reg_exec[rec->rd] = exec;
+            reg_mem_end[rec->rd] = mem_end;
+            reg_is_load[rec->rd] = APEX_opcode_is_load(rec->opcode);
+        }
+
+        /* Fetch refills decode in the cycle it drains, a taken branch
+         * redirects fetch after the flush bubbles */
+        fetch_ready = max_int(fetch_ready, exec_enter - 1);
+        if (APEX_opcode_is_branch(rec->opcode) && rec->branch_taken)
+        {
+            fetch_ready = max_int(fetch_ready, exec_enter + config->branch_penalty - 1);
+            stats->branches_taken++;
+            stats->flush_bubbles += config->branch_penalty;
+        }
+
+        prev_fetch = fetch;
+        prev_exec = exec;
+        prev_mem_end = mem_end;
+        stats->cycles = writeback;
+        stats->instructions++;
+    }
+}
+
+void
+APEX_timing_print_stats(const APEX_TimingConfig *config, const APEX_TimingStats *stats)
+{
+    printf("APEX_TIMING: forwarding=%s load_latency=%d store_latency=%d branch_penalty=%d\n",
+           config->forwarding ? "on" : "off", config->load_latency, config->store_latency,
+           config->branch_penalty);
+    printf("APEX_TIMING: Replay %s, cycles = %d instructions = %d CPI = %.3f\n",
+           stats->completed ? "Complete" : "Stopped", stats->cycles, stats->instructions,
+           stats->instructions ? (double)stats->cycles / stats->instructions : 0.0);
+    printf("|    Load-use stall cycles     | %-10d |\n", stats->load_use_stalls);
+    printf("|    Operand stall cycles      | %-10d |\n", stats->operand_stalls);
+    printf("|    Memory busy stall cycles  | %-10d |\n", stats->memory_stalls);
+    printf("|    Taken branches            | %-10d |\n", stats->branches_taken);
+    printf("|    Flush bubbles             | %-10d |\n", stats->flush_bubbles);
+    printf("|    Forwarded from EX         | %-10d |\n", stats->forwarded_ex);
+    printf("|    Forwarded from MEM        | %-10d |\n", stats->forwarded_mem);
+}
@@ -0,0 +1,42 @@
+/*
+ * apex_timing.h
+ * Contains declarations for the trace-driven, timing-only pipeline model
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_TIMING_H_
+#define _APEX_TIMING_H_
+
+#include "apex_trace.h"
+
+/* Timing parameters of the replayed pipeline */
+typedef struct APEX_TimingConfig
+{
+    int forwarding;     /* {TRUE, FALSE} EX and MEM forwarding paths into decode */
+    int load_latency;   /* Cycles a LOAD/LDR occupies the memory stage */
+    int store_latency;  /* Cycles a STORE/STR occupies the memory stage */
+    int branch_penalty; /* Fetch bubbles after a taken BZ/BNZ */
+} APEX_TimingConfig;
+
+typedef struct APEX_TimingStats
+{
+    int cycles;          /* Cycle in which the last replayed instruction retired */
+    int instructions;    /* Instructions replayed */
+    int completed;       /* {TRUE, FALSE} Whole trace replayed within the cycle limit */
+    int load_use_stalls; /* Decode cycles waiting for a LOAD/LDR result */
+    int operand_stalls;  /* Decode cycles waiting for any other producer */
+    int memory_stalls;   /* Cycles execute was held behind a busy memory stage */
+    int branches_taken;
+    int flush_bubbles;
+    int forwarded_ex;    /* Operands taken from the EX forwarding line */
+    int forwarded_mem;   /* Operands taken from the MEM forwarding line */
+} APEX_TimingStats;
+
+void APEX_timing_default_config(APEX_TimingConfig *config);
+void APEX_timing_run(const APEX_TraceRecord *trace, int count, const APEX_TimingConfig *config,
+                     int cycle_limit, APEX_TimingStats *stats);
+void APEX_timing_print_stats(const APEX_TimingConfig *config, const APEX_TimingStats *stats);
+
+#endif
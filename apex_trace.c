@@ -0,0 +1,141 @@
+/*
+ * apex_trace.c
+ * Contains functions to record the committed instruction stream of a run and
+ * to read it back for the trace-driven timing model
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_trace.h"
+
+/*
+ * Opens a trace file for writing and reserves space for the header
+ */
+APEX_TraceWriter *
+APEX_trace_open(const char *filename)
+{
+    APEX_TraceWriter *writer;
+    APEX_TraceHeader header;
+
+    if (!filename)
+    {
+        return NULL;
+    }
+
+    writer = calloc(1, sizeof(APEX_TraceWriter));
+    if (!writer)
+    {
+        return NULL;
+    }
+
+    writer->fp = fopen(filename, "wb");
+    if (!writer->fp)
+    {
+        free(writer);
+        return NULL;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, APEX_TRACE_MAGIC, sizeof(header.magic));
+    header.record_size = sizeof(APEX_TraceRecord);
+    fwrite(&header, sizeof(header), 1, writer->fp);
+    return writer;
+}
+
+/*
+ * Appends the instruction held in a writeback latch to the trace
+ */
+void
+APEX_trace_append(APEX_TraceWriter *writer, const CPU_Stage *stage)
+{
+    APEX_TraceRecord record;
+
+    record.pc = stage->pc;
+    record.opcode = stage->opcode;
+    record.rd = stage->rd;
+    record.rs1 = stage->rs1;
+    record.rs2 = stage->rs2;
+    record.rs3 = stage->rs3;
+    record.memory_address = stage->memory_address;
+    record.branch_taken = stage->branch_taken;
+
+    fwrite(&record, sizeof(record), 1, writer->fp);
+    writer->records++;
+}
+
+/*
+ * Patches the totals of the recording run into the header and closes the file
+ */
+void
+APEX_trace_close(APEX_TraceWriter *writer, int cycles, int instructions)
+{
+    APEX_TraceHeader header;
+
+    if (!writer)
+    {
+        return;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, APEX_TRACE_MAGIC, sizeof(header.magic));
+    header.record_size = sizeof(APEX_TraceRecord);
+    header.recorded_cycles = cycles;
+    header.recorded_instructions = instructions;
+
+    rewind(writer->fp);
+    fwrite(&header, sizeof(header), 1, writer->fp);
+    fclose(writer->fp);
+    free(writer);
+}
+
+/*
+ * Reads a whole trace file into memory, returns NULL if the file is not a trace
+ */
+APEX_TraceRecord *
+APEX_trace_load(const char *filename, int *count, APEX_TraceHeader *header)
+{
+    FILE *fp;
+    long size;
+    APEX_TraceRecord *records;
+
+    fp = fopen(filename, "rb");
+    if (!fp)
+    {
+        return NULL;
+    }
+
+    if (fread(header, sizeof(*header), 1, fp) != 1
+        || memcmp(header->magic, APEX_TRACE_MAGIC, sizeof(header->magic)) != 0
+        || header->record_size != sizeof(APEX_TraceRecord))
+    {
+        fclose(fp);
+        return NULL;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp) - (long)sizeof(*header);
+    fseek(fp, sizeof(*header), SEEK_SET);
+
+    *count = size / sizeof(APEX_TraceRecord);
+    records = calloc(*count ? *count : 1, sizeof(APEX_TraceRecord));
+    if (!records)
+    {
+        fclose(fp);
+        return NULL;
+    }
+
+    if (fread(records, sizeof(APEX_TraceRecord), *count, fp) != (size_t)*count)
+    {
+        free(records);
+        fclose(fp);
+        return NULL;
+    }
+
+    fclose(fp);
+    return records;
+}
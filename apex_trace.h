@@ -0,0 +1,51 @@
+/*
+ * apex_trace.h
+ * Contains declarations for recording and reading committed instruction traces
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_TRACE_H_
+#define _APEX_TRACE_H_
+
+#include <stdio.h>
+
+#include "apex_cpu.h"
+
+#define APEX_TRACE_MAGIC "APEXTRC1"
+
+/* One committed instruction, written in writeback order */
+typedef struct APEX_TraceRecord
+{
+    int pc;
+    int opcode;
+    int rd;
+    int rs1;
+    int rs2;
+    int rs3;
+    int memory_address; /* Effective address for LOAD/LDR/STORE/STR */
+    int branch_taken;   /* {TRUE, FALSE} Outcome of BZ and BNZ */
+} APEX_TraceRecord;
+
+/* Trace file header, cycles and instructions are patched in on close */
+typedef struct APEX_TraceHeader
+{
+    char magic[8];
+    int record_size;
+    int recorded_cycles;
+    int recorded_instructions;
+} APEX_TraceHeader;
+
+typedef struct APEX_TraceWriter
+{
+    FILE *fp;
+    int records;
+} APEX_TraceWriter;
+
+APEX_TraceWriter *APEX_trace_open(const char *filename);
+void APEX_trace_append(APEX_TraceWriter *writer, const CPU_Stage *stage);
+void APEX_trace_close(APEX_TraceWriter *writer, int cycles, int instructions);
+APEX_TraceRecord *APEX_trace_load(const char *filename, int *count, APEX_TraceHeader *header);
+
+#endif
@@ -0,0 +1,132 @@
+/*
+ * apex_watchdog.c
+ * Contains the watchdog that stops a CPU which no longer makes progress.
+ *
+ * Deadlock: no instruction retired for `threshold` cycles.
+ *
+ * Livelock: the PC, zero flag and state digest (registers and data memory)
+ * when a taken BZ/BNZ retires repeat exactly. Everything older than the
+ * branch has retired at that point, so the same signature means the program
+ * loops forever without changing state. Repeats are found with Brent's
+ * algorithm, which keeps a single saved signature and detects a loop within
+ * twice its length.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdlib.h>
+
+#include "apex_watchdog.h"
+
+APEX_Watchdog *
+APEX_watchdog_create(int threshold)
+{
+    APEX_Watchdog *watchdog;
+
+    if (threshold <= 0)
+    {
+        return NULL;
+    }
+
+    watchdog = calloc(1, sizeof(APEX_Watchdog));
+    if (!watchdog)
+    {
+        return NULL;
+    }
+    watchdog->threshold = threshold;
+    watchdog->power = 1;
+    return watchdog;
+}
+
+void
+APEX_watchdog_destroy(APEX_Watchdog *watchdog)
+{
+    free(watchdog);
+}
+
+/*
+ * Called when the taken branch at pc retires
+ */
+void
+APEX_watchdog_branch(APEX_Watchdog *watchdog, const APEX_CPU *cpu, int pc)
+{
+    APEX_LoopSignature signature;
+
+    if (watchdog->loop_length)
+    {
+        return;
+    }
+
+    signature.pc = pc;
+    signature.zero_flag = cpu->zero_flag;
+    signature.digest = cpu->digest;
+
+    if (watchdog->saved_valid && signature.pc == watchdog->saved.pc
+        && signature.zero_flag == watchdog->saved.zero_flag
+        && signature.digest == watchdog->saved.digest)
+    {
+        watchdog->loop_length = watchdog->length;
+        return;
+    }
+
+    if (!watchdog->saved_valid || watchdog->length == watchdog->power)
+    {
+        watchdog->saved = signature;
+        watchdog->saved_valid = TRUE;
+        watchdog->power *= 2;
+        watchdog->length = 0;
+    }
+    watchdog->length++;
+}
+
+/* PC of the oldest instruction in the pipeline, -1 when it is empty */
+static int
+oldest_pc(const APEX_CPU *cpu)
+{
+    int i;
+
+    for (i = cpu->num_stages - 1; i >= 0; --i)
+    {
+        if (cpu->stages[i].has_insn)
+        {
+            return cpu->stages[i].pc;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Called at the end of every cycle, returns TRUE and records the fault in
+ * cpu when the watchdog fires
+ */
+int
+APEX_watchdog_cycle(APEX_Watchdog *watchdog, APEX_CPU *cpu)
+{
+    int cycle = cpu->clock + 1;
+
+    if (cpu->insn_completed != watchdog->last_insn_completed)
+    {
+        watchdog->last_insn_completed = cpu->insn_completed;
+        watchdog->last_retire_cycle = cycle;
+    }
+
+    if (watchdog->loop_length)
+    {
+        cpu->fault.type = APEX_FAULT_LIVELOCK;
+        cpu->fault.pc = watchdog->saved.pc;
+        cpu->fault.address = watchdog->loop_length;
+        cpu->fault.cycle = cycle;
+        return TRUE;
+    }
+
+    if (cycle - watchdog->last_retire_cycle >= watchdog->threshold)
+    {
+        cpu->fault.type = APEX_FAULT_DEADLOCK;
+        cpu->fault.pc = oldest_pc(cpu);
+        cpu->fault.address = cycle - watchdog->last_retire_cycle;
+        cpu->fault.cycle = cycle;
+        return TRUE;
+    }
+    return FALSE;
+}
@@ -0,0 +1,41 @@
+/*
+ * apex_watchdog.h
+ * Contains declarations for the deadlock and livelock watchdog
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_WATCHDOG_H_
+#define _APEX_WATCHDOG_H_
+
+#include "apex_cpu.h"
+
+/* Architectural state when a taken branch retires */
+typedef struct APEX_LoopSignature
+{
+    int pc;
+    int zero_flag;
+    unsigned long long digest;
+} APEX_LoopSignature;
+
+typedef struct APEX_Watchdog
+{
+    int threshold;                 /* Cycles without a retirement that count as deadlock */
+    int last_retire_cycle;
+    int last_insn_completed;
+
+    /* Brent's cycle detection over the signatures of taken branches */
+    APEX_LoopSignature saved;
+    int saved_valid;
+    long power;
+    long length;                   /* Taken branches since saved */
+    long loop_length;              /* Taken branches per repetition, 0 until found */
+} APEX_Watchdog;
+
+APEX_Watchdog *APEX_watchdog_create(int threshold);
+void APEX_watchdog_destroy(APEX_Watchdog *watchdog);
+void APEX_watchdog_branch(APEX_Watchdog *watchdog, const APEX_CPU *cpu, int pc);
+int APEX_watchdog_cycle(APEX_Watchdog *watchdog, APEX_CPU *cpu);
+
+#endif
@@ -213,6 +213,9 @@ create_APEX_instruction(APEX_Instruction *ins, char *buffer)
     strcpy(ins->opcode_str, top_level_tokens[0]);
     ins->opcode = set_opcode_str(ins->opcode_str);
 
+    /* No destination unless the instruction has one, register 0 is a real register */
+    ins->rd = -1;
+
     switch (ins->opcode)
     {
     case OPCODE_ADD:
@@ -9,27 +9,626 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "apex_cache.h"
 #include "apex_cpu.h"
+#include "apex_debugger.h"
+#include "apex_dram.h"
+#include "apex_host_profile.h"
+#include "apex_interval.h"
+#include "apex_multicore.h"
+#include "apex_prefetch.h"
+#include "apex_profile.h"
+#include "apex_result_cache.h"
+#include "apex_sampler.h"
+#include "apex_timing.h"
+#include "apex_trace.h"
+#include "apex_watchdog.h"
+
+static void
+print_usage(const char *prog)
+{
+    fprintf(stderr, "APEX_Help: Usage %s <input_file> display/simulate/debug/replay function cycles [options]\n", prog);
+    fprintf(stderr, "APEX_Help: debug reads break/watch/until/continue commands from stdin, cycles 0 for no limit\n");
+    fprintf(stderr, "    --history <kb>          Undo journal for reverse/goto in debug mode (default off)\n");
+    fprintf(stderr, "APEX_Help: display/simulate options:\n");
+    fprintf(stderr, "    --trace <file>          Record the committed instruction stream\n");
+    fprintf(stderr, "    --mem-latency <n>       Memory stage cycles of LOAD/STORE (default 1)\n");
+    fprintf(stderr, "    --l1 <sets,ways,words>  Private L1 data cache (default 64,2,4 for multicore)\n");
+    fprintf(stderr, "    --miss-latency <n>      Memory stage cycles of an L1 miss (default 10)\n");
+    fprintf(stderr, "    --profile <file>        Write the program annotated with per-PC stalls ('-' for stdout)\n");
+    fprintf(stderr, "    --profile-top <n>       Hot instructions printed after the run (default 5)\n");
+    fprintf(stderr, "    --samples <file>        Write counters every --sample-every cycles (.csv or binary)\n");
+    fprintf(stderr, "    --sample-every <n>      Cycles per sample (default 1000)\n");
+    fprintf(stderr, "    --result-cache <dir>    Reuse results of identical simulate runs stored in dir\n");
+    fprintf(stderr, "    --watchdog <n>          Abort after n cycles without a retirement or on a loop that\n"
+                    "                            repeats the same state\n");
+    fprintf(stderr, "    --intervals <k>         Split the run into k intervals simulated in parallel\n");
+    fprintf(stderr, "    --warmup <n>            Warmup instructions before each interval (default 1000)\n");
+    fprintf(stderr, "    --fusion on/off         Fuse CMP+BZ/BNZ and ADDL+LOAD/STORE in decode (default off)\n");
+    fprintf(stderr, "    --store-buffer <n>      Entries of the store buffer, 0 stores in the memory stage (default 0)\n");
+    fprintf(stderr, "    --mshrs <n>             Load misses outstanding behind the memory stage, 0 blocks (default 0)\n");
+    fprintf(stderr, "    --prefetch <kind>       L1 prefetcher: none, stride or stream (default none, needs --l1)\n");
+    fprintf(stderr, "    --prefetch-degree <n>   Lines prefetched per trigger (default 2)\n");
+    fprintf(stderr, "    --prefetch-distance <n> Strides or lines between the access and the first prefetch (default 1)\n");
+    fprintf(stderr, "    --dram <c,b[,policy]>   DRAM behind data memory or the L1: channels, banks, open or closed page\n");
+    fprintf(stderr, "    --dram-timing <t>       DRAM tRCD,tCAS,tRP,tBURST in cycles (default 4,4,4,2)\n");
+    fprintf(stderr, "    --dram-trace <file>     Write the DRAM requests as an address trace for apex_dramsim\n");
+    fprintf(stderr, "    --icache <sets,ways,n>  Instruction cache with n instructions per line (default off)\n");
+    fprintf(stderr, "    --icache-miss-latency <n> Fetch cycles of an I-cache miss (default 10)\n");
+    fprintf(stderr, "    --fetch-queue <n>       Entries between fetch and decode, 0 fetches in lockstep (default 0,\n"
+                    "                            1 with --icache)\n");
+    fprintf(stderr, "    --pipeline <f,e,m>      Stages of fetch, execute and memory, 1 to %d each (default 1,1,1)\n",
+            APEX_STAGES_MAX);
+    fprintf(stderr, "    --loop-buffer <n>       Stream BZ/BNZ loops of up to n instructions from a loop buffer (default off)\n");
+    fprintf(stderr, "APEX_Help: multicore, <input_file> is a comma separated list of programs:\n");
+    fprintf(stderr, "    --quantum <n>           Cycles between core synchronizations (default 100)\n");
+    fprintf(stderr, "    --serial                Simulate all cores on one host thread\n");
+    fprintf(stderr, "    --smt <policy>          Run the programs as hardware threads of one core instead, fetching by\n"
+                    "                            round-robin, icount or switch (on stall)\n");
+    fprintf(stderr, "APEX_Help: replay <trace_file> options:\n");
+    fprintf(stderr, "    --forwarding on/off     EX/MEM forwarding paths (default on)\n");
+    fprintf(stderr, "    --load-latency <n>      Memory stage cycles of LOAD/LDR (default 1)\n");
+    fprintf(stderr, "    --store-latency <n>     Memory stage cycles of STORE/STR (default 1)\n");
+    fprintf(stderr, "    --branch-penalty <n>    Bubbles after a taken branch (default 2)\n");
+}
+
+/*
+ * Runs the timing-only model over a recorded trace
+ */
+static int
+replay_trace(const char *filename, const APEX_TimingConfig *config, int cyclesnumber)
+{
+    APEX_TraceRecord *trace;
+    APEX_TraceHeader header;
+    APEX_TimingStats stats;
+    int count;
+
+    trace = APEX_trace_load(filename, &count, &header);
+    if (!trace)
+    {
+        fprintf(stderr, "APEX_Error: Unable to read trace file %s\n", filename);
+        return 1;
+    }
+
+    printf("Replay is going to run %d recorded instructions\n", count);
+    APEX_timing_run(trace, count, config, cyclesnumber, &stats);
+    APEX_timing_print_stats(config, &stats);
+    printf("APEX_TIMING: Recorded run, cycles = %d instructions = %d\n", header.recorded_cycles,
+           header.recorded_instructions);
+
+    free(trace);
+    return 0;
+}
+
+/*
+ * Writes the annotated listing of a profiled run and prints its hot spots
+ */
+static void
+write_profile(const APEX_CPU *cpu, const char *asm_filename, const char *profile_file, int top)
+{
+    FILE *out = stdout;
+
+    if (strcmp(profile_file, "-") != 0)
+    {
+        out = fopen(profile_file, "w");
+        if (!out)
+        {
+            fprintf(stderr, "APEX_Error: Unable to open profile file %s\n", profile_file);
+            return;
+        }
+    }
+
+    if (!APEX_profile_write_listing(cpu->pc_profile, asm_filename, out))
+    {
+        fprintf(stderr, "APEX_Error: Unable to read %s for the profile listing\n", asm_filename);
+    }
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    APEX_profile_print_hotspots(cpu->pc_profile, cpu->code_memory, top);
+}
+
+/*
+ * Prints the statistics of the optional pipeline features after the result,
+ * of a simulated run or of one restored from the result cache. Every
+ * counter read here must be part of APEX_RunStats.
+ */
+static void
+print_run_stats(const APEX_CPU *cpu)
+{
+    if (cpu->fetch_stages > 1 || cpu->execute_stages > 1 || cpu->memory_stages > 1)
+    {
+        printf("APEX_CPU: Pipeline of %d stages, %d fetch, decode, %d execute, %d memory, writeback\n",
+               cpu->fetch_stages + cpu->execute_stages + cpu->memory_stages + 2, cpu->fetch_stages,
+               cpu->execute_stages, cpu->memory_stages);
+    }
+    if (cpu->fusion)
+    {
+        long fused = cpu->stats.fused_branches + cpu->stats.fused_memory;
+
+        printf("APEX_CPU: Fused %ld CMP+BZ/BNZ and %ld ADDL+LOAD/STORE pairs, %.2f%% of retired instructions\n",
+               cpu->stats.fused_branches, cpu->stats.fused_memory,
+               cpu->insn_completed ? 200.0 * fused / cpu->insn_completed : 0.0);
+    }
+    if (cpu->store_buffer_depth > 0)
+    {
+        printf("APEX_CPU: Store buffer of %d entries, average occupancy %.2f, peak %ld, "
+               "%ld of %ld loads forwarded, %ld cycles full\n",
+               cpu->store_buffer_depth, (double)cpu->stats.store_buffer_occupancy / (cpu->clock + 1),
+               cpu->stats.store_buffer_peak, cpu->stats.store_buffer_forwards, cpu->stats.loads,
+               cpu->stats.store_buffer_full);
+    }
+    if (cpu->num_mshrs > 0)
+    {
+        printf("APEX_CPU: %d MSHRs, %ld of %ld loads missed without blocking, average outstanding %.2f, "
+               "peak %ld, %ld blocked with every MSHR busy\n",
+               cpu->num_mshrs, cpu->stats.mshr_misses, cpu->stats.loads,
+               (double)cpu->stats.mshr_occupancy / (cpu->clock + 1), cpu->stats.mshr_peak,
+               cpu->stats.mshr_full);
+    }
+    if (cpu->prefetcher)
+    {
+        APEX_prefetch_print_stats(cpu->prefetcher, cpu->l1);
+    }
+    if (cpu->dram)
+    {
+        APEX_dram_print_stats(cpu->dram);
+    }
+    if (cpu->fetch_queue_depth > 0)
+    {
+        printf("APEX_CPU: Fetch queue of %d entries, average occupancy %.2f, %ld cycles empty, "
+               "%ld cycles full\n",
+               cpu->fetch_queue_depth, (double)cpu->stats.fetch_queue_occupancy / (cpu->clock + 1),
+               cpu->stats.fetch_queue_empty, cpu->stats.fetch_queue_full);
+    }
+    if (cpu->icache)
+    {
+        printf("APEX_CPU: I-cache %d hits, %d misses, hit rate %.2f%%, %ld fetch cycles waiting on misses\n",
+               cpu->icache->stats.hits, cpu->icache->stats.misses,
+               cpu->icache->stats.reads ? 100.0 * cpu->icache->stats.hits / cpu->icache->stats.reads : 0.0,
+               cpu->stats.icache_stalls);
+    }
+    if (cpu->loop_buffer_size > 0)
+    {
+        printf("APEX_CPU: Loop buffer of %d instructions, hit rate %.2f%% (%ld of %ld fetched), "
+               "%ld loops captured, %ld taken loop branches without a bubble, %ld loop exits\n",
+               cpu->loop_buffer_size,
+               cpu->stats.loop_buffer_fetches
+                   ? 100.0 * cpu->stats.loop_buffer_hits / cpu->stats.loop_buffer_fetches : 0.0,
+               cpu->stats.loop_buffer_hits, cpu->stats.loop_buffer_fetches,
+               cpu->stats.loop_buffer_captures, cpu->stats.loop_buffer_taken,
+               cpu->stats.loop_buffer_exits);
+    }
+}
 
 int main(int argc, char const *argv[])
 {
     APEX_CPU *cpu;
+    APEX_TimingConfig timing_config;
+    APEX_CacheConfig l1_config;
+    APEX_CacheConfig icache_config;
+    int use_icache = FALSE;
+    int fetch_queue = 0;
+    int loop_buffer = 0;
+    int fetch_stages = 1, execute_stages = 1, memory_stages = 1;
+    APEX_PrefetchConfig prefetch_config;
+    APEX_DramConfig dram_config;
+    int use_dram = FALSE;
+    const char *dram_trace = NULL;
+    const char *trace_file = NULL;
+    const char *profile_file = NULL;
+    int profile_top = 5;
+    const char *sample_file = NULL;
+    int sample_period = 1000;
+    const char *result_cache = NULL;
+    unsigned long long result_key = 0;
+    int completed;
+    int memory_latency = 1;
+    int use_l1 = FALSE;
+    int quantum = 100;
+    int threaded = TRUE;
+    int intervals = 0;
+    int warmup = 1000;
+    int history_kb = 0;
+    int watchdog = 0;
+    int fusion = FALSE;
+    int store_buffer = 0;
+    int mshrs = 0;
+    int smt_policy = -1;
+    int multicore;
+    int i;
 
     fprintf(stderr, "APEX CPU Pipeline Simulator v%0.1lf\n", VERSION);
 
-    if (argc != 4)
+    if (argc < 4)
     {
-        fprintf(stderr, "APEX_Help: Usage %s <input_file> display/simulate function cycles\n", argv[0]);
+        print_usage(argv[0]);
         exit(1);
     }
 
-    cpu = APEX_cpu_init(argv[1]);
+    APEX_timing_default_config(&timing_config);
+    APEX_cache_default_config(&l1_config);
+    APEX_cache_default_config(&icache_config);
+    APEX_prefetch_default_config(&prefetch_config);
+    APEX_dram_default_config(&dram_config);
+    for (i = 4; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            trace_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+        {
+            profile_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--profile-top") == 0 && i + 1 < argc)
+        {
+            profile_top = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+        {
+            sample_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--sample-every") == 0 && i + 1 < argc)
+        {
+            sample_period = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--result-cache") == 0 && i + 1 < argc)
+        {
+            result_cache = argv[++i];
+        }
+        else if (strcmp(argv[i], "--mem-latency") == 0 && i + 1 < argc)
+        {
+            memory_latency = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--l1") == 0 && i + 1 < argc)
+        {
+            use_l1 = TRUE;
+            if (sscanf(argv[++i], "%d,%d,%d", &l1_config.sets, &l1_config.ways,
+                       &l1_config.line_words) != 3)
+            {
+                print_usage(argv[0]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--miss-latency") == 0 && i + 1 < argc)
+        {
+            l1_config.miss_latency = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--quantum") == 0 && i + 1 < argc)
+        {
+            quantum = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--intervals") == 0 && i + 1 < argc)
+        {
+            intervals = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+        {
+            warmup = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--watchdog") == 0 && i + 1 < argc)
+        {
+            watchdog = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--history") == 0 && i + 1 < argc)
+        {
+            history_kb = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--fusion") == 0 && i + 1 < argc)
+        {
+            fusion = (strcmp(argv[++i], "on") == 0);
+        }
+        else if (strcmp(argv[i], "--store-buffer") == 0 && i + 1 < argc)
+        {
+            store_buffer = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--mshrs") == 0 && i + 1 < argc)
+        {
+            mshrs = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--prefetch") == 0 && i + 1 < argc)
+        {
+            prefetch_config.kind = APEX_prefetch_parse_kind(argv[++i]);
+            if (prefetch_config.kind < 0)
+            {
+                print_usage(argv[0]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--prefetch-degree") == 0 && i + 1 < argc)
+        {
+            prefetch_config.degree = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--prefetch-distance") == 0 && i + 1 < argc)
+        {
+            prefetch_config.distance = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--dram") == 0 && i + 1 < argc)
+        {
+            use_dram = TRUE;
+            if (!APEX_dram_parse_geometry(argv[++i], &dram_config))
+            {
+                print_usage(argv[0]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--dram-timing") == 0 && i + 1 < argc)
+        {
+            if (!APEX_dram_parse_timing(argv[++i], &dram_config))
+            {
+                print_usage(argv[0]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--dram-trace") == 0 && i + 1 < argc)
+        {
+            dram_trace = argv[++i];
+        }
+        else if (strcmp(argv[i], "--icache") == 0 && i + 1 < argc)
+        {
+            use_icache = TRUE;
+            if (sscanf(argv[++i], "%d,%d,%d", &icache_config.sets, &icache_config.ways,
+                       &icache_config.line_words) != 3)
+            {
+                print_usage(argv[0]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--icache-miss-latency") == 0 && i + 1 < argc)
+        {
+            icache_config.miss_latency = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--fetch-queue") == 0 && i + 1 < argc)
+        {
+            fetch_queue = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%d,%d,%d", &fetch_stages, &execute_stages, &memory_stages) != 3)
+            {
+                print_usage(argv[0]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--loop-buffer") == 0 && i + 1 < argc)
+        {
+            loop_buffer = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--smt") == 0 && i + 1 < argc)
+        {
+            smt_policy = APEX_smt_parse_policy(argv[++i]);
+            if (smt_policy < 0)
+            {
+                print_usage(argv[0]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--serial") == 0)
+        {
+            threaded = FALSE;
+        }
+        else if (strcmp(argv[i], "--forwarding") == 0 && i + 1 < argc)
+        {
+            timing_config.forwarding = (strcmp(argv[++i], "off") != 0);
+        }
+        else if (strcmp(argv[i], "--load-latency") == 0 && i + 1 < argc)
+        {
+            timing_config.load_latency = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--store-latency") == 0 && i + 1 < argc)
+        {
+            timing_config.store_latency = strtol(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--branch-penalty") == 0 && i + 1 < argc)
+        {
+            timing_config.branch_penalty = strtol(argv[++i], NULL, 0);
+        }
+        else
+        {
+            print_usage(argv[0]);
+            exit(1);
+        }
+    }
 
     int cyclesnumber = strtol(argv[3], NULL, 0);
     const char *sim_dis = argv[2];
     const char *dis = "display";
     const char *sim = "simulate";
+    const char *rep = "replay";
+    const char *dbg = "debug";
     int display = 0;
+    int debug = 0;
+
+    if (strcmp(sim_dis, rep) == 0)
+    {
+        return replay_trace(argv[1], &timing_config, cyclesnumber);
+    }
+
+    /* With --smt the programs are threads of one core rather than cores */
+    multicore = strchr(argv[1], ',') && smt_policy < 0;
+    if (smt_policy >= 0 && !strchr(argv[1], ','))
+    {
+        fprintf(stderr, "APEX_Error: --smt needs a comma separated list of programs\n");
+        exit(1);
+    }
+    if (smt_policy >= 0
+        && (intervals > 0 || fusion || mshrs > 0 || use_icache || fetch_queue > 0 || loop_buffer > 0
+            || fetch_stages > 1 || execute_stages > 1 || memory_stages > 1 || trace_file
+            || profile_file || watchdog > 0 || strcmp(sim_dis, dbg) == 0))
+    {
+        fprintf(stderr, "APEX_Error: --smt is not supported with interval or debug runs, --fusion, --mshrs, "
+                "--icache, --fetch-queue, --loop-buffer, --pipeline, --trace, --profile or --watchdog\n");
+        exit(1);
+    }
+
+    if (multicore && (trace_file || profile_file || sample_file || watchdog > 0 || result_cache
+                      || memory_latency != 1))
+    {
+        fprintf(stderr, "APEX_Error: --trace, --profile, --samples, --watchdog, --result-cache and "
+                "--mem-latency are not supported with multicore runs\n");
+        exit(1);
+    }
+    if (intervals > 0 && (trace_file || profile_file || sample_file || watchdog > 0 || result_cache))
+    {
+        fprintf(stderr, "APEX_Error: --trace, --profile, --samples, --watchdog and --result-cache are "
+                "not supported with interval runs\n");
+        exit(1);
+    }
+    if (fusion && (multicore || intervals > 0))
+    {
+        fprintf(stderr, "APEX_Error: --fusion is not supported with multicore or interval runs\n");
+        exit(1);
+    }
+    if (store_buffer < 0 || store_buffer > APEX_STORE_BUFFER_MAX)
+    {
+        fprintf(stderr, "APEX_Error: --store-buffer must be 0 to %d\n", APEX_STORE_BUFFER_MAX);
+        exit(1);
+    }
+    if (store_buffer > 0 && (multicore || intervals > 0))
+    {
+        fprintf(stderr, "APEX_Error: --store-buffer is not supported with multicore or interval runs\n");
+        exit(1);
+    }
+    if (mshrs < 0 || mshrs > APEX_MSHR_MAX)
+    {
+        fprintf(stderr, "APEX_Error: --mshrs must be 0 to %d\n", APEX_MSHR_MAX);
+        exit(1);
+    }
+    if (mshrs > 0 && (multicore || intervals > 0))
+    {
+        fprintf(stderr, "APEX_Error: --mshrs is not supported with multicore or interval runs\n");
+        exit(1);
+    }
+    if (prefetch_config.kind != APEX_PREFETCH_NONE)
+    {
+        /* Prefetches fill the L1 without a bus transaction */
+        if (multicore || intervals > 0)
+        {
+            fprintf(stderr, "APEX_Error: --prefetch is not supported with multicore or interval runs\n");
+            exit(1);
+        }
+        if (!use_l1)
+        {
+            fprintf(stderr, "APEX_Error: --prefetch needs an --l1 to prefetch into\n");
+            exit(1);
+        }
+        if (prefetch_config.degree <= 0 || prefetch_config.degree > APEX_PREFETCH_DEGREE_MAX
+            || prefetch_config.distance <= 0)
+        {
+            fprintf(stderr, "APEX_Error: --prefetch-degree must be 1 to %d and --prefetch-distance positive\n",
+                    APEX_PREFETCH_DEGREE_MAX);
+            exit(1);
+        }
+    }
+    if (use_dram && (multicore || intervals > 0))
+    {
+        fprintf(stderr, "APEX_Error: --dram is not supported with multicore or interval runs\n");
+        exit(1);
+    }
+    if (use_dram && prefetch_config.kind != APEX_PREFETCH_NONE)
+    {
+        /* Prefetches take the fixed miss latency and would bypass the DRAM queue */
+        fprintf(stderr, "APEX_Error: --dram is not supported with --prefetch\n");
+        exit(1);
+    }
+    if (dram_trace && !use_dram)
+    {
+        fprintf(stderr, "APEX_Error: --dram-trace needs --dram\n");
+        exit(1);
+    }
+    if (fetch_queue < 0 || fetch_queue > APEX_FETCH_QUEUE_MAX)
+    {
+        fprintf(stderr, "APEX_Error: --fetch-queue must be 0 to %d\n", APEX_FETCH_QUEUE_MAX);
+        exit(1);
+    }
+    if ((use_icache || fetch_queue > 0) && (multicore || intervals > 0))
+    {
+        fprintf(stderr, "APEX_Error: --icache and --fetch-queue are not supported with multicore or interval runs\n");
+        exit(1);
+    }
+    if (loop_buffer < 0 || loop_buffer > APEX_LOOP_BUFFER_MAX)
+    {
+        fprintf(stderr, "APEX_Error: --loop-buffer must be 0 to %d\n", APEX_LOOP_BUFFER_MAX);
+        exit(1);
+    }
+    if (loop_buffer > 0 && (multicore || intervals > 0))
+    {
+        fprintf(stderr, "APEX_Error: --loop-buffer is not supported with multicore or interval runs\n");
+        exit(1);
+    }
+    if (fetch_stages < 1 || fetch_stages > APEX_STAGES_MAX || execute_stages < 1
+        || execute_stages > APEX_STAGES_MAX || memory_stages < 1 || memory_stages > APEX_STAGES_MAX)
+    {
+        fprintf(stderr, "APEX_Error: --pipeline stages must be 1 to %d\n", APEX_STAGES_MAX);
+        exit(1);
+    }
+    if ((fetch_stages > 1 || execute_stages > 1 || memory_stages > 1)
+        && (multicore || intervals > 0))
+    {
+        fprintf(stderr, "APEX_Error: --pipeline is not supported with multicore or interval runs\n");
+        exit(1);
+    }
+    /* The I-cache sits in front of the fetch queue, one entry matches the fetch latch */
+    if (use_icache && fetch_queue == 0)
+    {
+        fetch_queue = 1;
+    }
+
+    if (multicore)
+    {
+        APEX_Multicore *mc;
+
+        if (strcmp(sim_dis, sim) != 0)
+        {
+            fprintf(stderr, "APEX_Error: Multicore runs support simulate only\n");
+            exit(1);
+        }
+
+        mc = APEX_multicore_init(argv[1], &l1_config, quantum, threaded);
+        if (!mc)
+        {
+            fprintf(stderr, "APEX_Error: Unable to initialize multicore system\n");
+            exit(1);
+        }
+        printf("Simulate is going to run %d cores for --- >%d cycles and Stop\n", mc->num_cores,
+               cyclesnumber);
+        ENABLE_DEBUG_MESSAGES = 0;
+        APEX_multicore_run(mc, cyclesnumber);
+        APEX_multicore_stop(mc);
+        APEX_HOST_PROFILE_REPORT();
+        return 0;
+    }
+
+    if (intervals > 0)
+    {
+        APEX_IntervalConfig interval_config;
+
+        if (strcmp(sim_dis, sim) != 0)
+        {
+            fprintf(stderr, "APEX_Error: Interval runs support simulate only\n");
+            exit(1);
+        }
+
+        interval_config.intervals = intervals;
+        interval_config.warmup = warmup;
+        interval_config.cycle_limit = cyclesnumber;
+        /* The pipeline retires at most one instruction a cycle, so a serial run of
+         * cyclesnumber cycles never gets further into the program than this */
+        interval_config.instruction_limit = cyclesnumber;
+        interval_config.memory_latency = memory_latency;
+        interval_config.l1_config = use_l1 ? &l1_config : NULL;
+        printf("Simulate is going to run %d intervals for --- >%d cycles and Stop\n", intervals,
+               cyclesnumber);
+        ENABLE_DEBUG_MESSAGES = 0;
+        i = APEX_interval_run(argv[1], &interval_config);
+        APEX_HOST_PROFILE_REPORT();
+        return i;
+    }
+
+    cpu = (smt_policy >= 0) ? APEX_cpu_init_threads(argv[1], smt_policy) : APEX_cpu_init(argv[1]);
+
     if (strcmp(sim_dis, dis) == 0)
     {
         printf("Display is going to run %d cycles and Stop.It displays each cycle pipelines",cyclesnumber);
@@ -40,9 +639,14 @@ int main(int argc, char const *argv[])
         printf("Simulate is going to run for --- >%d cycles and Stop\n",cyclesnumber);
         display = 0;
     }
+    else if (strcmp(sim_dis, dbg) == 0)
+    {
+        printf("Debug is going to run for --- >%d cycles and Stop\n",cyclesnumber);
+        debug = 1;
+    }
     else
     {
-        fprintf(stderr, "APEX_Help: Usage %s <input_file> display/simulate function cycles\n", argv[0]);
+        print_usage(argv[0]);
         exit(1);
     }
 
@@ -52,7 +656,191 @@ int main(int argc, char const *argv[])
         exit(1);
     }
 
-    APEX_cpu_run(cpu, display, cyclesnumber);
+    cpu->memory_latency = memory_latency;
+    cpu->fusion = fusion;
+    cpu->store_buffer_depth = store_buffer;
+    cpu->num_mshrs = mshrs;
+    cpu->fetch_queue_depth = fetch_queue;
+    cpu->loop_buffer_size = loop_buffer;
+    APEX_cpu_set_depth(cpu, fetch_stages, execute_stages, memory_stages);
+    if (use_l1)
+    {
+        cpu->l1 = APEX_cache_create(&l1_config, 0, NULL);
+        if (!cpu->l1)
+        {
+            fprintf(stderr, "APEX_Error: Invalid L1 configuration\n");
+            exit(1);
+        }
+    }
+    if (prefetch_config.kind != APEX_PREFETCH_NONE)
+    {
+        cpu->prefetcher = APEX_prefetch_create(&prefetch_config);
+        if (!cpu->prefetcher)
+        {
+            fprintf(stderr, "APEX_Error: Unable to create prefetcher\n");
+            exit(1);
+        }
+    }
+    if (use_icache)
+    {
+        cpu->icache = APEX_cache_create(&icache_config, 0, NULL);
+        if (!cpu->icache)
+        {
+            fprintf(stderr, "APEX_Error: Invalid I-cache configuration\n");
+            exit(1);
+        }
+    }
+    if (use_dram)
+    {
+        cpu->dram = APEX_dram_create(&dram_config);
+        if (!cpu->dram)
+        {
+            fprintf(stderr, "APEX_Error: Invalid DRAM configuration, at most %d channels and %d banks\n",
+                    APEX_DRAM_MAX_CHANNELS, APEX_DRAM_MAX_BANKS);
+            exit(1);
+        }
+    }
+    if (dram_trace)
+    {
+        cpu->dram->record = fopen(dram_trace, "w");
+        if (!cpu->dram->record)
+        {
+            fprintf(stderr, "APEX_Error: Unable to open DRAM trace file %s\n", dram_trace);
+            exit(1);
+        }
+    }
+
+    if (watchdog > 0)
+    {
+        cpu->watchdog = APEX_watchdog_create(watchdog);
+        if (!cpu->watchdog)
+        {
+            fprintf(stderr, "APEX_Error: Unable to create watchdog\n");
+            exit(1);
+        }
+    }
+
+    if (trace_file)
+    {
+        cpu->trace = APEX_trace_open(trace_file);
+        if (!cpu->trace)
+        {
+            fprintf(stderr, "APEX_Error: Unable to open trace file %s\n", trace_file);
+            exit(1);
+        }
+    }
+
+    if (profile_file)
+    {
+#ifdef APEX_NO_PC_PROFILE
+        fprintf(stderr, "APEX_Error: Built with APEX_NO_PC_PROFILE, --profile is not available\n");
+        exit(1);
+#else
+        cpu->pc_profile = APEX_profile_create(cpu->code_memory_size);
+        if (!cpu->pc_profile)
+        {
+            fprintf(stderr, "APEX_Error: Unable to create profiler\n");
+            exit(1);
+        }
+#endif
+    }
+
+    /* Only plain simulate runs are cached, other modes have side outputs */
+    if (result_cache && (display || debug || trace_file || profile_file || sample_file || dram_trace))
+    {
+        result_cache = NULL;
+    }
+    /* A stored result holds the registers of one thread */
+    if (cpu->num_threads > 1)
+    {
+        result_cache = NULL;
+    }
+    if (result_cache)
+    {
+        result_key = APEX_result_key(cpu, cyclesnumber, use_l1 ? &l1_config : NULL);
+        if (APEX_result_load(result_cache, result_key, cpu, &completed))
+        {
+            fprintf(stderr, "APEX_CPU: Result cache hit %016llx\n", result_key);
+            APEX_cpu_print_result(cpu, completed);
+            print_run_stats(cpu);
+            APEX_cpu_stop(cpu);
+            APEX_HOST_PROFILE_REPORT();
+            return 0;
+        }
+    }
+
+    if (sample_file)
+    {
+        cpu->sampler = APEX_sampler_open(sample_file, sample_period);
+        if (!cpu->sampler)
+        {
+            fprintf(stderr, "APEX_Error: Unable to open sample file %s\n", sample_file);
+            exit(1);
+        }
+    }
+
+    if (debug)
+    {
+        /* The journal does not record cache or DRAM state, nor the state and output of the
+         * trace, profiler, sampler and watchdog */
+        if (history_kb > 0
+            && (cpu->l1 || cpu->icache || cpu->dram || trace_file || profile_file || sample_file
+                || watchdog > 0))
+        {
+            fprintf(stderr, "APEX_Error: --history is not supported with --l1, --icache, --dram, --trace, "
+                    "--profile, --samples or --watchdog\n");
+            exit(1);
+        }
+        completed = APEX_debugger_run(cpu, cyclesnumber, (size_t)history_kb * 1024, stdin);
+        APEX_cpu_print_result(cpu, completed);
+    }
+    else
+    {
+        completed = APEX_cpu_run(cpu, display, cyclesnumber);
+    }
+    if (cpu->num_threads > 1)
+    {
+        printf("APEX_CPU: %d threads, %s fetch, throughput %.3f instructions per cycle\n",
+               cpu->num_threads, APEX_smt_policy_name(cpu->smt_policy),
+               (double)cpu->insn_completed / (cpu->clock + 1));
+        for (i = 0; i < cpu->num_threads; ++i)
+        {
+            const APEX_Thread *thread = &cpu->threads[i];
+            int cycles = thread->halted ? thread->halt_cycle : cpu->clock + 1;
+            const char *end = thread->halted ? "halted" : "stopped";
+
+            if (cpu->fault.type != APEX_FAULT_NONE && cpu->fault.thread == i)
+            {
+                end = "faulted";
+            }
+            printf("APEX_CPU: Thread %d %s at cycle %d, %d instructions, IPC %.3f, %ld fetched, "
+                   "%ld switched out on a stall\n",
+                   i, end, cycles, thread->insn_completed,
+                   (double)thread->insn_completed / cycles, thread->fetched, thread->switches);
+        }
+    }
+    print_run_stats(cpu);
+    /* A watchdog report dumps the latches, which are not part of a stored result */
+    if (cpu->fault.type == APEX_FAULT_DEADLOCK || cpu->fault.type == APEX_FAULT_LIVELOCK)
+    {
+        result_cache = NULL;
+    }
+    if (result_cache && !APEX_result_store(result_cache, result_key, cpu, completed))
+    {
+        fprintf(stderr, "APEX_Error: Unable to store result in %s\n", result_cache);
+    }
+    APEX_trace_close(cpu->trace, cpu->clock + 1, cpu->insn_completed);
+    APEX_sampler_close(cpu->sampler, cpu);
+    if (profile_file && cpu->pc_profile)
+    {
+        write_profile(cpu, argv[1], profile_file, profile_top);
+        APEX_profile_destroy(cpu->pc_profile);
+    }
+    if (dram_trace)
+    {
+        fclose(cpu->dram->record);
+    }
     APEX_cpu_stop(cpu);
+    APEX_HOST_PROFILE_REPORT();
     return 0;
-}
\ No newline at end of file
+}